@@ -19,6 +19,10 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <mntent.h>
+#ifdef MADV_HUGEPAGE
+#define _7ZIP_TRANSPARENT_HUGE_PAGES
+#define _7ZIP_THP_SIZE ((size_t)1 << 21)
+#endif
 #endif
 #endif
 
@@ -302,6 +306,19 @@ void *BigAlloc(size_t size)
     if (res != 0)
       return res;
   }
+  #ifdef _7ZIP_TRANSPARENT_HUGE_PAGES
+  /* no hugetlbfs: ask the kernel for transparent huge pages instead.
+     Large PPMd models and LZ dictionaries are accessed randomly, so TLB misses matter. */
+  if (size >= _7ZIP_THP_SIZE)
+  {
+    void *res = NULL;
+    if (posix_memalign(&res, _7ZIP_THP_SIZE, size) == 0)
+    {
+      madvise(res, size & ~(_7ZIP_THP_SIZE - 1), MADV_HUGEPAGE);
+      return res;
+    }
+  }
+  #endif
   #endif
   return VirtualAlloc(size, 0);
 }
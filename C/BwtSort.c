@@ -513,3 +513,214 @@ UInt32 BlockSort(UInt32 *Indices, const Byte *data, UInt32 blockSize)
   #endif
   return Groups[0];
 }
+
+
+/* ---------- SA-IS (induced sorting) ---------- */
+
+/*
+BlockSortSaIs uses linear-time suffix sorting (SA-IS) instead of prefix doubling.
+For a block whose rotations are all distinct, the order of the rotations of its
+minimal rotation (a Lyndon word) is equal to the order of its suffixes.
+So we rotate the block to the minimal rotation, sort the suffixes and rotate the
+indices back. The order of distinct rotations is unique, so the result is identical
+to BlockSort(). Periodic blocks (with equal rotations) are passed to BlockSort(),
+since the order of equal rotations (and so origPtr) is defined by BlockSort() only.
+*/
+
+#define SAIS_EMPTY ((UInt32)0xFFFFFFFF)
+
+/* type flag: 1 - S-type, 0 - L-type */
+#define SAIS_T_GET(t, i) ((t[(i) >> 5] >> ((i) & 31)) & 1)
+#define SAIS_T_SET(t, i) t[(i) >> 5] |= ((UInt32)1 << ((i) & 31))
+#define SAIS_IS_LMS(t, i) ((i) != 0 && SAIS_T_GET(t, i) && !SAIS_T_GET(t, (i) - 1))
+
+static void SaIs_GetBuckets(const UInt32 *s, UInt32 *bkt, UInt32 n, UInt32 k, Bool end)
+{
+  UInt32 i, sum = 0;
+  for (i = 0; i < k; i++)
+    bkt[i] = 0;
+  for (i = 0; i < n; i++)
+    bkt[s[i]]++;
+  for (i = 0; i < k; i++)
+  {
+    sum += bkt[i];
+    bkt[i] = end ? sum : sum - bkt[i];
+  }
+}
+
+static void SaIs_InduceL(const UInt32 *t, UInt32 *sa, const UInt32 *s, UInt32 *bkt, UInt32 n, UInt32 k)
+{
+  UInt32 i;
+  SaIs_GetBuckets(s, bkt, n, k, False);
+  for (i = 0; i < n; i++)
+  {
+    UInt32 j = sa[i];
+    if (j != SAIS_EMPTY && j != 0 && !SAIS_T_GET(t, j - 1))
+      sa[bkt[s[j - 1]]++] = j - 1;
+  }
+}
+
+static void SaIs_InduceS(const UInt32 *t, UInt32 *sa, const UInt32 *s, UInt32 *bkt, UInt32 n, UInt32 k)
+{
+  UInt32 i;
+  SaIs_GetBuckets(s, bkt, n, k, True);
+  for (i = n; i != 0;)
+  {
+    UInt32 j = sa[--i];
+    if (j != SAIS_EMPTY && j != 0 && SAIS_T_GET(t, j - 1))
+      sa[--bkt[s[j - 1]]] = j - 1;
+  }
+}
+
+/*
+SaIs: sorts suffixes of s[0 ... n-1] to sa[0 ... n-1].
+  s[n - 1] must be 0 (unique smallest symbol), other symbols are in [1, k - 1].
+  temp: (n / 16 + n / 2 + k + 64) words are enough for all recursion levels.
+*/
+
+static void SaIs(const UInt32 *s, UInt32 *sa, UInt32 n, UInt32 k, UInt32 *temp)
+{
+  UInt32 *t = temp;
+  UInt32 *bkt = temp + ((n + 31) >> 5);
+  UInt32 *s1;
+  UInt32 i, j, n1, name, prev;
+
+  for (i = 0; i < ((n + 31) >> 5); i++)
+    t[i] = 0;
+  SAIS_T_SET(t, n - 1);
+  for (i = n - 1; i != 0;)
+  {
+    i--;
+    if (s[i] < s[i + 1] || (s[i] == s[i + 1] && SAIS_T_GET(t, i + 1)))
+      SAIS_T_SET(t, i);
+  }
+
+  /* stage 1: sort LMS-substrings */
+  SaIs_GetBuckets(s, bkt, n, k, True);
+  for (i = 0; i < n; i++)
+    sa[i] = SAIS_EMPTY;
+  for (i = 1; i < n; i++)
+    if (SAIS_IS_LMS(t, i))
+      sa[--bkt[s[i]]] = i;
+  SaIs_InduceL(t, sa, s, bkt, n, k);
+  SaIs_InduceS(t, sa, s, bkt, n, k);
+
+  n1 = 0;
+  for (i = 0; i < n; i++)
+    if (SAIS_IS_LMS(t, sa[i]))
+      sa[n1++] = sa[i];
+
+  /* name LMS-substrings */
+  for (i = n1; i < n; i++)
+    sa[i] = SAIS_EMPTY;
+  name = 0;
+  prev = SAIS_EMPTY;
+  for (i = 0; i < n1; i++)
+  {
+    UInt32 pos = sa[i];
+    Bool diff = False;
+    UInt32 d;
+    for (d = 0; d < n; d++)
+      if (prev == SAIS_EMPTY
+          || s[pos + d] != s[prev + d]
+          || SAIS_T_GET(t, pos + d) != SAIS_T_GET(t, prev + d))
+      {
+        diff = True;
+        break;
+      }
+      else if (d > 0 && (SAIS_IS_LMS(t, pos + d) || SAIS_IS_LMS(t, prev + d)))
+        break;
+    if (diff)
+    {
+      name++;
+      prev = pos;
+    }
+    sa[n1 + (pos >> 1)] = name - 1;
+  }
+  for (i = n, j = n; i > n1;)
+  {
+    i--;
+    if (sa[i] != SAIS_EMPTY)
+      sa[--j] = sa[i];
+  }
+
+  /* stage 2: sort the reduced string */
+  s1 = sa + n - n1;
+  if (name < n1)
+    SaIs(s1, sa, n1, name, bkt);
+  else
+    for (i = 0; i < n1; i++)
+      sa[s1[i]] = i;
+
+  /* stage 3: induce the result from sorted LMS-suffixes */
+  SaIs_GetBuckets(s, bkt, n, k, True);
+  for (i = 1, j = 0; i < n; i++)
+    if (SAIS_IS_LMS(t, i))
+      s1[j++] = i;
+  for (i = 0; i < n1; i++)
+    sa[i] = s1[sa[i]];
+  for (i = n1; i < n; i++)
+    sa[i] = SAIS_EMPTY;
+  for (i = n1; i != 0;)
+  {
+    i--;
+    j = sa[i];
+    sa[i] = SAIS_EMPTY;
+    sa[--bkt[s[j]]] = j;
+  }
+  SaIs_InduceL(t, sa, s, bkt, n, k);
+  SaIs_InduceS(t, sa, s, bkt, n, k);
+}
+
+/* conditions: blockSize > 0 */
+UInt32 BlockSortSaIs(UInt32 *Indices, const Byte *data, UInt32 blockSize)
+{
+  UInt32 i = 0, j = 1, k = 0;
+  UInt32 minRot, origPtr = 0;
+  UInt32 *s;
+
+  /* find the minimal rotation. (k == blockSize) means that two rotations are equal */
+  while (i < blockSize && j < blockSize && k < blockSize)
+  {
+    UInt32 a = i + k, b = j + k;
+    if (a >= blockSize) a -= blockSize;
+    if (b >= blockSize) b -= blockSize;
+    if (data[a] == data[b])
+    {
+      k++;
+      continue;
+    }
+    if (data[a] > data[b])
+      i += k + 1;
+    else
+      j += k + 1;
+    if (i == j)
+      j++;
+    k = 0;
+  }
+  if (k == blockSize)
+    return BlockSort(Indices, data, blockSize);
+  minRot = (i < j ? i : j);
+
+  s = Indices + blockSize + 1;
+  for (i = 0; i < blockSize; i++)
+  {
+    UInt32 pos = minRot + i;
+    if (pos >= blockSize) pos -= blockSize;
+    s[i] = (UInt32)data[pos] + 1;
+  }
+  s[blockSize] = 0;
+
+  SaIs(s, Indices, blockSize + 1, 256 + 1, s + blockSize + 1);
+
+  /* Indices[0] is the sentinel suffix */
+  for (i = 0; i < blockSize; i++)
+  {
+    UInt32 pos = Indices[i + 1] + minRot;
+    if (pos >= blockSize) pos -= blockSize;
+    Indices[i] = pos;
+    if (pos == 0)
+      origPtr = i;
+  }
+  return origPtr;
+}
@@ -21,6 +21,12 @@ EXTERN_C_BEGIN
 
 UInt32 BlockSort(UInt32 *indices, const Byte *data, UInt32 blockSize);
 
+/* BlockSortSaIs returns same result as BlockSort, but it needs bigger buffer */
+
+#define BLOCK_SORT_SAIS_BUF_SIZE(blockSize) ((blockSize) * 3 + (1 << 16))
+
+UInt32 BlockSortSaIs(UInt32 *indices, const Byte *data, UInt32 blockSize);
+
 EXTERN_C_END
 
 #endif
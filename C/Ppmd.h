@@ -76,6 +76,15 @@ typedef
   #endif
   CPpmd_Byte_Ref;
 
+/* PPMD_PREFETCH hints the CPU to load the successor context early.
+   The model is a large pointer-chasing structure, so the next context is
+   usually a cache miss. Prefetch never faults, so any pointer is allowed. */
+#if defined(__GNUC__) && (__GNUC__ >= 4 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 1))
+  #define PPMD_PREFETCH(addr) __builtin_prefetch((const void *)(addr))
+#else
+  #define PPMD_PREFETCH(addr)
+#endif
+
 #define PPMD_SetAllBitsIn256Bytes(p) \
   { unsigned z; for (z = 0; z < 256 / sizeof(p[0]); z += 8) { \
   p[z+7] = p[z+6] = p[z+5] = p[z+4] = p[z+3] = p[z+2] = p[z+1] = p[z+0] = ~(size_t)0; }}
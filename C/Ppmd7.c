@@ -670,6 +670,7 @@ static void NextContext(CPpmd7 *p)
 void Ppmd7_Update1(CPpmd7 *p)
 {
   CPpmd_State *s = p->FoundState;
+  PPMD_PREFETCH(Ppmd7_GetPtr(p, SUCCESSOR(s)));
   s->Freq += 4;
   p->MinContext->SummFreq += 4;
   if (s[0].Freq > s[-1].Freq)
@@ -684,6 +685,7 @@ void Ppmd7_Update1(CPpmd7 *p)
 
 void Ppmd7_Update1_0(CPpmd7 *p)
 {
+  PPMD_PREFETCH(Ppmd7_GetPtr(p, SUCCESSOR(p->FoundState)));
   p->PrevSuccess = (2 * p->FoundState->Freq > p->MinContext->SummFreq);
   p->RunLength += p->PrevSuccess;
   p->MinContext->SummFreq += 4;
@@ -694,6 +696,7 @@ void Ppmd7_Update1_0(CPpmd7 *p)
 
 void Ppmd7_UpdateBin(CPpmd7 *p)
 {
+  PPMD_PREFETCH(Ppmd7_GetPtr(p, SUCCESSOR(p->FoundState)));
   p->FoundState->Freq = (Byte)(p->FoundState->Freq + (p->FoundState->Freq < 128 ? 1: 0));
   p->PrevSuccess = 1;
   p->RunLength++;
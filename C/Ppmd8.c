@@ -1072,6 +1072,7 @@ static void NextContext(CPpmd8 *p)
 void Ppmd8_Update1(CPpmd8 *p)
 {
   CPpmd_State *s = p->FoundState;
+  PPMD_PREFETCH(Ppmd8_GetPtr(p, SUCCESSOR(s)));
   s->Freq += 4;
   p->MinContext->SummFreq += 4;
   if (s[0].Freq > s[-1].Freq)
@@ -1086,6 +1087,7 @@ void Ppmd8_Update1(CPpmd8 *p)
 
 void Ppmd8_Update1_0(CPpmd8 *p)
 {
+  PPMD_PREFETCH(Ppmd8_GetPtr(p, SUCCESSOR(p->FoundState)));
   p->PrevSuccess = (2 * p->FoundState->Freq >= p->MinContext->SummFreq);
   p->RunLength += p->PrevSuccess;
   p->MinContext->SummFreq += 4;
@@ -1096,6 +1098,7 @@ void Ppmd8_Update1_0(CPpmd8 *p)
 
 void Ppmd8_UpdateBin(CPpmd8 *p)
 {
+  PPMD_PREFETCH(Ppmd8_GetPtr(p, SUCCESSOR(p->FoundState)));
   p->FoundState->Freq = (Byte)(p->FoundState->Freq + (p->FoundState->Freq < 196));
   p->PrevSuccess = 1;
   p->RunLength++;
@@ -226,6 +226,17 @@ void XzUnpacker_Construct(CXzUnpacker *p, ISzAlloc *alloc);
 void XzUnpacker_Init(CXzUnpacker *p);
 void XzUnpacker_Free(CXzUnpacker *p);
 
+/*
+XzUnpacker_PrepareToRandomBlockDecoding() prepares the unpacker to decode
+one block that starts at the current position of input data.
+It's used with the sizes of blocks from xz index. (streamFlags) are flags of xz stream.
+XzUnpacker_IsBlockFinished() returns True, when the block was decoded
+including its check field (the check was verified).
+*/
+
+void XzUnpacker_PrepareToRandomBlockDecoding(CXzUnpacker *p, CXzStreamFlags streamFlags);
+Bool XzUnpacker_IsBlockFinished(const CXzUnpacker *p);
+
 /*
 finishMode:
   It has meaning only if the decoding reaches output limit (*destLen).
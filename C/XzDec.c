@@ -616,6 +616,21 @@ void XzUnpacker_Init(CXzUnpacker *p)
   p->padSize = 0;
 }
 
+void XzUnpacker_PrepareToRandomBlockDecoding(CXzUnpacker *p, CXzStreamFlags streamFlags)
+{
+  p->state = XZ_STATE_BLOCK_HEADER;
+  p->pos = 0;
+  p->streamFlags = streamFlags;
+  p->numBlocks = 0;
+  p->indexSize = 0;
+  Sha256_Init(&p->sha);
+}
+
+Bool XzUnpacker_IsBlockFinished(const CXzUnpacker *p)
+{
+  return (p->state == XZ_STATE_BLOCK_HEADER) && (p->pos == 0);
+}
+
 void XzUnpacker_Construct(CXzUnpacker *p, ISzAlloc *alloc)
 {
   MixCoder_Construct(&p->decoder, alloc);
@@ -684,8 +699,14 @@ SRes XzUnpacker_Code(CXzUnpacker *p, Byte *dest, SizeT *destLen,
 
     if (srcRem == 0)
     {
-      *status = CODER_STATUS_NEEDS_MORE_INPUT;
-      return SZ_OK;
+      /* the footer of block without padding and check field doesn't need input bytes */
+      if (p->state != XZ_STATE_BLOCK_FOOTER
+          || ((p->packSize + p->alignPos) & 3) != 0
+          || p->pos != XzFlags_GetCheckSize(p->streamFlags))
+      {
+        *status = CODER_STATUS_NEEDS_MORE_INPUT;
+        return SZ_OK;
+      }
     }
 
     switch (p->state)
@@ -775,7 +796,9 @@ SRes XzUnpacker_Code(CXzUnpacker *p, Byte *dest, SizeT *destLen,
             (*srcLen) += cur;
             src += cur;
           }
-          else
+          /* we check the block as soon as all bytes of check field were read.
+             So the caller that provides exact size of block gets finished block. */
+          if (p->pos == checkSize)
           {
             Byte digest[XZ_CHECK_SIZE_MAX];
             p->state = XZ_STATE_BLOCK_HEADER;
@@ -158,16 +158,23 @@ static SRes Xz_AddIndexRecord(CXzStream *p, UInt64 unpackSize, UInt64 totalSize,
 
 /* ---------- CSeqCheckInStream ---------- */
 
+/* CSeqCheckInStream reads no more than (limit) bytes for each block.
+   (peekByte) is first byte of next block, that was read to detect the end of data. */
+
 typedef struct
 {
   ISeqInStream p;
   ISeqInStream *realStream;
+  UInt64 limit;
   UInt64 processed;
   CXzCheck check;
+  int peekDefined;
+  Byte peekByte;
 } CSeqCheckInStream;
 
-static void SeqCheckInStream_Init(CSeqCheckInStream *p, unsigned mode)
+static void SeqCheckInStream_Init(CSeqCheckInStream *p, unsigned mode, UInt64 limit)
 {
+  p->limit = limit;
   p->processed = 0;
   XzCheck_Init(&p->check, mode);
 }
@@ -180,12 +187,67 @@ static void SeqCheckInStream_GetDigest(CSeqCheckInStream *p, Byte *digest)
 static SRes SeqCheckInStream_Read(void *pp, void *data, size_t *size)
 {
   CSeqCheckInStream *p = (CSeqCheckInStream *)pp;
-  SRes res = p->realStream->Read(p->realStream, data, size);
-  XzCheck_Update(&p->check, data, *size);
-  p->processed += *size;
+  SRes res = SZ_OK;
+  size_t size2 = *size;
+  if (size2 > p->limit - p->processed)
+    size2 = (size_t)(p->limit - p->processed);
+  *size = 0;
+  if (size2 == 0)
+    return SZ_OK;
+  if (p->peekDefined)
+  {
+    *(Byte *)data = p->peekByte;
+    p->peekDefined = 0;
+    size2 = 1;
+  }
+  else
+    res = p->realStream->Read(p->realStream, data, &size2);
+  XzCheck_Update(&p->check, data, size2);
+  p->processed += size2;
+  *size = size2;
   return res;
 }
 
+/* returns (*finished = 1), if there is no more data in realStream */
+
+static SRes SeqCheckInStream_Peek(CSeqCheckInStream *p, int *finished)
+{
+  size_t size = 1;
+  *finished = 0;
+  if (p->peekDefined)
+    return SZ_OK;
+  RINOK(p->realStream->Read(p->realStream, &p->peekByte, &size));
+  if (size == 0)
+    *finished = 1;
+  else
+    p->peekDefined = 1;
+  return SZ_OK;
+}
+
+
+/* ---------- CProgressOffset ---------- */
+
+/* The encoder of block reports the sizes from the start of block.
+   CProgressOffset adds the sizes of previous blocks. */
+
+typedef struct
+{
+  ICompressProgress p;
+  ICompressProgress *realProgress;
+  UInt64 inOffset;
+  UInt64 outOffset;
+} CProgressOffset;
+
+static SRes ProgressOffset_Progress(void *pp, UInt64 inSize, UInt64 outSize)
+{
+  CProgressOffset *p = (CProgressOffset *)pp;
+  if (inSize != (UInt64)(Int64)-1)
+    inSize += p->inOffset;
+  if (outSize != (UInt64)(Int64)-1)
+    outSize += p->outOffset;
+  return p->realProgress->Progress(p->realProgress, inSize, outSize);
+}
+
 
 /* ---------- CSeqSizeOutStream ---------- */
 
@@ -395,6 +457,7 @@ void XzProps_Init(CXzProps *p)
   p->lzma2Props = NULL;
   p->filterProps = NULL;
   p->checkId = XZ_CHECK_CRC32;
+  p->blockSize = 0;
 }
 
 void XzFilterProps_Init(CXzFilterProps *p)
@@ -406,17 +469,11 @@ void XzFilterProps_Init(CXzFilterProps *p)
 }
 
 
-static SRes Xz_Compress(CXzStream *xz, CLzma2WithFilters *lzmaf,
-    ISeqOutStream *outStream, ISeqInStream *inStream,
+static SRes Xz_CompressBlock(CXzStream *xz, CLzma2WithFilters *lzmaf,
+    ISeqOutStream *outStream, CSeqCheckInStream *checkInStream,
     const CXzProps *props, ICompressProgress *progress)
 {
-  xz->flags = (Byte)props->checkId;
-
-  RINOK(Lzma2Enc_SetProps(lzmaf->lzma2, props->lzma2Props));
-  RINOK(Xz_WriteHeader(xz->flags, outStream));
-
   {
-    CSeqCheckInStream checkInStream;
     CSeqSizeOutStream seqSizeOutStream;
     CXzBlock block;
     unsigned filterIndex = 0;
@@ -457,22 +514,18 @@ static SRes Xz_Compress(CXzStream *xz, CLzma2WithFilters *lzmaf,
     
     RINOK(XzBlock_WriteHeader(&block, &seqSizeOutStream.p));
     
-    checkInStream.p.Read = SeqCheckInStream_Read;
-    checkInStream.realStream = inStream;
-    SeqCheckInStream_Init(&checkInStream, XzFlags_GetCheckType(xz->flags));
-    
     if (fp)
     {
       #ifdef USE_SUBBLOCK
       if (fp->id == XZ_ID_Subblock)
       {
-        lzmaf->sb.inStream = &checkInStream.p;
+        lzmaf->sb.inStream = &checkInStream->p;
         RINOK(SbEncInStream_Init(&lzmaf->sb));
       }
       else
       #endif
       {
-        lzmaf->filter.realStream = &checkInStream.p;
+        lzmaf->filter.realStream = &checkInStream->p;
         RINOK(SeqInFilter_Init(&lzmaf->filter, filter));
       }
     }
@@ -486,11 +539,11 @@ static SRes Xz_Compress(CXzStream *xz, CLzma2WithFilters *lzmaf,
             (fp->id == XZ_ID_Subblock) ? &lzmaf->sb.p:
             #endif
             &lzmaf->filter.p:
-            &checkInStream.p,
+            &checkInStream->p,
           progress);
       
       RINOK(res);
-      block.unpackSize = checkInStream.processed;
+      block.unpackSize = checkInStream->processed;
       block.packSize = seqSizeOutStream.processed - packPos;
     }
 
@@ -499,11 +552,51 @@ static SRes Xz_Compress(CXzStream *xz, CLzma2WithFilters *lzmaf,
       Byte buf[128];
       while ((((unsigned)block.packSize + padSize) & 3) != 0)
         buf[padSize++] = 0;
-      SeqCheckInStream_GetDigest(&checkInStream, buf + padSize);
+      SeqCheckInStream_GetDigest(checkInStream, buf + padSize);
       RINOK(WriteBytes(&seqSizeOutStream.p, buf, padSize + XzFlags_GetCheckSize(xz->flags)));
       RINOK(Xz_AddIndexRecord(xz, block.unpackSize, seqSizeOutStream.processed - padSize, &g_Alloc));
     }
   }
+  return SZ_OK;
+}
+
+
+static SRes Xz_Compress(CXzStream *xz, CLzma2WithFilters *lzmaf,
+    ISeqOutStream *outStream, ISeqInStream *inStream,
+    const CXzProps *props, ICompressProgress *progress)
+{
+  CSeqCheckInStream checkInStream;
+  CProgressOffset progressOffset;
+  const UInt64 blockSize = (props->blockSize == 0) ? (UInt64)(Int64)-1 : props->blockSize;
+  
+  xz->flags = (Byte)props->checkId;
+
+  RINOK(Lzma2Enc_SetProps(lzmaf->lzma2, props->lzma2Props));
+  RINOK(Xz_WriteHeader(xz->flags, outStream));
+
+  checkInStream.p.Read = SeqCheckInStream_Read;
+  checkInStream.realStream = inStream;
+  checkInStream.peekDefined = 0;
+
+  progressOffset.p.Progress = ProgressOffset_Progress;
+  progressOffset.realProgress = progress;
+  progressOffset.inOffset = 0;
+  progressOffset.outOffset = 0;
+
+  for (;;)
+  {
+    int finished;
+    SeqCheckInStream_Init(&checkInStream, XzFlags_GetCheckType(xz->flags), blockSize);
+    RINOK(Xz_CompressBlock(xz, lzmaf, outStream, &checkInStream, props, progress ? &progressOffset.p : NULL));
+    if (checkInStream.processed != blockSize)
+      break;
+    RINOK(SeqCheckInStream_Peek(&checkInStream, &finished));
+    if (finished)
+      break;
+    progressOffset.inOffset += checkInStream.processed;
+    progressOffset.outOffset += (xz->blocks[xz->numBlocks - 1].totalSize + 3) & ~(UInt64)3;
+  }
+  
   return Xz_WriteFooter(xz, outStream);
 }
 
@@ -25,6 +25,7 @@ typedef struct
   const CLzma2EncProps *lzma2Props;
   const CXzFilterProps *filterProps;
   unsigned checkId;
+  UInt64 blockSize; /* 0 : all data in one block */
 } CXzProps;
 
 void XzProps_Init(CXzProps *p);
@@ -3,6 +3,7 @@
 #include "StdAfx.h"
 
 #include "../../Common/LimitedStreams.h"
+#include "../../Common/LockedStreams.h"
 #include "../../Common/ProgressUtils.h"
 #include "../../Common/StreamObjects.h"
 
@@ -115,108 +116,6 @@ CDecoder::CDecoder(bool useMixerMT):
 {}
 
 
-struct CLockedInStream:
-  public IUnknown,
-  public CMyUnknownImp
-{
-  CMyComPtr<IInStream> Stream;
-  UInt64 Pos;
-
-  MY_UNKNOWN_IMP
-
-  #ifdef USE_MIXER_MT
-  NWindows::NSynchronization::CCriticalSection CriticalSection;
-  #endif
-};
-
-
-#ifdef USE_MIXER_MT
-
-class CLockedSequentialInStreamMT:
-  public ISequentialInStream,
-  public CMyUnknownImp
-{
-  CLockedInStream *_glob;
-  UInt64 _pos;
-  CMyComPtr<IUnknown> _globRef;
-public:
-  void Init(CLockedInStream *lockedInStream, UInt64 startPos)
-  {
-    _globRef = lockedInStream;
-    _glob = lockedInStream;
-    _pos = startPos;
-  }
-
-  MY_UNKNOWN_IMP1(ISequentialInStream)
-
-  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
-};
-
-STDMETHODIMP CLockedSequentialInStreamMT::Read(void *data, UInt32 size, UInt32 *processedSize)
-{
-  NWindows::NSynchronization::CCriticalSectionLock lock(_glob->CriticalSection);
-
-  if (_pos != _glob->Pos)
-  {
-    RINOK(_glob->Stream->Seek(_pos, STREAM_SEEK_SET, NULL));
-    _glob->Pos = _pos;
-  }
-
-  UInt32 realProcessedSize = 0;
-  HRESULT res = _glob->Stream->Read(data, size, &realProcessedSize);
-  _pos += realProcessedSize;
-  _glob->Pos = _pos;
-  if (processedSize)
-    *processedSize = realProcessedSize;
-  return res;
-}
-
-#endif
-
-
-#ifdef USE_MIXER_ST
-
-class CLockedSequentialInStreamST:
-  public ISequentialInStream,
-  public CMyUnknownImp
-{
-  CLockedInStream *_glob;
-  UInt64 _pos;
-  CMyComPtr<IUnknown> _globRef;
-public:
-  void Init(CLockedInStream *lockedInStream, UInt64 startPos)
-  {
-    _globRef = lockedInStream;
-    _glob = lockedInStream;
-    _pos = startPos;
-  }
-
-  MY_UNKNOWN_IMP1(ISequentialInStream)
-
-  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
-};
-
-STDMETHODIMP CLockedSequentialInStreamST::Read(void *data, UInt32 size, UInt32 *processedSize)
-{
-  if (_pos != _glob->Pos)
-  {
-    RINOK(_glob->Stream->Seek(_pos, STREAM_SEEK_SET, NULL));
-    _glob->Pos = _pos;
-  }
-
-  UInt32 realProcessedSize = 0;
-  HRESULT res = _glob->Stream->Read(data, size, &realProcessedSize);
-  _pos += realProcessedSize;
-  _glob->Pos = _pos;
-  if (processedSize)
-    *processedSize = realProcessedSize;
-  return res;
-}
-
-#endif
-
-
-
 HRESULT CDecoder::Decode(
     DECL_EXTERNAL_CODECS_LOC_VARS
     IInStream *inStream,
@@ -458,6 +357,23 @@ HRESULT CDecoder::Decode(
     _mixer->SelectMainCoder(!fullUnpack);
   }
 
+  if (outStream && fullUnpack
+      && folderInfo.Coders.Size() == 1
+      && folderInfo.PackStreams.Size() == 1)
+  {
+    const UInt64 packSize = packPositions[1] - packPositions[0];
+    CMyComPtr<ICompressDecodeBuf> decodeBuf;
+    _mixer->GetCoder(0).GetUnknown()->QueryInterface(IID_ICompressDecodeBuf, (void **)&decodeBuf);
+    if (decodeBuf && CInMemDecoder::CanDecode(packSize, folderUnpackSize))
+    {
+      /* the folders that contain one coder and have small sizes are decoded
+         in memory without intermediate stream buffers */
+      RINOK(inStream->Seek(startPos + packPositions[0], STREAM_SEEK_SET, NULL));
+      return _inMemDecoder.Decode(decodeBuf, inStream, (size_t)packSize, (size_t)folderUnpackSize,
+          outStream, compressProgress);
+    }
+  }
+
   CObjectVector< CMyComPtr<ISequentialInStream> > inStreams;
   
   CLockedInStream *lockedInStreamSpec = new CLockedInStream;
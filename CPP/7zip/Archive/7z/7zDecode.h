@@ -3,6 +3,8 @@
 #ifndef __7Z_DECODE_H
 #define __7Z_DECODE_H
 
+#include "../../Common/InMemDecoder.h"
+
 #include "../Common/CoderMixer2.h"
 
 #include "7zIn.h"
@@ -39,6 +41,8 @@ class CDecoder
   NCoderMixer2::CMixer *_mixer;
   CMyComPtr<IUnknown> _mixerRef;
 
+  CInMemDecoder _inMemDecoder;
+
 public:
 
   CDecoder(bool useMixerMT);
@@ -245,7 +245,7 @@ STDMETHODIMP CHandler::GetArchiveProperty(PROPID propID, PROPVARIANT *value)
   #endif
 }
 
-static void SetFileTimeProp_From_UInt64Def(PROPVARIANT *prop, const CUInt64DefVector &v, int index)
+static void SetFileTimeProp_From_UInt64Def(PROPVARIANT *prop, const CLazyUInt64DefVector &v, int index)
 {
   UInt64 value;
   if (v.GetItem(index, value))
@@ -347,6 +347,22 @@ STDMETHODIMP CHandler::GetRawProp(UInt32 index, PROPID propID, const void **data
   return S_OK;
 }
 
+STDMETHODIMP CHandler::FindItem(const wchar_t *path, UInt32 startIndex, UInt32 *index)
+{
+  COM_TRY_BEGIN
+  *index = (UInt32)(Int32)-1;
+  if (!_db.NameIndexWasBuilt)
+    _db.BuildNameIndex();
+  if (!_db.NameIndexIsSupported)
+    return E_NOTIMPL;
+  int i = _db.FindPath(path, startIndex);
+  if (i < 0)
+    return S_FALSE;
+  *index = (UInt32)i;
+  return S_OK;
+  COM_TRY_END
+}
+
 #ifndef _SFX
 
 HRESULT CHandler::SetMethodToProp(CNum folderIndex, PROPVARIANT *prop) const
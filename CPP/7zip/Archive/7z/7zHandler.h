@@ -45,6 +45,7 @@ public:
   bool _numSolidBytesDefined;
   bool _solidExtension;
   bool _useTypeSorting;
+  bool _dedupFiles;
 
   bool _compressHeaders;
   bool _encryptHeadersSpecified;
@@ -81,11 +82,13 @@ public:
 class CHandler:
   public IInArchive,
   public IArchiveGetRawProps,
+  public IArchiveFindItem,
   #ifdef __7Z_SET_PROPERTIES
   public ISetProperties,
   #endif
   #ifndef EXTRACT_ONLY
   public IOutArchive,
+  public IOutArchiveUpdateInPlace,
   #endif
   PUBLIC_ISetCompressCodecsInfo
   public CMyUnknownImp
@@ -96,11 +99,13 @@ class CHandler:
 public:
   MY_QUERYINTERFACE_BEGIN2(IInArchive)
   MY_QUERYINTERFACE_ENTRY(IArchiveGetRawProps)
+  MY_QUERYINTERFACE_ENTRY(IArchiveFindItem)
   #ifdef __7Z_SET_PROPERTIES
   MY_QUERYINTERFACE_ENTRY(ISetProperties)
   #endif
   #ifndef EXTRACT_ONLY
   MY_QUERYINTERFACE_ENTRY(IOutArchive)
+  MY_QUERYINTERFACE_ENTRY(IOutArchiveUpdateInPlace)
   #endif
   QUERY_ENTRY_ISetCompressCodecsInfo
   MY_QUERYINTERFACE_END
@@ -108,6 +113,7 @@ public:
 
   INTERFACE_IInArchive(;)
   INTERFACE_IArchiveGetRawProps(;)
+  INTERFACE_IArchiveFindItem(;)
 
   #ifdef __7Z_SET_PROPERTIES
   STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
@@ -115,6 +121,7 @@ public:
 
   #ifndef EXTRACT_ONLY
   INTERFACE_IOutArchive(;)
+  INTERFACE_IOutArchiveUpdateInPlace(;)
   #endif
 
   DECL_ISetCompressCodecsInfo
@@ -144,6 +151,9 @@ private:
   
   CRecordVector<CBond2> _bonds;
 
+  HRESULT UpdateItems2(ISequentialOutStream *outStream, UInt32 numItems,
+      IArchiveUpdateCallback *updateCallback, bool inPlace);
+
   HRESULT PropsMethod_To_FullMethod(CMethodFull &dest, const COneMethodInfo &m);
   HRESULT SetHeaderMethod(CCompressionMethodMode &headerMethod);
   HRESULT SetMainMethod(CCompressionMethodMode &method
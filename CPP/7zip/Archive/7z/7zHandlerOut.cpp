@@ -242,11 +242,9 @@ static int AddFolder(CObjectVector<CTreeFolder> &treeFolders, int cur, const USt
 }
 */
 
-STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numItems,
-    IArchiveUpdateCallback *updateCallback)
+HRESULT CHandler::UpdateItems2(ISequentialOutStream *outStream, UInt32 numItems,
+    IArchiveUpdateCallback *updateCallback, bool inPlace)
 {
-  COM_TRY_BEGIN
-
   const CDbEx *db = 0;
   #ifdef _7Z_VOL
   if (_volumes.Size() > 1)
@@ -285,9 +283,9 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
   
   if (db && !db->Files.IsEmpty())
   {
-    if (!Write_CTime.Def) need_CTime = !db->CTime.Defs.IsEmpty();
-    if (!Write_ATime.Def) need_ATime = !db->ATime.Defs.IsEmpty();
-    if (!Write_MTime.Def) need_MTime = !db->MTime.Defs.IsEmpty();
+    if (!Write_CTime.Def) need_CTime = !db->CTime.IsEmpty();
+    if (!Write_ATime.Def) need_ATime = !db->ATime.IsEmpty();
+    if (!Write_MTime.Def) need_MTime = !db->MTime.IsEmpty();
   }
 
   UString s;
@@ -620,11 +618,13 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
   options.NumSolidBytes = _numSolidBytes;
   options.SolidExtension = _solidExtension;
   options.UseTypeSorting = _useTypeSorting;
+  options.DedupFiles = _dedupFiles;
 
   options.RemoveSfxBlock = _removeSfxBlock;
   // options.VolumeMode = _volumeMode;
 
   options.MultiThreadMixer = _useMultiThreadMixer;
+  options.InPlace = inPlace;
 
   COutArchive archive;
   CArchiveDatabaseOut newDatabase;
@@ -668,7 +668,23 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
 
   return archive.WriteDatabase(EXTERNAL_CODECS_VARS
       newDatabase, options.HeaderMethod, options.HeaderOptions);
+}
 
+STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numItems,
+    IArchiveUpdateCallback *updateCallback)
+{
+  COM_TRY_BEGIN
+  return UpdateItems2(outStream, numItems, updateCallback, false);
+  COM_TRY_END
+}
+
+STDMETHODIMP CHandler::UpdateItemsInPlace(IOutStream *outStream, UInt32 numItems,
+    IArchiveUpdateCallback *updateCallback)
+{
+  COM_TRY_BEGIN
+  if (!_inStream)
+    return S_FALSE;
+  return UpdateItems2(outStream, numItems, updateCallback, true);
   COM_TRY_END
 }
 
@@ -712,6 +728,7 @@ void COutHandler::InitProps()
 
   InitSolid();
   _useTypeSorting = false;
+  _dedupFiles = false;
 }
 
 HRESULT COutHandler::SetSolidFromString(const UString &s)
@@ -833,6 +850,7 @@ HRESULT COutHandler::SetProperty(const wchar_t *nameSpec, const PROPVARIANT &val
     if (name.IsEqualTo("mtf")) return PROPVARIANT_to_bool(value, _useMultiThreadMixer);
 
     if (name.IsEqualTo("qs")) return PROPVARIANT_to_bool(value, _useTypeSorting);
+    if (name.IsEqualTo("qd")) return PROPVARIANT_to_bool(value, _dedupFiles);
 
     // if (name.IsEqualTo("v"))  return PROPVARIANT_to_bool(value, _volumeMode);
   }
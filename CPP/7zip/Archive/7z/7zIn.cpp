@@ -553,6 +553,80 @@ HRESULT CDatabase::GetPath_Prop(unsigned index, PROPVARIANT *path) const throw()
   */
 }
 
+static inline UInt32 GetPathChar(const Byte *p)
+{
+  UInt32 c = Get16(p);
+  #if WCHAR_PATH_SEPARATOR != L'/'
+  if (c == L'/')
+    c = WCHAR_PATH_SEPARATOR;
+  #endif
+  return c;
+}
+
+void CDatabase::BuildNameIndex()
+{
+  NameIndexWasBuilt = true;
+  NameIndexIsSupported = false;
+  if (!NameOffsets || !NamesBuf)
+    return;
+
+  const unsigned numFiles = Files.Size();
+  UInt32 numHeads = 1;
+  while (numHeads < numFiles)
+    numHeads <<= 1;
+  NameHashHeads.Alloc(numHeads);
+  NameHashNext.Alloc(numFiles);
+  NameHashMask = numHeads - 1;
+  UInt32 i;
+  for (i = 0; i < numHeads; i++)
+    NameHashHeads[i] = kNumNoIndex;
+
+  // we add items in reverse order, so each chain is sorted by index
+  for (i = numFiles; i != 0;)
+  {
+    i--;
+    const size_t offset = NameOffsets[i];
+    const size_t len = NameOffsets[i + 1] - offset - 1;
+    // the caller uses some default name for item with empty name
+    if (len == 0)
+      return;
+    const Byte *p = NamesBuf + offset * 2;
+    UInt32 hash = 0;
+    for (size_t k = 0; k < len; k++, p += 2)
+      hash = hash * 31 + GetPathChar(p);
+    UInt32 &head = NameHashHeads[hash & NameHashMask];
+    NameHashNext[i] = head;
+    head = i;
+  }
+  
+  NameIndexIsSupported = true;
+}
+
+int CDatabase::FindPath(const wchar_t *path, unsigned startIndex) const
+{
+  UInt32 hash = 0;
+  size_t len;
+  for (len = 0; path[len] != 0; len++)
+    hash = hash * 31 + (UInt32)path[len];
+  
+  for (UInt32 i = NameHashHeads[hash & NameHashMask]; i != kNumNoIndex; i = NameHashNext[i])
+  {
+    if (i < startIndex)
+      continue;
+    const size_t offset = NameOffsets[i];
+    if (NameOffsets[i + 1] - offset - 1 != len)
+      continue;
+    const Byte *p = NamesBuf + offset * 2;
+    size_t k;
+    for (k = 0; k < len; k++, p += 2)
+      if (GetPathChar(p) != (UInt32)path[k])
+        break;
+    if (k == len)
+      return (int)i;
+  }
+  return -1;
+}
+
 void CInArchive::WaitId(UInt64 id)
 {
   for (;;)
@@ -1022,25 +1096,71 @@ void CInArchive::ReadBoolVector2(unsigned numItems, CBoolVector &v)
     p[i] = true;
 }
 
+static unsigned GetNumBits(unsigned b)
+{
+  unsigned num = 0;
+  for (; b != 0; b &= b - 1)
+    num++;
+  return num;
+}
+
+bool CLazyUInt64DefVector::GetItem(unsigned index, UInt64 &value) const
+{
+  value = 0;
+  if (index >= NumItems)
+    return false;
+  size_t rank = index;
+  if (DefBits)
+  {
+    const Byte *p = DefBits + (index >> 3);
+    unsigned bitPos = index & 7;
+    if ((*p & (0x80 >> bitPos)) == 0)
+      return false;
+    rank = Ranks[index >> 6];
+    for (const Byte *p2 = DefBits + ((index >> 6) << 3); p2 != p; p2++)
+      rank += GetNumBits(*p2);
+    rank += GetNumBits(*p & (Byte)(0xFF00 >> bitPos));
+  }
+  value = Get64(Data + rank * 8);
+  return true;
+}
+
 void CInArchive::ReadUInt64DefVector(const CObjectVector<CByteBuffer> &dataVector,
-    CUInt64DefVector &v, unsigned numItems)
+    CLazyUInt64DefVector &v, unsigned numItems)
 {
-  ReadBoolVector2(numItems, v.Defs);
+  v.Clear();
+  size_t numDefined = numItems;
+
+  Byte allAreDefined = ReadByte();
+  if (allAreDefined == 0)
+  {
+    size_t numBytes = ((size_t)numItems + 7) >> 3;
+    if (numBytes > _inByteBack->GetRem())
+      ThrowEndOfData();
+    const Byte *p = _inByteBack->GetPtr();
+    _inByteBack->SkipDataNoCheck(numBytes);
+    v.DefBits = p;
+    v.Ranks.Alloc((numItems + 63) >> 6);
+    numDefined = 0;
+    for (size_t i = 0; i < numBytes; i++)
+    {
+      if ((i & 7) == 0)
+        v.Ranks[i >> 3] = (UInt32)numDefined;
+      unsigned b = p[i];
+      if (i == numBytes - 1 && (numItems & 7) != 0)
+        b &= (Byte)(0xFF00 >> (numItems & 7));
+      numDefined += GetNumBits(b);
+    }
+  }
 
   CStreamSwitch streamSwitch;
   streamSwitch.Set(this, &dataVector);
   
-  v.Vals.ClearAndSetSize(numItems);
-  UInt64 *p = &v.Vals[0];
-  const bool *defs = &v.Defs[0];
-
-  for (unsigned i = 0; i < numItems; i++)
-  {
-    UInt64 t = 0;
-    if (defs[i])
-      t = ReadUInt64();
-    p[i] = t;
-  }
+  if (numDefined > _inByteBack->GetRem() / 8)
+    ThrowEndOfData();
+  v.Data = _inByteBack->GetPtr();
+  v.NumItems = numItems;
+  _inByteBack->SkipDataNoCheck(numDefined * 8);
 }
 
 HRESULT CInArchive::ReadAndDecodePackedStreams(
@@ -1115,7 +1235,7 @@ HRESULT CInArchive::ReadHeader(
     type = ReadID();
   }
  
-  CObjectVector<CByteBuffer> dataVector;
+  CObjectVector<CByteBuffer> &dataVector = db.AdditionalStreams;
   
   if (type == NID::kAdditionalStreamsInfo)
   {
@@ -1192,17 +1312,17 @@ HRESULT CInArchive::ReadHeader(
         CStreamSwitch streamSwitch;
         streamSwitch.Set(this, &dataVector);
         size_t rem = _inByteBack->GetRem();
-        db.NamesBuf.Alloc(rem);
-        ReadBytes(db.NamesBuf, rem);
+        db.NamesBuf = _inByteBack->GetPtr();
+        _inByteBack->SkipRem();
         db.NameOffsets.Alloc(db.Files.Size() + 1);
         size_t pos = 0;
         unsigned i;
         for (i = 0; i < db.Files.Size(); i++)
         {
           size_t curRem = (rem - pos) / 2;
-          const UInt16 *buf = (const UInt16 *)(db.NamesBuf + pos);
+          const Byte *buf = db.NamesBuf + pos;
           size_t j;
-          for (j = 0; j < curRem && buf[j] != 0; j++);
+          for (j = 0; j < curRem && (buf[j * 2] | buf[j * 2 + 1]) != 0; j++);
           if (j == curRem)
             ThrowEndOfData();
           db.NameOffsets[i] = pos / 2;
@@ -1558,7 +1678,8 @@ HRESULT CInArchive::ReadDatabase2(
   size_t nextHeaderSize_t = (size_t)nextHeaderSize;
   if (nextHeaderSize_t != nextHeaderSize)
     return E_OUTOFMEMORY;
-  CByteBuffer buffer2(nextHeaderSize_t);
+  CByteBuffer &buffer2 = db.HeaderBufs.AddNew();
+  buffer2.Alloc(nextHeaderSize_t);
 
   RINOK(ReadStream_FALSE(_stream, buffer2, nextHeaderSize_t));
 
@@ -1571,8 +1692,6 @@ HRESULT CInArchive::ReadDatabase2(
   CStreamSwitch streamSwitch;
   streamSwitch.Set(this, buffer2);
   
-  CObjectVector<CByteBuffer> dataVector;
-  
   UInt64 type = ReadID();
   if (type != NID::kHeader)
   {
@@ -1582,16 +1701,17 @@ HRESULT CInArchive::ReadDatabase2(
         EXTERNAL_CODECS_LOC_VARS
         db.ArcInfo.StartPositionAfterHeader,
         db.ArcInfo.DataStartPosition2,
-        dataVector
+        db.HeaderBufs
         _7Z_DECODER_CRYPRO_VARS
         );
     RINOK(result);
-    if (dataVector.Size() == 0)
+    if (db.HeaderBufs.Size() == 1)
       return S_OK;
-    if (dataVector.Size() > 1)
+    if (db.HeaderBufs.Size() > 2)
       ThrowIncorrect();
     streamSwitch.Remove();
-    streamSwitch.Set(this, dataVector.Front());
+    buffer2.Free();
+    streamSwitch.Set(this, db.HeaderBufs[1]);
     if (ReadID() != NID::kHeader)
       ThrowIncorrect();
   }
@@ -107,14 +107,43 @@ struct CFolders
   }
 };
 
+/*
+  CLazyUInt64DefVector doesn't unpack the values at header parsing.
+  It keeps pointers to the bit vector of defined items and to the packed values
+  in decoded header, and GetItem() reads the value from header.
+  If some items are not defined, Ranks[i] is the number of defined items
+  before item (i * 64).
+*/
+
+struct CLazyUInt64DefVector
+{
+  const Byte *DefBits; // NULL, if all items are defined
+  const Byte *Data;
+  unsigned NumItems;
+  CObjArray<UInt32> Ranks;
+
+  CLazyUInt64DefVector(): DefBits(NULL), Data(NULL), NumItems(0) {}
+
+  void Clear()
+  {
+    DefBits = NULL;
+    Data = NULL;
+    NumItems = 0;
+    Ranks.Free();
+  }
+
+  bool IsEmpty() const { return NumItems == 0; }
+  bool GetItem(unsigned index, UInt64 &value) const;
+};
+
 struct CDatabase: public CFolders
 {
   CRecordVector<CFileItem> Files;
 
-  CUInt64DefVector CTime;
-  CUInt64DefVector ATime;
-  CUInt64DefVector MTime;
-  CUInt64DefVector StartPos;
+  CLazyUInt64DefVector CTime;
+  CLazyUInt64DefVector ATime;
+  CLazyUInt64DefVector MTime;
+  CLazyUInt64DefVector StartPos;
   CBoolVector IsAnti;
   /*
   CBoolVector IsAux;
@@ -122,9 +151,26 @@ struct CDatabase: public CFolders
   CRecordVector<UInt32> SecureIDs;
   */
 
-  CByteBuffer NamesBuf;
+  // decoded header and additional header streams.
+  // NamesBuf and time vectors point to data in these buffers.
+  CObjectVector<CByteBuffer> HeaderBufs;
+  CObjectVector<CByteBuffer> AdditionalStreams;
+
+  const Byte *NamesBuf;
   CObjArray<size_t> NameOffsets; // numFiles + 1, offsets of utf-16 symbols
 
+  /*
+    Optional index of names: hash table with chains of items in increasing order.
+    It's built at first FindPath() call.
+  */
+  CObjArray<UInt32> NameHashHeads;
+  CObjArray<UInt32> NameHashNext;
+  UInt32 NameHashMask;
+  bool NameIndexWasBuilt;
+  bool NameIndexIsSupported;
+
+  CDatabase(): NamesBuf(NULL), NameHashMask(0), NameIndexWasBuilt(false), NameIndexIsSupported(false) {}
+
   /*
   void ClearSecure()
   {
@@ -138,8 +184,13 @@ struct CDatabase: public CFolders
     CFolders::Clear();
     // ClearSecure();
 
-    NamesBuf.Free();
+    NamesBuf = NULL;
     NameOffsets.Free();
+    NameHashHeads.Free();
+    NameHashNext.Free();
+    NameHashMask = 0;
+    NameIndexWasBuilt = false;
+    NameIndexIsSupported = false;
     
     Files.Clear();
     CTime.Clear();
@@ -148,6 +199,9 @@ struct CDatabase: public CFolders
     StartPos.Clear();
     IsAnti.Clear();
     // IsAux.Clear();
+
+    HeaderBufs.Clear();
+    AdditionalStreams.Clear();
   }
 
   bool IsSolid() const
@@ -170,6 +224,11 @@ struct CDatabase: public CFolders
   */
   void GetPath(unsigned index, UString &path) const;
   HRESULT GetPath_Prop(unsigned index, PROPVARIANT *path) const throw();
+
+  void BuildNameIndex();
+  // returns index of first item (>= startIndex) with path equal to (path) in kpidPath form, or -1.
+  // The index must be built already and NameIndexIsSupported must be true.
+  int FindPath(const wchar_t *path, unsigned startIndex) const;
 };
 
 struct CInArchiveInfo
@@ -393,7 +452,7 @@ class CInArchive
   void ReadBoolVector(unsigned numItems, CBoolVector &v);
   void ReadBoolVector2(unsigned numItems, CBoolVector &v);
   void ReadUInt64DefVector(const CObjectVector<CByteBuffer> &dataVector,
-      CUInt64DefVector &v, unsigned numItems);
+      CLazyUInt64DefVector &v, unsigned numItems);
   HRESULT ReadAndDecodePackedStreams(
       DECL_EXTERNAL_CODECS_LOC_VARS
       UInt64 baseOffset, UInt64 &dataOffset,
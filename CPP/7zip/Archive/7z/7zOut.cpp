@@ -56,6 +56,15 @@ HRESULT COutArchive::WriteStartHeader(const CStartHeader &h)
   return WriteDirect(buf, 24);
 }
 
+HRESULT COutArchive::FlushStream()
+{
+  CMyComPtr<IOutStreamFlush> flush;
+  Stream.QueryInterface(IID_IOutStreamFlush, &flush);
+  if (!flush)
+    return S_OK;
+  return flush->Flush();
+}
+
 #ifdef _7Z_VOL
 HRESULT COutArchive::WriteFinishHeader(const CFinishHeader &h)
 {
@@ -81,6 +90,7 @@ HRESULT COutArchive::Create(ISequentialOutStream *stream, bool endMarker)
   // endMarker = false;
   _endMarker = endMarker;
   #endif
+  _durableStartHeader = false;
   SeqStream = stream;
   if (!endMarker)
   {
@@ -119,6 +129,20 @@ void COutArchive::Close()
   Stream.Release();
 }
 
+HRESULT COutArchive::CreateAppend(IOutStream *stream, UInt64 startHeaderPos, UInt64 appendPos)
+{
+  Close();
+  #ifdef _7Z_VOL
+  _endMarker = false;
+  #endif
+  _durableStartHeader = true;
+  SeqStream = stream;
+  Stream = stream;
+  _prefixHeaderPos = startHeaderPos;
+  RINOK(Stream->SetSize(appendPos));
+  return Stream->Seek(appendPos, STREAM_SEEK_SET, NULL);
+}
+
 HRESULT COutArchive::SkipPrefixArchiveHeader()
 {
   #ifdef _7Z_VOL
@@ -883,8 +907,17 @@ HRESULT COutArchive::WriteDatabase(
     h.NextHeaderSize = headerSize;
     h.NextHeaderCRC = headerCRC;
     h.NextHeaderOffset = headerOffset;
+    if (_durableStartHeader)
+    {
+      RINOK(FlushStream());
+    }
     RINOK(Stream->Seek(_prefixHeaderPos, STREAM_SEEK_SET, NULL));
-    return WriteStartHeader(h);
+    RINOK(WriteStartHeader(h));
+    if (_durableStartHeader)
+    {
+      RINOK(FlushStream());
+    }
+    return S_OK;
   }
 }
 
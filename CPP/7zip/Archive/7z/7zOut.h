@@ -227,6 +227,7 @@ struct CArchiveDatabaseOut: public COutFolders
 class COutArchive
 {
   UInt64 _prefixHeaderPos;
+  bool _durableStartHeader;
 
   HRESULT WriteDirect(const void *data, UInt32 size) { return WriteStream(SeqStream, data, size); }
   
@@ -292,17 +293,25 @@ class COutArchive
   HRESULT WriteFinishSignature();
   #endif
   HRESULT WriteStartHeader(const CStartHeader &h);
+  HRESULT FlushStream();
   #ifdef _7Z_VOL
   HRESULT WriteFinishHeader(const CFinishHeader &h);
   #endif
   CMyComPtr<IOutStream> Stream;
 public:
 
-  COutArchive() { _outByte.Create(1 << 16); }
+  COutArchive(): _durableStartHeader(false) { _outByte.Create(1 << 16); }
   CMyComPtr<ISequentialOutStream> SeqStream;
   HRESULT Create(ISequentialOutStream *stream, bool endMarker);
   void Close();
   HRESULT SkipPrefixArchiveHeader();
+  
+  /* CreateAppend() prepares (stream) with existing archive for appending new data.
+     The data after (appendPos) is removed. WriteDatabase() writes new header
+     at the end and it overwrites start header at (startHeaderPos) as last step.
+     The stream is flushed to disk before and after the start header is changed,
+     so the start header never points to data that is not on disk yet. */
+  HRESULT CreateAppend(IOutStream *stream, UInt64 startHeaderPos, UInt64 appendPos);
   HRESULT WriteDatabase(
       DECL_EXTERNAL_CODECS_LOC_VARS
       const CArchiveDatabaseOut &db,
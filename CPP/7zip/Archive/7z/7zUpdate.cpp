@@ -4,11 +4,17 @@
 
 #include "../../../../C/CpuArch.h"
 
+#include "../../../Common/AutoPtr.h"
 #include "../../../Common/Wildcard.h"
 
 #include "../../Common/CreateCoder.h"
+#include "../../Common/InOutTempBuffer.h"
 #include "../../Common/LimitedStreams.h"
 #include "../../Common/ProgressUtils.h"
+#ifndef _7ZIP_ST
+#include "../../../Windows/System.h"
+#include "../../Common/ProgressMt.h"
+#endif
 
 #include "../../Compress/CopyCoder.h"
 
@@ -971,6 +977,211 @@ HRESULT CAnalysis::GetFilterGroup(UInt32 index, const CUpdateItem &ui, CFilterMo
   return S_OK;
 }
 
+/* ---------- Duplicate files ----------
+  7z format can't refer two files to one unpack stream.
+  So we place each duplicate file just after the first file with same data,
+  and the encoder replaces the copy by long matches (or Dedup references).
+  We compare only the sizes and CRCs of files. It's safe,
+  since wrong result can change the order of files only. */
+
+static const size_t kDupBufSize = 1 << 16;
+
+class CDupHashThread
+  #ifndef _7ZIP_ST
+    : public CVirtThread
+  #endif
+{
+public:
+  CMyComPtr<ISequentialInStream> Stream;
+  CByteBuffer Buffer;
+  UInt32 ItemIndex;
+  UInt64 Size;
+  UInt32 Crc;
+  HRESULT Result;
+
+  void HashStream();
+
+  #ifndef _7ZIP_ST
+  ~CDupHashThread() { CVirtThread::WaitThreadFinish(); }
+  virtual void Execute() { HashStream(); }
+  #endif
+};
+
+void CDupHashThread::HashStream()
+{
+  Size = 0;
+  UInt32 crc = CRC_INIT_VAL;
+  try
+  {
+    if (Buffer.Size() != kDupBufSize)
+      Buffer.Alloc(kDupBufSize);
+    for (;;)
+    {
+      size_t size = kDupBufSize;
+      Result = ReadStream(Stream, Buffer, &size);
+      if (Result != S_OK || size == 0)
+        break;
+      crc = CrcUpdate(crc, Buffer, size);
+      Size += size;
+    }
+  }
+  catch(...) { Result = E_OUTOFMEMORY; }
+  Crc = CRC_GET_DIGEST(crc);
+}
+
+struct CDupItem
+{
+  UInt32 Index;
+  UInt32 Crc;
+};
+
+static int CompareDupItemsBySize(const unsigned *p1, const unsigned *p2, void *param)
+{
+  const CObjectVector<CUpdateItem> &updateItems = *(const CObjectVector<CUpdateItem> *)param;
+  RINOZ_COMP(updateItems[*p1].Size, updateItems[*p2].Size);
+  return MyCompare(*p1, *p2);
+}
+
+static int CompareDupItems(const CDupItem *p1, const CDupItem *p2, void *param)
+{
+  const CObjectVector<CUpdateItem> &updateItems = *(const CObjectVector<CUpdateItem> *)param;
+  RINOZ_COMP(updateItems[p1->Index].Size, updateItems[p2->Index].Size);
+  RINOZ_COMP(p1->Crc, p2->Crc);
+  return MyCompare(p1->Index, p2->Index);
+}
+
+/*
+  FindDuplicateFiles() reads and hashes new files that have same size as some other new file.
+  The streams are opened and released in main thread, and only hashing is parallel.
+  dupLeaders[i] is index of first item with same data, or (-1).
+*/
+
+static HRESULT FindDuplicateFiles(IArchiveUpdateCallbackFile *callback,
+    const CObjectVector<CUpdateItem> &updateItems, UInt32 numThreads,
+    CIntVector &dupLeaders)
+{
+  CUIntVector sizeRefs;
+  FOR_VECTOR (i, updateItems)
+  {
+    const CUpdateItem &ui = updateItems[i];
+    if (ui.NewData && ui.HasStream())
+      sizeRefs.Add(i);
+  }
+  sizeRefs.Sort(CompareDupItemsBySize, (void *)&updateItems);
+
+  CUIntVector cands;
+  {
+    for (unsigned i = 0; i < sizeRefs.Size();)
+    {
+      const UInt64 size = updateItems[sizeRefs[i]].Size;
+      unsigned k;
+      for (k = i + 1; k < sizeRefs.Size() && updateItems[sizeRefs[k]].Size == size; k++);
+      if (k - i > 1)
+        for (; i < k; i++)
+          cands.Add(sizeRefs[i]);
+      i = k;
+    }
+  }
+  if (cands.IsEmpty())
+    return S_OK;
+
+  if (numThreads < 1)
+    numThreads = 1;
+  if (numThreads > cands.Size())
+    numThreads = cands.Size();
+  
+  CObjArray<CDupHashThread> threads(numThreads);
+  
+  #ifndef _7ZIP_ST
+  if (numThreads > 1)
+    for (UInt32 t = 0; t < numThreads; t++)
+    {
+      WRes wres = threads[t].Create();
+      if (wres != 0)
+        return HRESULT_FROM_WIN32(wres);
+    }
+  #endif
+
+  CRecordVector<CDupItem> items;
+  
+  for (unsigned i = 0; i < cands.Size();)
+  {
+    UInt32 numStarted = 0;
+    
+    for (; numStarted < numThreads && i < cands.Size(); i++)
+    {
+      CDupHashThread &thread = threads[numStarted];
+      thread.Stream.Release();
+      HRESULT res = callback->GetStream2(cands[i], &thread.Stream, NUpdateNotifyOp::kAnalyze);
+      if (res == S_FALSE || !thread.Stream)
+      {
+        thread.Stream.Release();
+        continue;
+      }
+      RINOK(res);
+      thread.ItemIndex = cands[i];
+      thread.Result = E_FAIL;
+      #ifndef _7ZIP_ST
+      if (numThreads > 1)
+        thread.Start();
+      else
+      #endif
+        thread.HashStream();
+      numStarted++;
+    }
+
+    HRESULT res = S_OK;
+    
+    for (UInt32 t = 0; t < numStarted; t++)
+    {
+      CDupHashThread &thread = threads[t];
+      #ifndef _7ZIP_ST
+      if (numThreads > 1)
+        thread.WaitExecuteFinish();
+      #endif
+      thread.Stream.Release();
+      if (thread.Result != S_OK)
+      {
+        if (res == S_OK)
+          res = thread.Result;
+        continue;
+      }
+      const unsigned index = thread.ItemIndex;
+      // the file could be changed after scanning
+      if (thread.Size != updateItems[index].Size)
+        continue;
+      CDupItem item;
+      item.Index = index;
+      item.Crc = thread.Crc;
+      items.Add(item);
+    }
+
+    RINOK(res);
+  }
+
+  items.Sort(CompareDupItems, (void *)&updateItems);
+
+  dupLeaders.ClearAndSetSize(updateItems.Size());
+  {
+    FOR_VECTOR (i, updateItems)
+      dupLeaders[i] = -1;
+  }
+  
+  for (unsigned i = 1; i < items.Size(); i++)
+  {
+    const CDupItem &prev = items[i - 1];
+    const CDupItem &item = items[i];
+    if (item.Crc == prev.Crc && updateItems[item.Index].Size == updateItems[prev.Index].Size)
+    {
+      int leader = dupLeaders[prev.Index];
+      dupLeaders[item.Index] = (leader >= 0 ? leader : (int)prev.Index);
+    }
+  }
+  
+  return S_OK;
+}
+
+
 static inline void GetMethodFull(UInt64 methodID, UInt32 numStreams, CMethodFull &m)
 {
   m.Id = methodID;
@@ -1588,6 +1799,494 @@ static void GetFile(const CDatabase &inDb, unsigned index, CFileItem &file, CFil
   // file2.IsAux = inDb.IsItemAux(index);
 }
 
+static void AddOldFolderInfo(const CDbEx &db, CNum folderIndex, CArchiveDatabaseOut &newDatabase)
+{
+  CFolder &folder = newDatabase.Folders.AddNew();
+  db.ParseFolderInfo(folderIndex, folder);
+  CNum startIndex = db.FoStartPackStreamIndex[folderIndex];
+  FOR_VECTOR(j, folder.PackStreams)
+  {
+    newDatabase.PackSizes.Add(db.GetStreamPackSize(startIndex + j));
+    // newDatabase.PackCRCsDefined.Add(db.PackCRCsDefined[startIndex + j]);
+    // newDatabase.PackCRCs.Add(db.PackCRCs[startIndex + j]);
+  }
+
+  size_t indexStart = db.FoToCoderUnpackSizes[folderIndex];
+  size_t indexEnd = db.FoToCoderUnpackSizes[folderIndex + 1];
+  for (; indexStart < indexEnd; indexStart++)
+    newDatabase.CoderUnpackSizes.Add(db.CoderUnpackSizes[indexStart]);
+}
+
+// it adds the files of old folder that are not replaced by new data
+
+static void AddOldFolderFiles(const CDbEx &db, CNum folderIndex,
+    const CIntArr &fileIndexToUpdateIndexMap,
+    const CObjectVector<CUpdateItem> &updateItems,
+    CArchiveDatabaseOut &newDatabase)
+{
+  CNum numUnpackStreams = db.NumUnpackStreamsVector[folderIndex];
+  CNum indexInFolder = 0;
+  for (CNum fi = db.FolderStartFileIndex[folderIndex]; indexInFolder < numUnpackStreams; fi++)
+  {
+    CFileItem file;
+    CFileItem2 file2;
+    GetFile(db, fi, file, file2);
+    UString name;
+    db.GetPath(fi, name);
+    if (file.HasStream)
+    {
+      indexInFolder++;
+      int updateIndex = fileIndexToUpdateIndexMap[fi];
+      if (updateIndex >= 0)
+      {
+        const CUpdateItem &ui = updateItems[updateIndex];
+        if (ui.NewData)
+          continue;
+        if (ui.NewProps)
+        {
+          CFileItem uf;
+          FromUpdateItemToFileItem(ui, uf, file2);
+          uf.Size = file.Size;
+          uf.Crc = file.Crc;
+          uf.CrcDefined = file.CrcDefined;
+          uf.HasStream = file.HasStream;
+          file = uf;
+          name = ui.Name;
+        }
+        /*
+        file.Parent = ui.ParentFolderIndex;
+        if (ui.TreeFolderIndex >= 0)
+          treeFolderToArcIndex[ui.TreeFolderIndex] = newDatabase.Files.Size();
+        if (totalSecureDataSize != 0)
+          newDatabase.SecureIDs.Add(ui.SecureIndex);
+        */
+        newDatabase.AddFile(file, file2, name);
+      }
+    }
+  }
+}
+
+/*
+  In-place update writes new solid blocks after the end of existing archive
+  and then it writes new header. Old solid blocks and old header are not changed
+  until the start header is overwritten at the end of update.
+  So it's possible only if there are no deleted or changed old files.
+*/
+
+static bool CanUpdateInPlace(const CDbEx &db, const CObjectVector<CUpdateItem> &updateItems)
+{
+  if (db.ArcInfo.StartPosition != 0
+      || !db.PhySizeWasConfirmed
+      || db.ThereIsHeaderError
+      || db.UnexpectedEnd
+      || db.StartHeaderWasRecovered
+      || db.UnsupportedFeatureError)
+    return false;
+  
+  // WriteDatabase() doesn't support gap between start header and packed streams
+  if (db.NumPackStreams != 0
+      && db.ArcInfo.DataStartPosition != db.ArcInfo.StartPositionAfterHeader)
+    return false;
+
+  unsigned numOldItems = 0;
+  FOR_VECTOR (i, updateItems)
+  {
+    const CUpdateItem &ui = updateItems[i];
+    if (ui.IndexInArchive == -1)
+      continue;
+    if (ui.NewData)
+      return false;
+    numOldItems++;
+  }
+  return numOldItems == db.Files.Size();
+}
+
+static void AddOldFoldersInPlace(const CDbEx &db,
+    const CIntArr &fileIndexToUpdateIndexMap,
+    const CObjectVector<CUpdateItem> &updateItems,
+    CArchiveDatabaseOut &newDatabase)
+{
+  for (CNum i = 0; i < db.NumFolders; i++)
+  {
+    AddOldFolderInfo(db, i, newDatabase);
+    newDatabase.NumUnpackStreamsVector.Add(db.NumUnpackStreamsVector[i]);
+    AddOldFolderFiles(db, i, fileIndexToUpdateIndexMap, updateItems, newDatabase);
+  }
+
+  /* The old header (and packed streams of encoded header) is kept as
+     "Copy" folder without files. Normal update removes such folder. */
+  
+  UInt64 packEnd = db.ArcInfo.StartPositionAfterHeader;
+  if (db.NumPackStreams != 0)
+    packEnd += db.PackPositions[db.NumPackStreams];
+  const UInt64 phyEnd = db.ArcInfo.StartPosition + db.PhySize;
+  if (phyEnd <= packEnd)
+    return;
+  const UInt64 gapSize = phyEnd - packEnd;
+  
+  CFolder &folder = newDatabase.Folders.AddNew();
+  folder.Coders.SetSize(1);
+  CCoderInfo &coder = folder.Coders[0];
+  coder.MethodID = k_Copy;
+  coder.NumStreams = 1;
+  folder.PackStreams.SetSize(1);
+  folder.PackStreams[0] = 0;
+  newDatabase.PackSizes.Add(gapSize);
+  newDatabase.CoderUnpackSizes.Add(gapSize);
+  newDatabase.NumUnpackStreamsVector.Add(0);
+}
+
+// it adds the files of new folder. It returns the size of skipped (locked) files in (skippedSize).
+
+static HRESULT AddNewFolderFiles(const CDbEx *db,
+    const CObjectVector<CUpdateItem> &updateItems,
+    const UInt32 *indices, unsigned numSubFiles,
+    const CFolderInStream &inStream,
+    CArchiveDatabaseOut &newDatabase, UInt64 &skippedSize)
+{
+  CNum numUnpackStreams = 0;
+  skippedSize = 0;
+  
+  for (unsigned subIndex = 0; subIndex < numSubFiles; subIndex++)
+  {
+    const CUpdateItem &ui = updateItems[indices[subIndex]];
+    CFileItem file;
+    CFileItem2 file2;
+    UString name;
+    if (ui.NewProps)
+    {
+      FromUpdateItemToFileItem(ui, file, file2);
+      name = ui.Name;
+    }
+    else
+    {
+      GetFile(*db, ui.IndexInArchive, file, file2);
+      db->GetPath(ui.IndexInArchive, name);
+    }
+    if (file2.IsAnti || file.IsDir)
+      return E_FAIL;
+    
+    /*
+    CFileItem &file = newDatabase.Files[
+          startFileIndexInDatabase + i + subIndex];
+    */
+    if (!inStream.Processed[subIndex])
+    {
+      skippedSize += ui.Size;
+      continue;
+      // file.Name.AddAscii(".locked");
+    }
+
+    file.Crc = inStream.CRCs[subIndex];
+    file.Size = inStream.Sizes[subIndex];
+    
+    // if (file.Size >= 0) // test purposes
+    if (file.Size != 0)
+    {
+      file.CrcDefined = true;
+      file.HasStream = true;
+      numUnpackStreams++;
+    }
+    else
+    {
+      file.CrcDefined = false;
+      file.HasStream = false;
+    }
+
+    /*
+    file.Parent = ui.ParentFolderIndex;
+    if (ui.TreeFolderIndex >= 0)
+      treeFolderToArcIndex[ui.TreeFolderIndex] = newDatabase.Files.Size();
+    if (totalSecureDataSize != 0)
+      newDatabase.SecureIDs.Add(ui.SecureIndex);
+    */
+    newDatabase.AddFile(file, file2, name);
+  }
+
+  // numUnpackStreams = 0 is very bad case for locked files
+  // v3.13 doesn't understand it.
+  newDatabase.NumUnpackStreamsVector.Add(numUnpackStreams);
+  return S_OK;
+}
+
+
+#ifndef _7ZIP_ST
+
+/*
+  Multithreaded compression of solid blocks:
+  each thread compresses whole solid block with its own CEncoder to temp buffer.
+  Main thread writes the blocks to archive in original order.
+  The calls from encoding threads to update callback and to progress
+  are serialized with critical section of progress mixer.
+*/
+
+class CMtUpdateCallback:
+  public IArchiveUpdateCallback,
+  public CMyUnknownImp
+{
+  CMyComPtr<IArchiveUpdateCallback> _callback;
+  NWindows::NSynchronization::CCriticalSection *_cs;
+public:
+  CMtUpdateCallback(IArchiveUpdateCallback *callback, NWindows::NSynchronization::CCriticalSection *cs):
+      _callback(callback), _cs(cs) {}
+
+  MY_UNKNOWN_IMP
+  INTERFACE_IArchiveUpdateCallback(;)
+};
+
+#define MT_CALLBACK_LOCK NWindows::NSynchronization::CCriticalSectionLock lock(*_cs);
+
+STDMETHODIMP CMtUpdateCallback::SetTotal(UInt64 total)
+  { MT_CALLBACK_LOCK return _callback->SetTotal(total); }
+STDMETHODIMP CMtUpdateCallback::SetCompleted(const UInt64 *completeValue)
+  { MT_CALLBACK_LOCK return _callback->SetCompleted(completeValue); }
+STDMETHODIMP CMtUpdateCallback::GetUpdateItemInfo(UInt32 index, Int32 *newData, Int32 *newProps, UInt32 *indexInArchive)
+  { MT_CALLBACK_LOCK return _callback->GetUpdateItemInfo(index, newData, newProps, indexInArchive); }
+STDMETHODIMP CMtUpdateCallback::GetProperty(UInt32 index, PROPID propID, PROPVARIANT *value)
+  { MT_CALLBACK_LOCK return _callback->GetProperty(index, propID, value); }
+STDMETHODIMP CMtUpdateCallback::GetStream(UInt32 index, ISequentialInStream **inStream)
+  { MT_CALLBACK_LOCK return _callback->GetStream(index, inStream); }
+STDMETHODIMP CMtUpdateCallback::SetOperationResult(Int32 operationResult)
+  { MT_CALLBACK_LOCK return _callback->SetOperationResult(operationResult); }
+
+
+class CFolderEncodeThread: public CVirtThread
+{
+public:
+  DECL_EXTERNAL_CODECS_LOC_VARS2;
+  
+  CMyAutoPtr<CEncoder> Encoder;
+  IArchiveUpdateCallback *UpdateCallback;
+  const UInt64 *InSizeForReduce;
+
+  const UInt32 *Indices;
+  unsigned NumFiles;
+  CFolder *Folder;
+
+  CFolderInStream *InStreamSpec;
+  CMyComPtr<ISequentialInStream> InStream;
+  CInOutTempBuffer TempBuffer;
+  CSequentialOutTempBufferImp *OutStreamSpec;
+  CMyComPtr<ISequentialOutStream> OutStream;
+  CMtCompressProgress *ProgressSpec;
+  CMyComPtr<ICompressProgressInfo> Progress;
+
+  CRecordVector<UInt64> CoderUnpackSizes;
+  CRecordVector<UInt64> PackSizes;
+  UInt64 UnpackSize;
+  HRESULT Result;
+
+  HRESULT Create(const CCompressionMethodMode &method,
+      CMtCompressProgressMixer *progressMixer, unsigned index);
+  ~CFolderEncodeThread() { CVirtThread::WaitThreadFinish(); }
+  virtual void Execute();
+};
+
+HRESULT CFolderEncodeThread::Create(const CCompressionMethodMode &method,
+    CMtCompressProgressMixer *progressMixer, unsigned index)
+{
+  Encoder.reset(new CEncoder(method));
+  InStreamSpec = new CFolderInStream;
+  InStream = InStreamSpec;
+  TempBuffer.Create();
+  OutStreamSpec = new CSequentialOutTempBufferImp;
+  OutStream = OutStreamSpec;
+  OutStreamSpec->Init(&TempBuffer);
+  ProgressSpec = new CMtCompressProgress;
+  Progress = ProgressSpec;
+  ProgressSpec->Init(progressMixer, (int)index);
+  WRes wres = CVirtThread::Create();
+  return HRESULT_FROM_WIN32(wres);
+}
+
+void CFolderEncodeThread::Execute()
+{
+  try
+  {
+    CoderUnpackSizes.Clear();
+    PackSizes.Clear();
+    TempBuffer.InitWriting();
+    InStreamSpec->Init(UpdateCallback, Indices, NumFiles);
+    
+    Result = (*Encoder).Encode(
+        EXTERNAL_CODECS_LOC_VARS
+        InStream,
+        InSizeForReduce,
+        *Folder, CoderUnpackSizes, UnpackSize,
+        OutStream, PackSizes, Progress);
+    
+    if (Result == S_OK && !InStreamSpec->WasFinished())
+      Result = E_FAIL;
+    if (Result == S_OK)
+    {
+      UInt64 packSize = 0;
+      FOR_VECTOR (i, PackSizes)
+        packSize += PackSizes[i];
+      Result = Progress->SetRatioInfo(&UnpackSize, &packSize);
+    }
+  }
+  catch(...) { Result = E_FAIL; }
+}
+
+static void SetMethodNumThreads(CCompressionMethodMode &method, UInt32 numThreads)
+{
+  method.NumThreads = numThreads;
+  FOR_VECTOR (i, method.Methods)
+  {
+    CObjectVector<CProp> &props = method.Methods[i].Props;
+    FOR_VECTOR (k, props)
+      if (props[k].Id == NCoderPropID::kNumThreads)
+        props[k].Value = (UInt32)numThreads;
+  }
+}
+
+/* GetFolderEncoderMemUsage() returns the estimated size of memory
+   that is used by one folder encoding job with one coder thread. */
+
+static UInt64 GetFolderEncoderMemUsage(const CCompressionMethodMode &method)
+{
+  UInt64 size = (UInt64)1 << 20; // TempBuffer of CFolderEncodeThread
+  FOR_VECTOR (i, method.Methods)
+  {
+    const CMethodFull &m = method.Methods[i];
+    switch (m.Id)
+    {
+      case k_LZMA:
+      case k_LZMA2:
+      {
+        // window, hash and binary tree of match finder
+        const UInt64 dicSize = m.Get_Lzma_DicSize();
+        size += dicSize * 11 + (dicSize >> 1) + ((UInt32)6 << 20);
+        break;
+      }
+      case k_PPMD: size += (UInt64)m.Get_Ppmd_MemSize() + ((UInt32)2 << 20); break;
+      case k_BZip2: size += (UInt64)m.Get_BZip2_BlockSize() * 10 + ((UInt32)1 << 20); break;
+      default: size += (UInt32)4 << 20;
+    }
+  }
+  return size;
+}
+
+/*
+  EncodeFoldersMt() compresses solid blocks (blockStarts[i] ... blockStarts[i + 1])
+  in (numJobs) threads. Each thread uses (method.NumThreads / numJobs) threads for codecs.
+*/
+
+static HRESULT EncodeFoldersMt(
+    DECL_EXTERNAL_CODECS_LOC_VARS
+    const CCompressionMethodMode &method,
+    unsigned numJobs,
+    IArchiveUpdateCallback *updateCallback,
+    const UInt64 *inSizeForReduce,
+    const CDbEx *db,
+    const CObjectVector<CUpdateItem> &updateItems,
+    const UInt32 *indices,
+    const CUIntVector &blockStarts,
+    ISequentialOutStream *outStream,
+    CArchiveDatabaseOut &newDatabase,
+    CLocalProgress *lps,
+    UInt64 &complexity)
+{
+  const unsigned numBlocks = blockStarts.Size() - 1;
+  
+  CCompressionMethodMode jobMethod = method;
+  {
+    UInt32 numCoderThreads = method.NumThreads / (UInt32)numJobs;
+    if (numCoderThreads < 1)
+      numCoderThreads = 1;
+    SetMethodNumThreads(jobMethod, numCoderThreads);
+  }
+
+  CMtCompressProgressMixer progressMixer;
+  progressMixer.Init(numJobs, lps);
+  
+  CMtUpdateCallback *mtCallbackSpec = new CMtUpdateCallback(updateCallback, &progressMixer.CriticalSection);
+  CMyComPtr<IArchiveUpdateCallback> mtCallback = mtCallbackSpec;
+
+  CObjArray<CFolderEncodeThread> threads(numJobs);
+  
+  unsigned i;
+  for (i = 0; i < numJobs; i++)
+  {
+    CFolderEncodeThread &thread = threads[i];
+    #ifdef EXTERNAL_CODECS
+    thread.__externalCodecs = __externalCodecs;
+    #endif
+    thread.UpdateCallback = mtCallback;
+    thread.InSizeForReduce = inSizeForReduce;
+    RINOK(thread.Create(jobMethod, &progressMixer, i));
+  }
+
+  // the folders of new blocks are filled by encoding threads
+  const unsigned folderIndexStart = newDatabase.Folders.Size();
+  for (i = 0; i < numBlocks; i++)
+    newDatabase.Folders.AddNew();
+
+  UInt64 totalUnpackSize = 0;
+  UInt64 totalPackSize = 0;
+  unsigned numStarted = 0;
+  HRESULT res = S_OK;
+
+  for (unsigned blockIndex = 0;; blockIndex++)
+  {
+    while (res == S_OK && numStarted < numBlocks && numStarted < blockIndex + numJobs)
+    {
+      CFolderEncodeThread &thread = threads[numStarted % numJobs];
+      thread.Indices = indices + blockStarts[numStarted];
+      thread.NumFiles = blockStarts[numStarted + 1] - blockStarts[numStarted];
+      thread.Folder = &newDatabase.Folders[folderIndexStart + numStarted];
+      thread.Result = E_FAIL;
+      thread.ProgressSpec->Reinit();
+      thread.Start();
+      numStarted++;
+    }
+    
+    // if some thread has failed, we wait all started threads
+    if (blockIndex >= numStarted)
+      break;
+
+    CFolderEncodeThread &thread = threads[blockIndex % numJobs];
+    thread.WaitExecuteFinish();
+    
+    if (res != S_OK)
+      continue;
+    res = thread.Result;
+    if (res == S_OK)
+      res = thread.TempBuffer.WriteToStream(outStream);
+    if (res != S_OK)
+      continue;
+
+    FOR_VECTOR (k, thread.PackSizes)
+    {
+      newDatabase.PackSizes.Add(thread.PackSizes[k]);
+      totalPackSize += thread.PackSizes[k];
+    }
+    FOR_VECTOR (k, thread.CoderUnpackSizes)
+      newDatabase.CoderUnpackSizes.Add(thread.CoderUnpackSizes[k]);
+    totalUnpackSize += thread.UnpackSize;
+
+    UInt64 skippedSize;
+    res = AddNewFolderFiles(db, updateItems, thread.Indices, thread.NumFiles,
+        *thread.InStreamSpec, newDatabase, skippedSize);
+    
+    if (res == S_OK && skippedSize != 0 && complexity >= skippedSize)
+    {
+      complexity -= skippedSize;
+      res = mtCallback->SetTotal(complexity);
+    }
+  }
+
+  RINOK(res);
+  
+  // all sizes of completed blocks were reported to (lps) via progressMixer
+  lps->InSize += totalUnpackSize;
+  lps->OutSize += totalPackSize;
+  return S_OK;
+}
+
+#endif
+
+
 HRESULT Update(
     DECL_EXTERNAL_CODECS_LOC_VARS
     IInStream *inStream,
@@ -1624,6 +2323,10 @@ HRESULT Update(
     return E_NOTIMPL;
   */
 
+  if (options.InPlace)
+    if (!db || !CanUpdateInPlace(*db, updateItems))
+      return S_FALSE;
+
   UInt64 startBlockSize = db ? db->ArcInfo.StartPosition: 0;
   if (startBlockSize > 0 && !options.RemoveSfxBlock)
   {
@@ -1692,6 +2395,10 @@ HRESULT Update(
       if (numCopyItems == 0)
         continue;
 
+      // in-place update keeps all old folders at their positions
+      if (options.InPlace)
+        continue;
+
       CFolderRepack rep;
       rep.FolderIndex = i;
       rep.NumCopyFiles = numCopyItems;
@@ -1817,6 +2524,19 @@ HRESULT Update(
     }
   }
 
+  // ---------- Find duplicate files ----------
+
+  CIntVector dupLeaders;
+  
+  if (options.DedupFiles && numSolidFiles > 1 && opCallback)
+  {
+    UInt32 numThreads = 1;
+    #ifndef _7ZIP_ST
+    numThreads = options.Method->NumThreads;
+    #endif
+    RINOK(FindDuplicateFiles(opCallback, updateItems, numThreads, dupLeaders));
+  }
+
 
   #ifndef _NO_CRYPTO
 
@@ -1849,8 +2569,21 @@ HRESULT Update(
   
   // ---------- Compress ----------
 
-  RINOK(archive.Create(seqOutStream, false));
-  RINOK(archive.SkipPrefixArchiveHeader());
+  if (options.InPlace)
+  {
+    CMyComPtr<IOutStream> outStream;
+    seqOutStream->QueryInterface(IID_IOutStream, (void **)&outStream);
+    if (!outStream)
+      return E_NOTIMPL;
+    RINOK(archive.CreateAppend(outStream,
+        db->ArcInfo.StartPositionAfterHeader - (kStartHeaderSize + 4),
+        db->ArcInfo.StartPosition + db->PhySize));
+  }
+  else
+  {
+    RINOK(archive.Create(seqOutStream, false));
+    RINOK(archive.SkipPrefixArchiveHeader());
+  }
 
   /*
   CIntVector treeFolderToArcIndex;
@@ -1948,6 +2681,9 @@ HRESULT Update(
     }
   }
 
+  if (options.InPlace)
+    AddOldFoldersInPlace(*db, fileIndexToUpdateIndexMap, updateItems, newDatabase);
+
   lps->ProgressOffset = 0;
 
   {
@@ -2037,20 +2773,7 @@ HRESULT Update(
             db->GetFolderStreamPos(folderIndex, 0), packSize, progress));
         lps->ProgressOffset += packSize;
         
-        CFolder &folder = newDatabase.Folders.AddNew();
-        db->ParseFolderInfo(folderIndex, folder);
-        CNum startIndex = db->FoStartPackStreamIndex[folderIndex];
-        FOR_VECTOR(j, folder.PackStreams)
-        {
-          newDatabase.PackSizes.Add(db->GetStreamPackSize(startIndex + j));
-          // newDatabase.PackCRCsDefined.Add(db.PackCRCsDefined[startIndex + j]);
-          // newDatabase.PackCRCs.Add(db.PackCRCs[startIndex + j]);
-        }
-
-        size_t indexStart = db->FoToCoderUnpackSizes[folderIndex];
-        size_t indexEnd = db->FoToCoderUnpackSizes[folderIndex + 1];
-        for (; indexStart < indexEnd; indexStart++)
-          newDatabase.CoderUnpackSizes.Add(db->CoderUnpackSizes[indexStart]);
+        AddOldFolderInfo(*db, folderIndex, newDatabase);
       }
       else
       {
@@ -2263,46 +2986,7 @@ HRESULT Update(
       }
       
       newDatabase.NumUnpackStreamsVector.Add(rep.NumCopyFiles);
-      
-      CNum indexInFolder = 0;
-      for (CNum fi = db->FolderStartFileIndex[folderIndex]; indexInFolder < numUnpackStreams; fi++)
-      {
-        CFileItem file;
-        CFileItem2 file2;
-        GetFile(*db, fi, file, file2);
-        UString name;
-        db->GetPath(fi, name);
-        if (file.HasStream)
-        {
-          indexInFolder++;
-          int updateIndex = fileIndexToUpdateIndexMap[fi];
-          if (updateIndex >= 0)
-          {
-            const CUpdateItem &ui = updateItems[updateIndex];
-            if (ui.NewData)
-              continue;
-            if (ui.NewProps)
-            {
-              CFileItem uf;
-              FromUpdateItemToFileItem(ui, uf, file2);
-              uf.Size = file.Size;
-              uf.Crc = file.Crc;
-              uf.CrcDefined = file.CrcDefined;
-              uf.HasStream = file.HasStream;
-              file = uf;
-              name = ui.Name;
-            }
-            /*
-            file.Parent = ui.ParentFolderIndex;
-            if (ui.TreeFolderIndex >= 0)
-              treeFolderToArcIndex[ui.TreeFolderIndex] = newDatabase.Files.Size();
-            if (totalSecureDataSize != 0)
-              newDatabase.SecureIDs.Add(ui.SecureIndex);
-            */
-            newDatabase.AddFile(file, file2, name);
-          }
-        }
-      }
+      AddOldFolderFiles(*db, folderIndex, fileIndexToUpdateIndexMap, updateItems, newDatabase);
     }
 
 
@@ -2326,11 +3010,13 @@ HRESULT Update(
     refItems.Sort(CompareUpdateItems, (void *)&sortParam);
     
     CObjArray<UInt32> indices(numFiles);
+    CBoolArr isDupFollower(numFiles);
 
     for (i = 0; i < numFiles; i++)
     {
       UInt32 index = refItems[i].Index;
       indices[i] = index;
+      isDupFollower[i] = false;
       /*
       const CUpdateItem &ui = updateItems[index];
       CFileItem file;
@@ -2343,19 +3029,78 @@ HRESULT Update(
       newDatabase.Files.Add(file);
       */
     }
+
+    if (!dupLeaders.IsEmpty())
+    {
+      // we move each duplicate file to the position after its leader file in that group
+      CIntArr firstFollower(updateItems.Size());
+      CIntArr nextFollower(updateItems.Size());
+      CBoolArr inGroup(updateItems.Size());
+      for (i = 0; i < updateItems.Size(); i++)
+      {
+        firstFollower[i] = -1;
+        inGroup[i] = false;
+      }
+      for (i = 0; i < numFiles; i++)
+        inGroup[refItems[i].Index] = true;
+      
+      for (i = numFiles; i != 0;)
+      {
+        UInt32 index = refItems[--i].Index;
+        int leader = dupLeaders[index];
+        if (leader >= 0 && inGroup[(unsigned)leader])
+        {
+          nextFollower[index] = firstFollower[(unsigned)leader];
+          firstFollower[(unsigned)leader] = index;
+        }
+      }
+      
+      unsigned pos = 0;
+      for (i = 0; i < numFiles; i++)
+      {
+        UInt32 index = refItems[i].Index;
+        int leader = dupLeaders[index];
+        if (leader >= 0 && inGroup[(unsigned)leader])
+          continue;
+        isDupFollower[pos] = false;
+        indices[pos++] = index;
+        for (int k = firstFollower[index]; k >= 0; k = nextFollower[(unsigned)k])
+        {
+          isDupFollower[pos] = true;
+          indices[pos++] = k;
+        }
+      }
+      if (pos != numFiles)
+        return E_FAIL;
+    }
+    
+    // ---------- Split files to solid blocks ----------
+
+    CUIntVector blockStarts;
     
     for (i = 0; i < numFiles;)
     {
       UInt64 totalSize = 0;
-      unsigned numSubFiles;
+      UInt64 numLeaders = 0;
+      unsigned numSubFiles = 0;
       
       const wchar_t *prevExtension = NULL;
       
-      for (numSubFiles = 0; i + numSubFiles < numFiles && numSubFiles < numSolidFiles; numSubFiles++)
+      /* duplicate file is cheap, so we keep it in the solid block of its leader file.
+         The leader file and its followers are not split, and the followers
+         are not counted in the limits of solid block. */
+      
+      while (i + numSubFiles < numFiles)
       {
+        unsigned unitSize = 1;
+        while (i + numSubFiles + unitSize < numFiles && isDupFollower[i + numSubFiles + unitSize])
+          unitSize++;
+        
+        if (numSubFiles != 0 && numLeaders >= numSolidFiles)
+          break;
         const CUpdateItem &ui = updateItems[indices[i + numSubFiles]];
         totalSize += ui.Size;
-        if (totalSize > options.NumSolidBytes)
+        if (numSubFiles != 0 && totalSize > options.NumSolidBytes)
           break;
         if (options.SolidExtension)
         {
@@ -2367,10 +3112,58 @@ HRESULT Update(
           else if (!StringsAreEqualNoCase(ext, prevExtension))
             break;
         }
+        
+        numLeaders++;
+        numSubFiles += unitSize;
       }
 
-      if (numSubFiles < 1)
-        numSubFiles = 1;
+      blockStarts.Add(i);
+      i += numSubFiles;
+    }
+    blockStarts.Add(numFiles);
+
+    const unsigned numBlocks = blockStarts.Size() - 1;
+
+    #ifndef _7ZIP_ST
+    {
+      // we don't use threads for blocks without compression
+      unsigned numJobs = method.NumThreads;
+      if (numJobs > numBlocks)
+        numJobs = numBlocks;
+      if (method.Methods.Size() == 1 && method.Methods[0].Id == k_Copy)
+        numJobs = 1;
+      
+      if (numJobs > 1)
+      {
+        // each job has own encoder, so the number of jobs is limited by RAM size
+        UInt64 memLimit = (UInt64)sizeof(size_t) << 29;
+        {
+          UInt64 ramSize;
+          if (NWindows::NSystem::GetRamSize(ramSize))
+            memLimit = ramSize / 2;
+        }
+        const UInt64 maxJobs = memLimit / GetFolderEncoderMemUsage(method);
+        if (numJobs > maxJobs)
+          numJobs = (maxJobs == 0 ? 1 : (unsigned)maxJobs);
+      }
+      
+      if (numJobs > 1)
+      {
+        RINOK(lps->SetCur());
+        RINOK(EncodeFoldersMt(
+            EXTERNAL_CODECS_LOC_VARS
+            method, numJobs, updateCallback, &inSizeForReduce,
+            db, updateItems, indices, blockStarts,
+            archive.SeqStream, newDatabase, lps, complexity));
+        continue;
+      }
+    }
+    #endif
+
+    for (unsigned blockIndex = 0; blockIndex < numBlocks; blockIndex++)
+    {
+      i = blockStarts[blockIndex];
+      const unsigned numSubFiles = blockStarts[blockIndex + 1] - i;
 
       RINOK(lps->SetCur());
 
@@ -2399,69 +3192,9 @@ HRESULT Update(
       // newDatabase.PackCRCsDefined.Add(false);
       // newDatabase.PackCRCs.Add(0);
 
-      CNum numUnpackStreams = 0;
-      UInt64 skippedSize = 0;
-      
-      for (unsigned subIndex = 0; subIndex < numSubFiles; subIndex++)
-      {
-        const CUpdateItem &ui = updateItems[indices[i + subIndex]];
-        CFileItem file;
-        CFileItem2 file2;
-        UString name;
-        if (ui.NewProps)
-        {
-          FromUpdateItemToFileItem(ui, file, file2);
-          name = ui.Name;
-        }
-        else
-        {
-          GetFile(*db, ui.IndexInArchive, file, file2);
-          db->GetPath(ui.IndexInArchive, name);
-        }
-        if (file2.IsAnti || file.IsDir)
-          return E_FAIL;
-        
-        /*
-        CFileItem &file = newDatabase.Files[
-              startFileIndexInDatabase + i + subIndex];
-        */
-        if (!inStreamSpec->Processed[subIndex])
-        {
-          skippedSize += ui.Size;
-          continue;
-          // file.Name.AddAscii(".locked");
-        }
-
-        file.Crc = inStreamSpec->CRCs[subIndex];
-        file.Size = inStreamSpec->Sizes[subIndex];
-        
-        // if (file.Size >= 0) // test purposes
-        if (file.Size != 0)
-        {
-          file.CrcDefined = true;
-          file.HasStream = true;
-          numUnpackStreams++;
-        }
-        else
-        {
-          file.CrcDefined = false;
-          file.HasStream = false;
-        }
-
-        /*
-        file.Parent = ui.ParentFolderIndex;
-        if (ui.TreeFolderIndex >= 0)
-          treeFolderToArcIndex[ui.TreeFolderIndex] = newDatabase.Files.Size();
-        if (totalSecureDataSize != 0)
-          newDatabase.SecureIDs.Add(ui.SecureIndex);
-        */
-        newDatabase.AddFile(file, file2, name);
-      }
-
-      // numUnpackStreams = 0 is very bad case for locked files
-      // v3.13 doesn't understand it.
-      newDatabase.NumUnpackStreamsVector.Add(numUnpackStreams);
-      i += numSubFiles;
+      UInt64 skippedSize;
+      RINOK(AddNewFolderFiles(db, updateItems, &indices[i], numSubFiles,
+          *inStreamSpec, newDatabase, skippedSize));
 
       if (skippedSize != 0 && complexity >= skippedSize)
       {
@@ -99,9 +99,11 @@ struct CUpdateOptions
   bool SolidExtension;
   
   bool UseTypeSorting;
+  bool DedupFiles; // place duplicate files after first copy in same solid block
   
   bool RemoveSfxBlock;
   bool MultiThreadMixer;
+  bool InPlace; // append new folders to (seqOutStream) that is the same file as (inStream)
 
   CUpdateOptions():
       Method(NULL),
@@ -113,8 +115,10 @@ struct CUpdateOptions
       NumSolidBytes((UInt64)(Int64)(-1)),
       SolidExtension(false),
       UseTypeSorting(true),
+      DedupFiles(false),
       RemoveSfxBlock(false),
-      MultiThreadMixer(true)
+      MultiThreadMixer(true),
+      InPlace(false)
     {}
 };
 
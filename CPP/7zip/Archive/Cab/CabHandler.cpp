@@ -538,13 +538,25 @@ STDMETHODIMP CHandler::Close()
   return S_OK;
 }
 
-class CFolderOutStream:
+class CFolderOutStreamBase:
   public ISequentialOutStream,
   public CMyUnknownImp
 {
+protected:
+  UInt64 m_FolderSize;
+  UInt64 m_PosInFolder;
 public:
   MY_UNKNOWN_IMP
 
+  bool NeedMoreWrite() const { return (m_FolderSize > m_PosInFolder); }
+  UInt64 GetRemain() const { return m_FolderSize - m_PosInFolder; }
+  UInt64 GetPosInFolder() const { return m_PosInFolder; }
+};
+
+
+class CFolderOutStream: public CFolderOutStreamBase
+{
+public:
   STDMETHOD(Write)(const void *data, UInt32 size, UInt32 *processedSize);
 private:
   const CMvDatabaseEx *m_Database;
@@ -566,8 +578,6 @@ private:
   bool m_IsOk;
   bool m_FileIsOpen;
   UInt32 m_RemainFileSize;
-  UInt64 m_FolderSize;
-  UInt64 m_PosInFolder;
 
   void FreeTempBuf()
   {
@@ -593,10 +603,6 @@ public:
       bool testMode);
   HRESULT FlushCorrupted(unsigned folderIndex);
   HRESULT Unsupported();
-
-  bool NeedMoreWrite() const { return (m_FolderSize > m_PosInFolder); }
-  UInt64 GetRemain() const { return m_FolderSize - m_PosInFolder; }
-  UInt64 GetPosInFolder() const { return m_PosInFolder; }
 };
 
 
@@ -897,6 +903,461 @@ HRESULT CFolderOutStream::Unsupported()
 }
 
 
+/* CFolderBufOutStream writes the unpacked data of folder to memory buffer.
+   The data after the end of folder is ignored, as in CFolderOutStream. */
+
+class CFolderBufOutStream: public CFolderOutStreamBase
+{
+  Byte *_buf;
+public:
+  void Init(Byte *buf, UInt64 folderSize)
+  {
+    _buf = buf;
+    m_FolderSize = folderSize;
+    m_PosInFolder = 0;
+  }
+
+  STDMETHOD(Write)(const void *data, UInt32 size, UInt32 *processedSize);
+};
+
+STDMETHODIMP CFolderBufOutStream::Write(const void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (m_PosInFolder < m_FolderSize)
+  {
+    UInt64 rem = m_FolderSize - m_PosInFolder;
+    memcpy(_buf + (size_t)m_PosInFolder, data, (size_t)MyMin((UInt64)size, rem));
+  }
+  m_PosInFolder += size;
+  if (processedSize)
+    *processedSize = size;
+  return S_OK;
+}
+
+
+#ifndef _7ZIP_ST
+
+/* The folders are decoded in threads. Each decoder reads the volume streams
+   at its own position. Seek() and Read() of real stream are called under
+   CriticalSection that is common for all volumes. */
+
+class CPosInStream:
+  public IInStream,
+  public CMyUnknownImp
+{
+  NWindows::NSynchronization::CCriticalSection *_cs;
+  UInt64 _pos;
+public:
+  IInStream *Stream;
+
+  void Init(NWindows::NSynchronization::CCriticalSection *cs)
+  {
+    _cs = cs;
+    _pos = 0;
+    Stream = NULL;
+  }
+
+  MY_UNKNOWN_IMP2(ISequentialInStream, IInStream)
+
+  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
+};
+
+STDMETHODIMP CPosInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  NWindows::NSynchronization::CCriticalSectionLock lock(*_cs);
+  RINOK(Stream->Seek(_pos, STREAM_SEEK_SET, NULL));
+  UInt32 realProcessedSize = 0;
+  HRESULT res = Stream->Read(data, size, &realProcessedSize);
+  _pos += realProcessedSize;
+  if (processedSize)
+    *processedSize = realProcessedSize;
+  return res;
+}
+
+STDMETHODIMP CPosInStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition)
+{
+  switch (seekOrigin)
+  {
+    case STREAM_SEEK_SET: break;
+    case STREAM_SEEK_CUR: offset += _pos; break;
+    case STREAM_SEEK_END:
+    {
+      UInt64 size;
+      {
+        NWindows::NSynchronization::CCriticalSectionLock lock(*_cs);
+        RINOK(Stream->Seek(0, STREAM_SEEK_END, &size));
+      }
+      offset += size;
+      break;
+    }
+    default: return STG_E_INVALIDFUNCTION;
+  }
+  if (offset < 0)
+    return HRESULT_WIN32_ERROR_NEGATIVE_SEEK;
+  _pos = offset;
+  if (newPosition)
+    *newPosition = offset;
+  return S_OK;
+}
+
+#endif
+
+
+class CFolderDecoder
+{
+  NCompress::CCopyCoder *copyCoderSpec;
+  CMyComPtr<ICompressCoder> copyCoder;
+
+  NCompress::NDeflate::NDecoder::CCOMCoder *deflateDecoderSpec;
+  CMyComPtr<ICompressCoder> deflateDecoder;
+
+  NCompress::NLzx::CDecoder *lzxDecoderSpec;
+  CMyComPtr<IUnknown> lzxDecoder;
+
+  NCompress::NQuantum::CDecoder *quantumDecoderSpec;
+  CMyComPtr<IUnknown> quantumDecoder;
+
+  CCabBlockInStream *cabBlockInStreamSpec;
+  CMyComPtr<ISequentialInStream> cabBlockInStream;
+
+  #ifndef _7ZIP_ST
+  CPosInStream *_posStreamSpec;
+  CMyComPtr<IInStream> _posStream;
+  #endif
+
+public:
+  CFolderDecoder():
+      deflateDecoderSpec(NULL),
+      lzxDecoderSpec(NULL),
+      quantumDecoderSpec(NULL)
+      #ifndef _7ZIP_ST
+      , _posStreamSpec(NULL)
+      #endif
+      {}
+
+  bool Create();
+  
+  #ifndef _7ZIP_ST
+  void SetCriticalSection(NWindows::NSynchronization::CCriticalSection *cs)
+  {
+    _posStreamSpec = new CPosInStream;
+    _posStream = _posStreamSpec;
+    _posStreamSpec->Init(cs);
+  }
+  #endif
+
+  // it returns E_INVALIDARG for unsupported method
+  HRESULT SetMethod(const CFolder &folder);
+
+  // it returns S_FALSE for data error
+  HRESULT Decode(const CMvDatabaseEx &database, unsigned volIndex, int locFolderIndex,
+      CFolderOutStreamBase *folderOutStream,
+      CLocalProgress *lps, UInt64 totalUnPacked, UInt64 &totalPacked);
+};
+
+bool CFolderDecoder::Create()
+{
+  copyCoderSpec = new NCompress::CCopyCoder;
+  copyCoder = copyCoderSpec;
+  cabBlockInStreamSpec = new CCabBlockInStream();
+  cabBlockInStream = cabBlockInStreamSpec;
+  return cabBlockInStreamSpec->Create();
+}
+
+HRESULT CFolderDecoder::SetMethod(const CFolder &folder)
+{
+  cabBlockInStreamSpec->MsZip = false;
+  HRESULT res = S_OK;
+  
+  switch (folder.GetMethod())
+  {
+    case NHeader::NMethod::kNone:
+      break;
+    
+    case NHeader::NMethod::kMSZip:
+      if (!deflateDecoder)
+      {
+        deflateDecoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder;
+        deflateDecoder = deflateDecoderSpec;
+      }
+      cabBlockInStreamSpec->MsZip = true;
+      break;
+    
+    case NHeader::NMethod::kLZX:
+      if (!lzxDecoder)
+      {
+        lzxDecoderSpec = new NCompress::NLzx::CDecoder;
+        lzxDecoder = lzxDecoderSpec;
+      }
+      res = lzxDecoderSpec->SetParams_and_Alloc(folder.MethodMinor);
+      break;
+
+    case NHeader::NMethod::kQuantum:
+      if (!quantumDecoder)
+      {
+        quantumDecoderSpec = new NCompress::NQuantum::CDecoder;
+        quantumDecoder = quantumDecoderSpec;
+      }
+      res = quantumDecoderSpec->SetParams(folder.MethodMinor);
+      break;
+    
+    default:
+      res = E_INVALIDARG;
+      break;
+  }
+
+  return res;
+}
+
+HRESULT CFolderDecoder::Decode(const CMvDatabaseEx &database, unsigned volIndex, int locFolderIndex,
+    CFolderOutStreamBase *folderOutStream,
+    CLocalProgress *lps, UInt64 totalUnPacked, UInt64 &totalPacked)
+{
+  ISequentialOutStream *outStream = folderOutStream;
+  HRESULT res = S_OK;
+  bool keepHistory = false;
+  bool keepInputBuffer = false;
+  bool thereWasNotAlignedChunk = false;
+  
+  for (UInt32 bl = 0; folderOutStream->NeedMoreWrite();)
+  {
+    if (volIndex >= database.Volumes.Size())
+    {
+      res = S_FALSE;
+      break;
+    }
+
+    const CDatabaseEx &db2 = database.Volumes[volIndex];
+    const CFolder &folder2 = db2.Folders[locFolderIndex];
+    
+    IInStream *stream = db2.Stream;
+    #ifndef _7ZIP_ST
+    if (_posStreamSpec)
+    {
+      _posStreamSpec->Stream = db2.Stream;
+      stream = _posStream;
+    }
+    #endif
+
+    if (bl == 0)
+    {
+      cabBlockInStreamSpec->ReservedSize = db2.ArcInfo.GetDataBlockReserveSize();
+      RINOK(stream->Seek(db2.StartPosition + folder2.DataStart, STREAM_SEEK_SET, NULL));
+    }
+    
+    if (bl == folder2.NumDataBlocks)
+    {
+      /*
+        CFolder::NumDataBlocks (CFFOLDER::cCFData in CAB specification) is 16-bit.
+        But there are some big CAB archives from MS that contain more
+        than (0xFFFF) CFDATA blocks in folder.
+        Old cab extracting software can show error (or ask next volume)
+        but cab extracting library in new Windows ignores this error.
+        15.00 : We also try to ignore such error, if archive is not multi-volume.
+      */
+      if (database.Volumes.Size() > 1)
+      {
+        volIndex++;
+        locFolderIndex = 0;
+        bl = 0;
+        continue;
+      }
+    }
+    
+    bl++;
+
+    if (!keepInputBuffer)
+      cabBlockInStreamSpec->InitForNewBlock();
+
+    UInt32 packSize, unpackSize;
+    res = cabBlockInStreamSpec->PreRead(stream, packSize, unpackSize);
+    if (res == S_FALSE)
+      break;
+    RINOK(res);
+    keepInputBuffer = (unpackSize == 0);
+    if (keepInputBuffer)
+      continue;
+
+    totalPacked += packSize;
+
+    if (lps)
+    {
+      lps->OutSize = totalUnPacked + folderOutStream->GetPosInFolder();
+      lps->InSize = totalPacked;
+      RINOK(lps->SetCur());
+    }
+
+    const UInt32 kBlockSizeMax = (1 << 15);
+
+    /* We don't try to reduce last block.
+       Note that LZX converts data with x86 filter.
+       and filter needs larger input data than reduced size.
+       It's simpler to decompress full chunk here.
+       also we need full block for quantum for more integrity checks */
+
+    if (unpackSize > kBlockSizeMax)
+    {
+      res = S_FALSE;
+      break;
+    }
+
+    if (unpackSize != kBlockSizeMax)
+    {
+      if (thereWasNotAlignedChunk)
+      {
+        res = S_FALSE;
+        break;
+      }
+      thereWasNotAlignedChunk = true;
+    }
+
+    UInt64 unpackSize64 = unpackSize;
+    UInt32 packSizeChunk = cabBlockInStreamSpec->GetPackSizeAvail();
+
+    switch (folder2.GetMethod())
+    {
+      case NHeader::NMethod::kNone:
+        res = copyCoder->Code(cabBlockInStream, outStream, NULL, &unpackSize64, NULL);
+        break;
+      
+      case NHeader::NMethod::kMSZip:
+        deflateDecoderSpec->Set_KeepHistory(keepHistory);
+        /* v9.31: now we follow MSZIP specification that requires to finish deflate stream at the end of each block.
+           But PyCabArc can create CAB archives that doesn't have finish marker at the end of block.
+           Cabarc probably ignores such errors in cab archives.
+           Maybe we also should ignore that error?
+           Or we should extract full file and show the warning? */
+        deflateDecoderSpec->Set_NeedFinishInput(true);
+        res = deflateDecoder->Code(cabBlockInStream, outStream, NULL, &unpackSize64, NULL);
+        if (res == S_OK)
+        {
+          if (!deflateDecoderSpec->IsFinished())
+            res = S_FALSE;
+          if (!deflateDecoderSpec->IsFinalBlock())
+            res = S_FALSE;
+        }
+        break;
+
+      case NHeader::NMethod::kLZX:
+        lzxDecoderSpec->SetKeepHistory(keepHistory);
+        lzxDecoderSpec->KeepHistoryForNext = true;
+        
+        res = lzxDecoderSpec->Code(cabBlockInStreamSpec->GetData(), packSizeChunk, unpackSize);
+
+        if (res == S_OK)
+          res = WriteStream(outStream,
+              lzxDecoderSpec->GetUnpackData(),
+              lzxDecoderSpec->GetUnpackSize());
+        break;
+      
+      case NHeader::NMethod::kQuantum:
+        res = quantumDecoderSpec->Code(cabBlockInStreamSpec->GetData(),
+            packSizeChunk, outStream, unpackSize, keepHistory);
+        break;
+    }
+  
+    if (res != S_OK)
+    {
+      if (res != S_FALSE)
+        RINOK(res);
+      break;
+    }
+    
+    keepHistory = true;
+  }
+
+  return res;
+}
+
+
+#ifndef _7ZIP_ST
+
+struct CFolderJob: public CDecodeJob
+{
+  CFolderDecoder Decoder;
+  CFolderBufOutStream *OutStreamSpec;
+  CMyComPtr<ISequentialOutStream> OutStream;
+  CByteBuffer Buf;
+
+  const CMvDatabaseEx *Database;
+  CRecordVector<bool> ExtractStatuses;
+  unsigned StartIndex;
+  unsigned VolIndex;
+  int LocFolderIndex;
+  unsigned FolderIndex;   // folder index in volume for FlushCorrupted()
+  UInt64 FolderSize;
+  
+  UInt64 PackSize;
+  bool IsUnsupported;
+
+  HRESULT Create(NWindows::NSynchronization::CCriticalSection *cs)
+  {
+    if (!Decoder.Create())
+      return E_OUTOFMEMORY;
+    Decoder.SetCriticalSection(cs);
+    OutStreamSpec = new CFolderBufOutStream;
+    OutStream = OutStreamSpec;
+    return S_OK;
+  }
+  
+  virtual HRESULT Decode();
+};
+
+HRESULT CFolderJob::Decode()
+{
+  PackSize = 0;
+  IsUnsupported = false;
+  const CDatabaseEx &db = Database->Volumes[VolIndex];
+  HRESULT res = Decoder.SetMethod(db.Folders[FolderIndex]);
+  if (res == E_INVALIDARG)
+  {
+    IsUnsupported = true;
+    return S_OK;
+  }
+  RINOK(res);
+  Buf.AllocAtLeast((size_t)FolderSize);
+  OutStreamSpec->Init(Buf, FolderSize);
+  return Decoder.Decode(*Database, VolIndex, LocFolderIndex, OutStreamSpec, NULL, 0, PackSize);
+}
+
+HRESULT CHandler::FinishFolderJob(CDecodeThread &thread, const CFolderJob &job,
+    IArchiveExtractCallback *extractCallback, bool testMode,
+    UInt64 &totalUnPacked, UInt64 &totalPacked)
+{
+  HRESULT res = thread.WaitJob();
+  
+  CFolderOutStream *cabFolderOutStream = new CFolderOutStream;
+  CMyComPtr<ISequentialOutStream> outStream(cabFolderOutStream);
+  cabFolderOutStream->Init(&m_Database, &job.ExtractStatuses, job.StartIndex,
+      job.FolderSize, extractCallback, testMode);
+  
+  totalUnPacked += job.FolderSize;
+  totalPacked += job.PackSize;
+
+  if (job.IsUnsupported)
+    return cabFolderOutStream->Unsupported();
+
+  if (res != S_OK && res != S_FALSE)
+    return res;
+  
+  UInt64 size = MyMin(job.OutStreamSpec->GetPosInFolder(), job.FolderSize);
+  RINOK(WriteStream(outStream, job.Buf, (size_t)size));
+  
+  if (res == S_OK)
+  {
+    RINOK(cabFolderOutStream->WriteEmptyFiles());
+  }
+  
+  if (res != S_OK || cabFolderOutStream->NeedMoreWrite())
+  {
+    RINOK(cabFolderOutStream->FlushCorrupted(job.FolderIndex));
+  }
+  return S_OK;
+}
+
+#endif
+
+
 STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testModeSpec, IArchiveExtractCallback *extractCallback)
 {
@@ -913,6 +1374,7 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   UInt32 i;
   int lastFolder = -2;
   UInt64 lastFolderSize = 0;
+  UInt32 numFolders = 0;
   
   for (i = 0; i < numItems; i++)
   {
@@ -923,7 +1385,10 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
       continue;
     int folderIndex = m_Database.GetFolderIndex(&mvItem);
     if (folderIndex != lastFolder)
+    {
       totalUnPacked += lastFolderSize;
+      numFolders++;
+    }
     lastFolder = folderIndex;
     lastFolderSize = item.GetEndOffset();
   }
@@ -940,23 +1405,41 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   CMyComPtr<ICompressProgressInfo> progress = lps;
   lps->Init(extractCallback, false);
 
-  NCompress::CCopyCoder *copyCoderSpec = new NCompress::CCopyCoder;
-  CMyComPtr<ICompressCoder> copyCoder = copyCoderSpec;
-
-  NCompress::NDeflate::NDecoder::CCOMCoder *deflateDecoderSpec = NULL;
-  CMyComPtr<ICompressCoder> deflateDecoder;
-
-  NCompress::NLzx::CDecoder *lzxDecoderSpec = NULL;
-  CMyComPtr<IUnknown> lzxDecoder;
-
-  NCompress::NQuantum::CDecoder *quantumDecoderSpec = NULL;
-  CMyComPtr<IUnknown> quantumDecoder;
-
-  CCabBlockInStream *cabBlockInStreamSpec = new CCabBlockInStream();
-  CMyComPtr<ISequentialInStream> cabBlockInStream = cabBlockInStreamSpec;
-  if (!cabBlockInStreamSpec->Create())
+  CFolderDecoder decoder;
+  if (!decoder.Create())
     return E_OUTOFMEMORY;
 
+  /* Independent folders are decoded by threads to memory buffers.
+     The main thread writes the folders in original order.
+     Big folders and items without folder are processed in main thread
+     after all previous folders. */
+
+  #ifndef _7ZIP_ST
+  NWindows::NSynchronization::CCriticalSection cs;
+  CObjArray<CFolderJob> jobs;
+  CDecodeThreads threads;
+  UInt32 numThreads = 0;
+  UInt32 numStarted = 0;
+  UInt32 numFinished = 0;
+  bool needWaitAll = false;
+  UInt64 folderSizeMax = 0;
+  
+  RINOK(threads.Create(_mtProps.NumThreads, numFolders));
+  if (threads.Size() != 0)
+  {
+    numThreads = threads.Size();
+    folderSizeMax = GetDecodeMemLimit() / numThreads;
+    jobs.Alloc(numThreads);
+    for (UInt32 t = 0; t < numThreads; t++)
+    {
+      CFolderJob &job = jobs[t];
+      job.Database = &m_Database;
+      RINOK(job.Create(&cs));
+    }
+    decoder.SetCriticalSection(&cs);
+  }
+  #endif
+
   CRecordVector<bool> extractStatuses;
   
   for (i = 0;;)
@@ -965,6 +1448,18 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     lps->InSize = totalPacked;
     RINOK(lps->SetCur());
 
+    #ifndef _7ZIP_ST
+    if (numStarted != numFinished
+        && (numStarted - numFinished == numThreads || i >= numItems || needWaitAll))
+    {
+      unsigned t = numFinished % numThreads;
+      numFinished++;
+      RINOK(FinishFolderJob(threads[t], jobs[t], extractCallback, testMode, totalUnPacked, totalPacked));
+      continue;
+    }
+    needWaitAll = false;
+    #endif
+
     if (i >= numItems)
       break;
 
@@ -975,6 +1470,18 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     unsigned itemIndex = mvItem.ItemIndex;
     const CItem &item = db.Items[itemIndex];
 
+    int folderIndex = -1;
+    if (!item.IsDir())
+      folderIndex = m_Database.GetFolderIndex(&mvItem);
+
+    #ifndef _7ZIP_ST
+    if (folderIndex < 0 && numStarted != numFinished)
+    {
+      needWaitAll = true;
+      continue;
+    }
+    #endif
+
     i++;
     if (item.IsDir())
     {
@@ -989,8 +1496,6 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
       continue;
     }
     
-    int folderIndex = m_Database.GetFolderIndex(&mvItem);
-    
     if (folderIndex < 0)
     {
       // If we need previous archive
@@ -1032,54 +1537,43 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
       curUnpack = item2.GetEndOffset();
     }
 
+    unsigned folderIndex2 = item.GetFolderIndex(db.Folders.Size());
+
+    #ifndef _7ZIP_ST
+    if (numThreads != 0)
+    {
+      if (curUnpack <= folderSizeMax)
+      {
+        unsigned t = numStarted % numThreads;
+        CFolderJob &job = jobs[t];
+        job.ExtractStatuses = extractStatuses;
+        job.StartIndex = startIndex2;
+        job.VolIndex = mvItem.VolumeIndex;
+        job.LocFolderIndex = folderIndex2;
+        job.FolderIndex = folderIndex2;
+        job.FolderSize = curUnpack;
+        threads[t].StartJob(&job);
+        numStarted++;
+        continue;
+      }
+      while (numStarted != numFinished)
+      {
+        unsigned t = numFinished % numThreads;
+        numFinished++;
+        RINOK(FinishFolderJob(threads[t], jobs[t], extractCallback, testMode, totalUnPacked, totalPacked));
+      }
+    }
+    #endif
+
     CFolderOutStream *cabFolderOutStream = new CFolderOutStream;
     CMyComPtr<ISequentialOutStream> outStream(cabFolderOutStream);
 
-    unsigned folderIndex2 = item.GetFolderIndex(db.Folders.Size());
     const CFolder &folder = db.Folders[folderIndex2];
 
     cabFolderOutStream->Init(&m_Database, &extractStatuses, startIndex2,
         curUnpack, extractCallback, testMode);
 
-    cabBlockInStreamSpec->MsZip = false;
-    HRESULT res = S_OK;
-    
-    switch (folder.GetMethod())
-    {
-      case NHeader::NMethod::kNone:
-        break;
-      
-      case NHeader::NMethod::kMSZip:
-        if (!deflateDecoder)
-        {
-          deflateDecoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder;
-          deflateDecoder = deflateDecoderSpec;
-        }
-        cabBlockInStreamSpec->MsZip = true;
-        break;
-      
-      case NHeader::NMethod::kLZX:
-        if (!lzxDecoder)
-        {
-          lzxDecoderSpec = new NCompress::NLzx::CDecoder;
-          lzxDecoder = lzxDecoderSpec;
-        }
-        res = lzxDecoderSpec->SetParams_and_Alloc(folder.MethodMinor);
-        break;
-
-      case NHeader::NMethod::kQuantum:
-        if (!quantumDecoder)
-        {
-          quantumDecoderSpec = new NCompress::NQuantum::CDecoder;
-          quantumDecoder = quantumDecoderSpec;
-        }
-        res = quantumDecoderSpec->SetParams(folder.MethodMinor);
-        break;
-      
-      default:
-        res = E_INVALIDARG;
-        break;
-    }
+    HRESULT res = decoder.SetMethod(folder);
 
     if (res == E_INVALIDARG)
     {
@@ -1089,153 +1583,13 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     }
     RINOK(res);
 
+    res = decoder.Decode(m_Database, mvItem.VolumeIndex, folderIndex2,
+        cabFolderOutStream, lps, totalUnPacked, totalPacked);
+    RINOK(res == S_FALSE ? S_OK : res);
+    
+    if (res == S_OK)
     {
-      unsigned volIndex = mvItem.VolumeIndex;
-      int locFolderIndex = item.GetFolderIndex(db.Folders.Size());
-      bool keepHistory = false;
-      bool keepInputBuffer = false;
-      bool thereWasNotAlignedChunk = false;
-      
-      for (UInt32 bl = 0; cabFolderOutStream->NeedMoreWrite();)
-      {
-        if (volIndex >= m_Database.Volumes.Size())
-        {
-          res = S_FALSE;
-          break;
-        }
-
-        const CDatabaseEx &db2 = m_Database.Volumes[volIndex];
-        const CFolder &folder2 = db2.Folders[locFolderIndex];
-        
-        if (bl == 0)
-        {
-          cabBlockInStreamSpec->ReservedSize = db2.ArcInfo.GetDataBlockReserveSize();
-          RINOK(db2.Stream->Seek(db2.StartPosition + folder2.DataStart, STREAM_SEEK_SET, NULL));
-        }
-        
-        if (bl == folder2.NumDataBlocks)
-        {
-          /*
-            CFolder::NumDataBlocks (CFFOLDER::cCFData in CAB specification) is 16-bit.
-            But there are some big CAB archives from MS that contain more
-            than (0xFFFF) CFDATA blocks in folder.
-            Old cab extracting software can show error (or ask next volume)
-            but cab extracting library in new Windows ignores this error.
-            15.00 : We also try to ignore such error, if archive is not multi-volume.
-          */
-          if (m_Database.Volumes.Size() > 1)
-          {
-            volIndex++;
-            locFolderIndex = 0;
-            bl = 0;
-            continue;
-          }
-        }
-        
-        bl++;
-
-        if (!keepInputBuffer)
-          cabBlockInStreamSpec->InitForNewBlock();
-
-        UInt32 packSize, unpackSize;
-        res = cabBlockInStreamSpec->PreRead(db2.Stream, packSize, unpackSize);
-        if (res == S_FALSE)
-          break;
-        RINOK(res);
-        keepInputBuffer = (unpackSize == 0);
-        if (keepInputBuffer)
-          continue;
-
-        UInt64 totalUnPacked2 = totalUnPacked + cabFolderOutStream->GetPosInFolder();
-        totalPacked += packSize;
-
-        lps->OutSize = totalUnPacked2;
-        lps->InSize = totalPacked;
-        RINOK(lps->SetCur());
-
-        const UInt32 kBlockSizeMax = (1 << 15);
-
-        /* We don't try to reduce last block.
-           Note that LZX converts data with x86 filter.
-           and filter needs larger input data than reduced size.
-           It's simpler to decompress full chunk here.
-           also we need full block for quantum for more integrity checks */
-
-        if (unpackSize > kBlockSizeMax)
-        {
-          res = S_FALSE;
-          break;
-        }
-
-        if (unpackSize != kBlockSizeMax)
-        {
-          if (thereWasNotAlignedChunk)
-          {
-            res = S_FALSE;
-            break;
-          }
-          thereWasNotAlignedChunk = true;
-        }
-
-        UInt64 unpackSize64 = unpackSize;
-        UInt32 packSizeChunk = cabBlockInStreamSpec->GetPackSizeAvail();
-
-        switch (folder2.GetMethod())
-        {
-          case NHeader::NMethod::kNone:
-            res = copyCoder->Code(cabBlockInStream, outStream, NULL, &unpackSize64, NULL);
-            break;
-          
-          case NHeader::NMethod::kMSZip:
-            deflateDecoderSpec->Set_KeepHistory(keepHistory);
-            /* v9.31: now we follow MSZIP specification that requires to finish deflate stream at the end of each block.
-               But PyCabArc can create CAB archives that doesn't have finish marker at the end of block.
-               Cabarc probably ignores such errors in cab archives.
-               Maybe we also should ignore that error?
-               Or we should extract full file and show the warning? */
-            deflateDecoderSpec->Set_NeedFinishInput(true);
-            res = deflateDecoder->Code(cabBlockInStream, outStream, NULL, &unpackSize64, NULL);
-            if (res == S_OK)
-            {
-              if (!deflateDecoderSpec->IsFinished())
-                res = S_FALSE;
-              if (!deflateDecoderSpec->IsFinalBlock())
-                res = S_FALSE;
-            }
-            break;
-
-          case NHeader::NMethod::kLZX:
-            lzxDecoderSpec->SetKeepHistory(keepHistory);
-            lzxDecoderSpec->KeepHistoryForNext = true;
-            
-            res = lzxDecoderSpec->Code(cabBlockInStreamSpec->GetData(), packSizeChunk, unpackSize);
-
-            if (res == S_OK)
-              res = WriteStream(outStream,
-                  lzxDecoderSpec->GetUnpackData(),
-                  lzxDecoderSpec->GetUnpackSize());
-            break;
-          
-          case NHeader::NMethod::kQuantum:
-            res = quantumDecoderSpec->Code(cabBlockInStreamSpec->GetData(),
-                packSizeChunk, outStream, unpackSize, keepHistory);
-            break;
-        }
-      
-        if (res != S_OK)
-        {
-          if (res != S_FALSE)
-            RINOK(res);
-          break;
-        }
-        
-        keepHistory = true;
-      }
-      
-      if (res == S_OK)
-      {
-        RINOK(cabFolderOutStream->WriteEmptyFiles());
-      }
+      RINOK(cabFolderOutStream->WriteEmptyFiles());
     }
 
     if (res != S_OK || cabFolderOutStream->NeedMoreWrite())
@@ -1252,6 +1606,23 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 }
 
 
+STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps)
+{
+  _mtProps.Init();
+
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    if (name.IsEmpty())
+      return E_INVALIDARG;
+
+    RINOK(_mtProps.SetProperty(name, values[i]));
+  }
+  return S_OK;
+}
+
+
 STDMETHODIMP CHandler::GetNumberOfItems(UInt32 *numItems)
 {
   *numItems = m_Database.Items.Size();
@@ -5,6 +5,8 @@
 
 #include "../../../Common/MyCom.h"
 
+#include "../../Common/DecodeThreads.h"
+
 #include "../IArchive.h"
 
 #include "CabIn.h"
@@ -12,14 +14,20 @@
 namespace NArchive {
 namespace NCab {
 
+#ifndef _7ZIP_ST
+struct CFolderJob;
+#endif
+
 class CHandler:
   public IInArchive,
+  public ISetProperties,
   public CMyUnknownImp
 {
 public:
-  MY_UNKNOWN_IMP1(IInArchive)
+  MY_UNKNOWN_IMP2(IInArchive, ISetProperties)
 
   INTERFACE_IInArchive(;)
+  STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
 
 private:
   CMvDatabaseEx m_Database;
@@ -30,6 +38,13 @@ private:
   // int _mainVolIndex;
   UInt32 _phySize;
   UInt64 _offset;
+  CDecodeMtProps _mtProps;
+
+  #ifndef _7ZIP_ST
+  HRESULT FinishFolderJob(CDecodeThread &thread, const CFolderJob &job,
+      IArchiveExtractCallback *extractCallback, bool testMode,
+      UInt64 &totalUnPacked, UInt64 &totalPacked);
+  #endif
 };
 
 }}
@@ -11,6 +11,7 @@
 
 #include "../../Windows/PropVariant.h"
 
+#include "../Common/DecodeThreads.h"
 #include "../Common/LimitedStreams.h"
 #include "../Common/ProgressUtils.h"
 #include "../Common/RegisterArc.h"
@@ -186,11 +187,13 @@ struct CExtraFile
 class CHandler:
   public IInArchive,
   public IInArchiveGetStream,
+  public ISetProperties,
   public CMyUnknownImp
 {
   CMyComPtr<IInStream> _inStream;
   CObjectVector<CFile> _files;
   bool _masterCrcError;
+  CDecodeMtProps _mtProps;
 
   UInt64 _startPos;
   UInt64 _phySize;
@@ -202,9 +205,10 @@ class CHandler:
   HRESULT Open2(IInStream *stream);
   HRESULT Extract(IInStream *stream);
 public:
-  MY_UNKNOWN_IMP2(IInArchive, IInArchiveGetStream)
+  MY_UNKNOWN_IMP3(IInArchive, IInArchiveGetStream, ISetProperties)
   INTERFACE_IInArchive(;)
   STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
+  STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
 };
 
 // that limit can be increased, if there are such dmg files
@@ -1068,6 +1072,120 @@ STDMETHODIMP CAdcDecoder::Code(ISequentialInStream *inStream,
 }
 
 
+// Chunks that are not larger than that limit can be unpacked in memory.
+static const size_t kChunkSizeMax = (size_t)1 << 24;
+
+static bool IsMemChunk(const CBlock &block)
+{
+  switch (block.Type)
+  {
+    case METHOD_ADC:
+    case METHOD_ZLIB:
+    case METHOD_BZIP2:
+      return block.PackSize <= kChunkSizeMax && block.UnpSize <= kChunkSizeMax;
+  }
+  return false;
+}
+
+/*
+  CChunkDecoder unpacks compressed chunk (ADC / ZLIB / BZIP2) from memory buffer.
+  (outSize) is the number of unpacked bytes, even if the function returns S_FALSE.
+*/
+
+class CChunkDecoder
+{
+  CBufInStream *_inStreamSpec;
+  CMyComPtr<ISequentialInStream> _inStream;
+  
+  CBufPtrSeqOutStream *_outStreamSpec;
+  CMyComPtr<ISequentialOutStream> _outStream;
+
+  NCompress::NBZip2::CDecoder *_bzip2CoderSpec;
+  CMyComPtr<ICompressCoder> _bzip2Coder;
+
+  NCompress::NZlib::CDecoder *_zlibCoderSpec;
+  CMyComPtr<ICompressCoder> _zlibCoder;
+
+  CMyComPtr<ICompressCoder> _adcCoder;
+public:
+  CChunkDecoder():
+      _bzip2CoderSpec(NULL),
+      _zlibCoderSpec(NULL)
+  {
+    _inStreamSpec = new CBufInStream;
+    _inStream = _inStreamSpec;
+    _outStreamSpec = new CBufPtrSeqOutStream;
+    _outStream = _outStreamSpec;
+  }
+  
+  HRESULT Decode(const CBlock &block, const Byte *packed, Byte *dest, size_t &outSize);
+};
+
+HRESULT CChunkDecoder::Decode(const CBlock &block, const Byte *packed, Byte *dest, size_t &outSize)
+{
+  outSize = 0;
+  _inStreamSpec->Init(packed, (size_t)block.PackSize);
+  _outStreamSpec->Init(dest, (size_t)block.UnpSize);
+  HRESULT res;
+  
+  switch (block.Type)
+  {
+    case METHOD_ADC:
+      if (!_adcCoder)
+        _adcCoder = new CAdcDecoder();
+      res = _adcCoder->Code(_inStream, _outStream, &block.PackSize, &block.UnpSize, NULL);
+      break;
+      
+    case METHOD_ZLIB:
+      if (!_zlibCoder)
+      {
+        _zlibCoderSpec = new NCompress::NZlib::CDecoder();
+        _zlibCoder = _zlibCoderSpec;
+      }
+      res = _zlibCoder->Code(_inStream, _outStream, NULL, NULL, NULL);
+      if (res == S_OK && _zlibCoderSpec->GetInputProcessedSize() != block.PackSize)
+        res = S_FALSE;
+      break;
+      
+    case METHOD_BZIP2:
+      if (!_bzip2Coder)
+      {
+        _bzip2CoderSpec = new NCompress::NBZip2::CDecoder();
+        _bzip2Coder = _bzip2CoderSpec;
+      }
+      res = _bzip2Coder->Code(_inStream, _outStream, NULL, NULL, NULL);
+      if (res == S_OK && _bzip2CoderSpec->GetInputProcessedSize() != block.PackSize)
+        res = S_FALSE;
+      break;
+    
+    default:
+      return E_NOTIMPL;
+  }
+  
+  outSize = _outStreamSpec->GetPos();
+  if (res == S_OK && outSize != block.UnpSize)
+    res = S_FALSE;
+  return res;
+}
+
+
+#ifndef _7ZIP_ST
+
+struct CChunkDecodeJob: public CDecodeJob
+{
+  CChunkDecoder Decoder;
+  const CBlock *Block;
+  unsigned BlockIndex;
+  CByteBuffer Packed;
+  CByteBuffer Unpacked;
+  size_t OutSize;
+
+  virtual HRESULT Decode() { return Decoder.Decode(*Block, Packed, Unpacked, OutSize); }
+};
+
+#endif
+
+
 STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback)
 {
@@ -1121,6 +1239,19 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   CMyComPtr<ISequentialInStream> inStream(streamSpec);
   streamSpec->SetStream(_inStream);
 
+  #ifndef _7ZIP_ST
+  /* compressed chunks are unpacked to memory by (numThreads) threads.
+     The job for chunk (j) is (jobs[j % numThreads]) in (threads[j % numThreads]).
+     The main thread reads packed data of next chunks,
+     and it writes unpacked chunks to output stream in original order. */
+  CObjArray<CChunkDecodeJob> jobs; // it must be destroyed after (threads)
+  CDecodeThreads threads;
+  RINOK(threads.Create(_mtProps.NumThreads, (UInt32)(GetDecodeMemLimit() / (kChunkSizeMax * 2))));
+  const unsigned numThreads = threads.Size();
+  if (numThreads != 0)
+    jobs.Alloc(numThreads);
+  #endif
+
   for (i = 0; i < numItems; i++, currentPackTotal += currentPackSize, currentUnpTotal += currentUnpSize)
   {
     lps->InSize = currentPackTotal;
@@ -1172,6 +1303,9 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
       UInt64 unpPos = 0;
       UInt64 packPos = 0;
+      #ifndef _7ZIP_ST
+      unsigned nextJob = 0; // the first chunk that was not checked for thread unpacking
+      #endif
       {
         FOR_VECTOR (j, item.Blocks)
         {
@@ -1190,6 +1324,41 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
             break;
           }
 
+          #ifndef _7ZIP_ST
+          CDecodeThread *jobThread = NULL;
+          if (numThreads != 0)
+          {
+            if (nextJob < j)
+              nextJob = j;
+            for (; nextJob < item.Blocks.Size() && nextJob < j + numThreads; nextJob++)
+            {
+              const CBlock &b = item.Blocks[nextJob];
+              if (!IsMemChunk(b))
+                continue;
+              CDecodeThread &t = threads[nextJob % numThreads];
+              CChunkDecodeJob &job = jobs[nextJob % numThreads];
+              t.WaitJob();
+              const size_t packSize = (size_t)b.PackSize;
+              const size_t unpSize = (size_t)b.UnpSize;
+              if (job.Packed.Size() < packSize)
+                job.Packed.Alloc(packSize);
+              if (job.Unpacked.Size() < unpSize)
+                job.Unpacked.Alloc(unpSize);
+              RINOK(_inStream->Seek(_startPos + item.StartPos + b.PackPos, STREAM_SEEK_SET, NULL));
+              size_t processed = packSize;
+              RINOK(ReadStream(_inStream, job.Packed, &processed));
+              if (processed != packSize)
+                continue; // the chunk is unpacked in main thread, and it reports data error
+              job.Block = &b;
+              job.BlockIndex = nextJob;
+              t.StartJob(&job);
+            }
+            jobThread = &threads[j % numThreads];
+            if (!jobThread->IsBusy() || jobs[j % numThreads].BlockIndex != j)
+              jobThread = NULL;
+          }
+          #endif
+
           RINOK(_inStream->Seek(_startPos + item.StartPos + block.PackPos, STREAM_SEEK_SET, NULL));
           streamSpec->Init(block.PackSize);
           bool realMethod = true;
@@ -1198,6 +1367,17 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
           outCrcStreamSpec->EnableCalc(needCrc);
 
+          #ifndef _7ZIP_ST
+          if (jobThread)
+          {
+            HRESULT jobRes = jobThread->WaitJob();
+            const CChunkDecodeJob &job = jobs[j % numThreads];
+            res = WriteStream(outStream, job.Unpacked, job.OutSize);
+            if (res == S_OK)
+              res = jobRes;
+          }
+          else
+          #endif
           switch (block.Type)
           {
             case METHOD_ZERO_0:
@@ -1269,6 +1449,10 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
             }
           }
         }
+        
+        #ifndef _7ZIP_ST
+        threads.WaitAll();
+        #endif
       }
   
       if (needCrc && opRes == NExtract::NOperationResult::kOK)
@@ -1301,22 +1485,12 @@ class CInStream:
   int _latestBlock;
   UInt64 _accessMark;
   CObjectVector<CChunk> _chunks;
+  UInt64 _chunksSize; // total size of buffers in (_chunks)
 
-  NCompress::NBZip2::CDecoder *bzip2CoderSpec;
-  CMyComPtr<ICompressCoder> bzip2Coder;
-
-  NCompress::NZlib::CDecoder *zlibCoderSpec;
-  CMyComPtr<ICompressCoder> zlibCoder;
-
-  CAdcDecoder *adcCoderSpec;
-  CMyComPtr<ICompressCoder> adcCoder;
-
-  CBufPtrSeqOutStream *outStreamSpec;
-  CMyComPtr<ISequentialOutStream> outStream;
-
-  CLimitedSequentialInStream *limitedStreamSpec;
-  CMyComPtr<ISequentialInStream> inStream;
+  CChunkDecoder _decoder;
+  CByteBuffer _packed;
 
+  void FreeOldestChunk();
 public:
   CMyComPtr<IInStream> Stream;
   UInt64 Size;
@@ -1330,13 +1504,7 @@ public:
     _latestChunk = -1;
     _latestBlock = -1;
     _accessMark = 0;
-
-    limitedStreamSpec = new CLimitedSequentialInStream;
-    inStream = limitedStreamSpec;
-    limitedStreamSpec->SetStream(Stream);
-
-    outStreamSpec = new CBufPtrSeqOutStream;
-    outStream = outStreamSpec;
+    _chunksSize = 0;
     return S_OK;
   }
 
@@ -1362,6 +1530,23 @@ unsigned FindBlock(const CRecordVector<CBlock> &blocks, UInt64 pos)
   }
 }
 
+/* The cache of unpacked chunks is limited by number of chunks and by total size.
+   Nested handlers (HFS) read the image randomly, so we keep
+   the least recently used chunks. */
+
+static const unsigned kNumChunksMax = 128;
+static const UInt64 kChunksSizeMax = (UInt64)1 << 26;
+
+void CInStream::FreeOldestChunk()
+{
+  unsigned chunkIndex = 0;
+  for (unsigned i = 1; i < _chunks.Size(); i++)
+    if (_chunks[i].AccessMark < _chunks[chunkIndex].AccessMark)
+      chunkIndex = i;
+  _chunksSize -= _chunks[chunkIndex].Buf.Size();
+  _chunks.Delete(chunkIndex);
+}
+
 STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
 {
   COM_TRY_BEGIN
@@ -1378,17 +1563,30 @@ STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
       size = (UInt32)rem;
   }
 
+  unsigned nextBlock = 0;
+
   if (_latestBlock >= 0)
   {
     const CBlock &block = File->Blocks[_latestBlock];
     if (_virtPos < block.UnpPos || (_virtPos - block.UnpPos) >= block.UnpSize)
+    {
+      nextBlock = _latestBlock + 1;
       _latestBlock = -1;
+    }
   }
   
   if (_latestBlock < 0)
   {
     _latestChunk = -1;
-    unsigned blockIndex = FindBlock(File->Blocks, _virtPos);
+    unsigned blockIndex;
+    {
+      // fast check for sequential reading
+      const CBlock *next = (nextBlock != 0 && nextBlock < File->Blocks.Size()) ? &File->Blocks[nextBlock] : NULL;
+      if (next && _virtPos >= next->UnpPos && (_virtPos - next->UnpPos) < next->UnpSize)
+        blockIndex = nextBlock;
+      else
+        blockIndex = FindBlock(File->Blocks, _virtPos);
+    }
     const CBlock &block = File->Blocks[blockIndex];
     
     if (!block.IsZeroMethod() && block.Type != METHOD_COPY)
@@ -1402,85 +1600,32 @@ STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
         _latestChunk = i;
       else
       {
-        const unsigned kNumChunksMax = 128;
-        unsigned chunkIndex;
-      
-        if (_chunks.Size() != kNumChunksMax)
-          chunkIndex = _chunks.Add(CChunk());
-        else
-        {
-          chunkIndex = 0;
-          for (i = 0; i < _chunks.Size(); i++)
-            if (_chunks[i].AccessMark < _chunks[chunkIndex].AccessMark)
-              chunkIndex = i;
-        }
+        if (block.UnpSize > ((UInt32)1 << 31) || block.PackSize > ((UInt32)1 << 31))
+          return E_FAIL;
         
+        while (_chunks.Size() != 0 && (_chunks.Size() == kNumChunksMax
+            || _chunksSize + block.UnpSize > kChunksSizeMax))
+          FreeOldestChunk();
+        
+        const unsigned chunkIndex = _chunks.Add(CChunk());
         CChunk &chunk = _chunks[chunkIndex];
         chunk.BlockIndex = -1;
         chunk.AccessMark = 0;
+        chunk.Buf.Alloc((size_t)block.UnpSize);
+        _chunksSize += block.UnpSize;
         
-        if (chunk.Buf.Size() < block.UnpSize)
-        {
-          chunk.Buf.Free();
-          if (block.UnpSize > ((UInt32)1 << 31))
-            return E_FAIL;
-          chunk.Buf.Alloc((size_t)block.UnpSize);
-        }
-        
-        outStreamSpec->Init(chunk.Buf, (size_t)block.UnpSize);
-          
+        const size_t packSize = (size_t)block.PackSize;
+        if (_packed.Size() < packSize)
+          _packed.Alloc(packSize);
         RINOK(Stream->Seek(_startPos + File->StartPos + block.PackPos, STREAM_SEEK_SET, NULL));
-
-        limitedStreamSpec->Init(block.PackSize);
-        HRESULT res = S_OK;
-        
-        switch (block.Type)
-        {
-          case METHOD_COPY:
-            if (block.PackSize != block.UnpSize)
-              return E_FAIL;
-            res = ReadStream_FAIL(inStream, chunk.Buf, (size_t)block.UnpSize);
-            break;
-            
-          case METHOD_ADC:
-            if (!adcCoder)
-            {
-              adcCoderSpec = new CAdcDecoder();
-              adcCoder = adcCoderSpec;
-            }
-            res = adcCoder->Code(inStream, outStream, &block.PackSize, &block.UnpSize, NULL);
-            break;
-            
-          case METHOD_ZLIB:
-            if (!zlibCoder)
-            {
-              zlibCoderSpec = new NCompress::NZlib::CDecoder();
-              zlibCoder = zlibCoderSpec;
-            }
-            res = zlibCoder->Code(inStream, outStream, NULL, NULL, NULL);
-            if (res == S_OK && zlibCoderSpec->GetInputProcessedSize() != block.PackSize)
-              res = S_FALSE;
-            break;
-            
-          case METHOD_BZIP2:
-            if (!bzip2Coder)
-            {
-              bzip2CoderSpec = new NCompress::NBZip2::CDecoder();
-              bzip2Coder = bzip2CoderSpec;
-            }
-            res = bzip2Coder->Code(inStream, outStream, NULL, NULL, NULL);
-            if (res == S_OK && bzip2CoderSpec->GetInputProcessedSize() != block.PackSize)
-              res = S_FALSE;
-            break;
-            
-          default:
-            return E_FAIL;
-        }
+        RINOK(ReadStream_FAIL(Stream, _packed, packSize));
         
+        size_t outSize;
+        HRESULT res = _decoder.Decode(block, _packed, chunk.Buf, outSize);
+        if (res == E_NOTIMPL)
+          return E_FAIL;
         if (res != S_OK)
           return res;
-        if (block.Type != METHOD_COPY && outStreamSpec->GetPos() != block.UnpSize)
-          return E_FAIL;
         chunk.BlockIndex = blockIndex;
         _latestChunk = chunkIndex;
       }
@@ -1534,6 +1679,21 @@ STDMETHODIMP CInStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPositio
   return S_OK;
 }
 
+STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps)
+{
+  _mtProps.Init();
+
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    if (name.IsEmpty())
+      return E_INVALIDARG;
+    RINOK(_mtProps.SetProperty(name, values[i]));
+  }
+  return S_OK;
+}
+
 STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
 {
   COM_TRY_BEGIN
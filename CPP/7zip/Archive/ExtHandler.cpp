@@ -28,6 +28,7 @@
 #include "../../Windows/PropVariantUtils.h"
 #include "../../Windows/TimeUtils.h"
 
+#include "../Common/DecodeThreads.h"
 #include "../Common/ProgressUtils.h"
 #include "../Common/RegisterArc.h"
 #include "../Common/StreamObjects.h"
@@ -779,13 +780,16 @@ struct CItem
   int SymLinkItemIndex; // in _items[], if the Node contains SymLink to existing dir
   Byte Type;
   
-  AString Name;
+  unsigned NamePos;     // in _names[], the name is zero terminated
+  unsigned NameLen;
 
   CItem():
       Node(0),
       ParentNode(-1),
       SymLinkItemIndex(-1),
-      Type(k_Type_UNKNOWN)
+      Type(k_Type_UNKNOWN),
+      NamePos(0),
+      NameLen(0)
         {}
   
   void Clear()
@@ -794,7 +798,8 @@ struct CItem
     ParentNode = -1;
     SymLinkItemIndex = -1;
     Type = k_Type_UNKNOWN;
-    Name.Empty();
+    NamePos = 0;
+    NameLen = 0;
   }
 
   bool IsDir() const { return Type == k_Type_DIR; }
@@ -807,22 +812,138 @@ struct CItem
 static const unsigned kNumTreeLevelsMax = 6; // must be >= 3
 
 
+// dir items of one dir are stored in contiguous range of CHandler::_dirItems[]
+
+struct CDir
+{
+  unsigned StartIndex;
+  unsigned NumItems;
+};
+
+
+/* CReadContext contains the stream and temp buffers that are used to read
+   block lists and extent trees of nodes.
+   CHandler uses own context, and each thread in Open2() has another context. */
+
+struct CReadContext
+{
+  CMyComPtr<IInStream> Stream;
+  UInt64 TotalRead;
+  CByteBuffer TempBufs[kNumTreeLevelsMax];
+  
+  CReadContext(): TotalRead(0) {}
+};
+
+
+// inodes of one group (block group descriptor)
+
+struct CGroupNodes
+{
+  CGroupDescriptor Gd;
+  UInt32 FirstNode;      // global index of first node in group
+  UInt32 NumNodes;       // number of used entries in inode table (it's smaller for last group)
+  UInt32 NumNodesInTable;
+  
+  CRecordVector<CNode> Nodes;
+  CRecordVector<UInt32> NodeIndexes; // global indexes for Nodes[]
+  UInt32 NumEmpty_in_Map;
+  bool HeadersError;
+  
+  CByteBuffer NodesMap;
+  CByteBuffer NodesData;
+};
+
+
+#ifndef _7ZIP_ST
+
+/* Threads in Open2() read the archive stream at their own positions.
+   Seek() and Read() of real stream are called under CriticalSection. */
+
+struct CLockedInStream
+{
+  CMyComPtr<IInStream> Stream;
+  NWindows::NSynchronization::CCriticalSection CriticalSection;
+};
+
+class CPosInStream:
+  public IInStream,
+  public CMyUnknownImp
+{
+  CLockedInStream *_glob;
+  UInt64 _pos;
+public:
+  void Init(CLockedInStream *lockedInStream)
+  {
+    _glob = lockedInStream;
+    _pos = 0;
+  }
+
+  MY_UNKNOWN_IMP2(ISequentialInStream, IInStream)
+
+  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
+};
+
+STDMETHODIMP CPosInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  NWindows::NSynchronization::CCriticalSectionLock lock(_glob->CriticalSection);
+  RINOK(_glob->Stream->Seek(_pos, STREAM_SEEK_SET, NULL));
+  UInt32 realProcessedSize = 0;
+  HRESULT res = _glob->Stream->Read(data, size, &realProcessedSize);
+  _pos += realProcessedSize;
+  if (processedSize)
+    *processedSize = realProcessedSize;
+  return res;
+}
+
+STDMETHODIMP CPosInStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition)
+{
+  switch (seekOrigin)
+  {
+    case STREAM_SEEK_SET: break;
+    case STREAM_SEEK_CUR: offset += _pos; break;
+    case STREAM_SEEK_END:
+    {
+      UInt64 size;
+      {
+        NWindows::NSynchronization::CCriticalSectionLock lock(_glob->CriticalSection);
+        RINOK(_glob->Stream->Seek(0, STREAM_SEEK_END, &size));
+      }
+      offset += size;
+      break;
+    }
+    default: return STG_E_INVALIDFUNCTION;
+  }
+  if (offset < 0)
+    return HRESULT_WIN32_ERROR_NEGATIVE_SEEK;
+  _pos = offset;
+  if (newPosition)
+    *newPosition = offset;
+  return S_OK;
+}
+
+#endif
+
+
 class CHandler:
   public IInArchive,
   public IArchiveGetRawProps,
   public IInArchiveGetStream,
+  public ISetProperties,
   public CMyUnknownImp
 {
-  CObjectVector<CItem> _items;
+  CRecordVector<CItem> _items;
+  CRecordVector<char> _names;
   CIntVector _refs;
   CRecordVector<CNode> _nodes;
-  CObjectVector<CUIntVector> _dirs; // each CUIntVector contains indexes in _items[] only for dir items;
+  CRecordVector<CDir> _dirs;
+  CUIntVector _dirItems; // indexes in _items[] only for dir items
   AStringVector _symLinks;
   AStringVector _auxItems;
   int _auxSysIndex;
   int _auxUnknownIndex;
 
-  CMyComPtr<IInStream> _stream;
+  CReadContext _ctx; // _ctx.Stream is archive stream
   UInt64 _phySize;
   bool _isArc;
   bool _headersError;
@@ -834,16 +955,15 @@ class CHandler:
   CHeader _h;
 
   IArchiveOpenCallback *_openCallback;
-  UInt64 _totalRead;
   UInt64 _totalReadPrev;
 
-  CByteBuffer _tempBufs[kNumTreeLevelsMax];
+  CDecodeMtProps _mtProps;
 
   
   HRESULT CheckProgress2()
   {
     const UInt64 numFiles = _items.Size();
-    return _openCallback->SetCompleted(&numFiles, &_totalRead);
+    return _openCallback->SetCompleted(&numFiles, &_ctx.TotalRead);
   }
 
   HRESULT CheckProgress()
@@ -851,15 +971,26 @@ class CHandler:
     HRESULT res = S_OK;
     if (_openCallback)
     {
-      if (_totalRead - _totalReadPrev >= ((UInt32)1 << 20))
+      if (_ctx.TotalRead - _totalReadPrev >= ((UInt32)1 << 20))
       {
-        _totalReadPrev = _totalRead;
+        _totalReadPrev = _ctx.TotalRead;
         res = CheckProgress2();
       }
     }
     return res;
   }
 
+  const char *GetName(const CItem &item) const { return &_names[item.NamePos]; }
+
+  void AddName(CItem &item, const char *name, unsigned len)
+  {
+    item.NamePos = _names.Size();
+    item.NameLen = len;
+    for (unsigned i = 0; i < len; i++)
+      _names.Add(name[i]);
+    _names.Add(0);
+  }
+
   
   const int GetParentAux(const CItem &item) const
   {
@@ -868,35 +999,67 @@ class CHandler:
     return _auxUnknownIndex;
   }
 
-  HRESULT SeekAndRead(IInStream *inStream, UInt64 block, Byte *data, size_t size);
+  HRESULT SeekAndRead(CReadContext &ctx, UInt64 block, Byte *data, size_t size) const;
   HRESULT ParseDir(const Byte *data, size_t size, unsigned iNodeDir);
+  HRESULT AddDir(const CByteBuffer &data, unsigned iNodeDir);
+  void AddGroupNodes(const CGroupNodes &g);
   int FindTargetItem_for_SymLink(unsigned dirNode, const AString &path) const;
 
-  HRESULT FillFileBlocks2(UInt32 block, unsigned level, unsigned numBlocks, CRecordVector<UInt32> &blocks);
-  HRESULT FillFileBlocks(const Byte *p, unsigned numBlocks, CRecordVector<UInt32> &blocks);
-  HRESULT FillExtents(const Byte *p, size_t size, CRecordVector<CExtent> &extents, int parentDepth);
+  HRESULT FillFileBlocks2(CReadContext &ctx, UInt32 block, unsigned level, unsigned numBlocks, CRecordVector<UInt32> &blocks) const;
+  HRESULT FillFileBlocks(CReadContext &ctx, const Byte *p, unsigned numBlocks, CRecordVector<UInt32> &blocks) const;
+  HRESULT FillExtents(CReadContext &ctx, const Byte *p, size_t size, CRecordVector<CExtent> &extents, int parentDepth) const;
 
-  HRESULT GetStream_Node(unsigned nodeIndex, ISequentialInStream **stream);
-  HRESULT ExtractNode(unsigned nodeIndex, CByteBuffer &data);
+  HRESULT GetStream_Node(CReadContext &ctx, const CNode &node, ISequentialInStream **stream) const;
 
   void ClearRefs();
   HRESULT Open2(IInStream *inStream);
 
   void GetPath(unsigned index, AString &s) const;
   bool GetPackSize(unsigned index, UInt64 &res) const;
+  void InitProps() { _mtProps.Init(); }
 
 public:
-  CHandler() {}
+  // these functions can be called from threads in Open2()
+  HRESULT ReadGroupNodes(CReadContext &ctx, CGroupNodes &g) const;
+  HRESULT ExtractNode(CReadContext &ctx, const CNode &node, CByteBuffer &data) const;
+
+  CHandler() { InitProps(); }
   ~CHandler() {}
 
-  MY_UNKNOWN_IMP3(IInArchive, IArchiveGetRawProps, IInArchiveGetStream)
+  MY_UNKNOWN_IMP4(IInArchive, IArchiveGetRawProps, IInArchiveGetStream, ISetProperties)
   
   INTERFACE_IInArchive(;)
   INTERFACE_IArchiveGetRawProps(;)
   STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
+  STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
 };
 
 
+#ifndef _7ZIP_ST
+
+struct CReadJob: public CDecodeJob
+{
+  const CHandler *Handler;
+  CReadContext Ctx;
+  
+  bool IsGroupJob;
+  CGroupNodes Group;
+  
+  unsigned INode;      // for dir node job
+  CNode Node;
+  CByteBuffer Data;
+  
+  virtual HRESULT Decode()
+  {
+    if (IsGroupJob)
+      return Handler->ReadGroupNodes(Ctx, Group);
+    return Handler->ExtractNode(Ctx, Node, Data);
+  }
+};
+
+#endif
+
+
 
 HRESULT CHandler::ParseDir(const Byte *p, size_t size, unsigned iNodeDir)
 {
@@ -906,7 +1069,13 @@ HRESULT CHandler::ParseDir(const Byte *p, size_t size, unsigned iNodeDir)
 
   CNode &nodeDir = _nodes[_refs[iNodeDir]];
   nodeDir.DirIndex = _dirs.Size();
-  CUIntVector &dir = _dirs.AddNew();
+  {
+    CDir dir;
+    dir.StartIndex = _dirItems.Size();
+    dir.NumItems = 0;
+    _dirs.Add(dir);
+  }
+  CDir &dir = _dirs.Back();
   int parentNode = -1;
 
   CItem item;
@@ -941,30 +1110,35 @@ HRESULT CHandler::ParseDir(const Byte *p, size_t size, unsigned iNodeDir)
 
     item.ParentNode = iNodeDir;
     item.Node = iNode;
-    item.Name.SetFrom_CalcLen((const char *)(p + 8), nameLen);
+    
+    const char *name = (const char *)(p + 8);
+    if (memchr(name, 0, nameLen))
+      return S_FALSE;
+    
+    // the name is added to _names[] here, and it's removed later, if we skip that entry
+    AddName(item, name, nameLen);
+    name = GetName(item);
   
     p += recLen;
     size -= recLen;
-   
-    if (item.Name.Len() != nameLen)
-      return S_FALSE;
     
     if (_isUTF)
-      _isUTF = CheckUTF8(item.Name);
+      _isUTF = CheckUTF8(name);
 
     if (iNode == 0)
     {
       /*
       ext3 deleted??
-      if (item.Name.Len() != 0)
+      if (item.NameLen != 0)
         return S_FALSE;
       */
 
-      PRF(printf("\n EMPTY %6d %d %s", (unsigned)recLen, (unsigned)type, (const char *)item.Name));
+      PRF(printf("\n EMPTY %6d %d %s", (unsigned)recLen, (unsigned)type, name));
       if (type == 0xDE)
       {
         // checksum
       }
+      _names.DeleteFrom(item.NamePos);
       continue;
     }
 
@@ -983,21 +1157,22 @@ HRESULT CHandler::ParseDir(const Byte *p, size_t size, unsigned iNodeDir)
 
     node.NumLinksCalced++;
     
-    PRF(printf("\n%s %6d %s", item.IsDir() ? "DIR  " : "     ", (unsigned)item.Node, (const char *)item.Name));
+    PRF(printf("\n%s %6d %s", item.IsDir() ? "DIR  " : "     ", (unsigned)item.Node, name));
     
-    if (item.Name[0] == '.')
+    if (name[0] == '.')
     {
-      if (item.Name[1] == 0)
+      if (name[1] == 0)
       {
         if (isThereSelfLink)
           return S_FALSE;
         isThereSelfLink = true;
         if (iNode != iNodeDir)
           return S_FALSE;
+        _names.DeleteFrom(item.NamePos);
         continue;
       }
       
-      if (item.Name[1] == '.' && item.Name[2] == 0)
+      if (name[1] == '.' && name[2] == 0)
       {
         if (parentNode >= 0)
           return S_FALSE;
@@ -1013,6 +1188,7 @@ HRESULT CHandler::ParseDir(const Byte *p, size_t size, unsigned iNodeDir)
         else if ((unsigned)nodeDir.ParentNode != iNode)
           return S_FALSE;
 
+        _names.DeleteFrom(item.NamePos);
         continue;
       }
     }
@@ -1030,7 +1206,8 @@ HRESULT CHandler::ParseDir(const Byte *p, size_t size, unsigned iNodeDir)
       else if ((unsigned)node.ParentNode != iNodeDir)
         return S_FALSE;
       const unsigned itemIndex = _items.Size();
-      dir.Add(itemIndex);
+      _dirItems.Add(itemIndex);
+      dir.NumItems++;
       node.ItemIndex = itemIndex;
     }
 
@@ -1044,6 +1221,18 @@ HRESULT CHandler::ParseDir(const Byte *p, size_t size, unsigned iNodeDir)
 }
 
 
+HRESULT CHandler::AddDir(const CByteBuffer &data, unsigned iNodeDir)
+{
+  if (data.Size() == 0)
+  {
+    // _headersError = true;
+    return S_FALSE;
+  }
+  RINOK(ParseDir(data, data.Size(), iNodeDir));
+  return CheckProgress();
+}
+
+
 int CHandler::FindTargetItem_for_SymLink(unsigned iNode, const AString &path) const
 {
   unsigned pos = 0;
@@ -1095,14 +1284,14 @@ int CHandler::FindTargetItem_for_SymLink(unsigned iNode, const AString &path) co
     if (node.DirIndex < 0)
       return -1;
 
-    const CUIntVector &dir = _dirs[node.DirIndex];
+    const CDir &dir = _dirs[node.DirIndex];
     
     for (unsigned i = 0;; i++)
     {
-      if (i >= dir.Size())
+      if (i >= dir.NumItems)
         return -1;
-      const CItem &item = _items[dir[i]];
-      if (item.Name == s)
+      const CItem &item = _items[_dirItems[dir.StartIndex + i]];
+      if (s == GetName(item))
       {
         iNode = item.Node;
         break;
@@ -1114,15 +1303,116 @@ int CHandler::FindTargetItem_for_SymLink(unsigned iNode, const AString &path) co
 }
 
 
-HRESULT CHandler::SeekAndRead(IInStream *inStream, UInt64 block, Byte *data, size_t size)
+HRESULT CHandler::SeekAndRead(CReadContext &ctx, UInt64 block, Byte *data, size_t size) const
 {
   if (block == 0 || block >= _h.NumBlocks)
     return S_FALSE;
   if (((size + ((size_t)1 << _h.BlockBits) - 1) >> _h.BlockBits) > _h.NumBlocks - block)
     return S_FALSE;
-  RINOK(inStream->Seek((UInt64)block << _h.BlockBits, STREAM_SEEK_SET, NULL));
-  _totalRead += size;
-  return ReadStream_FALSE(inStream, data, size);
+  RINOK(ctx.Stream->Seek((UInt64)block << _h.BlockBits, STREAM_SEEK_SET, NULL));
+  ctx.TotalRead += size;
+  return ReadStream_FALSE(ctx.Stream, data, size);
+}
+
+
+HRESULT CHandler::ReadGroupNodes(CReadContext &ctx, CGroupNodes &g) const
+{
+  g.Nodes.Clear();
+  g.NodeIndexes.Clear();
+  g.NumEmpty_in_Map = 0;
+  g.HeadersError = false;
+  
+  const size_t blockSize = (size_t)1 << _h.BlockBits;
+  const size_t nodesDataSize = (size_t)g.NumNodesInTable * _h.InodeSize;
+  
+  {
+    // bitmap of inodes is one block. We don't read after it, if (InodesPerGroup) is too big
+    size_t mapSize = ((size_t)g.NumNodesInTable + 7) >> 3;
+    if (mapSize < blockSize)
+      mapSize = blockSize;
+    if (g.NodesMap.Size() != mapSize)
+      g.NodesMap.Alloc(mapSize);
+    memset(g.NodesMap + blockSize, 0, mapSize - blockSize);
+  }
+  if (g.NodesData.Size() != nodesDataSize)
+    g.NodesData.Alloc(nodesDataSize);
+  
+  PRF(printf("\n\ng%6d block = %6x\n", (unsigned)(g.FirstNode / g.NumNodesInTable), (unsigned)g.Gd.InodeTable));
+  
+  RINOK(SeekAndRead(ctx, g.Gd.InodeBitmap, g.NodesMap, blockSize));
+  RINOK(SeekAndRead(ctx, g.Gd.InodeTable, g.NodesData, nodesDataSize));
+  
+  const Byte *nodesMap = g.NodesMap;
+  
+  for (UInt32 n = 0; n < g.NumNodes; n++)
+  {
+    if ((nodesMap[n >> 3] & ((unsigned)1 << (n & 7))) == 0)
+    {
+      g.NumEmpty_in_Map++;
+      continue;
+    }
+    
+    const UInt32 globalNodeIndex = g.FirstNode + n;
+    const Byte *p = g.NodesData + (size_t)n * _h.InodeSize;
+    if (IsEmptyData(p, _h.InodeSize))
+    {
+      if (globalNodeIndex + 1 >= _h.FirstInode)
+      {
+        g.HeadersError = true;
+        // return S_FALSE;
+      }
+      continue;
+    }
+    
+    CNode node;
+    
+    PRF(printf("\nnode = %5d ", (unsigned)n));
+    
+    if (!node.Parse(p, _h))
+      return S_FALSE;
+    
+    // PRF(printf("\n %6d", (unsigned)n));
+    /*
+      SetUi32(p + 0x7C, 0)
+      SetUi32(p + 0x82, 0)
+      
+      UInt32 crc = Crc32C_Calc(_h.Uuid, sizeof(_h.Uuid));
+      Byte i_le[4];
+      SetUi32(i_le, n);
+      crc = Crc32C_Update(crc, i_le, 4);
+      crc = Crc32C_Update(crc, p, _h.InodeSize);
+      if (crc != node.Checksum) return S_FALSE;
+    */
+    
+    g.Nodes.Add(node);
+    g.NodeIndexes.Add(globalNodeIndex);
+  }
+  
+  return S_OK;
+}
+
+
+void CHandler::AddGroupNodes(const CGroupNodes &g)
+{
+  FOR_VECTOR (i, g.Nodes)
+  {
+    const UInt32 globalNodeIndex = g.NodeIndexes[i];
+    while (_refs.Size() < globalNodeIndex + 1)
+    {
+      // numEmpty++;
+      _refs.Add(-1);
+    }
+    _refs.Add(_nodes.Add(g.Nodes[i]));
+  }
+  
+  if (g.HeadersError)
+    _headersError = true;
+  
+  if (g.NumEmpty_in_Map != g.Gd.NumFreeInodes)
+  {
+    _headersWarning = true;
+    // return S_FALSE;
+  }
 }
 
 
@@ -1131,6 +1421,15 @@ static const unsigned kHeaderDataOffset = 1024;
 
 HRESULT CHandler::Open2(IInStream *inStream)
 {
+  _ctx.Stream = inStream;
+
+  #ifndef _7ZIP_ST
+  CLockedInStream lockedStream;
+  CObjArray<CReadJob> jobs; // it must be destroyed after (threads)
+  CDecodeThreads threads;
+  unsigned numThreads = 0;
+  #endif
+  
   {
     Byte buf[kHeaderSize];
     RINOK(ReadStream_FALSE(inStream, buf, kHeaderSize));
@@ -1180,7 +1479,7 @@ HRESULT CHandler::Open2(IInStream *inStream)
       if ((gdBufSize >> gdBits) != numGroups)
         return S_FALSE;
       gdBuf.Alloc(gdBufSize);
-      RINOK(SeekAndRead(inStream, (_h.BlockBits <= 10 ? 2 : 1), gdBuf, gdBufSize));
+      RINOK(SeekAndRead(_ctx, (_h.BlockBits <= 10 ? 2 : 1), gdBuf, gdBufSize));
 
       for (unsigned i = 0; i < numGroups; i++)
       {
@@ -1240,89 +1539,89 @@ HRESULT CHandler::Open2(IInStream *inStream)
         _refs.Reserve(numReserveInodes);
       }
       
-      CByteBuffer nodesData;
-      nodesData.Alloc(nodesDataSize);
-      
-      CByteBuffer nodesMap;
-      const size_t blockSize = (size_t)1 << _h.BlockBits;
-      nodesMap.Alloc(blockSize);
-      
-      unsigned globalNodeIndex = 0;
-      // unsigned numEmpty = 0;
-      unsigned numEmpty_in_Maps = 0;
+      /* Inode tables of groups are read and parsed by threads.
+         The main thread adds the nodes of groups in original order. */
 
-      FOR_VECTOR (gi, groups)
+      unsigned numGroupsToRead = numGroups;
       {
-        if (globalNodeIndex >= _h.NumInodes)
-          break;
+        const UInt64 numGroups2 = ((UInt64)_h.NumInodes + numNodes - 1) / numNodes;
+        if (numGroupsToRead > numGroups2)
+          numGroupsToRead = (unsigned)numGroups2;
+      }
 
-        const CGroupDescriptor &gd = groups[gi];
-        
-        PRF(printf("\n\ng%6d block = %6x\n", gi, (unsigned)gd.InodeTable));
-        
-        RINOK(SeekAndRead(inStream, gd.InodeBitmap, nodesMap, blockSize));
-        RINOK(SeekAndRead(inStream, gd.InodeTable, nodesData, nodesDataSize));
+      CGroupNodes groupST;
+      UInt32 numEmpty_in_Maps = 0;
 
-        unsigned numEmpty_in_Map = 0;
-        
-        for (size_t n = 0; n < numNodes && globalNodeIndex < _h.NumInodes; n++, globalNodeIndex++)
+      #ifndef _7ZIP_ST
+      RINOK(threads.Create(_mtProps.NumThreads, (UInt32)(Int32)-1));
+      numThreads = threads.Size();
+      if (numThreads != 0)
+      {
+        jobs.Alloc(numThreads);
+        lockedStream.Stream = inStream;
+        for (unsigned t = 0; t < numThreads; t++)
         {
-          if ((nodesMap[n >> 3] & ((unsigned)1 << (n & 7))) == 0)
-          {
-            numEmpty_in_Map++;
-            continue;
-          }
+          CReadJob &job = jobs[t];
+          job.Handler = this;
+          CPosInStream *streamSpec = new CPosInStream;
+          job.Ctx.Stream = streamSpec;
+          streamSpec->Init(&lockedStream);
+        }
+      }
+      unsigned numStarted = 0;
+      unsigned numFinished = 0;
+      #endif
+
+      for (unsigned gi = 0;;)
+      {
+        CGroupNodes *g = &groupST;
 
-          const Byte *p = nodesData + (size_t)n * _h.InodeSize;
-          if (IsEmptyData(p, _h.InodeSize))
+        #ifndef _7ZIP_ST
+        if (numThreads != 0)
+        {
+          if (numStarted != numFinished && (numStarted - numFinished == numThreads || gi == numGroupsToRead))
           {
-            if (globalNodeIndex + 1 >= _h.FirstInode)
-            {
-              _headersError = true;
-              // return S_FALSE;
-            }
+            const unsigned t = numFinished % numThreads;
+            numFinished++;
+            RINOK(threads[t].WaitJob());
+            CReadJob &job = jobs[t];
+            _ctx.TotalRead += job.Ctx.TotalRead;
+            job.Ctx.TotalRead = 0;
+            AddGroupNodes(job.Group);
+            numEmpty_in_Maps += job.Group.NumEmpty_in_Map;
+            RINOK(CheckProgress());
             continue;
           }
+          g = &jobs[numStarted % numThreads].Group;
+        }
+        #endif
 
-          CNode node;
-              
-          PRF(printf("\nnode = %5d ", (unsigned)n));
+        if (gi == numGroupsToRead)
+          break;
 
-          if (!node.Parse(p, _h))
-            return S_FALSE;
-  
-          // PRF(printf("\n %6d", (unsigned)n));
-          /*
-            SetUi32(p + 0x7C, 0)
-            SetUi32(p + 0x82, 0)
-            
-            UInt32 crc = Crc32C_Calc(_h.Uuid, sizeof(_h.Uuid));
-            Byte i_le[4];
-            SetUi32(i_le, n);
-            crc = Crc32C_Update(crc, i_le, 4);
-            crc = Crc32C_Update(crc, p, _h.InodeSize);
-            if (crc != node.Checksum) return S_FALSE;
-          */
-
-          while (_refs.Size() < globalNodeIndex + 1)
-          {
-            // numEmpty++;
-            _refs.Add(-1);
-          }
-          
-          _refs.Add(_nodes.Add(node));
-        }
+        g->Gd = groups[gi];
+        g->FirstNode = (UInt32)gi * numNodes;
+        g->NumNodesInTable = numNodes;
+        g->NumNodes = MyMin(numNodes, _h.NumInodes - g->FirstNode);
+        gi++;
 
-        
-        numEmpty_in_Maps += numEmpty_in_Map;
-        
-        if (numEmpty_in_Map != gd.NumFreeInodes)
+        #ifndef _7ZIP_ST
+        if (numThreads != 0)
         {
-          _headersWarning = true;
-          // return S_FALSE;
+          const unsigned t = numStarted % numThreads;
+          jobs[t].IsGroupJob = true;
+          threads[t].StartJob(&jobs[t]);
+          numStarted++;
+          continue;
         }
+        #endif
+
+        RINOK(ReadGroupNodes(_ctx, *g));
+        AddGroupNodes(*g);
+        numEmpty_in_Maps += g->NumEmpty_in_Map;
+        RINOK(CheckProgress());
       }
-      
+
       if (numEmpty_in_Maps != _h.NumFreeInodes)
       {
         // some ext2 examples has incorrect value in _h.NumFreeInodes.
@@ -1337,34 +1636,63 @@ HRESULT CHandler::Open2(IInStream *inStream)
     }
   }
 
-  _stream = inStream; // we need stream for dir nodes
-
   {
     // ---------- Read Dirs ----------
 
-    CByteBuffer dataBuf;
+    /* Threads read the data (extent trees and blocks) of dir nodes.
+       The main thread parses dirs in original order. */
 
-    FOR_VECTOR (i, _refs)
+    CUIntVector dirNodes; // indexes in _refs[]
     {
-      int nodeIndex = _refs[i];
+      FOR_VECTOR (i, _refs)
       {
-        if (nodeIndex < 0)
-          continue;
-        const CNode &node = _nodes[nodeIndex];
-        if (!node.IsDir())
-          continue;
-      }
-      RINOK(ExtractNode(nodeIndex, dataBuf));
-      if (dataBuf.Size() == 0)
-      {
-        // _headersError = true;
-        return S_FALSE;
+        int nodeIndex = _refs[i];
+        if (nodeIndex >= 0 && _nodes[nodeIndex].IsDir())
+          dirNodes.Add(i);
       }
-      else
+    }
+
+    CByteBuffer dataBuf;
+
+    #ifndef _7ZIP_ST
+    unsigned numStarted = 0;
+    unsigned numFinished = 0;
+    #endif
+
+    for (unsigned k = 0;;)
+    {
+      #ifndef _7ZIP_ST
+      if (numThreads != 0)
       {
-        RINOK(ParseDir(dataBuf, dataBuf.Size(), i));
+        if (numStarted != numFinished && (numStarted - numFinished == numThreads || k == dirNodes.Size()))
+        {
+          const unsigned t = numFinished % numThreads;
+          numFinished++;
+          RINOK(threads[t].WaitJob());
+          CReadJob &job = jobs[t];
+          _ctx.TotalRead += job.Ctx.TotalRead;
+          job.Ctx.TotalRead = 0;
+          RINOK(AddDir(job.Data, job.INode));
+          continue;
+        }
+        if (k == dirNodes.Size())
+          break;
+        const unsigned t = numStarted % numThreads;
+        CReadJob &job = jobs[t];
+        job.IsGroupJob = false;
+        job.INode = dirNodes[k++];
+        job.Node = _nodes[_refs[job.INode]];
+        threads[t].StartJob(&job);
+        numStarted++;
+        continue;
       }
-      RINOK(CheckProgress());
+      #endif
+
+      if (k == dirNodes.Size())
+        break;
+      const unsigned iNode = dirNodes[k++];
+      RINOK(ExtractNode(_ctx, _nodes[_refs[iNode]], dataBuf));
+      RINOK(AddDir(dataBuf, iNode));
     }
 
     if (_nodes[_refs[k_INODE_ROOT]].ParentNode != k_INODE_ROOT)
@@ -1471,7 +1799,7 @@ HRESULT CHandler::Open2(IInStream *inStream)
         continue;
       if (node.FileSize > ((UInt32)1 << 14))
         continue;
-      if (ExtractNode(nodeIndex, data) == S_OK && data.Size() != 0)
+      if (ExtractNode(_ctx, node, data) == S_OK && data.Size() != 0)
       {
         s.SetFrom_CalcLen((const char *)(const Byte *)data, (unsigned)data.Size());
         if (s.Len() == data.Size())
@@ -1530,22 +1858,25 @@ HRESULT CHandler::Open2(IInStream *inStream)
         if (node.FileSize == 0)
           continue;
 
+        const char *name = "";
+        char temp[16];
+
         if (i < _h.FirstInode)
         {
           if (item.Node < ARRAY_SIZE(k_SysInode_Names))
-            item.Name = k_SysInode_Names[item.Node];
+            name = k_SysInode_Names[item.Node];
           useSys = true;
         }
         else
           useUnknown = true;
         
-        if (item.Name.IsEmpty())
+        if (name[0] == 0)
         {
-          char temp[16];
           ConvertUInt32ToString(item.Node, temp);
-          item.Name = temp;
+          name = temp;
         }
 
+        AddName(item, name, MyStringLen(name));
         _items.Add(item);
       }
     }
@@ -1582,7 +1913,6 @@ STDMETHODIMP CHandler::Open(IInStream *stream, const UInt64 *, IArchiveOpenCallb
       ClearRefs();
       return res;
     }
-    _stream = stream;
   }
   return S_OK;
   COM_TRY_END
@@ -1591,13 +1921,15 @@ STDMETHODIMP CHandler::Open(IInStream *stream, const UInt64 *, IArchiveOpenCallb
 
 void CHandler::ClearRefs()
 {
-  _stream.Release();
+  _ctx.Stream.Release();
   _items.Clear();
+  _names.Clear();
   _nodes.Clear();
   _refs.Clear();
   _auxItems.Clear();
   _symLinks.Clear();
   _dirs.Clear();
+  _dirItems.Clear();
   _auxSysIndex = -1;
   _auxUnknownIndex = -1;
 }
@@ -1605,7 +1937,7 @@ void CHandler::ClearRefs()
 
 STDMETHODIMP CHandler::Close()
 {
-  _totalRead = 0;
+  _ctx.TotalRead = 0;
   _totalReadPrev = 0;
   _phySize = 0;
   _isArc = false;
@@ -1634,7 +1966,7 @@ void CHandler::GetPath(unsigned index, AString &s) const
     const CItem &item = _items[index];
     if (!s.IsEmpty())
       s.InsertAtFront(CHAR_PATH_SEPARATOR);
-    s.Insert(0, item.Name);
+    s.Insert(0, GetName(item));
 
     if (item.ParentNode == k_INODE_ROOT)
       return;
@@ -1885,7 +2217,7 @@ STDMETHODIMP CHandler::GetArchiveProperty(PROPID propID, PROPVARIANT *value)
       if (!_isArc) v |= kpv_ErrorFlags_IsNotArc;;
       if (_linksError) v |= kpv_ErrorFlags_HeadersError;
       if (_headersError) v |= kpv_ErrorFlags_HeadersError;
-      if (!_stream && v == 0 && _isArc)
+      if (!_ctx.Stream && v == 0 && _isArc)
         v = kpv_ErrorFlags_HeadersError;
       if (v != 0)
         prop = v;
@@ -1968,11 +2300,11 @@ STDMETHODIMP CHandler::GetRawProp(UInt32 index, PROPID propID, const void **data
   {
     if (index < _items.Size())
     {
-      const AString &s = _items[index].Name;
-      if (!s.IsEmpty())
+      const CItem &item = _items[index];
+      if (item.NameLen != 0)
       {
-        *data = (void *)(const char *)s;
-        *dataSize = (UInt32)s.Len() + 1;
+        *data = (const void *)GetName(item);
+        *dataSize = (UInt32)item.NameLen + 1;
         *propType = NPropDataType::kUtf8z;
       }
       return S_OK;
@@ -2078,8 +2410,9 @@ STDMETHODIMP CHandler::GetProperty(UInt32 index, PROPID propID, PROPVARIANT *val
       {
         UString u;
         {
-          if (!_isUTF || !ConvertUTF8ToUnicode(item.Name, u))
-            MultiByteToUnicodeString2(u, item.Name);
+          const AString name = GetName(item);
+          if (!_isUTF || !ConvertUTF8ToUnicode(name, u))
+            MultiByteToUnicodeString2(u, name);
         }
         prop = u;
       }
@@ -2385,15 +2718,15 @@ STDMETHODIMP CExtInStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosi
 
 
 
-HRESULT CHandler::FillFileBlocks2(UInt32 block, unsigned level, unsigned numBlocks, CRecordVector<UInt32> &blocks)
+HRESULT CHandler::FillFileBlocks2(CReadContext &ctx, UInt32 block, unsigned level, unsigned numBlocks, CRecordVector<UInt32> &blocks) const
 {
   const size_t blockSize = (size_t)1 << _h.BlockBits;
-  CByteBuffer &tempBuf = _tempBufs[level];
+  CByteBuffer &tempBuf = ctx.TempBufs[level];
   tempBuf.Alloc(blockSize);
 
   PRF2(printf("\n level = %d, block = %7d", level, (unsigned)block));
 
-  RINOK(SeekAndRead(_stream, block, tempBuf, blockSize));
+  RINOK(SeekAndRead(ctx, block, tempBuf, blockSize));
 
   const Byte *p = tempBuf;
   size_t num = (size_t)1 << (_h.BlockBits - 2);
@@ -2424,7 +2757,7 @@ HRESULT CHandler::FillFileBlocks2(UInt32 block, unsigned level, unsigned numBloc
         return S_FALSE;
       }
       
-      RINOK(FillFileBlocks2(val, level - 1, numBlocks, blocks));
+      RINOK(FillFileBlocks2(ctx, val, level - 1, numBlocks, blocks));
       continue;
     }
     
@@ -2441,7 +2774,7 @@ HRESULT CHandler::FillFileBlocks2(UInt32 block, unsigned level, unsigned numBloc
 
 static const unsigned kNumDirectNodeBlocks = 12;
 
-HRESULT CHandler::FillFileBlocks(const Byte *p, unsigned numBlocks, CRecordVector<UInt32> &blocks)
+HRESULT CHandler::FillFileBlocks(CReadContext &ctx, const Byte *p, unsigned numBlocks, CRecordVector<UInt32> &blocks) const
 {
   // ext2 supports zero blocks (blockIndex == 0).
 
@@ -2480,7 +2813,7 @@ HRESULT CHandler::FillFileBlocks(const Byte *p, unsigned numBlocks, CRecordVecto
       return S_FALSE;
     }
 
-    RINOK(FillFileBlocks2(val, level, numBlocks, blocks));
+    RINOK(FillFileBlocks2(ctx, val, level, numBlocks, blocks));
   }
   
   return S_OK;
@@ -2527,7 +2860,7 @@ static bool UpdateExtents(CRecordVector<CExtent> &extents, UInt32 block)
 }
 
 
-HRESULT CHandler::FillExtents(const Byte *p, size_t size, CRecordVector<CExtent> &extents, int parentDepth)
+HRESULT CHandler::FillExtents(CReadContext &ctx, const Byte *p, size_t size, CRecordVector<CExtent> &extents, int parentDepth) const
 {
   CExtentTreeHeader eth;
   if (!eth.Parse(p))
@@ -2562,7 +2895,7 @@ HRESULT CHandler::FillExtents(const Byte *p, size_t size, CRecordVector<CExtent>
   }
 
   const size_t blockSize = (size_t)1 << _h.BlockBits;
-  CByteBuffer &tempBuf = _tempBufs[eth.Depth];
+  CByteBuffer &tempBuf = ctx.TempBufs[eth.Depth];
   tempBuf.Alloc(blockSize);
 
   for (unsigned i = 0; i < eth.NumEntries; i++)
@@ -2576,22 +2909,20 @@ HRESULT CHandler::FillExtents(const Byte *p, size_t size, CRecordVector<CExtent>
     if (!UpdateExtents(extents, e.VirtBlock))
       return S_FALSE;
 
-    RINOK(SeekAndRead(_stream, e.PhyLeaf, tempBuf, blockSize));
-    RINOK(FillExtents(tempBuf, blockSize, extents, eth.Depth));
+    RINOK(SeekAndRead(ctx, e.PhyLeaf, tempBuf, blockSize));
+    RINOK(FillExtents(ctx, tempBuf, blockSize, extents, eth.Depth));
   }
 
   return S_OK;
 }
 
 
-HRESULT CHandler::GetStream_Node(unsigned nodeIndex, ISequentialInStream **stream)
+HRESULT CHandler::GetStream_Node(CReadContext &ctx, const CNode &node, ISequentialInStream **stream) const
 {
   COM_TRY_BEGIN
 
   *stream = NULL;
 
-  const CNode &node = _nodes[nodeIndex];
-
   if (!node.IsFlags_EXTENTS())
   {
     // maybe sparse file can have (node.NumBlocks == 0) ?
@@ -2624,9 +2955,9 @@ HRESULT CHandler::GetStream_Node(unsigned nodeIndex, ISequentialInStream **strea
     
     streamSpec->BlockBits = _h.BlockBits;
     streamSpec->Size = node.FileSize;
-    streamSpec->Stream = _stream;
+    streamSpec->Stream = ctx.Stream;
     
-    RINOK(FillExtents(node.Block, kNodeBlockFieldSize, streamSpec->Extents, -1));
+    RINOK(FillExtents(ctx, node.Block, kNodeBlockFieldSize, streamSpec->Extents, -1));
 
     UInt32 end = 0;
     if (!streamSpec->Extents.IsEmpty())
@@ -2684,9 +3015,9 @@ HRESULT CHandler::GetStream_Node(unsigned nodeIndex, ISequentialInStream **strea
 
     streamSpec->BlockBits = _h.BlockBits;
     streamSpec->Size = node.FileSize;
-    streamSpec->Stream = _stream;
+    streamSpec->Stream = ctx.Stream;
 
-    RINOK(FillFileBlocks(node.Block, numBlocks, streamSpec->Vector));
+    RINOK(FillFileBlocks(ctx, node.Block, numBlocks, streamSpec->Vector));
     streamSpec->InitAndSeek();
   }
 
@@ -2698,19 +3029,18 @@ HRESULT CHandler::GetStream_Node(unsigned nodeIndex, ISequentialInStream **strea
 }
 
 
-HRESULT CHandler::ExtractNode(unsigned nodeIndex, CByteBuffer &data)
+HRESULT CHandler::ExtractNode(CReadContext &ctx, const CNode &node, CByteBuffer &data) const
 {
   data.Free();
-  const CNode &node = _nodes[nodeIndex];
   size_t size = (size_t)node.FileSize;
   if (size != node.FileSize)
     return S_FALSE;
   CMyComPtr<ISequentialInStream> inSeqStream;
-  RINOK(GetStream_Node(nodeIndex, &inSeqStream));
+  RINOK(GetStream_Node(ctx, node, &inSeqStream));
   if (!inSeqStream)
     return S_FALSE;
   data.Alloc(size);
-  _totalRead += size;
+  ctx.TotalRead += size;
   return ReadStream_FALSE(inSeqStream, data, size);
 }
 
@@ -2840,7 +3170,23 @@ STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
   *stream = NULL;
   if (index >= _items.Size())
     return S_FALSE;
-  return GetStream_Node(_refs[_items[index].Node], stream);
+  return GetStream_Node(_ctx, _nodes[_refs[_items[index].Node]], stream);
+}
+
+
+STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps)
+{
+  InitProps();
+
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    if (name.IsEmpty())
+      return E_INVALIDARG;
+    RINOK(_mtProps.SetProperty(name, values[i]));
+  }
+  return S_OK;
 }
 
 
@@ -20,12 +20,9 @@
 #include "../Common/RegisterArc.h"
 #include "../Common/StreamUtils.h"
 
-#include "../Compress/CopyCoder.h"
-
-#include "Common/DummyOutStream.h"
-
 #define Get16(p) GetUi16(p)
 #define Get32(p) GetUi32(p)
+#define Get64(p) GetUi64(p)
 
 #define PRF(x) /* x */
 
@@ -36,8 +33,8 @@ static const UInt32 kFatItemUsedByDirMask = (UInt32)1 << 31;
 
 struct CHeader
 {
-  UInt32 NumSectors;
-  UInt16 NumReservedSectors;
+  UInt64 NumSectors;
+  UInt32 NumReservedSectors;
   Byte NumFats;
   UInt32 NumFatSectors;
   UInt32 RootDirSector;
@@ -57,6 +54,7 @@ struct CHeader
   UInt32 NumHiddenSectors;
 
   bool VolFieldsDefined;
+  bool IsExFat;
   
   UInt32 VolId;
   // Byte VolName[11];
@@ -65,7 +63,7 @@ struct CHeader
   // Byte OemName[5];
   Byte MediaType;
 
-  // 32-bit FAT
+  // 32-bit FAT and exFAT
   UInt16 Flags;
   UInt16 FsInfoSector;
   UInt32 RootCluster;
@@ -74,7 +72,7 @@ struct CHeader
   UInt64 GetPhySize() const { return (UInt64)NumSectors << SectorSizeLog; }
   UInt32 SectorSize() const { return (UInt32)1 << SectorSizeLog; }
   UInt32 ClusterSize() const { return (UInt32)1 << ClusterSizeLog; }
-  UInt32 ClusterToSector(UInt32 c) const { return DataSector + ((c - 2) << SectorsPerClusterLog); }
+  UInt64 ClusterToPos(UInt32 c) const { return ((UInt64)DataSector << SectorSizeLog) + ((UInt64)(c - 2) << ClusterSizeLog); }
   UInt32 IsEoc(UInt32 c) const { return c > BadCluster; }
   UInt32 IsEocAndUnused(UInt32 c) const { return c > BadCluster && (c & kFatItemUsedByDirMask) == 0; }
   UInt32 IsValidCluster(UInt32 c) const { return c >= 2 && c < FatSize; }
@@ -83,22 +81,26 @@ struct CHeader
 
   UInt32 GetFatSector() const
   {
+    if (IsExFat)
+      return NumReservedSectors + ((NumFats == 2 && (Flags & 1) != 0) ? NumFatSectors : 0);
     UInt32 index = (IsFat32() && (Flags & 0x80) != 0) ? (Flags & 0xF) : 0;
     if (index > NumFats)
       index = 0;
     return NumReservedSectors + index * NumFatSectors;
   }
 
-  UInt64 GetFilePackSize(UInt32 unpackSize) const
+  UInt64 GetFilePackSize(UInt64 unpackSize) const
   {
     UInt64 mask = ClusterSize() - 1;
     return (unpackSize + mask) & ~mask;
   }
 
-  UInt32 GetNumClusters(UInt32 size) const
-    { return (UInt32)(((UInt64)size + ClusterSize() - 1) >> ClusterSizeLog); }
+  // the caller checks that size is not larger than (FatSize << ClusterSizeLog)
+  UInt32 GetNumClusters(UInt64 size) const
+    { return (UInt32)((size + ClusterSize() - 1) >> ClusterSizeLog); }
 
   bool Parse(const Byte *p);
+  bool ParseExFat(const Byte *p);
 };
 
 static int GetLog(UInt32 num)
@@ -125,6 +127,10 @@ bool CHeader::Parse(const Byte *p)
   if (p[0x1FE] != 0x55 || p[0x1FF] != 0xAA)
     return false;
 
+  if (memcmp(p + 3, "EXFAT   ", 8) == 0)
+    return ParseExFat(p);
+  IsExFat = false;
+
   int codeOffset = 0;
   switch (p[0])
   {
@@ -240,7 +246,7 @@ bool CHeader::Parse(const Byte *p)
   DataSector = RootDirSector + NumRootDirSectors;
   if (NumSectors < DataSector)
     return false;
-  UInt32 numDataSectors = NumSectors - DataSector;
+  UInt32 numDataSectors = (UInt32)(NumSectors - DataSector);
   UInt32 numClusters = numDataSectors >> SectorsPerClusterLog;
   
   BadCluster = 0x0FFFFFF7;
@@ -260,17 +266,75 @@ bool CHeader::Parse(const Byte *p)
   return true;
 }
 
+bool CHeader::ParseExFat(const Byte *p)
+{
+  for (unsigned i = 11; i < 0x40; i++)
+    if (p[i] != 0)
+      return false;
+
+  IsExFat = true;
+  NumFatBits = 32;
+  NumSectors = Get64(p + 0x48);
+  NumReservedSectors = Get32(p + 0x50); // FatOffset
+  NumFatSectors = Get32(p + 0x54);
+  DataSector = Get32(p + 0x58); // ClusterHeapOffset
+  UInt32 numClusters = Get32(p + 0x5C);
+  RootCluster = Get32(p + 0x60);
+  VolId = Get32(p + 0x64);
+  VolFieldsDefined = true;
+  if (p[0x69] != 1) // major version of FileSystemRevision
+    return false;
+  Flags = Get16(p + 0x6A); // VolumeFlags
+  SectorSizeLog = p[0x6C];
+  SectorsPerClusterLog = p[0x6D];
+  NumFats = p[0x6E];
+
+  if (SectorSizeLog < 9 || SectorSizeLog > 12 || SectorsPerClusterLog > 25 - SectorSizeLog)
+    return false;
+  ClusterSizeLog = (Byte)(SectorSizeLog + SectorsPerClusterLog);
+  if (NumFats < 1 || NumFats > 2)
+    return false;
+
+  NumRootDirSectors = 0;
+  RootDirSector = DataSector;
+  MediaType = 0xF8;
+  SectorsPerTrack = 0;
+  NumHeads = 0;
+  NumHiddenSectors = 0;
+  FsInfoSector = 0;
+
+  if (NumReservedSectors == 0 || NumFatSectors == 0
+      || (UInt64)NumReservedSectors + (UInt64)NumFatSectors * NumFats > DataSector
+      || NumSectors < DataSector
+      || ((NumSectors - DataSector) >> SectorsPerClusterLog) < numClusters)
+    return false;
+
+  /* exFAT uses 32-bit cluster numbers. We map FAT values to 28-bit values of FAT32,
+     so we don't support (numClusters >= 0x0FFFFFF5) that is more than real volumes use. */
+  BadCluster = 0x0FFFFFF7;
+  if (numClusters >= BadCluster - 2)
+    return false;
+  FatSize = numClusters + 2;
+  return CalcFatSizeInSectors() <= NumFatSectors;
+}
+
 struct CItem
 {
   UString UName;
   char DosName[11];
   Byte CTime2;
+  Byte MTime2;
   UInt32 CTime;
   UInt32 MTime;
-  UInt16 ADate;
+  UInt32 ATime;
+  Byte CTimeZone; // exFAT UTC offsets; (0) means local time
+  Byte MTimeZone;
+  Byte ATimeZone;
   Byte Attrib;
   Byte Flags;
-  UInt32 Size;
+  bool NoFatChain; // exFAT: the clusters are contiguous, and FAT is not used
+  UInt64 Size;
+  UInt64 ValidSize; // exFAT: the data after ValidSize is zeros
   UInt32 Cluster;
   Int32 Parent;
 
@@ -352,6 +416,8 @@ struct CDatabase
   bool VolItemDefined;
   CItem VolItem;
   UInt32 NumDirClusters;
+  UInt32 BitmapCluster;
+  UInt64 BitmapSize;
   CByteBuffer ByteBuf;
   UInt64 NumCurUsedBytes;
 
@@ -368,13 +434,16 @@ struct CDatabase
   UString GetItemPath(Int32 index) const;
   HRESULT Open();
   HRESULT ReadDir(Int32 parent, UInt32 cluster, unsigned level);
+  HRESULT ReadExFatDir(Int32 parent, UInt32 cluster, UInt64 size, bool noFatChain, unsigned level);
+  HRESULT ReadExFatBitmap();
+  HRESULT GetExtents(const CItem &item, CRecordVector<CSeekExtent> &extents) const;
 
   UInt64 GetHeadersSize() const
   {
-    return (UInt64)(Header.DataSector + (NumDirClusters << Header.SectorsPerClusterLog)) << Header.SectorSizeLog;
+    return ((UInt64)Header.DataSector << Header.SectorSizeLog) + ((UInt64)NumDirClusters << Header.ClusterSizeLog);
   }
   HRESULT SeekToSector(UInt32 sector);
-  HRESULT SeekToCluster(UInt32 cluster) { return SeekToSector(Header.ClusterToSector(cluster)); }
+  HRESULT SeekToCluster(UInt32 cluster) { return InStream->Seek(Header.ClusterToPos(cluster), STREAM_SEEK_SET, NULL); }
 };
 
 HRESULT CDatabase::SeekToSector(UInt32 sector)
@@ -387,6 +456,8 @@ void CDatabase::Clear()
   PhySize = 0;
   VolItemDefined = false;
   NumDirClusters = 0;
+  BitmapCluster = 0;
+  BitmapSize = 0;
   NumCurUsedBytes = 0;
 
   Items.Clear();
@@ -578,7 +649,9 @@ HRESULT CDatabase::ReadDir(Int32 parent, UInt32 cluster, unsigned level)
         item.DosName[0] = (char)(Byte)0xE5;
       item.Attrib = attrib;
       item.Flags = p[12];
+      item.NoFatChain = false;
       item.Size = Get32(p + 28);
+      item.ValidSize = item.Size;
       item.Cluster = Get16(p + 26);
       if (Header.NumFatBits > 16)
         item.Cluster |= ((UInt32)Get16(p + 20) << 16);
@@ -589,8 +662,12 @@ HRESULT CDatabase::ReadDir(Int32 parent, UInt32 cluster, unsigned level)
 
       item.CTime = Get32(p + 14);
       item.CTime2 = p[13];
-      item.ADate = Get16(p + 18);
+      item.MTime2 = 0;
+      item.ATime = (UInt32)Get16(p + 18) << 16;
       item.MTime = Get32(p + 22);
+      item.CTimeZone = 0;
+      item.MTimeZone = 0;
+      item.ATimeZone = 0;
       item.Parent = parent;
 
       if (attrib == 8)
@@ -626,6 +703,301 @@ HRESULT CDatabase::ReadDir(Int32 parent, UInt32 cluster, unsigned level)
   return S_OK;
 }
 
+static UInt16 ExFatCheckSum(UInt16 sum, const Byte *p, bool isPrimary)
+{
+  for (unsigned i = 0; i < 32; i++)
+  {
+    if (isPrimary && (i == 2 || i == 3)) // SetChecksum field
+      continue;
+    sum = (UInt16)(((sum & 1) ? 0x8000 : 0) + (sum >> 1) + p[i]);
+  }
+  return sum;
+}
+
+// exFAT directory entry types
+static const Byte kExType_Bitmap = 0x81;
+static const Byte kExType_UpCase = 0x82;
+static const Byte kExType_Label = 0x83;
+static const Byte kExType_File = 0x85;
+static const Byte kExType_Stream = 0xC0;
+static const Byte kExType_Name = 0xC1;
+
+static const unsigned kExNameCharsInEntry = 15;
+
+/* exFAT directory is sequence of entry sets. Entry set is File entry
+   followed by Stream Extension entry and File Name entries.
+   The size of root directory is defined by FAT chain only.
+   The size of subdirectory is stored in Stream Extension entry. */
+
+HRESULT CDatabase::ReadExFatDir(Int32 parent, UInt32 cluster, UInt64 size, bool noFatChain, unsigned level)
+{
+  unsigned startIndex = Items.Size();
+  if (startIndex >= (1 << 30) || level > 256)
+    return S_FALSE;
+
+  UInt32 numClusters = 0;
+  if (parent >= 0)
+  {
+    // the maximum size of directory in exFAT is 256 MiB
+    if (size > ((UInt64)1 << 28))
+      return S_FALSE;
+    numClusters = Header.GetNumClusters(size);
+  }
+
+  const UInt32 blockSize = Header.ClusterSize();
+  ByteBuf.Alloc(blockSize);
+  UInt32 numReadClusters = 0;
+
+  CItem item;
+  wchar_t nameBuf[256];
+  unsigned nameLen = 0;
+  unsigned namePos = 0;
+  unsigned numSecondary = 0;
+  UInt16 checkSum = 0;
+  UInt16 setCheckSum = 0;
+  bool streamDefined = false;
+
+  for (UInt32 pos = blockSize;; pos += 32)
+  {
+    if (pos == blockSize)
+    {
+      pos = 0;
+
+      if ((NumDirClusters & 0xFF) == 0)
+      {
+        RINOK(OpenProgress());
+      }
+
+      if (parent >= 0 && numReadClusters == numClusters)
+        break;
+      if (!noFatChain && Header.IsEoc(cluster))
+      {
+        if (parent >= 0)
+          return S_FALSE;
+        break;
+      }
+      if (!Header.IsValidCluster(cluster))
+        return S_FALSE;
+      RINOK(SeekToCluster(cluster));
+      UInt32 newCluster = Fat[cluster];
+      if ((newCluster & kFatItemUsedByDirMask) != 0)
+        return S_FALSE;
+      Fat[cluster] |= kFatItemUsedByDirMask;
+      if (noFatChain)
+        cluster++;
+      else
+        cluster = newCluster;
+      numReadClusters++;
+      NumDirClusters++;
+      NumCurUsedBytes += blockSize;
+
+      RINOK(ReadStream_FALSE(InStream, ByteBuf, blockSize));
+    }
+
+    const Byte *p = ByteBuf + pos;
+    const Byte type = p[0];
+
+    if (numSecondary != 0)
+    {
+      // all secondary entries of file are "in use" entries
+      if ((type & 0xC0) != 0xC0)
+        return S_FALSE;
+      checkSum = ExFatCheckSum(checkSum, p, false);
+      if (type == kExType_Stream)
+      {
+        if (streamDefined)
+          return S_FALSE;
+        streamDefined = true;
+        item.NoFatChain = ((p[1] & 2) != 0);
+        nameLen = p[3];
+        item.ValidSize = Get64(p + 8);
+        item.Cluster = Get32(p + 20);
+        item.Size = Get64(p + 24);
+        if (nameLen == 0 || item.ValidSize > item.Size)
+          return S_FALSE;
+      }
+      else if (type == kExType_Name)
+      {
+        if (!streamDefined)
+          return S_FALSE;
+        for (unsigned i = 0; i < kExNameCharsInEntry && namePos < nameLen; i++)
+          nameBuf[namePos++] = Get16(p + 2 + i * 2);
+      }
+      if (--numSecondary != 0)
+        continue;
+
+      if (!streamDefined || namePos != nameLen || checkSum != setCheckSum)
+        return S_FALSE;
+      nameBuf[namePos] = 0;
+      item.UName = nameBuf;
+      if (!item.IsDir())
+        NumCurUsedBytes += Header.GetFilePackSize(item.Size);
+      Items.Add(item);
+      continue;
+    }
+
+    if (type == 0) // end of directory
+      break;
+    if ((type & 0x80) == 0) // unused entry
+      continue;
+
+    switch (type)
+    {
+      case kExType_File:
+      {
+        numSecondary = p[1];
+        if (numSecondary < 2)
+          return S_FALSE;
+        setCheckSum = Get16(p + 2);
+        checkSum = ExFatCheckSum(0, p, true);
+        streamDefined = false;
+        namePos = 0;
+        memset(item.DosName, ' ', 11);
+        item.Attrib = (Byte)Get16(p + 4);
+        item.Flags = 0;
+        item.CTime = Get32(p + 8);
+        item.MTime = Get32(p + 12);
+        item.ATime = Get32(p + 16);
+        item.CTime2 = p[20];
+        item.MTime2 = p[21];
+        item.CTimeZone = p[22];
+        item.MTimeZone = p[23];
+        item.ATimeZone = p[24];
+        item.Parent = parent;
+        break;
+      }
+      case kExType_Bitmap:
+        if (parent < 0 && BitmapCluster == 0)
+        {
+          BitmapCluster = Get32(p + 20);
+          BitmapSize = Get64(p + 24);
+        }
+        break;
+      case kExType_UpCase:
+        break;
+      case kExType_Label:
+      {
+        unsigned len = p[1];
+        if (len > 11)
+          return S_FALSE;
+        for (unsigned i = 0; i < len; i++)
+          nameBuf[i] = Get16(p + 2 + i * 2);
+        nameBuf[len] = 0;
+        VolItem.UName = nameBuf;
+        VolItemDefined = true;
+        break;
+      }
+      default:
+        // unknown critical primary and secondary entries are not allowed
+        if ((type & 0x20) == 0 || (type & 0x40) != 0)
+          return S_FALSE;
+        break;
+    }
+  }
+
+  if (numSecondary != 0)
+    return S_FALSE;
+
+  unsigned finishIndex = Items.Size();
+  for (unsigned i = startIndex; i < finishIndex; i++)
+  {
+    const CItem &item2 = Items[i];
+    if (item2.IsDir() && item2.Size != 0)
+    {
+      RINOK(ReadExFatDir(i, item2.Cluster, item2.Size, item2.NoFatChain, level + 1));
+    }
+  }
+  return S_OK;
+}
+
+HRESULT CDatabase::ReadExFatBitmap()
+{
+  const UInt32 numClusters = Header.FatSize - 2;
+  if (BitmapCluster == 0 || BitmapSize < (numClusters + 7) / 8 || BitmapSize > ((UInt64)1 << 28))
+    return S_OK;
+  CItem item;
+  item.Cluster = BitmapCluster;
+  item.Size = item.ValidSize = BitmapSize;
+  item.NoFatChain = false;
+  CRecordVector<CSeekExtent> extents;
+  if (GetExtents(item, extents) != S_OK)
+    return S_OK;
+  CByteBuffer buf((size_t)BitmapSize);
+  for (unsigned i = 0; i + 1 < extents.Size(); i++)
+  {
+    const CSeekExtent &e = extents[i];
+    size_t size = (size_t)(extents[i + 1].Virt - e.Virt);
+    RINOK(InStream->Seek(e.Phy, STREAM_SEEK_SET, NULL));
+    size_t processed = size;
+    RINOK(ReadStream(InStream, buf + (size_t)e.Virt, &processed));
+    if (processed != size)
+      return S_OK;
+  }
+  UInt32 numUsed = 0;
+  const Byte *p = buf;
+  for (UInt32 i = 0; i < numClusters; i++)
+    numUsed += (p[i >> 3] >> (i & 7)) & 1;
+  NumFreeClusters = numClusters - numUsed;
+  return S_OK;
+}
+
+/* GetExtents() converts cluster chain of item to the list of runs of contiguous clusters.
+   The last extent in list is end marker that contains the size of data. */
+
+HRESULT CDatabase::GetExtents(const CItem &item, CRecordVector<CSeekExtent> &extents) const
+{
+  extents.Clear();
+  UInt32 cluster = item.Cluster;
+  CSeekExtent e;
+
+  if (item.Size == 0)
+  {
+    if (cluster != 0)
+      return S_FALSE;
+  }
+  else
+  {
+    if (item.Size > ((UInt64)Header.FatSize << Header.ClusterSizeLog))
+      return S_FALSE;
+    const UInt32 numClusters = Header.GetNumClusters(item.Size);
+    const UInt32 numValidClusters = Header.GetNumClusters(item.ValidSize);
+    if (item.NoFatChain)
+    {
+      if (!Header.IsValidCluster(cluster) || numClusters > Header.FatSize - cluster)
+        return S_FALSE;
+      if (numValidClusters != 0)
+      {
+        e.Phy = Header.ClusterToPos(cluster);
+        e.Virt = 0;
+        extents.Add(e);
+      }
+    }
+    else
+    {
+      UInt32 prev = 0;
+      for (UInt32 i = 0; i < numClusters; i++)
+      {
+        if (!Header.IsValidCluster(cluster))
+          return S_FALSE;
+        if (i < numValidClusters && (i == 0 || cluster != prev + 1))
+        {
+          e.Phy = Header.ClusterToPos(cluster);
+          e.Virt = (UInt64)i << Header.ClusterSizeLog;
+          extents.Add(e);
+        }
+        prev = cluster;
+        cluster = Fat[cluster];
+      }
+      if (!Header.IsEocAndUnused(cluster))
+        return S_FALSE;
+    }
+  }
+  e.Phy = 0;
+  e.Virt = item.ValidSize;
+  extents.Add(e);
+  return S_OK;
+}
+
 HRESULT CDatabase::Open()
 {
   Clear();
@@ -644,7 +1016,13 @@ HRESULT CDatabase::Open()
       return S_FALSE;
     */
 
-    if (Header.IsFat32())
+    if (Header.IsExFat)
+    {
+      // free clusters are counted later from allocation bitmap
+      NumFreeClusters = 0;
+      numFreeClustersDefined = true;
+    }
+    else if (Header.IsFat32())
     {
       SeekToSector(Header.FsInfoSector);
       RINOK(ReadStream_FALSE(InStream, buf, kHeaderSize));
@@ -683,7 +1061,18 @@ HRESULT CDatabase::Open()
 
       const UInt32 *src = (const UInt32 *)(const Byte *)byteBuf;
       UInt32 *dest = Fat + i;
-      if (numFreeClustersDefined)
+      if (Header.IsExFat)
+      {
+        // exFAT uses all 32 bits. We map end of chain and bad cluster markers to FAT32 values.
+        for (UInt32 j = 0; j < size; j++)
+        {
+          UInt32 v = Get32(src + j);
+          if (v > 0x0FFFFFFF)
+            v = (v >= 0xFFFFFFF7) ? (v & 0x0FFFFFFF) : Header.BadCluster;
+          dest[j] = v;
+        }
+      }
+      else if (numFreeClustersDefined)
         for (UInt32 j = 0; j < size; j++)
           dest[j] = Get32(src + j) & 0x0FFFFFFF;
       else
@@ -734,7 +1123,15 @@ HRESULT CDatabase::Open()
   if ((Fat[0] & 0xFF) != Header.MediaType)
      return S_FALSE;
 
-  RINOK(ReadDir(-1, Header.RootCluster, 0));
+  if (Header.IsExFat)
+  {
+    RINOK(ReadExFatDir(-1, Header.RootCluster, 0, false, 0));
+    RINOK(ReadExFatBitmap());
+  }
+  else
+  {
+    RINOK(ReadDir(-1, Header.RootCluster, 0));
+  }
 
   PhySize = Header.GetPhySize();
   return S_OK;
@@ -757,39 +1154,14 @@ STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
   COM_TRY_BEGIN
   *stream = 0;
   const CItem &item = Items[index];
-  CClusterInStream *streamSpec = new CClusterInStream;
+  // the stream can't return zeros after ValidSize of exFAT file
+  if (item.IsDir() || item.ValidSize != item.Size)
+    return S_FALSE;
+  CExtentsStream *streamSpec = new CExtentsStream;
   CMyComPtr<ISequentialInStream> streamTemp = streamSpec;
+  RINOK(GetExtents(item, streamSpec->Extents));
   streamSpec->Stream = InStream;
-  streamSpec->StartOffset = Header.DataSector << Header.SectorSizeLog;
-  streamSpec->BlockSizeLog = Header.ClusterSizeLog;
-  streamSpec->Size = item.Size;
-
-  UInt32 numClusters = Header.GetNumClusters(item.Size);
-  streamSpec->Vector.ClearAndReserve(numClusters);
-  UInt32 cluster = item.Cluster;
-  UInt32 size = item.Size;
-
-  if (size == 0)
-  {
-    if (cluster != 0)
-      return S_FALSE;
-  }
-  else
-  {
-    UInt32 clusterSize = Header.ClusterSize();
-    for (;; size -= clusterSize)
-    {
-      if (!Header.IsValidCluster(cluster))
-        return S_FALSE;
-      streamSpec->Vector.AddInReserved(cluster - 2);
-      cluster = Fat[cluster];
-      if (size <= clusterSize)
-        break;
-    }
-    if (!Header.IsEocAndUnused(cluster))
-      return S_FALSE;
-  }
-  RINOK(streamSpec->InitAndSeek());
+  streamSpec->Init();
   *stream = streamTemp.Detach();
   return S_OK;
   COM_TRY_END
@@ -839,18 +1211,29 @@ static const CStatProp kArcProps[] =
 IMP_IInArchive_Props
 IMP_IInArchive_ArcProps_WITH_NAME
 
-static void FatTimeToProp(UInt32 dosTime, UInt32 ms10, NWindows::NCOM::CPropVariant &prop)
+static void FatTimeToProp(UInt32 dosTime, UInt32 ms10, Byte utcOffset, NWindows::NCOM::CPropVariant &prop)
 {
   FILETIME localFileTime, utc;
-  if (NWindows::NTime::DosTimeToFileTime(dosTime, localFileTime))
-    if (LocalFileTimeToFileTime(&localFileTime, &utc))
-    {
-      UInt64 t64 = (((UInt64)utc.dwHighDateTime) << 32) + utc.dwLowDateTime;
-      t64 += ms10 * 100000;
-      utc.dwLowDateTime = (DWORD)t64;
-      utc.dwHighDateTime = (DWORD)(t64 >> 32);
-      prop = utc;
-    }
+  if (!NWindows::NTime::DosTimeToFileTime(dosTime, localFileTime))
+    return;
+  Int64 offset = 0;
+  if ((utcOffset & 0x80) != 0)
+  {
+    // exFAT: signed offset from UTC in 15-minute units
+    int v = utcOffset & 0x7F;
+    if (v >= 0x40)
+      v -= 0x80;
+    offset = (Int64)v * 15 * 60 * 10000000;
+    utc = localFileTime;
+  }
+  else if (!LocalFileTimeToFileTime(&localFileTime, &utc))
+    return;
+  UInt64 t64 = (((UInt64)utc.dwHighDateTime) << 32) + utc.dwLowDateTime;
+  t64 += ms10 * 100000;
+  t64 -= offset;
+  utc.dwLowDateTime = (DWORD)t64;
+  utc.dwHighDateTime = (DWORD)(t64 >> 32);
+  prop = utc;
 }
 
 /*
@@ -873,6 +1256,11 @@ STDMETHODIMP CHandler::GetArchiveProperty(PROPID propID, PROPVARIANT *value)
   {
     case kpidFileSystem:
     {
+      if (Header.IsExFat)
+      {
+        prop = "exFAT";
+        break;
+      }
       char s[16];
       s[0] = 'F';
       s[1] = 'A';
@@ -885,7 +1273,7 @@ STDMETHODIMP CHandler::GetArchiveProperty(PROPID propID, PROPVARIANT *value)
     case kpidPhySize: prop = PhySize; break;
     case kpidFreeSpace: prop = (UInt64)NumFreeClusters << Header.ClusterSizeLog; break;
     case kpidHeadersSize: prop = GetHeadersSize(); break;
-    case kpidMTime: if (VolItemDefined) FatTimeToProp(VolItem.MTime, 0, prop); break;
+    case kpidMTime: if (VolItemDefined && !Header.IsExFat) FatTimeToProp(VolItem.MTime, 0, 0, prop); break;
     case kpidShortComment:
     case kpidVolumeName: if (VolItemDefined) prop = VolItem.GetVolName(); break;
     case kpidNumFats: if (Header.NumFats != 2) prop = Header.NumFats; break;
@@ -911,11 +1299,11 @@ STDMETHODIMP CHandler::GetProperty(UInt32 index, PROPID propID, PROPVARIANT *val
   switch (propID)
   {
     case kpidPath: prop = GetItemPath(index); break;
-    case kpidShortName: prop = item.GetShortName(); break;
+    case kpidShortName: if (!Header.IsExFat) prop = item.GetShortName(); break;
     case kpidIsDir: prop = item.IsDir(); break;
-    case kpidMTime: FatTimeToProp(item.MTime, 0, prop); break;
-    case kpidCTime: FatTimeToProp(item.CTime, item.CTime2, prop); break;
-    case kpidATime: FatTimeToProp(((UInt32)item.ADate << 16), 0, prop); break;
+    case kpidMTime: FatTimeToProp(item.MTime, item.MTime2, item.MTimeZone, prop); break;
+    case kpidCTime: FatTimeToProp(item.CTime, item.CTime2, item.CTimeZone, prop); break;
+    case kpidATime: FatTimeToProp(item.ATime, 0, item.ATimeZone, prop); break;
     case kpidAttrib: prop = (UInt32)item.Attrib; break;
     case kpidSize: if (!item.IsDir()) prop = item.Size; break;
     case kpidPackSize: if (!item.IsDir()) prop = Header.GetFilePackSize(item.Size); break;
@@ -955,6 +1343,22 @@ STDMETHODIMP CHandler::Close()
   return S_OK;
 }
 
+static HRESULT WriteZeros(ISequentialOutStream *outStream, UInt64 size)
+{
+  const size_t kBufSize = (size_t)1 << 16;
+  CByteBuffer buf(kBufSize);
+  memset(buf, 0, kBufSize);
+  while (size != 0)
+  {
+    size_t cur = kBufSize;
+    if (cur > size)
+      cur = (size_t)size;
+    RINOK(WriteStream(outStream, buf, cur));
+    size -= cur;
+  }
+  return S_OK;
+}
+
 STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback)
 {
@@ -977,62 +1381,120 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   UInt64 totalPackSize;
   totalSize = totalPackSize = 0;
   
-  NCompress::CCopyCoder *copyCoderSpec = new NCompress::CCopyCoder();
-  CMyComPtr<ICompressCoder> copyCoder = copyCoderSpec;
-
   CLocalProgress *lps = new CLocalProgress;
   CMyComPtr<ICompressProgressInfo> progress = lps;
   lps->Init(extractCallback, false);
 
-  CDummyOutStream *outStreamSpec = new CDummyOutStream;
-  CMyComPtr<ISequentialOutStream> outStream(outStreamSpec);
+  /* Cluster chains of group of small items are converted to runs of clusters.
+     The runs are read to memory in order of physical position, and the items
+     are sent to callback in original order. Big items are copied directly by runs. */
 
-  for (i = 0; i < numItems; i++)
+  CExtentsReader reader;
+  CRecordVector<CSeekExtent> extents;
+  CBoolVector chainIsOK;
+
+  for (i = 0; i < numItems;)
   {
     lps->InSize = totalPackSize;
     lps->OutSize = totalSize;
     RINOK(lps->SetCur());
-    CMyComPtr<ISequentialOutStream> realOutStream;
-    Int32 askMode = testMode ?
-        NExtract::NAskMode::kTest :
-        NExtract::NAskMode::kExtract;
-    Int32 index = allFilesMode ? i : indices[i];
-    const CItem &item = Items[index];
-    RINOK(extractCallback->GetStream(index, &realOutStream, askMode));
 
-    if (item.IsDir())
+    reader.Clear();
+    chainIsOK.Clear();
+    UInt32 numBatchItems;
+
+    for (numBatchItems = 0; i + numBatchItems < numItems; numBatchItems++)
     {
-      RINOK(extractCallback->PrepareOperation(askMode));
-      RINOK(extractCallback->SetOperationResult(NExtract::NOperationResult::kOK));
-      continue;
+      const CItem &item = Items[allFilesMode ? i + numBatchItems : indices[i + numBatchItems]];
+      const UInt64 size = item.IsDir() ? 0 : item.ValidSize;
+      if (size > CExtentsReader::kReadSize
+          || reader.GetDataSize() + size > CExtentsReader::kBufSize)
+        break;
+      reader.AddItem();
+      bool isOK = true;
+      if (!item.IsDir())
+      {
+        isOK = (GetExtents(item, extents) == S_OK);
+        if (isOK)
+          for (unsigned e = 0; e + 1 < extents.Size(); e++)
+            reader.AddExtent(extents[e].Phy, (size_t)(extents[e + 1].Virt - extents[e].Virt));
+      }
+      chainIsOK.Add(isOK);
     }
 
-    totalPackSize += Header.GetFilePackSize(item.Size);
-    totalSize += item.Size;
-
-    if (!testMode && !realOutStream)
-      continue;
-    RINOK(extractCallback->PrepareOperation(askMode));
+    if (numBatchItems != 0)
+    {
+      RINOK(reader.Read(InStream, progress));
+    }
 
-    outStreamSpec->SetStream(realOutStream);
-    realOutStream.Release();
-    outStreamSpec->Init();
+    // if (numBatchItems == 0), we copy one big item directly
+    const UInt32 numCurItems = (numBatchItems == 0) ? 1 : numBatchItems;
 
-    int res = NExtract::NOperationResult::kDataError;
-    CMyComPtr<ISequentialInStream> inStream;
-    HRESULT hres = GetStream(index, &inStream);
-    if (hres != S_FALSE)
+    for (UInt32 k = 0; k < numCurItems; k++, i++)
     {
-      RINOK(hres);
-      if (inStream)
+      CMyComPtr<ISequentialOutStream> realOutStream;
+      Int32 askMode = testMode ?
+          NExtract::NAskMode::kTest :
+          NExtract::NAskMode::kExtract;
+      Int32 index = allFilesMode ? i : indices[i];
+      const CItem &item = Items[index];
+      RINOK(extractCallback->GetStream(index, &realOutStream, askMode));
+
+      if (item.IsDir())
+      {
+        RINOK(extractCallback->PrepareOperation(askMode));
+        RINOK(extractCallback->SetOperationResult(NExtract::NOperationResult::kOK));
+        continue;
+      }
+
+      const UInt64 packPos = totalPackSize;
+      const UInt64 unpackPos = totalSize;
+      totalPackSize += Header.GetFilePackSize(item.Size);
+      totalSize += item.Size;
+
+      if (!testMode && !realOutStream)
+        continue;
+      RINOK(extractCallback->PrepareOperation(askMode));
+
+      bool isOK;
+      UInt64 processed = 0;
+      if (numBatchItems != 0)
+      {
+        isOK = chainIsOK[k];
+        if (isOK)
+        {
+          RINOK(reader.WriteItem(k, realOutStream, processed));
+        }
+      }
+      else
       {
-        RINOK(copyCoder->Code(inStream, outStream, NULL, NULL, progress));
-        if (copyCoderSpec->TotalSize == item.Size)
-          res = NExtract::NOperationResult::kOK;
+        isOK = (GetExtents(item, extents) == S_OK);
+        if (isOK)
+          for (unsigned e = 0; e + 1 < extents.Size(); e++)
+          {
+            lps->InSize = packPos + processed;
+            lps->OutSize = unpackPos + processed;
+            const UInt64 size = extents[e + 1].Virt - extents[e].Virt;
+            UInt64 cur;
+            RINOK(reader.CopyExtent(InStream, extents[e].Phy, size, realOutStream, progress, cur));
+            processed += cur;
+            if (cur != size)
+              break;
+          }
+      }
+
+      int res = NExtract::NOperationResult::kDataError;
+      if (isOK && processed == item.ValidSize)
+      {
+        if (realOutStream && item.Size != item.ValidSize)
+        {
+          RINOK(WriteZeros(realOutStream, item.Size - item.ValidSize));
+        }
+        res = NExtract::NOperationResult::kOK;
       }
+      realOutStream.Release();
+      RINOK(extractCallback->SetOperationResult(res));
     }
-    outStreamSpec->ReleaseStream();
-    RINOK(extractCallback->SetOperationResult(res));
   }
   return S_OK;
   COM_TRY_END
@@ -4,17 +4,21 @@
 
 // #include  <stdio.h>
 
+#include "../../../C/7zCrc.h"
 #include "../../../C/CpuArch.h"
 
 #include "../../Common/ComTry.h"
 #include "../../Common/Defs.h"
+#include "../../Common/MyBuffer.h"
 #include "../../Common/StringConvert.h"
 
 #include "../../Windows/PropVariant.h"
 #include "../../Windows/TimeUtils.h"
 
+#include "../Common/LimitedStreams.h"
 #include "../Common/ProgressUtils.h"
 #include "../Common/RegisterArc.h"
+#include "../Common/StreamObjects.h"
 #include "../Common/StreamUtils.h"
 
 #include "../Compress/CopyCoder.h"
@@ -25,7 +29,9 @@
 #include "Common/InStreamWithCRC.h"
 #include "Common/OutStreamWithCRC.h"
 
+#define Get16(p) GetUi16(p)
 #define Get32(p) GetUi32(p)
+#define Get64(p) GetUi64(p)
 
 using namespace NWindows;
 
@@ -446,9 +452,357 @@ HRESULT CItem::WriteFooter(ISequentialOutStream *stream)
   return WriteStream(stream, buf, 8);
 }
 
+/*
+  CSeekInStream provides random access to unpacked data of seekable gzip archive.
+  While it decodes data first time, it stores access points at the starts of
+  deflate blocks after every kAccessPointStep bytes of unpacked data.
+  Each access point contains the position of block in packed stream and
+  up to 32 KB of unpacked data before that block (the history for matches).
+  Then Seek() + Read() decodes data from nearest previous access point.
+  Seek() from the end decodes all remaining data at first call.
+  CRC of gzip stream is checked only if that stream was decoded from its start.
+*/
+
+static const UInt32 kAccessPointStep = (UInt32)1 << 20;
+
+/*
+  7-Zip can split data to independent gzip streams of same unpack size (-ms={Size}).
+  Then it writes the index of these streams in the extra field of last empty gzip stream:
+    SI1 SI2 : '7' 'i'
+    for each gzip stream after first stream:
+      UInt64 UnpackPos
+      UInt64 Distance  // from the start of gzip stream to the start of index stream
+    UInt64 UnpackSize
+    UInt32 NumPoints
+    UInt32 Crc         // CRC of previous bytes of subfield
+  Distances are counted from the end, so the header of first stream can be changed.
+  CSeekInStream uses the index as the list of access points and as the unpack size.
+  Other gzip decoders unpack such archive as usual, since the index stream is empty.
+*/
+
+namespace NIndex
+{
+  static const Byte kSubfieldId_1 = '7';
+  static const Byte kSubfieldId_2 = 'i';
+  
+  static const unsigned kHeaderSize = 10 + 2 + 4; // gzip header, XLEN, subfield header
+  static const unsigned kPointSize = 16;
+  static const unsigned kFooterSize = 16;
+  static const unsigned kTailSize = 2 + 8; // empty deflate block and gzip footer
+  static const unsigned kMaxPoints = (0xFFFF - 4 - kFooterSize) / kPointSize;
+  
+  static const Byte kEmptyBlock_0 = 3; // final block with fixed huffman codes and end code
+  static const Byte kEmptyBlock_1 = 0;
+}
+
+struct CIndexPoint
+{
+  UInt64 UnpackPos;
+  UInt64 PackPos;
+};
+
+struct CAccessPoint
+{
+  UInt64 UnpackPos;
+  UInt64 PackBitPos;
+  bool IsStreamStart; // the point is at the start of gzip header
+  CByteBuffer History;
+};
+
+class CSeekInStream:
+  public IInStream,
+  public CMyUnknownImp
+{
+  enum EState
+  {
+    kState_Header,
+    kState_Data,
+    kState_Finished
+  };
+
+  CMyComPtr<ICompressCoder> _decoder;
+  NDecoder::CCOMCoder *_decoderSpec;
+  
+  CObjectVector<CAccessPoint> _points;
+  CByteBuffer _buf;
+  
+  EState _state;
+  bool _decoderIsReady;
+  bool _headerIsRequired; // decoder was initialized at the start of gzip stream
+  bool _sizeDefined;
+  bool _crcIsActive;
+  UInt32 _crc;
+  UInt64 _size;
+  UInt64 _virtPos;
+  UInt64 _curPos;
+  UInt64 _streamStartPos; // unpack position of current gzip stream
+  UInt64 _inStartPos;     // position in packed stream, where decoder was initialized
+
+  HRESULT InitFromPoint(unsigned pointIndex);
+  HRESULT AddPoint();
+  HRESULT ReadStreamHeader();
+  HRESULT ReadStreamFooter();
+  HRESULT DecodeData(Byte *data, UInt32 size, UInt32 &processed);
+  HRESULT SkipTo(UInt64 pos);
+public:
+  CMyComPtr<IInStream> InStream;
+  CMyComPtr<IUnknown> HandlerRef;
+
+  MY_UNKNOWN_IMP2(ISequentialInStream, IInStream)
+  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
+
+  HRESULT Init();
+  void SetIndex(const CRecordVector<CIndexPoint> &points, UInt64 size);
+};
+
+HRESULT CSeekInStream::Init()
+{
+  _decoderSpec = new NDecoder::CCOMCoder;
+  _decoder = _decoderSpec;
+  _decoderSpec->Set_StopAtBlockEnd(true);
+  _decoderSpec->SetInStream(InStream);
+  _buf.Alloc(kHistorySize32 << 1);
+  
+  CAccessPoint &p = _points.AddNew();
+  p.UnpackPos = 0;
+  p.PackBitPos = 0;
+  p.IsStreamStart = true;
+
+  _decoderIsReady = false;
+  _sizeDefined = false;
+  _size = 0;
+  _virtPos = 0;
+  _curPos = 0;
+  return S_OK;
+}
+
+void CSeekInStream::SetIndex(const CRecordVector<CIndexPoint> &points, UInt64 size)
+{
+  FOR_VECTOR (i, points)
+  {
+    CAccessPoint &p = _points.AddNew();
+    p.UnpackPos = points[i].UnpackPos;
+    p.PackBitPos = points[i].PackPos << 3;
+    p.IsStreamStart = true;
+  }
+  _size = size;
+  _sizeDefined = true;
+}
+
+HRESULT CSeekInStream::InitFromPoint(unsigned pointIndex)
+{
+  const CAccessPoint &p = _points[pointIndex];
+  _decoderIsReady = false;
+  _inStartPos = p.PackBitPos >> 3;
+  RINOK(InStream->Seek(_inStartPos, STREAM_SEEK_SET, NULL));
+  _curPos = p.UnpackPos;
+  _crcIsActive = false;
+  _headerIsRequired = p.IsStreamStart;
+  if (p.IsStreamStart)
+  {
+    RINOK(_decoderSpec->InitInStream(true));
+    _state = kState_Header;
+  }
+  else
+  {
+    RINOK(_decoderSpec->InitAtBlockStart(p.History, (UInt32)p.History.Size(), (unsigned)p.PackBitPos & 7));
+    _state = kState_Data;
+  }
+  _decoderIsReady = true;
+  return S_OK;
+}
+
+HRESULT CSeekInStream::AddPoint()
+{
+  CAccessPoint &p = _points.AddNew();
+  p.UnpackPos = _curPos;
+  p.PackBitPos = (_inStartPos << 3) + _decoderSpec->GetInputProcessedBits();
+  p.IsStreamStart = false;
+  UInt32 size = _decoderSpec->GetHistory(_buf, kHistorySize32);
+  p.History.CopyFrom(_buf, size);
+  return S_OK;
+}
+
+HRESULT CSeekInStream::ReadStreamHeader()
+{
+  CItem item;
+  HRESULT res = item.ReadHeader(_decoderSpec);
+  if (res != S_OK && res != S_FALSE)
+    return res;
+  if (res != S_OK || _decoderSpec->InputEofError())
+  {
+    // there are no more gzip streams. Tail data is ignored as in Extract()
+    if (_headerIsRequired)
+      return S_FALSE;
+    _state = kState_Finished;
+    _size = _curPos;
+    _sizeDefined = true;
+    return S_OK;
+  }
+  _decoderSpec->InitForNextStream();
+  _headerIsRequired = false;
+  _state = kState_Data;
+  _crcIsActive = true;
+  _crc = CRC_INIT_VAL;
+  _streamStartPos = _curPos;
+  return S_OK;
+}
+
+HRESULT CSeekInStream::ReadStreamFooter()
+{
+  _decoderSpec->AlignToByte();
+  CItem item;
+  RINOK(item.ReadFooter1(_decoderSpec));
+  if (_crcIsActive)
+    if (item.Crc != CRC_GET_DIGEST(_crc) ||
+        item.Size32 != (UInt32)(_curPos - _streamStartPos))
+      return S_FALSE;
+  _state = kState_Header;
+  return S_OK;
+}
+
+HRESULT CSeekInStream::DecodeData(Byte *data, UInt32 size, UInt32 &processed)
+{
+  processed = 0;
+  
+  try
+  {
+    while (size != 0 && _state != kState_Finished)
+    {
+      if (_state == kState_Header)
+      {
+        RINOK(ReadStreamHeader());
+        continue;
+      }
+      
+      if (_decoderSpec->IsAtBlockStart()
+          && _curPos >= _points.Back().UnpackPos + kAccessPointStep)
+      {
+        RINOK(AddPoint());
+      }
+      
+      UInt32 cur = 0;
+      RINOK(_decoderSpec->Read(data, size, &cur));
+      if (_decoderSpec->InputEofError())
+        return S_FALSE;
+      if (_crcIsActive)
+        _crc = CrcUpdate(_crc, data, cur);
+      data += cur;
+      size -= cur;
+      processed += cur;
+      _curPos += cur;
+      
+      if (_decoderSpec->IsFinished())
+      {
+        RINOK(ReadStreamFooter());
+      }
+    }
+  }
+  catch(const CInBufferException &e) { return e.ErrorCode; }
+  
+  return S_OK;
+}
+
+HRESULT CSeekInStream::SkipTo(UInt64 pos)
+{
+  while (_curPos < pos && _state != kState_Finished)
+  {
+    UInt64 rem = pos - _curPos;
+    UInt32 size = (UInt32)_buf.Size();
+    if (size > rem)
+      size = (UInt32)rem;
+    UInt32 processed;
+    RINOK(DecodeData(_buf, size, processed));
+  }
+  return S_OK;
+}
+
+STDMETHODIMP CSeekInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (processedSize)
+    *processedSize = 0;
+  if (size == 0)
+    return S_OK;
+  if (_sizeDefined)
+  {
+    if (_virtPos >= _size)
+      return S_OK;
+    const UInt64 rem = _size - _virtPos;
+    if (size > rem)
+      size = (UInt32)rem;
+  }
+
+  if (!_decoderIsReady || _curPos != _virtPos)
+  {
+    unsigned left = 0, right = _points.Size();
+    while (right - left > 1)
+    {
+      const unsigned mid = (left + right) / 2;
+      if (_points[mid].UnpackPos <= _virtPos)
+        left = mid;
+      else
+        right = mid;
+    }
+    if (!_decoderIsReady || _curPos > _virtPos || _curPos < _points[left].UnpackPos)
+    {
+      RINOK(InitFromPoint(left));
+    }
+    RINOK(SkipTo(_virtPos));
+    if (_curPos != _virtPos)
+      return S_OK;
+  }
+
+  UInt32 processed;
+  HRESULT res = DecodeData((Byte *)data, size, processed);
+  _virtPos += processed;
+  if (processedSize)
+    *processedSize = processed;
+  if (res != S_OK)
+    _decoderIsReady = false;
+  return res;
+}
+
+STDMETHODIMP CSeekInStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition)
+{
+  switch (seekOrigin)
+  {
+    case STREAM_SEEK_SET: break;
+    case STREAM_SEEK_CUR: offset += _virtPos; break;
+    case STREAM_SEEK_END:
+    {
+      if (!_sizeDefined)
+      {
+        // we decode all data from the latest position to get the size
+        if (!_decoderIsReady || _curPos < _points.Back().UnpackPos)
+        {
+          RINOK(InitFromPoint(_points.Size() - 1));
+        }
+        HRESULT res = SkipTo((UInt64)(Int64)-1);
+        if (res != S_OK)
+        {
+          _decoderIsReady = false;
+          return res;
+        }
+      }
+      offset += _size;
+      break;
+    }
+    default: return STG_E_INVALIDFUNCTION;
+  }
+  if (offset < 0)
+    return HRESULT_WIN32_ERROR_NEGATIVE_SEEK;
+  _virtPos = offset;
+  if (newPosition)
+    *newPosition = offset;
+  return S_OK;
+}
+
+
 class CHandler:
   public IInArchive,
   public IArchiveOpenSeq,
+  public IInArchiveGetStream,
   public IOutArchive,
   public ISetProperties,
   public CMyUnknownImp
@@ -469,24 +823,33 @@ class CHandler:
   UInt64 _numStreams;
   UInt64 _headerSize; // only start header (without footer)
   
+  bool _index_Defined;
+  UInt64 _indexUnpackSize;
+  CRecordVector<CIndexPoint> _indexPoints;
+
   CMyComPtr<IInStream> _stream;
   CMyComPtr<ICompressCoder> _decoder;
   NDecoder::CCOMCoder *_decoderSpec;
 
   CSingleMethodProps _props;
+  UInt64 _streamSize; // unpack size of each gzip stream. 0 : one gzip stream
+
+  HRESULT ReadIndex(IInStream *stream);
 
 public:
-  MY_UNKNOWN_IMP4(
+  MY_UNKNOWN_IMP5(
       IInArchive,
       IArchiveOpenSeq,
+      IInArchiveGetStream,
       IOutArchive,
       ISetProperties)
   INTERFACE_IInArchive(;)
   INTERFACE_IOutArchive(;)
   STDMETHOD(OpenSeq)(ISequentialInStream *stream);
+  STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
   STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
 
-  CHandler()
+  CHandler(): _streamSize(0)
   {
     _decoderSpec = new NDecoder::CCOMCoder;
     _decoder = _decoderSpec;
@@ -577,6 +940,8 @@ STDMETHODIMP CHandler::GetProperty(UInt32 /* index */, PROPID propID, PROPVARIAN
     {
       if (_unpackSize_Defined)
         prop = _unpackSize;
+      else if (_index_Defined)
+        prop = _indexUnpackSize;
       else if (_stream)
         prop = (UInt64)_item.Size32;
       break;
@@ -589,7 +954,7 @@ STDMETHODIMP CHandler::GetProperty(UInt32 /* index */, PROPID propID, PROPVARIAN
     }
     case kpidHostOS: prop = (_item.HostOS < ARRAY_SIZE(kHostOSes)) ?
           kHostOSes[_item.HostOS] : kUnknownOS; break;
-    case kpidCRC: if (_stream) prop = _item.Crc; break;
+    case kpidCRC: if (_stream && !_index_Defined) prop = _item.Crc; break;
   }
   prop.Detach(value);
   return S_OK;
@@ -631,6 +996,7 @@ STDMETHODIMP CHandler::Open(IInStream *stream, const UInt64 *, IArchiveOpenCallb
   RINOK(stream->Seek(-8, STREAM_SEEK_END, &endPos));
   _packSize = endPos + 8;
   RINOK(_item.ReadFooter2(stream));
+  RINOK(ReadIndex(stream));
   _stream = stream;
   _isArc = true;
   _needSeekToStart = true;
@@ -638,6 +1004,78 @@ STDMETHODIMP CHandler::Open(IInStream *stream, const UInt64 *, IArchiveOpenCallb
   COM_TRY_END
 }
 
+// ReadIndex() returns S_OK, if there is no correct index
+
+HRESULT CHandler::ReadIndex(IInStream *stream)
+{
+  using namespace NIndex;
+  
+  Byte buf[kFooterSize + kTailSize];
+  if (_packSize < kHeaderSize + kFooterSize + kTailSize)
+    return S_OK;
+  RINOK(stream->Seek(_packSize - sizeof(buf), STREAM_SEEK_SET, NULL));
+  RINOK(ReadStream_FALSE(stream, buf, sizeof(buf)));
+  {
+    const Byte *p = buf + kFooterSize;
+    if (p[0] != kEmptyBlock_0 || p[1] != kEmptyBlock_1)
+      return S_OK;
+    for (unsigned i = 2; i < kTailSize; i++)
+      if (p[i] != 0)
+        return S_OK;
+  }
+  const UInt32 numPoints = Get32(buf + 8);
+  if (numPoints > kMaxPoints)
+    return S_OK;
+  const UInt32 dataSize = numPoints * kPointSize + kFooterSize;
+  const UInt32 indexSize = kHeaderSize + dataSize + kTailSize;
+  if (indexSize > _packSize)
+    return S_OK;
+  const UInt64 indexPos = _packSize - indexSize;
+  
+  CByteBuffer index(indexSize);
+  RINOK(stream->Seek(indexPos, STREAM_SEEK_SET, NULL));
+  RINOK(ReadStream_FALSE(stream, index, indexSize));
+  const Byte *p = index;
+  if (p[0] != kSignature_0
+      || p[1] != kSignature_1
+      || p[2] != kSignature_2
+      || p[3] != NFlags::kExtra
+      || Get16(p + 10) != dataSize + 4
+      || p[12] != kSubfieldId_1
+      || p[13] != kSubfieldId_2
+      || Get16(p + 14) != dataSize)
+    return S_OK;
+  p += kHeaderSize;
+  if (CrcCalc(p, dataSize - 4) != Get32(p + dataSize - 4))
+    return S_OK;
+  
+  const UInt64 unpackSize = Get64(p + numPoints * kPointSize);
+  UInt64 prevUnpackPos = 0;
+  UInt64 prevPackPos = 0;
+  _indexPoints.ClearAndReserve(numPoints);
+  for (UInt32 i = 0; i < numPoints; i++, p += kPointSize)
+  {
+    CIndexPoint point;
+    point.UnpackPos = Get64(p);
+    const UInt64 distance = Get64(p + 8);
+    if (point.UnpackPos <= prevUnpackPos
+        || point.UnpackPos >= unpackSize
+        || distance > indexPos
+        || indexPos - distance <= prevPackPos)
+    {
+      _indexPoints.Clear();
+      return S_OK;
+    }
+    point.PackPos = indexPos - distance;
+    prevUnpackPos = point.UnpackPos;
+    prevPackPos = point.PackPos;
+    _indexPoints.AddInReserved(point);
+  }
+  _indexUnpackSize = unpackSize;
+  _index_Defined = true;
+  return S_OK;
+}
+
 STDMETHODIMP CHandler::OpenSeq(ISequentialInStream *stream)
 {
   COM_TRY_BEGIN
@@ -671,6 +1109,10 @@ STDMETHODIMP CHandler::Close()
   _packSize = 0;
   _headerSize = 0;
   
+  _index_Defined = false;
+  _indexUnpackSize = 0;
+  _indexPoints.Clear();
+
   _stream.Release();
   _decoderSpec->ReleaseInStream();
   return S_OK;
@@ -866,6 +1308,24 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   COM_TRY_END
 }
 
+STDMETHODIMP CHandler::GetStream(UInt32 /* index */, ISequentialInStream **stream)
+{
+  COM_TRY_BEGIN
+  *stream = NULL;
+  if (!_stream)
+    return S_FALSE;
+  CSeekInStream *streamSpec = new CSeekInStream;
+  CMyComPtr<ISequentialInStream> streamTemp = streamSpec;
+  streamSpec->InStream = _stream;
+  streamSpec->HandlerRef = (IInArchive *)this;
+  RINOK(streamSpec->Init());
+  if (_index_Defined)
+    streamSpec->SetIndex(_indexPoints, _indexUnpackSize);
+  *stream = streamTemp.Detach();
+  return S_OK;
+  COM_TRY_END
+}
+
 static const Byte kHostOS =
   #ifdef _WIN32
   NHostOS::kFAT;
@@ -873,11 +1333,61 @@ static const Byte kHostOS =
   NHostOS::kUnix;
   #endif
 
+static HRESULT WriteIndex(ISequentialOutStream *outStream,
+    const CRecordVector<CIndexPoint> &points, UInt64 indexPos, UInt64 unpackSize)
+{
+  using namespace NIndex;
+  
+  // the index is limited by the size of extra field, so we can skip some points
+  unsigned step = (points.Size() + kMaxPoints - 1) / kMaxPoints;
+  if (step == 0)
+    step = 1;
+  const unsigned numPoints = (points.Size() + step - 1) / step;
+  const unsigned dataSize = numPoints * kPointSize + kFooterSize;
+  const unsigned indexSize = kHeaderSize + dataSize + kTailSize;
+  
+  CByteBuffer index(indexSize);
+  Byte *p = index;
+  memset(p, 0, indexSize);
+  p[0] = kSignature_0;
+  p[1] = kSignature_1;
+  p[2] = kSignature_2;
+  p[3] = NFlags::kExtra;
+  p[9] = kHostOS;
+  SetUi16(p + 10, (UInt16)(dataSize + 4));
+  p[12] = kSubfieldId_1;
+  p[13] = kSubfieldId_2;
+  SetUi16(p + 14, (UInt16)dataSize);
+  p += kHeaderSize;
+  
+  for (unsigned i = 0; i < points.Size(); i += step, p += kPointSize)
+  {
+    SetUi64(p, points[i].UnpackPos);
+    SetUi64(p + 8, indexPos - points[i].PackPos);
+  }
+  SetUi64(p, unpackSize);
+  SetUi32(p + 8, numPoints);
+  p += 12;
+  SetUi32(p, CrcCalc(index + kHeaderSize, dataSize - 4));
+  p += 4;
+  p[0] = kEmptyBlock_0;
+  p[1] = kEmptyBlock_1;
+  // CRC and size of empty stream are zeros
+  
+  return WriteStream(outStream, index, indexSize);
+}
+
+/*
+  if (streamSize != 0), UpdateArchive() writes new gzip stream after each
+  (streamSize) bytes of data, and it writes the index of gzip streams at the end.
+*/
+
 static HRESULT UpdateArchive(
     ISequentialOutStream *outStream,
     UInt64 unpackSize,
     CItem &item,
     const CSingleMethodProps &props,
+    UInt64 streamSize,
     IArchiveUpdateCallback *updateCallback)
 {
   UInt64 complexity = 0;
@@ -888,10 +1398,18 @@ static HRESULT UpdateArchive(
 
   RINOK(updateCallback->GetStream(0, &fileInStream));
 
+  CLimitedSequentialInStream *limitStreamSpec = new CLimitedSequentialInStream;
+  CMyComPtr<ISequentialInStream> limitStream(limitStreamSpec);
+  limitStreamSpec->SetStream(fileInStream);
+
   CSequentialInStreamWithCRC *inStreamSpec = new CSequentialInStreamWithCRC;
   CMyComPtr<ISequentialInStream> crcStream(inStreamSpec);
-  inStreamSpec->SetStream(fileInStream);
-  inStreamSpec->Init();
+  inStreamSpec->SetStream(limitStream);
+
+  CSequentialOutStreamSizeCount *outSizeStreamSpec = new CSequentialOutStreamSizeCount;
+  CMyComPtr<ISequentialOutStream> outSizeStream(outSizeStreamSpec);
+  outSizeStreamSpec->SetStream(outStream);
+  outSizeStreamSpec->Init();
 
   CLocalProgress *lps = new CLocalProgress;
   CMyComPtr<ICompressProgressInfo> progress = lps;
@@ -903,16 +1421,47 @@ static HRESULT UpdateArchive(
 
   item.HostOS = kHostOS;
 
-  RINOK(item.WriteHeader(outStream));
-
   NEncoder::CCOMCoder *deflateEncoderSpec = new NEncoder::CCOMCoder;
   CMyComPtr<ICompressCoder> deflateEncoder = deflateEncoderSpec;
   RINOK(props.SetCoderProps(deflateEncoderSpec, NULL));
-  RINOK(deflateEncoder->Code(crcStream, outStream, NULL, NULL, progress));
 
-  item.Crc = inStreamSpec->GetCRC();
-  item.Size32 = (UInt32)inStreamSpec->GetSize();
-  RINOK(item.WriteFooter(outStream));
+  CRecordVector<CIndexPoint> points;
+  UInt64 unpackPos = 0;
+
+  for (;;)
+  {
+    const UInt64 packPos = outSizeStreamSpec->GetSize();
+    limitStreamSpec->Init(streamSize != 0 ? streamSize : (UInt64)(Int64)-1);
+    inStreamSpec->Init();
+    
+    RINOK(item.WriteHeader(outSizeStream));
+    RINOK(deflateEncoder->Code(crcStream, outSizeStream, NULL, NULL, progress));
+    item.Crc = inStreamSpec->GetCRC();
+    item.Size32 = (UInt32)inStreamSpec->GetSize();
+    RINOK(item.WriteFooter(outSizeStream));
+
+    const UInt64 size = inStreamSpec->GetSize();
+    if (unpackPos != 0 && size != 0)
+    {
+      CIndexPoint point;
+      point.UnpackPos = unpackPos;
+      point.PackPos = packPos;
+      points.Add(point);
+    }
+    unpackPos += size;
+    if (streamSize == 0 || size != streamSize || limitStreamSpec->WasFinished())
+      break;
+    
+    lps->InSize = unpackPos;
+    lps->OutSize = outSizeStreamSpec->GetSize();
+    // the name is stored only in first gzip stream
+    item.Flags = (Byte)(item.Flags & ~NFlags::kName);
+  }
+
+  if (streamSize != 0)
+  {
+    RINOK(WriteIndex(outSizeStream, points, outSizeStreamSpec->GetSize(), unpackPos));
+  }
   return updateCallback->SetOperationResult(NUpdate::NOperationResult::kOK);
 }
 
@@ -990,7 +1539,7 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
         return E_INVALIDARG;
       size = prop.uhVal.QuadPart;
     }
-    return UpdateArchive(outStream, size, newItem, _props, updateCallback);
+    return UpdateArchive(outStream, size, newItem, _props, _streamSize, updateCallback);
   }
 
   if (indexInArchive != 0)
@@ -1029,7 +1578,26 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
 
 STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps)
 {
-  return _props.SetProperties(names, values, numProps);
+  CRecordVector<const wchar_t *> names2;
+  CRecordVector<PROPVARIANT> values2;
+  _streamSize = 0;
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    if (!name.IsEmpty() && name[0] == 's')
+    {
+      // s={Size} : the size of unpacked data in each gzip stream
+      name.Delete(0);
+      RINOK(ParsePropToSize(name, values[i], _streamSize));
+      continue;
+    }
+    names2.Add(names[i]);
+    values2.Add(values[i]);
+  }
+  if (names2.IsEmpty())
+    return _props.SetProperties(NULL, NULL, 0);
+  return _props.SetProperties(&names2.Front(), &values2.Front(), names2.Size());
 }
 
 static const Byte k_Signature[] = { kSignature_0, kSignature_1, kSignature_2 };
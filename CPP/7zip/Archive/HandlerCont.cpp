@@ -260,6 +260,165 @@ STDMETHODIMP CHandlerImg::Extract(const UInt32 *indices, UInt32 numItems,
 }
 
 
+#ifndef _7ZIP_ST
+
+void CClusterDecodeJob::Alloc(Func_CreateClusterDecoder createDecoder, size_t packedSizeMax)
+{
+  if (!Decoder)
+    Decoder = createDecoder();
+  if (Packed.Size() < packedSizeMax)
+    Packed.Alloc(packedSizeMax);
+}
+
+HRESULT CClusterDecodeJob::Decode()
+{
+  return Decoder->Decode(Packed, PackedSize, Dest, DestSize);
+}
+
+#endif
+
+
+static const UInt64 kEmptyClusterKey = (UInt64)(Int64)-1;
+
+CClusterCache::CClusterCache():
+    _slotSize(0),
+    _time(0),
+    _lastSlot(0)
+    #ifndef _7ZIP_ST
+    , _numJobs(0)
+    #endif
+    {}
+
+void CClusterCache::Alloc(size_t slotSize, size_t cacheSizeMax)
+{
+  size_t numSlots = cacheSizeMax / slotSize;
+  if (numSlots < 2)
+    numSlots = 2;
+  if (slotSize != _slotSize || numSlots != _slots.Size())
+  {
+    _data.Free();
+    _slots.Clear();
+    _data.Alloc(slotSize * numSlots);
+    _slotSize = slotSize;
+    for (size_t i = 0; i < numSlots; i++)
+    {
+      CSlot slot;
+      slot.UseTime = 0;
+      slot.DataSize = 0;
+      _slots.Add(slot);
+    }
+    Clear();
+  }
+}
+
+void CClusterCache::Free()
+{
+  _data.Free();
+  _slots.Clear();
+  _slotSize = 0;
+  _lastSlot = 0;
+}
+
+void CClusterCache::Clear()
+{
+  FOR_VECTOR (i, _slots)
+  {
+    CSlot &slot = _slots[i];
+    slot.Key = kEmptyClusterKey;
+    slot.UseTime = 0;
+  }
+  _time = 0;
+  _lastSlot = 0;
+}
+
+const Byte *CClusterCache::Find(UInt64 key, size_t &dataSize)
+{
+  if (_slots.IsEmpty())
+    return NULL;
+  if (_slots[_lastSlot].Key != key)
+  {
+    unsigned i;
+    for (i = 0; i < _slots.Size(); i++)
+      if (_slots[i].Key == key)
+        break;
+    if (i == _slots.Size())
+      return NULL;
+    _lastSlot = i;
+  }
+  CSlot &slot = _slots[_lastSlot];
+  slot.UseTime = ++_time;
+  dataSize = slot.DataSize;
+  return GetSlotData(_lastSlot);
+}
+
+bool CClusterCache::IsCached(UInt64 key) const
+{
+  FOR_VECTOR (i, _slots)
+    if (_slots[i].Key == key)
+      return true;
+  return false;
+}
+
+unsigned CClusterCache::GetNewSlot()
+{
+  unsigned best = 0;
+  for (unsigned i = 1; i < _slots.Size(); i++)
+    if (_slots[i].UseTime < _slots[best].UseTime)
+      best = i;
+  CSlot &slot = _slots[best];
+  slot.Key = kEmptyClusterKey;
+  slot.UseTime = ++_time;
+  return best;
+}
+
+#ifndef _7ZIP_ST
+
+HRESULT CClusterCache::CreateThreads(unsigned numThreads, Func_CreateClusterDecoder createDecoder, size_t packedSizeMax)
+{
+  // the jobs of one batch must not replace each other in cache
+  RINOK(_threads.Create(numThreads, _slots.Size()));
+  _jobs.SetSize(_threads.Size());
+  for (unsigned i = 0; i < _jobs.Size(); i++)
+    _jobs[i].Alloc(createDecoder, packedSizeMax);
+  return S_OK;
+}
+
+CClusterDecodeJob &CClusterCache::AddJob(UInt64 key)
+{
+  CClusterDecodeJob &job = _jobs[_numJobs++];
+  job.Key = key;
+  job.SlotIndex = GetNewSlot();
+  job.Dest = GetSlotData(job.SlotIndex);
+  job.DestSize = _slotSize;
+  job.PackedSize = 0;
+  return job;
+}
+
+HRESULT CClusterCache::DecodeJobs()
+{
+  unsigned numJobs = _numJobs;
+  _numJobs = 0;
+  unsigned i;
+  for (i = 0; i < numJobs; i++)
+    _threads[i].StartJob(&_jobs[i]);
+  HRESULT res = S_OK;
+  for (i = 0; i < numJobs; i++)
+  {
+    const CClusterDecodeJob &job = _jobs[i];
+    HRESULT jobRes = _threads[i].WaitJob();
+    if (jobRes == S_OK)
+      SetSlotKey(job.SlotIndex, job.Key, job.DestSize);
+    else
+      _slots[job.SlotIndex].UseTime = 0;
+    if (i == 0)
+      res = jobRes;
+  }
+  return res;
+}
+
+#endif
+
+
 HRESULT ReadZeroTail(ISequentialInStream *stream, bool &areThereNonZeros, UInt64 &numZeros, UInt64 maxSize)
 {
   areThereNonZeros = false;
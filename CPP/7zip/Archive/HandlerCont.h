@@ -3,8 +3,11 @@
 #ifndef __HANDLER_CONT_H
 #define __HANDLER_CONT_H
 
+#include "../../Common/MyBuffer.h"
 #include "../../Common/MyCom.h"
 
+#include "../Common/DecodeThreads.h"
+
 #include "IArchive.h"
 
 namespace NArchive {
@@ -109,6 +112,121 @@ public:
 };
 
 
+/*
+  CClusterDecoder unpacks one compressed cluster (block) of disk image or file system.
+  (destSize) is the size of (dest) buffer on input and the size of unpacked data on output.
+  It must return S_FALSE, if the data is not correct.
+*/
+
+struct CClusterDecoder
+{
+  virtual HRESULT Decode(const Byte *src, size_t srcSize, Byte *dest, size_t &destSize) = 0;
+  virtual ~CClusterDecoder() {}
+};
+
+typedef CClusterDecoder * (*Func_CreateClusterDecoder)();
+
+
+#ifndef _7ZIP_ST
+
+struct CClusterDecodeJob: public CDecodeJob
+{
+  CClusterDecoder *Decoder;
+  CByteBuffer Packed;
+  size_t PackedSize;
+  UInt64 Key;
+  unsigned SlotIndex;
+  Byte *Dest;
+  size_t DestSize;
+
+  CClusterDecodeJob(): Decoder(NULL) {}
+  ~CClusterDecodeJob() { delete Decoder; }
+  void Alloc(Func_CreateClusterDecoder createDecoder, size_t packedSizeMax);
+  virtual HRESULT Decode();
+};
+
+#endif
+
+
+/*
+  CClusterCache keeps up to (NumSlots) unpacked clusters of disk image
+  (or unpacked blocks of file system).
+  If there is no free slot, the least recently used cluster is replaced.
+  (Key) is any value that identifies the cluster in handler.
+
+  The handler can create threads to unpack compressed clusters in parallel:
+  if it detects sequential reading, it adds the requested cluster and the
+  next compressed clusters as jobs (AddJob), fills packed data of each job,
+  and calls DecodeJobs(). Packed data must be read by the caller thread,
+  so the threads only unpack data that is already in memory.
+*/
+
+// default size of memory for unpacked clusters in image handlers
+const size_t kClusterCacheSize = (size_t)1 << 24;
+
+class CClusterCache
+{
+  struct CSlot
+  {
+    UInt64 Key;
+    UInt64 UseTime;
+    size_t DataSize;
+  };
+
+  CByteBuffer _data;
+  CRecordVector<CSlot> _slots;
+  size_t _slotSize;
+  UInt64 _time;
+  unsigned _lastSlot;
+
+  #ifndef _7ZIP_ST
+  CObjArray2<CClusterDecodeJob> _jobs;
+  CDecodeThreads _threads;
+  unsigned _numJobs;
+  #endif
+
+public:
+  CClusterCache();
+
+  /* numSlots is calculated from cacheSizeMax, but it's not smaller than 2.
+     The cached clusters are kept, if the size of cache was not changed. */
+  void Alloc(size_t slotSize, size_t cacheSizeMax);
+  void Free();
+  void Clear();
+  unsigned NumSlots() const { return _slots.Size(); }
+  
+  const Byte *Find(UInt64 key, size_t &dataSize);
+  const Byte *Find(UInt64 key)
+  {
+    size_t dataSize;
+    return Find(key, dataSize);
+  }
+  bool IsCached(UInt64 key) const;
+
+  // it returns least recently used slot. Key of returned slot is cleared.
+  unsigned GetNewSlot();
+  Byte *GetSlotData(unsigned slotIndex) { return _data + _slotSize * slotIndex; }
+  void SetSlotKey(unsigned slotIndex, UInt64 key, size_t dataSize)
+  {
+    CSlot &slot = _slots[slotIndex];
+    slot.Key = key;
+    slot.DataSize = dataSize;
+  }
+  void SetSlotKey(unsigned slotIndex, UInt64 key) { SetSlotKey(slotIndex, key, _slotSize); }
+
+  #ifndef _7ZIP_ST
+  HRESULT CreateThreads(unsigned numThreads, Func_CreateClusterDecoder createDecoder, size_t packedSizeMax);
+  unsigned GetNumThreads() const { return _threads.Size(); }
+  unsigned GetNumJobs() const { return _numJobs; }
+  CClusterDecoder *GetThreadDecoder(unsigned index) { return _jobs[index].Decoder; }
+  // it returns buffer for packed data of new job. The caller must set (PackedSize).
+  CClusterDecodeJob &AddJob(UInt64 key);
+  // it returns the result of first job. Failed next jobs are not cached.
+  HRESULT DecodeJobs();
+  #endif
+};
+
+
 HRESULT ReadZeroTail(ISequentialInStream *stream, bool &areThereNonZeros, UInt64 &numZeros, UInt64 maxSize);
 
 }
@@ -9,6 +9,7 @@
 
 #include "../../Windows/PropVariant.h"
 
+#include "../Common/DecodeThreads.h"
 #include "../Common/LimitedStreams.h"
 #include "../Common/RegisterArc.h"
 #include "../Common/StreamObjects.h"
@@ -299,6 +300,7 @@ struct CRef
 
 class CDatabase
 {
+  bool CheckForkExtents(const CFork &fork) const;
   HRESULT ReadFile(const CFork &fork, CByteBuffer &buf, IInStream *inStream);
   HRESULT LoadExtentFile(const CFork &fork, IInStream *inStream, CObjectVector<CIdExtents> *overflowExtentsArray);
   HRESULT LoadAttrs(const CFork &fork, IInStream *inStream, IArchiveOpenCallback *progress);
@@ -424,26 +426,39 @@ void CDatabase::GetItemPath(unsigned index, NWindows::NCOM::CPropVariant &path)
   }
 }
 
-// Actually we read all blocks. It can be larger than fork.Size
-
-HRESULT CDatabase::ReadFile(const CFork &fork, CByteBuffer &buf, IInStream *inStream)
+bool CDatabase::CheckForkExtents(const CFork &fork) const
 {
   if (fork.NumBlocks >= Header.NumBlocks)
-    return S_FALSE;
+    return false;
   size_t totalSize = (size_t)fork.NumBlocks << Header.BlockSizeLog;
   if ((totalSize >> Header.BlockSizeLog) != fork.NumBlocks)
-    return S_FALSE;
-  buf.Alloc(totalSize);
+    return false;
   UInt32 curBlock = 0;
   FOR_VECTOR (i, fork.Extents)
   {
     if (curBlock >= fork.NumBlocks)
-      return S_FALSE;
+      return false;
     const CExtent &e = fork.Extents[i];
     if (e.Pos > Header.NumBlocks ||
         e.NumBlocks > fork.NumBlocks - curBlock ||
         e.NumBlocks > Header.NumBlocks - e.Pos)
-      return S_FALSE;
+      return false;
+    curBlock += e.NumBlocks;
+  }
+  return true;
+}
+
+// Actually we read all blocks. It can be larger than fork.Size
+
+HRESULT CDatabase::ReadFile(const CFork &fork, CByteBuffer &buf, IInStream *inStream)
+{
+  if (!CheckForkExtents(fork))
+    return S_FALSE;
+  buf.Alloc((size_t)fork.NumBlocks << Header.BlockSizeLog);
+  UInt32 curBlock = 0;
+  FOR_VECTOR (i, fork.Extents)
+  {
+    const CExtent &e = fork.Extents[i];
     RINOK(inStream->Seek((UInt64)e.Pos << Header.BlockSizeLog, STREAM_SEEK_SET, NULL));
     RINOK(ReadStream_FALSE(inStream,
         (Byte *)buf + ((size_t)curBlock << Header.BlockSizeLog),
@@ -531,6 +546,122 @@ HRESULT CHeaderRec::Parse(const Byte *p)
 }
 
 
+/* CNodeCache reads the nodes of B-tree file on demand.
+   The file is read in batches of (1 << kBatchSizeLog) bytes, and the last
+   kNumBatches batches are kept in cache. So we don't need the buffer for
+   whole catalog file, and the leaf nodes that are not sorted by node
+   number still are read with large reads. */
+
+static const unsigned kBatchSizeLog = 18;
+static const unsigned kNumBatches = 16;
+
+class CNodeCache
+{
+  struct CBatch
+  {
+    CByteBuffer Buf;
+    size_t Size;
+    UInt32 Index;
+    UInt32 LastUse;
+
+    CBatch(): Size(0), LastUse(0) {}
+  };
+
+  IInStream *_stream;
+  const CFork *_fork;
+  unsigned _blockSizeLog;
+  UInt64 _size;
+  UInt32 _useCounter;
+  CBatch _batches[kNumBatches];
+
+  HRESULT ReadBatch(CBatch &batch, UInt32 index);
+public:
+  void Init(IInStream *stream, const CFork &fork, unsigned blockSizeLog)
+  {
+    _stream = stream;
+    _fork = &fork;
+    _blockSizeLog = blockSizeLog;
+    _size = (UInt64)fork.NumBlocks << blockSizeLog;
+    _useCounter = 0;
+    for (unsigned i = 0; i < kNumBatches; i++)
+      _batches[i].Size = 0;
+  }
+  
+  UInt64 GetSize() const { return _size; }
+
+  // the data (offset, size) must not cross the border of batch
+  HRESULT GetData(UInt64 offset, size_t size, const Byte *&p);
+};
+
+HRESULT CNodeCache::ReadBatch(CBatch &batch, UInt32 index)
+{
+  batch.Size = 0;
+  const UInt64 start = (UInt64)index << kBatchSizeLog;
+  const size_t size = (size_t)MyMin(_size - start, (UInt64)1 << kBatchSizeLog);
+  if (batch.Buf.Size() < size)
+    batch.Buf.Alloc((size_t)MyMin(_size, (UInt64)1 << kBatchSizeLog));
+  
+  UInt64 virt = 0;
+  size_t pos = 0;
+  FOR_VECTOR (i, _fork->Extents)
+  {
+    const CExtent &e = _fork->Extents[i];
+    const UInt64 extentSize = (UInt64)e.NumBlocks << _blockSizeLog;
+    if (virt + extentSize > start + pos)
+    {
+      const UInt64 offset = start + pos - virt;
+      size_t cur = size - pos;
+      if (cur > extentSize - offset)
+        cur = (size_t)(extentSize - offset);
+      RINOK(_stream->Seek(((UInt64)e.Pos << _blockSizeLog) + offset, STREAM_SEEK_SET, NULL));
+      RINOK(ReadStream_FALSE(_stream, (Byte *)batch.Buf + pos, cur));
+      pos += cur;
+      if (pos == size)
+        break;
+    }
+    virt += extentSize;
+  }
+  if (pos != size)
+    return S_FALSE;
+  batch.Size = size;
+  batch.Index = index;
+  return S_OK;
+}
+
+HRESULT CNodeCache::GetData(UInt64 offset, size_t size, const Byte *&p)
+{
+  p = NULL;
+  if (offset >= _size || size > _size - offset)
+    return S_FALSE;
+  const UInt32 index = (UInt32)(offset >> kBatchSizeLog);
+  const size_t offsetInBatch = (size_t)offset & (((size_t)1 << kBatchSizeLog) - 1);
+  
+  unsigned best = 0;
+  unsigned i;
+  for (i = 0; i < kNumBatches; i++)
+  {
+    const CBatch &b = _batches[i];
+    if (b.Size != 0 && b.Index == index)
+      break;
+    if (b.LastUse < _batches[best].LastUse)
+      best = i;
+  }
+  
+  if (i == kNumBatches)
+  {
+    i = best;
+    RINOK(ReadBatch(_batches[i], index));
+  }
+  
+  CBatch &batch = _batches[i];
+  if (size > batch.Size - offsetInBatch)
+    return S_FALSE;
+  batch.LastUse = ++_useCounter;
+  p = (const Byte *)batch.Buf + offsetInBatch;
+  return S_OK;
+}
+
+
 static const Byte kNodeType_Leaf   = 0xFF;
 // static const Byte kNodeType_Index  = 0;
 // static const Byte kNodeType_Header = 1;
@@ -869,9 +1000,14 @@ HRESULT CDatabase::LoadCatalog(const CFork &fork, const CObjectVector<CIdExtents
   CRecordVector<CIdIndexPair> IdToIndexMap;
   IdToIndexMap.ClearAndReserve(reserveSize);
 
-  CByteBuffer buf;
-  RINOK(ReadFile(fork, buf, inStream));
-  const Byte *p = (const Byte *)buf;
+  if (!CheckForkExtents(fork))
+    return S_FALSE;
+  CNodeCache nodeCache;
+  nodeCache.Init(inStream, fork, Header.BlockSizeLog);
+  const Byte *p;
+  
+  const unsigned kHeaderNodeSizeMin = 1 << 9;
+  RINOK(nodeCache.GetData(0, kHeaderNodeSizeMin, p));
 
   // CNodeDescriptor nodeDesc;
   // nodeDesc.Parse(p);
@@ -880,7 +1016,7 @@ HRESULT CDatabase::LoadCatalog(const CFork &fork, const CObjectVector<CIdExtents
   
   // CaseSensetive = (Header.IsHfsX() && hr.KeyCompareType == 0xBC);
 
-  if ((buf.Size() >> hr.NodeSizeLog) < hr.TotalNodes)
+  if ((nodeCache.GetSize() >> hr.NodeSizeLog) < hr.TotalNodes)
     return S_FALSE;
 
   CByteBuffer usedBuf(hr.TotalNodes);
@@ -898,9 +1034,10 @@ HRESULT CDatabase::LoadCatalog(const CFork &fork, const CObjectVector<CIdExtents
       return S_FALSE;
     usedBuf[node] = 1;
     
-    size_t nodeOffset = (size_t)node << hr.NodeSizeLog;
+    const UInt32 nodeSize = ((UInt32)1 << hr.NodeSizeLog);
+    RINOK(nodeCache.GetData((UInt64)node << hr.NodeSizeLog, nodeSize, p));
     CNodeDescriptor desc;
-    desc.Parse(p + nodeOffset);
+    desc.Parse(p);
     if (!desc.CheckNumRecords(hr.NodeSizeLog))
       return S_FALSE;
     if (desc.Kind != kNodeType_Leaf)
@@ -908,9 +1045,8 @@ HRESULT CDatabase::LoadCatalog(const CFork &fork, const CObjectVector<CIdExtents
     
     for (unsigned i = 0; i < desc.NumRecords; i++)
     {
-      UInt32 nodeSize = (1 << hr.NodeSizeLog);
-      UInt32 offs = Get16(p + nodeOffset + nodeSize - (i + 1) * 2);
-      UInt32 offsNext = Get16(p + nodeOffset + nodeSize - (i + 2) * 2);
+      UInt32 offs = Get16(p + nodeSize - (i + 1) * 2);
+      UInt32 offsNext = Get16(p + nodeSize - (i + 2) * 2);
       UInt32 recSize = offsNext - offs;
       if (offs >= nodeSize
           || offs >= nodeSize
@@ -918,7 +1054,7 @@ HRESULT CDatabase::LoadCatalog(const CFork &fork, const CObjectVector<CIdExtents
           || recSize < 6)
         return S_FALSE;
 
-      const Byte *r = p + nodeOffset + offs;
+      const Byte *r = p + offs;
       UInt32 keyLen = Get16(r);
       UInt32 parentID = Get32(r + 2);
       if (keyLen < 6 || (keyLen & 1) != 0 || keyLen + 2 > recSize)
@@ -1267,30 +1403,108 @@ HRESULT CDatabase::Open2(IInStream *inStream, IArchiveOpenCallback *progress)
 }
 
 
+static const UInt32 kCompressionBlockSize = 1 << 16;
+
+// CChunkDecoder decodes one 64 KB chunk of decmpfs file
+
+struct CChunkDecoder
+{
+  NCompress::NZlib::CDecoder *ZlibDecoderSpec;
+  CMyComPtr<ICompressCoder> ZlibDecoder;
+  CBufInStream *InStreamSpec;
+  CMyComPtr<ISequentialInStream> InStream;
+  CBufPtrSeqOutStream *OutStreamSpec;
+  CMyComPtr<ISequentialOutStream> OutStream;
+
+  CByteBuffer InBuf; // we need 1 additional bytes for uncompressed chunk header
+  CByteBuffer OutBuf;
+  UInt32 PackSize;
+  UInt32 UnpackSize;
+
+  CChunkDecoder(): ZlibDecoderSpec(NULL) {}
+  void Create();
+  HRESULT Decode();
+};
+
+void CChunkDecoder::Create()
+{
+  if (ZlibDecoder)
+    return;
+  ZlibDecoderSpec = new NCompress::NZlib::CDecoder();
+  ZlibDecoder = ZlibDecoderSpec;
+  InStreamSpec = new CBufInStream;
+  InStream = InStreamSpec;
+  OutStreamSpec = new CBufPtrSeqOutStream;
+  OutStream = OutStreamSpec;
+  InBuf.Alloc(kCompressionBlockSize + 0x10);
+  OutBuf.Alloc(kCompressionBlockSize);
+}
+
+HRESULT CChunkDecoder::Decode()
+{
+  if ((InBuf[0] & 0xF) == 0xF)
+  {
+    if (PackSize - 1 != UnpackSize)
+      return S_FALSE;
+    memcpy(OutBuf, InBuf + 1, UnpackSize);
+    return S_OK;
+  }
+  UInt64 unpackSize64 = UnpackSize;
+  InStreamSpec->Init(InBuf, PackSize);
+  OutStreamSpec->Init(OutBuf, UnpackSize);
+  RINOK(ZlibDecoder->Code(InStream, OutStream, NULL, &unpackSize64, NULL));
+  if (ZlibDecoderSpec->GetOutputProcessedSize() != UnpackSize ||
+      ZlibDecoderSpec->GetInputProcessedSize() != PackSize)
+    return S_FALSE;
+  return S_OK;
+}
+
+#ifndef _7ZIP_ST
+
+struct CChunkJob: public CDecodeJob
+{
+  CChunkDecoder Decoder;
+  virtual HRESULT Decode() { return Decoder.Decode(); }
+};
+
+#endif
+
 
 class CHandler:
   public IInArchive,
   public IArchiveGetRawProps,
   public IInArchiveGetStream,
+  public ISetProperties,
   public CMyUnknownImp,
   public CDatabase
 {
   CMyComPtr<IInStream> _stream;
+  CDecodeMtProps _mtProps;
+  
+  #ifndef _7ZIP_ST
+  CObjArray2<CChunkJob> _jobs; // it must be destroyed after (_threads)
+  CDecodeThreads _threads;
+  
+  HRESULT CreateThreads();
+  #endif
 
   HRESULT GetForkStream(const CFork &fork, ISequentialInStream **stream);
 
   HRESULT ExtractZlibFile(
       ISequentialOutStream *realOutStream,
       const CItem &item,
-      NCompress::NZlib::CDecoder *_zlibDecoderSpec,
+      CChunkDecoder &decoder,
       CByteBuffer &buf,
       UInt64 progressStart,
       IArchiveExtractCallback *extractCallback);
+
 public:
-  MY_UNKNOWN_IMP3(IInArchive, IArchiveGetRawProps, IInArchiveGetStream)
+  
+  MY_UNKNOWN_IMP4(IInArchive, IArchiveGetRawProps, IInArchiveGetStream, ISetProperties)
   INTERFACE_IInArchive(;)
   INTERFACE_IArchiveGetRawProps(;)
   STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
+  STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
 };
 
 static const Byte kProps[] =
@@ -1493,12 +1707,23 @@ STDMETHODIMP CHandler::Close()
   return S_OK;
 }
 
-static const UInt32 kCompressionBlockSize = 1 << 16;
+#ifndef _7ZIP_ST
+
+HRESULT CHandler::CreateThreads()
+{
+  RINOK(_threads.Create(_mtProps.NumThreads, (UInt32)(Int32)-1));
+  _jobs.SetSize(_threads.Size());
+  for (unsigned t = 0; t < _jobs.Size(); t++)
+    _jobs[t].Decoder.Create();
+  return S_OK;
+}
+
+#endif
 
 HRESULT CHandler::ExtractZlibFile(
     ISequentialOutStream *outStream,
     const CItem &item,
-    NCompress::NZlib::CDecoder *_zlibDecoderSpec,
+    CChunkDecoder &decoder,
     CByteBuffer &buf,
     UInt64 progressStart,
     IArchiveExtractCallback *extractCallback)
@@ -1559,52 +1784,105 @@ HRESULT CHandler::ExtractZlibFile(
   if (prev != dataSize2)
     return S_FALSE;
 
-  CBufInStream *bufInStreamSpec = new CBufInStream;
-  CMyComPtr<ISequentialInStream> bufInStream = bufInStreamSpec;
+  /* The chunks are read in main thread, and they are decoded by
+     threads in parallel. The main thread writes the decoded chunks in
+     original order. We must wait all started threads before exit. */
+
+  #ifndef _7ZIP_ST
+  UInt32 numThreads = 0;
+  if (numBlocks > 1)
+  {
+    RINOK(CreateThreads());
+    numThreads = _threads.Size();
+  }
+  UInt32 numStarted = 0;
+  UInt32 numFinished = 0;
+  #endif
 
+  HRESULT res = S_OK;
   UInt64 outPos = 0;
-  for (i = 0; i < numBlocks; i++)
+  
+  for (i = 0;;)
   {
-    UInt64 rem = item.UnpackSize - outPos;
-    if (rem == 0)
-      return S_FALSE;
-    UInt32 blockSize = kCompressionBlockSize;
-    if (rem < kCompressionBlockSize)
-      blockSize = (UInt32)rem;
+    const CChunkDecoder *d = &decoder;
+    
+    #ifndef _7ZIP_ST
+    if (numStarted != numFinished
+        && (numStarted - numFinished == numThreads || i == numBlocks || res != S_OK))
+    {
+      const unsigned t = numFinished % numThreads;
+      const HRESULT jobRes = _threads[t].WaitJob();
+      numFinished++;
+      if (res != S_OK)
+        continue;
+      res = jobRes;
+      d = &_jobs[t].Decoder;
+    }
+    else
+    #endif
+    {
+      if (i == numBlocks || res != S_OK)
+        break;
+      
+      UInt64 rem = item.UnpackSize - (UInt64)i * kCompressionBlockSize;
+      if (rem == 0)
+      {
+        res = S_FALSE;
+        continue;
+      }
+      UInt32 blockSize = kCompressionBlockSize;
+      if (rem < kCompressionBlockSize)
+        blockSize = (UInt32)rem;
 
-    UInt32 size = GetUi32(tableBuf + i * 8 + 4);
+      UInt32 size = GetUi32(tableBuf + i * 8 + 4);
+      i++;
 
-    if (size > buf.Size() || size > kCompressionBlockSize + 1)
-      return S_FALSE;
+      CChunkDecoder *dest = &decoder;
+      #ifndef _7ZIP_ST
+      if (numThreads != 0)
+        dest = &_jobs[numStarted % numThreads].Decoder;
+      #endif
 
-    RINOK(ReadStream_FALSE(inStream, buf, size));
+      if (size > dest->InBuf.Size() || size > kCompressionBlockSize + 1)
+      {
+        res = S_FALSE;
+        continue;
+      }
 
-    if ((buf[0] & 0xF) == 0xF)
-    {
-      // that code was not tested. Are there HFS archives with uncompressed block
-      if (size - 1 != blockSize)
-        return S_FALSE;
+      res = ReadStream_FALSE(inStream, dest->InBuf, size);
+      if (res != S_OK)
+        continue;
+      dest->PackSize = size;
+      dest->UnpackSize = blockSize;
 
-      if (outStream)
+      #ifndef _7ZIP_ST
+      if (numThreads != 0)
       {
-        RINOK(WriteStream(outStream, buf, blockSize));
+        const unsigned t = numStarted % numThreads;
+        _threads[t].StartJob(&_jobs[t]);
+        numStarted++;
+        continue;
       }
+      #endif
+      
+      res = decoder.Decode();
     }
-    else
+    
+    if (res != S_OK)
+      continue;
+    if (outStream)
     {
-      UInt64 blockSize64 = blockSize;
-      bufInStreamSpec->Init(buf, size);
-      RINOK(_zlibDecoderSpec->Code(bufInStream, outStream, NULL, &blockSize64, NULL));
-      if (_zlibDecoderSpec->GetOutputProcessedSize() != blockSize ||
-          _zlibDecoderSpec->GetInputProcessedSize() != size)
-        return S_FALSE;
+      res = WriteStream(outStream, d->OutBuf, d->UnpackSize);
+      if (res != S_OK)
+        continue;
     }
-    
-    outPos += blockSize;
+    outPos += d->UnpackSize;
     UInt64 progressPos = progressStart + outPos;
-    RINOK(extractCallback->SetCompleted(&progressPos));
+    res = extractCallback->SetCompleted(&progressPos);
   }
 
+  RINOK(res);
+
   if (outPos != item.UnpackSize)
     return S_FALSE;
 
@@ -1656,10 +1934,9 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   UInt64 currentTotalSize = 0, currentItemSize = 0;
   
   const size_t kBufSize = kCompressionBlockSize;
-  CByteBuffer buf(kBufSize + 0x10); // we need 1 additional bytes for uncompressed chunk header
+  CByteBuffer buf(kBufSize + 0x10);
 
-  NCompress::NZlib::CDecoder *_zlibDecoderSpec = NULL;
-  CMyComPtr<ICompressCoder> _zlibDecoder;
+  CChunkDecoder chunkDecoder;
 
   for (i = 0; i < numItems; i++, currentTotalSize += currentItemSize)
   {
@@ -1707,11 +1984,7 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
       }
       else
       {
-        if (!_zlibDecoder)
-        {
-          _zlibDecoderSpec = new NCompress::NZlib::CDecoder();
-          _zlibDecoder = _zlibDecoderSpec;
-        }
+        chunkDecoder.Create();
         
         if (item.Method == kMethod_Attr)
         {
@@ -1719,19 +1992,19 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
           CMyComPtr<ISequentialInStream> bufInStream = bufInStreamSpec;
           bufInStreamSpec->Init(AttrBuf + item.DataPos, item.PackSize);
           
-          HRESULT hres = _zlibDecoder->Code(bufInStream, realOutStream, NULL, &item.UnpackSize, NULL);
+          HRESULT hres = chunkDecoder.ZlibDecoder->Code(bufInStream, realOutStream, NULL, &item.UnpackSize, NULL);
           if (hres != S_FALSE)
           {
             if (hres != S_OK)
               return hres;
-            if (_zlibDecoderSpec->GetOutputProcessedSize() == item.UnpackSize &&
-                _zlibDecoderSpec->GetInputProcessedSize() == item.PackSize)
+            if (chunkDecoder.ZlibDecoderSpec->GetOutputProcessedSize() == item.UnpackSize &&
+                chunkDecoder.ZlibDecoderSpec->GetInputProcessedSize() == item.PackSize)
               res = NExtract::NOperationResult::kOK;
           }
         }
         else
         {
-          HRESULT hres = ExtractZlibFile(realOutStream, item, _zlibDecoderSpec, buf,
+          HRESULT hres = ExtractZlibFile(realOutStream, item, chunkDecoder, buf,
             currentTotalSize, extractCallback);
           if (hres != S_FALSE)
           {
@@ -1866,6 +2139,21 @@ STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
   return GetForkStream(item.GetFork(ref.IsResource), stream);
 }
 
+STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps)
+{
+  _mtProps.Init();
+
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    if (name.IsEmpty())
+      return E_INVALIDARG;
+    RINOK(_mtProps.SetProperty(name, values[i]));
+  }
+  return S_OK;
+}
+
 static const Byte k_Signature[] = {
     4, 'H', '+', 0, 4,
     4, 'H', 'X', 0, 5 };
@@ -333,6 +333,25 @@ ARCHIVE_INTERFACE(IArchiveGetRootProps, 0x71)
   INTERFACE_IArchiveGetRootProps(PURE)
 };
 
+/*
+FindItem
+  searches the item with (kpidPath) property equal to (path).
+  The search starts from item (startIndex), so the caller can find all items with same path.
+  It's faster than enumeration of all items, if the handler supports the index of names.
+  Result:
+    S_OK      - item was found, (*index) is index of item
+    S_FALSE   - there are no more such items
+    E_NOTIMPL - the search is not supported for this archive, the caller must enumerate items
+*/
+
+#define INTERFACE_IArchiveFindItem(x) \
+  STDMETHOD(FindItem)(const wchar_t *path, UInt32 startIndex, UInt32 *index) x; \
+
+ARCHIVE_INTERFACE(IArchiveFindItem, 0x72)
+{
+  INTERFACE_IArchiveFindItem(PURE)
+};
+
 ARCHIVE_INTERFACE(IArchiveOpenSeq, 0x61)
 {
   STDMETHOD(OpenSeq)(ISequentialInStream *stream) PURE;
@@ -488,6 +507,29 @@ ARCHIVE_INTERFACE(IOutArchive, 0xA0)
 };
 
 
+/*
+IOutArchiveUpdateInPlace::UpdateItemsInPlace()
+  (outStream) is opened for writing to the same file as the archive
+  that was opened with IInArchive::Open().
+  The handler appends new data to the end of archive instead of writing new archive.
+  The old data of archive must stay valid until the update is finished,
+  so the archive can be opened (without new items), if the update is interrupted.
+  
+  S_FALSE : the handler can't update that archive in place (for example,
+            some items must be deleted or changed). Nothing was written to outStream.
+            The caller can call IOutArchive::UpdateItems() with new temp file instead.
+  other error code : the file can contain some additional data after the end of archive.
+*/
+
+#define INTERFACE_IOutArchiveUpdateInPlace(x) \
+  STDMETHOD(UpdateItemsInPlace)(IOutStream *outStream, UInt32 numItems, IArchiveUpdateCallback *updateCallback) x; \
+
+ARCHIVE_INTERFACE(IOutArchiveUpdateInPlace, 0xA1)
+{
+  INTERFACE_IOutArchiveUpdateInPlace(PURE)
+};
+
+
 ARCHIVE_INTERFACE(ISetProperties, 0x03)
 {
   STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps) PURE;
@@ -12,8 +12,6 @@
 #include "../../Common/LimitedStreams.h"
 #include "../../Common/ProgressUtils.h"
 
-#include "../../Compress/CopyCoder.h"
-
 #include "../Common/ItemNameUtils.h"
 
 #include "IsoHandler.h"
@@ -262,90 +260,147 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   UInt64 currentTotalSize = 0;
   UInt64 currentItemSize;
   
-  NCompress::CCopyCoder *copyCoderSpec = new NCompress::CCopyCoder();
-  CMyComPtr<ICompressCoder> copyCoder = copyCoderSpec;
-
   CLocalProgress *lps = new CLocalProgress;
   CMyComPtr<ICompressProgressInfo> progress = lps;
   lps->Init(extractCallback, false);
 
-  CLimitedSequentialInStream *streamSpec = new CLimitedSequentialInStream;
-  CMyComPtr<ISequentialInStream> inStream(streamSpec);
-  streamSpec->SetStream(_stream);
+  /* The data of small items is read to memory in order of physical position of extents.
+     Then these items are sent to callback in original order.
+     Big items are copied with big reads without buffering. */
+
+  CExtentsReader reader;
 
-  for (i = 0; i < numItems; i++, currentTotalSize += currentItemSize)
+  for (i = 0; i < numItems;)
   {
     lps->InSize = lps->OutSize = currentTotalSize;
     RINOK(lps->SetCur());
-    currentItemSize = 0;
-    CMyComPtr<ISequentialOutStream> realOutStream;
-    Int32 askMode = testMode ?
-        NExtract::NAskMode::kTest :
-        NExtract::NAskMode::kExtract;
-    UInt32 index = allFilesMode ? i : indices[i];
-    
-    RINOK(extractCallback->GetStream(index, &realOutStream, askMode));
 
-    UInt64 blockIndex;
-    if (index < (UInt32)_archive.Refs.Size())
+    reader.Clear();
+    UInt32 numBatchItems;
+    
+    for (numBatchItems = 0; i + numBatchItems < numItems; numBatchItems++)
     {
-      const CRef &ref = _archive.Refs[index];
-      const CDir &item = ref.Dir->_subItems[ref.Index];
-      if (item.IsDir())
+      UInt32 index = allFilesMode ? i + numBatchItems : indices[i + numBatchItems];
+      UInt64 size;
+      if (index < (UInt32)_archive.Refs.Size())
       {
-        RINOK(extractCallback->PrepareOperation(askMode));
-        RINOK(extractCallback->SetOperationResult(NExtract::NOperationResult::kOK));
+        const CRef &ref = _archive.Refs[index];
+        const CDir &item = ref.Dir->_subItems[ref.Index];
+        size = item.IsDir() ? 0 : ref.TotalSize;
+      }
+      else
+        size = _archive.GetBootItemSize(index - _archive.Refs.Size());
+      
+      if (size > CExtentsReader::kReadSize
+          || reader.GetDataSize() + size > CExtentsReader::kBufSize)
+        break;
+      
+      reader.AddItem();
+      if (size == 0)
         continue;
+      
+      if (index < (UInt32)_archive.Refs.Size())
+      {
+        const CRef &ref = _archive.Refs[index];
+        for (UInt32 e = 0; e < ref.NumExtents; e++)
+        {
+          const CDir &item2 = ref.Dir->_subItems[ref.Index + e];
+          reader.AddExtent((UInt64)item2.ExtentLocation * kBlockSize, item2.Size);
+        }
+      }
+      else
+      {
+        const CBootInitialEntry &be = _archive.BootEntries[index - _archive.Refs.Size()];
+        reader.AddExtent((UInt64)be.LoadRBA * kBlockSize, (size_t)size);
       }
-      currentItemSize = ref.TotalSize;
-      blockIndex = item.ExtentLocation;
     }
-    else
+
+    if (numBatchItems != 0)
     {
-      unsigned bootIndex = index - _archive.Refs.Size();
-      const CBootInitialEntry &be = _archive.BootEntries[bootIndex];
-      currentItemSize = _archive.GetBootItemSize(bootIndex);
-      blockIndex = be.LoadRBA;
+      RINOK(reader.Read(_stream, progress));
     }
-   
-
-    if (!testMode && !realOutStream)
-      continue;
 
-    RINOK(extractCallback->PrepareOperation(askMode));
-
-    bool isOK = true;
-    if (index < (UInt32)_archive.Refs.Size())
+    // if (numBatchItems == 0), we copy one big item directly
+    const UInt32 numCurItems = (numBatchItems == 0) ? 1 : numBatchItems;
+  
+    for (UInt32 k = 0; k < numCurItems; k++, i++, currentTotalSize += currentItemSize)
     {
-      const CRef &ref = _archive.Refs[index];
-      UInt64 offset = 0;
-      for (UInt32 e = 0; e < ref.NumExtents; e++)
+      currentItemSize = 0;
+      CMyComPtr<ISequentialOutStream> realOutStream;
+      Int32 askMode = testMode ?
+          NExtract::NAskMode::kTest :
+          NExtract::NAskMode::kExtract;
+      UInt32 index = allFilesMode ? i : indices[i];
+      
+      RINOK(extractCallback->GetStream(index, &realOutStream, askMode));
+  
+      UInt64 blockIndex;
+      if (index < (UInt32)_archive.Refs.Size())
       {
-        lps->InSize = lps->OutSize = currentTotalSize + offset;
-        const CDir &item2 = ref.Dir->_subItems[ref.Index + e];
-        RINOK(_stream->Seek((UInt64)item2.ExtentLocation * kBlockSize, STREAM_SEEK_SET, NULL));
-        streamSpec->Init(item2.Size);
-        RINOK(copyCoder->Code(inStream, realOutStream, NULL, NULL, progress));
-        if (copyCoderSpec->TotalSize != item2.Size)
+        const CRef &ref = _archive.Refs[index];
+        const CDir &item = ref.Dir->_subItems[ref.Index];
+        if (item.IsDir())
         {
-          isOK = false;
-          break;
+          RINOK(extractCallback->PrepareOperation(askMode));
+          RINOK(extractCallback->SetOperationResult(NExtract::NOperationResult::kOK));
+          continue;
         }
-        offset += item2.Size;
+        currentItemSize = ref.TotalSize;
+        blockIndex = item.ExtentLocation;
       }
+      else
+      {
+        unsigned bootIndex = index - _archive.Refs.Size();
+        const CBootInitialEntry &be = _archive.BootEntries[bootIndex];
+        currentItemSize = _archive.GetBootItemSize(bootIndex);
+        blockIndex = be.LoadRBA;
+      }
+     
+  
+      if (!testMode && !realOutStream)
+        continue;
+  
+      RINOK(extractCallback->PrepareOperation(askMode));
+  
+      bool isOK = true;
+      if (numBatchItems != 0)
+      {
+        UInt64 processed;
+        RINOK(reader.WriteItem(k, realOutStream, processed));
+        isOK = (processed == currentItemSize);
+      }
+      else if (index < (UInt32)_archive.Refs.Size())
+      {
+        const CRef &ref = _archive.Refs[index];
+        UInt64 offset = 0;
+        for (UInt32 e = 0; e < ref.NumExtents; e++)
+        {
+          lps->InSize = lps->OutSize = currentTotalSize + offset;
+          const CDir &item2 = ref.Dir->_subItems[ref.Index + e];
+          UInt64 processed;
+          RINOK(reader.CopyExtent(_stream, (UInt64)item2.ExtentLocation * kBlockSize, item2.Size,
+              realOutStream, progress, processed));
+          if (processed != item2.Size)
+          {
+            isOK = false;
+            break;
+          }
+          offset += item2.Size;
+        }
+      }
+      else
+      {
+        UInt64 processed;
+        RINOK(reader.CopyExtent(_stream, (UInt64)blockIndex * kBlockSize, currentItemSize,
+            realOutStream, progress, processed));
+        if (processed != currentItemSize)
+          isOK = false;
+      }
+      realOutStream.Release();
+      RINOK(extractCallback->SetOperationResult(isOK ?
+          NExtract::NOperationResult::kOK:
+          NExtract::NOperationResult::kDataError));
     }
-    else
-    {
-      RINOK(_stream->Seek((UInt64)blockIndex * kBlockSize, STREAM_SEEK_SET, NULL));
-      streamSpec->Init(currentItemSize);
-      RINOK(copyCoder->Code(inStream, realOutStream, NULL, NULL, progress));
-      if (copyCoderSpec->TotalSize != currentItemSize)
-        isOK = false;
-    }
-    realOutStream.Release();
-    RINOK(extractCallback->SetOperationResult(isOK ?
-        NExtract::NOperationResult::kOK:
-        NExtract::NOperationResult::kDataError));
   }
   return S_OK;
   COM_TRY_END
@@ -19,6 +19,7 @@
 #include "../../Windows/PropVariant.h"
 #include "../../Windows/TimeUtils.h"
 
+#include "../Common/DecodeThreads.h"
 #include "../Common/MethodProps.h"
 #include "../Common/ProgressUtils.h"
 #include "../Common/RegisterArc.h"
@@ -787,12 +788,7 @@ STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
     if (!isCompressed)
     {
       const CExtent &e = Extents[i];
-      UInt64 newPos = (e.Phy << BlockSizeLog) + _virtPos - (e.Virt << BlockSizeLog);
-      if (newPos != _physPos)
-      {
-        _physPos = newPos;
-        RINOK(SeekToPhys());
-      }
+      _physPos = (e.Phy << BlockSizeLog) + _virtPos - (e.Virt << BlockSizeLog);
       UInt64 next = Extents[i + 1].Virt;
       if (next > virtBlock2End)
         next &= ~((UInt64)comprUnitSize - 1);
@@ -830,12 +826,8 @@ STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
         break;
       if (e.Virt >= virtBlock2End)
         return S_FALSE;
-      UInt64 newPos = (e.Phy + (curVirt - e.Virt)) << BlockSizeLog;
-      if (newPos != _physPos)
-      {
-        _physPos = newPos;
-        RINOK(SeekToPhys());
-      }
+      _physPos = (e.Phy + (curVirt - e.Virt)) << BlockSizeLog;
+      RINOK(SeekToPhys());
       UInt64 numChunks = Extents[i + 1].Virt - curVirt;
       if (curVirt + numChunks > virtBlock2End)
         numChunks = virtBlock2End - curVirt;
@@ -870,6 +862,9 @@ STDMETHODIMP CInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
     memset(data, 0, size);
   else
   {
+    /* The main stream is shared with other streams of the handler,
+       and MFT records are read from it on demand. So we seek before each read. */
+    RINOK(SeekToPhys());
     res = Stream->Read(data, size, &size);
     _physPos += size;
   }
@@ -965,9 +960,6 @@ struct CMftRec
   CMftRef BaseMftRef;
   // UInt32 ThisRecNumber;
   
-  UInt32 MyNumNameLinks;
-  int MyItemIndex; // index in Items[] of main item  for that record, or -1 if there is no item for that record
-
   CObjectVector<CAttr> DataAttrs;
   CObjectVector<CFileNameAttr> FileNames;
   CRecordVector<CDataRef> DataRefs;
@@ -1044,7 +1036,20 @@ struct CMftRec
 
   UInt64 GetSize(unsigned dataIndex) const { return DataAttrs[DataRefs[dataIndex].Start].GetSize(); }
 
-  CMftRec(): MyNumNameLinks(0), MyItemIndex(-1) {}
+  void Clear()
+  {
+    Magic = 0;
+    SeqNumber = 0;
+    Flags = 0;
+    BaseMftRef.Val = 0;
+    DataAttrs.Clear();
+    FileNames.Clear();
+    DataRefs.Clear();
+    memset(&SiAttr, 0, sizeof(SiAttr));
+    ReparseData.Free();
+  }
+
+  CMftRec() { Clear(); }
 };
 
 void CMftRec::ParseDataNames()
@@ -1287,6 +1292,10 @@ struct CItem
 {
   unsigned RecIndex;  // index in Recs array
   unsigned NameIndex; // index in CMftRec::FileNames
+  UInt32 NamePos;       // position of file name in CRecsTable::Chars
+  UInt32 StreamNamePos; // position of alt stream name in CRecsTable::Chars
+  UInt16 NameLen;
+  UInt16 StreamNameLen;
 
   int DataIndex;      /* index in CMftRec::DataRefs
                          -1: file without unnamed data stream
@@ -1299,7 +1308,8 @@ struct CItem
   int ParentHost;     /* index in Items array, if it's AltStream
                          -1: if it's not AltStream */
   
-  CItem(): DataIndex(k_Item_DataIndex_IsDir), ParentFolder(-1), ParentHost(-1) {}
+  CItem(): StreamNamePos(0), StreamNameLen(0),
+      DataIndex(k_Item_DataIndex_IsDir), ParentFolder(-1), ParentHost(-1) {}
   
   bool IsAltStream() const { return ParentHost != -1; }
   bool IsDir() const { return DataIndex == k_Item_DataIndex_IsDir; }
@@ -1308,15 +1318,226 @@ struct CItem
         // But it doesn't do it for $Secure:$SDS
 };
 
+
+/*
+  We don't keep parsed MFT records (CMftRec) in memory.
+  Open() keeps only compact information for each record (CRecInfo) and
+  the names of items in one buffer (CRecsTable::Chars).
+  Other attributes are parsed from MFT again, when they are requested (CDatabase::LoadRec).
+*/
+
+struct CRecInfo
+{
+  UInt16 SeqNumber;
+  UInt16 Flags;
+  UInt32 MyNumNameLinks;
+  int MyItemIndex; // index in Items[] of main item  for that record, or -1 if there is no item for that record
+
+  bool InUse() const { return (Flags & 1) != 0; }
+  bool IsDir() const { return (Flags & 2) != 0; }
+};
+
+// file name or data stream name of record in CRecsTable
+
+struct CNameRef
+{
+  UInt64 ParentDirRef;
+  UInt32 Pos;   // position in CRecsTable::Chars
+  UInt16 Len;
+  Byte NameType;
+};
+
+struct CRecHead
+{
+  UInt64 BaseMftRef;
+  UInt16 SeqNumber;
+  UInt16 Flags;
+  bool IsFILE;
+  bool HasExtRecs; // the names must be read again with the attributes from extension records
+  UInt32 FirstName;
+  UInt32 NumNames;
+  UInt32 FirstStream;
+  UInt32 NumStreams;
+
+  bool InUse() const { return (Flags & 1) != 0; }
+};
+
+// the table of MFT records, that is used only in Open()
+
+struct CRecsTable
+{
+  CRecordVector<CRecHead> Heads;
+  CRecordVector<CNameRef> Names;
+  CRecordVector<CNameRef> Streams;
+  CRecordVector<wchar_t> Chars;
+
+  UInt32 AddString(const wchar_t *s, unsigned len)
+  {
+    UInt32 pos = Chars.Size();
+    for (unsigned i = 0; i < len; i++)
+      Chars.Add(s[i]);
+    Chars.Add(0);
+    return pos;
+  }
+  
+  void AddNames(const CMftRec &rec, CRecHead &head);
+  void Append(const CRecsTable &t);
+  
+  void Clear()
+  {
+    Heads.Clear();
+    Names.Clear();
+    Streams.Clear();
+    Chars.Clear();
+  }
+};
+
+void CRecsTable::AddNames(const CMftRec &rec, CRecHead &head)
+{
+  head.FirstName = Names.Size();
+  head.NumNames = rec.FileNames.Size();
+  FOR_VECTOR (i, rec.FileNames)
+  {
+    const CFileNameAttr &fna = rec.FileNames[i];
+    CNameRef ref;
+    ref.ParentDirRef = fna.ParentDirRef.Val;
+    ref.Len = (UInt16)fna.Name.Len();
+    ref.Pos = AddString(fna.Name.GetRawPtr(), ref.Len);
+    ref.NameType = fna.NameType;
+    Names.Add(ref);
+  }
+  head.FirstStream = Streams.Size();
+  head.NumStreams = rec.DataRefs.Size();
+  FOR_VECTOR (i, rec.DataRefs)
+  {
+    const UString2 &name = rec.DataAttrs[rec.DataRefs[i].Start].Name;
+    CNameRef ref;
+    ref.ParentDirRef = 0;
+    ref.Len = (UInt16)name.Len();
+    ref.Pos = AddString(name.GetRawPtr(), ref.Len);
+    ref.NameType = 0;
+    Streams.Add(ref);
+  }
+}
+
+void CRecsTable::Append(const CRecsTable &t)
+{
+  const UInt32 namesOffset = Names.Size();
+  const UInt32 streamsOffset = Streams.Size();
+  const UInt32 charsOffset = Chars.Size();
+  unsigned i;
+  for (i = 0; i < t.Heads.Size(); i++)
+  {
+    CRecHead head = t.Heads[i];
+    head.FirstName += namesOffset;
+    head.FirstStream += streamsOffset;
+    Heads.Add(head);
+  }
+  for (i = 0; i < t.Names.Size(); i++)
+  {
+    CNameRef ref = t.Names[i];
+    ref.Pos += charsOffset;
+    Names.Add(ref);
+  }
+  for (i = 0; i < t.Streams.Size(); i++)
+  {
+    CNameRef ref = t.Streams[i];
+    ref.Pos += charsOffset;
+    Streams.Add(ref);
+  }
+  for (i = 0; i < t.Chars.Size(); i++)
+    Chars.Add(t.Chars[i]);
+}
+
+struct CMftParseParams
+{
+  unsigned SectorSizeLog;
+  unsigned RecSizeLog;
+  UInt32 NumSectorsInRec;
+  bool ShowSystemFiles;
+  bool ShowDeletedFiles;
+};
+
+// the block of MFT records that can be parsed in separate thread
+
+struct CMftChunk
+{
+  CByteBuffer Buf;
+  size_t Size;
+  UInt32 FirstRec;
+  const CMftParseParams *Params;
+  CRecsTable Table;
+
+  HRESULT Parse();
+};
+
+HRESULT CMftChunk::Parse()
+{
+  Table.Clear();
+  const CMftParseParams &pp = *Params;
+  const size_t recSize = (size_t)1 << pp.RecSizeLog;
+  CMftRec rec;
+  
+  for (size_t i = 0; i < Size; i += recSize)
+  {
+    const UInt32 recIndex = FirstRec + (UInt32)(i >> pp.RecSizeLog);
+    rec.Clear();
+    if (!rec.Parse(Buf + i, pp.SectorSizeLog, pp.NumSectorsInRec, recIndex, NULL))
+      return S_FALSE;
+    CRecHead head;
+    head.IsFILE = rec.IsFILE();
+    head.BaseMftRef = rec.BaseMftRef.Val;
+    head.SeqNumber = rec.SeqNumber;
+    head.Flags = rec.Flags;
+    head.HasExtRecs = false;
+    head.FirstName = Table.Names.Size();
+    head.NumNames = 0;
+    head.FirstStream = Table.Streams.Size();
+    head.NumStreams = 0;
+    if (rec.IsFILE()
+        && rec.BaseMftRef.IsBaseItself()
+        && (recIndex >= kNumSysRecs || pp.ShowSystemFiles)
+        && (rec.InUse() || pp.ShowDeletedFiles))
+    {
+      rec.ParseDataNames();
+      Table.AddNames(rec, head);
+    }
+    Table.Heads.Add(head);
+  }
+  return S_OK;
+}
+
+#ifndef _7ZIP_ST
+
+struct CMftChunkJob: public CDecodeJob
+{
+  CMftChunk Chunk;
+  virtual HRESULT Decode() { return Chunk.Parse(); }
+};
+
+#endif
+
 struct CDatabase
 {
   CRecordVector<CItem> Items;
-  CObjectVector<CMftRec> Recs;
+  CRecordVector<CRecInfo> Recs;
+  CRecsTable Table; // (Table.Chars) contains the names of items. Other fields are used only in Open()
+  CRecordVector<UInt64> ExtRecs; // (baseRecIndex << 32) | extRecIndex, sorted
   CMyComPtr<IInStream> InStream;
+  CMyComPtr<IInStream> MftStream;
   CHeader Header;
   unsigned RecSizeLog;
+  UInt32 NumSectorsInRec;
+  UInt64 MftSize;
   UInt64 PhySize;
 
+  CMftRec Rec; // the record loaded by LoadRec()
+  int _recIndex;
+  CByteBuffer _mftBuf;
+  UInt64 _mftBufPos;
+  size_t _mftBufSize;
+  CByteBuffer _recBuf;
+
   IArchiveOpenCallback *OpenCallback;
 
   CByteBuffer ByteBuf;
@@ -1339,15 +1560,18 @@ struct CDatabase
 
   bool ThereAreAltStreams;
 
+  CDecodeMtProps _mtProps;
+
   void InitProps()
   {
     _showSystemFiles = true;
     // we show SystemFiles by default since it's difficult to track $Extend\* system files
     // it must be fixed later
     _showDeletedFiles = false;
+    _mtProps.Init();
   }
 
-  CDatabase() { InitProps(); }
+  CDatabase(): _recIndex(-1), _mftBufSize(0) { InitProps(); }
   ~CDatabase() { ClearAndClose(); }
 
   void Clear();
@@ -1357,12 +1581,17 @@ struct CDatabase
   HRESULT Open();
 
   HRESULT SeekToCluster(UInt64 cluster);
+  HRESULT ReadRec(UInt32 recIndex, CMftRec &rec, CObjectVector<CAttr> *attrs);
+  HRESULT LoadRec(unsigned recIndex);
+  HRESULT ParseMft();
+
+  const wchar_t *GetName(UInt32 pos) const { return &Table.Chars[pos]; }
 
   int FindDirItemForMtfRec(UInt64 recIndex) const
   {
     if (recIndex >= Recs.Size())
       return -1;
-    const CMftRec &rec = Recs[(unsigned)recIndex];
+    const CRecInfo &rec = Recs[(unsigned)recIndex];
     if (!rec.IsDir())
       return -1;
     return rec.MyItemIndex;
@@ -1414,6 +1643,12 @@ void CDatabase::Clear()
 {
   Items.Clear();
   Recs.Clear();
+  Table.Clear();
+  ExtRecs.Clear();
+  MftStream.Release();
+  Rec.Clear();
+  _recIndex = -1;
+  _mftBufSize = 0;
   SecurOffsets.Clear();
   SecurData.Free();
   VirtFolderNames.Clear();
@@ -1435,24 +1670,21 @@ void CDatabase::GetItemPath(unsigned index, NCOM::CPropVariant &path) const
 {
   const CItem *item = &Items[index];
   unsigned size = 0;
-  const CMftRec &rec = Recs[item->RecIndex];
-  size += rec.FileNames[item->NameIndex].Name.Len();
+  size += item->NameLen;
 
   bool isAltStream = item->IsAltStream();
 
   if (isAltStream)
   {
-    const CAttr &data = rec.DataAttrs[rec.DataRefs[item->DataIndex].Start];
     if (item->RecIndex == kRecIndex_RootDir)
     {
-      wchar_t *s = path.AllocBstr(data.Name.Len() + 1);
+      wchar_t *s = path.AllocBstr(item->StreamNameLen + 1);
       s[0] = L':';
-      if (!data.Name.IsEmpty())
-        MyStringCopy(s + 1, data.Name.GetRawPtr());
+      MyStringCopy(s + 1, GetName(item->StreamNamePos));
       return;
     }
 
-    size += data.Name.Len();
+    size += item->StreamNameLen;
     size++;
   }
 
@@ -1473,7 +1705,7 @@ void CDatabase::GetItemPath(unsigned index, NCOM::CPropVariant &path) const
       if (index2 >= 0)
       {
         item = &Items[index2];
-        size += Recs[item->RecIndex].FileNames[item->NameIndex].Name.Len() + 1;
+        size += item->NameLen + 1;
         continue;
       }
       if (index2 == -1)
@@ -1493,21 +1725,20 @@ void CDatabase::GetItemPath(unsigned index, NCOM::CPropVariant &path) const
   bool needColon = false;
   if (isAltStream)
   {
-    const UString2 &name = rec.DataAttrs[rec.DataRefs[item->DataIndex].Start].Name;
-    if (!name.IsEmpty())
+    unsigned len = item->StreamNameLen;
+    if (len != 0)
     {
-      size -= name.Len();
-      MyStringCopy(s + size, name.GetRawPtr());
+      size -= len;
+      MyStringCopy(s + size, GetName(item->StreamNamePos));
     }
     s[--size] = ':';
     needColon = true;
   }
 
   {
-    const UString2 &name = rec.FileNames[item->NameIndex].Name;
-    unsigned len = name.Len();
+    unsigned len = item->NameLen;
     if (len != 0)
-      MyStringCopy(s + size - len, name.GetRawPtr());
+      MyStringCopy(s + size - len, GetName(item->NamePos));
     if (needColon)
       s[size] =  ':';
     size -= len;
@@ -1525,13 +1756,12 @@ void CDatabase::GetItemPath(unsigned index, NCOM::CPropVariant &path) const
       if (index2 >= 0)
       {
         item = &Items[index2];
-        const UString2 &name = Recs[item->RecIndex].FileNames[item->NameIndex].Name;
-        unsigned len = name.Len();
+        unsigned len = item->NameLen;
         size--;
         if (len != 0)
         {
           size -= len;
-          MyStringCopy(s + size, name.GetRawPtr());
+          MyStringCopy(s + size, GetName(item->NamePos));
         }
         s[size + len] = WCHAR_PATH_SEPARATOR;
         continue;
@@ -1620,6 +1850,177 @@ HRESULT CDatabase::ParseSecuritySDS_2()
   return S_OK;
 }
 
+static int CompareExtRecs(const UInt64 *p1, const UInt64 *p2, void * /* param */)
+{
+  return MyCompare(*p1, *p2);
+}
+
+// MFT records are usually requested in MFT order. So we read MFT by big blocks
+static const size_t kMftBufSize = (size_t)1 << 16;
+
+HRESULT CDatabase::ReadRec(UInt32 recIndex, CMftRec &rec, CObjectVector<CAttr> *attrs)
+{
+  const size_t recSize = (size_t)1 << RecSizeLog;
+  const UInt64 pos = (UInt64)recIndex << RecSizeLog;
+  if (pos + recSize > MftSize)
+    return S_FALSE;
+  
+  if (_mftBufSize == 0 || pos < _mftBufPos || pos + recSize > _mftBufPos + _mftBufSize)
+  {
+    _mftBufSize = 0;
+    if (_mftBuf.Size() != kMftBufSize)
+      _mftBuf.Alloc(kMftBufSize);
+    _mftBufPos = pos & ~(UInt64)(kMftBufSize - 1);
+    size_t size = kMftBufSize;
+    if (size > MftSize - _mftBufPos)
+      size = (size_t)(MftSize - _mftBufPos);
+    RINOK(MftStream->Seek(_mftBufPos, STREAM_SEEK_SET, NULL));
+    RINOK(ReadStream_FALSE(MftStream, _mftBuf, size));
+    _mftBufSize = size;
+  }
+  
+  // CMftRec::Parse() changes the data in buffer. So we parse the copy of record
+  if (_recBuf.Size() != recSize)
+    _recBuf.Alloc(recSize);
+  memcpy(_recBuf, _mftBuf + (size_t)(pos - _mftBufPos), recSize);
+  rec.Clear();
+  if (!rec.Parse(_recBuf, Header.SectorSizeLog, NumSectorsInRec, recIndex, attrs))
+    return S_FALSE;
+  return S_OK;
+}
+
+HRESULT CDatabase::LoadRec(unsigned recIndex)
+{
+  if (_recIndex == (int)recIndex)
+    return S_OK;
+  _recIndex = -1;
+  RINOK(ReadRec(recIndex, Rec, NULL));
+  
+  {
+    const UInt64 key = (UInt64)recIndex << 32;
+    unsigned left = 0, right = ExtRecs.Size();
+    while (left != right)
+    {
+      unsigned mid = (left + right) / 2;
+      if (ExtRecs[mid] < key)
+        left = mid + 1;
+      else
+        right = mid;
+    }
+    CMftRec extRec;
+    for (; left < ExtRecs.Size() && (ExtRecs[left] >> 32) == recIndex; left++)
+    {
+      RINOK(ReadRec((UInt32)ExtRecs[left], extRec, NULL));
+      Rec.MoveAttrsFrom(extRec);
+    }
+  }
+
+  Rec.ParseDataNames();
+  _recIndex = recIndex;
+  return S_OK;
+}
+
+static const size_t kMftChunkSize = (size_t)1 << 18;
+
+HRESULT CDatabase::ParseMft()
+{
+  const UInt64 numRecs64 = MftSize >> RecSizeLog;
+  if (numRecs64 > (1 << 30))
+    return S_FALSE;
+  const UInt32 numRecs = (UInt32)numRecs64;
+  if (OpenCallback)
+  {
+    RINOK(OpenCallback->SetTotal(&numRecs64, &MftSize));
+  }
+  Table.Clear();
+  Table.Heads.ClearAndReserve(numRecs);
+  
+  CMftParseParams params;
+  params.SectorSizeLog = Header.SectorSizeLog;
+  params.RecSizeLog = RecSizeLog;
+  params.NumSectorsInRec = NumSectorsInRec;
+  params.ShowSystemFiles = _showSystemFiles;
+  params.ShowDeletedFiles = _showDeletedFiles;
+
+  const UInt32 numRecsInChunk = (UInt32)(kMftChunkSize >> RecSizeLog);
+
+  CMftChunk chunkST;
+  
+  /* The chunks of MFT are parsed by (numThreads) threads.
+     The main thread reads the chunks and it appends the results to table in original order. */
+
+  #ifndef _7ZIP_ST
+  CObjArray<CMftChunkJob> jobs; // it must be destroyed after (threads)
+  CDecodeThreads threads;
+  RINOK(threads.Create(_mtProps.NumThreads, (numRecs + numRecsInChunk - 1) / numRecsInChunk));
+  const unsigned numThreads = threads.Size();
+  if (numThreads != 0)
+    jobs.Alloc(numThreads);
+  unsigned numStarted = 0;
+  unsigned numFinished = 0;
+  #endif
+
+  for (UInt32 nextRec = 0;;)
+  {
+    CMftChunk *chunk = &chunkST;
+    
+    #ifndef _7ZIP_ST
+    if (numThreads != 0)
+    {
+      if (numStarted != numFinished && (numStarted - numFinished == numThreads || nextRec == numRecs))
+      {
+        const unsigned k = numFinished % numThreads;
+        numFinished++;
+        RINOK(threads[k].WaitJob());
+        Table.Append(jobs[k].Chunk.Table);
+        if (OpenCallback)
+        {
+          const UInt64 numFiles = Table.Heads.Size();
+          const UInt64 pos = numFiles << RecSizeLog;
+          RINOK(OpenCallback->SetCompleted(&numFiles, &pos));
+        }
+        continue;
+      }
+      chunk = &jobs[numStarted % numThreads].Chunk;
+    }
+    #endif
+    
+    if (nextRec == numRecs)
+      break;
+    
+    const UInt32 num = MyMin(numRecsInChunk, numRecs - nextRec);
+    const size_t size = (size_t)num << RecSizeLog;
+    if (chunk->Buf.Size() != kMftChunkSize)
+      chunk->Buf.Alloc(kMftChunkSize);
+    RINOK(ReadStream_FALSE(MftStream, chunk->Buf, size));
+    chunk->Size = size;
+    chunk->FirstRec = nextRec;
+    chunk->Params = &params;
+    nextRec += num;
+
+    #ifndef _7ZIP_ST
+    if (numThreads != 0)
+    {
+      const unsigned k = numStarted % numThreads;
+      threads[k].StartJob(&jobs[k]);
+      numStarted++;
+      continue;
+    }
+    #endif
+
+    RINOK(chunk->Parse());
+    Table.Append(chunk->Table);
+    if (OpenCallback)
+    {
+      const UInt64 numFiles = Table.Heads.Size();
+      const UInt64 pos = numFiles << RecSizeLog;
+      RINOK(OpenCallback->SetCompleted(&numFiles, &pos));
+    }
+  }
+  
+  return S_OK;
+}
+
 HRESULT CDatabase::Open()
 {
   Clear();
@@ -1668,9 +2069,7 @@ HRESULT CDatabase::Open()
   SeekToCluster(Header.MftCluster);
 
   CMftRec mftRec;
-  UInt32 numSectorsInRec;
 
-  CMyComPtr<IInStream> mftStream;
   {
     UInt32 blockSize = 1 << 12;
     ByteBuf.Alloc(blockSize);
@@ -1686,84 +2085,33 @@ HRESULT CDatabase::Open()
         return S_FALSE;
     }
 
-    numSectorsInRec = 1 << (RecSizeLog - Header.SectorSizeLog);
-    if (!mftRec.Parse(ByteBuf, Header.SectorSizeLog, numSectorsInRec, 0, NULL))
+    NumSectorsInRec = 1 << (RecSizeLog - Header.SectorSizeLog);
+    if (!mftRec.Parse(ByteBuf, Header.SectorSizeLog, NumSectorsInRec, 0, NULL))
       return S_FALSE;
     if (!mftRec.IsFILE())
       return S_FALSE;
     mftRec.ParseDataNames();
     if (mftRec.DataRefs.IsEmpty())
       return S_FALSE;
-    RINOK(mftRec.GetStream(InStream, 0, Header.ClusterSizeLog, Header.NumClusters, &mftStream));
-    if (!mftStream)
+    RINOK(mftRec.GetStream(InStream, 0, Header.ClusterSizeLog, Header.NumClusters, &MftStream));
+    if (!MftStream)
       return S_FALSE;
   }
 
   // CObjectVector<CAttr> SecurityAttrs;
 
-  UInt64 mftSize = mftRec.DataAttrs[0].Size;
-  if ((mftSize >> 4) > Header.GetPhySize_Clusters())
-    return S_FALSE;
-
-  const size_t kBufSize = (1 << 15);
-  const size_t recSize = ((size_t)1 << RecSizeLog);
-  if (kBufSize < recSize)
+  MftSize = mftRec.DataAttrs[0].Size;
+  if ((MftSize >> 4) > Header.GetPhySize_Clusters())
     return S_FALSE;
 
-  {
-    const UInt64 numFiles = mftSize >> RecSizeLog;
-    if (numFiles > (1 << 30))
-      return S_FALSE;
-    if (OpenCallback)
-    {
-      RINOK(OpenCallback->SetTotal(&numFiles, &mftSize));
-    }
-    
-    ByteBuf.Alloc(kBufSize);
-    Recs.ClearAndReserve((unsigned)numFiles);
-  }
-  
-  for (UInt64 pos64 = 0;;)
-  {
-    if (OpenCallback)
-    {
-      const UInt64 numFiles = Recs.Size();
-      if ((numFiles & 0x3FF) == 0)
-      {
-        RINOK(OpenCallback->SetCompleted(&numFiles, &pos64));
-      }
-    }
-    size_t readSize = kBufSize;
-    {
-      const UInt64 rem = mftSize - pos64;
-      if (readSize > rem)
-        readSize = (size_t)rem;
-    }
-    if (readSize < recSize)
-      break;
-    RINOK(ReadStream_FALSE(mftStream, ByteBuf, readSize));
-    pos64 += readSize;
-
-    for (size_t i = 0; readSize >= recSize; i += recSize, readSize -= recSize)
-    {
-      PRF(printf("\n---------------------"));
-      PRF(printf("\n%5d:", Recs.Size()));
-      
-      Byte *p = ByteBuf + i;
-      CMftRec rec;
+  RINOK(ParseMft());
 
-      CObjectVector<CAttr> *attrs = NULL;
-      unsigned recIndex = Recs.Size();
-      switch (recIndex)
-      {
-        case kRecIndex_Volume: attrs = &VolAttrs; break;
-        // case kRecIndex_Security: attrs = &SecurityAttrs; break;
-      }
+  const unsigned numRecs = Table.Heads.Size();
 
-      if (!rec.Parse(p, Header.SectorSizeLog, numSectorsInRec, (UInt32)Recs.Size(), attrs))
-        return S_FALSE;
-      Recs.Add(rec);
-    }
+  if (numRecs > kRecIndex_Volume)
+  {
+    CMftRec volRec;
+    RINOK(ReadRec(kRecIndex_Volume, volRec, &VolAttrs));
   }
 
   /*
@@ -1814,69 +2162,78 @@ HRESULT CDatabase::Open()
 
   unsigned i;
   
-  for (i = 0; i < Recs.Size(); i++)
+  for (i = 0; i < numRecs; i++)
   {
-    CMftRec &rec = Recs[i];
-    if (!rec.BaseMftRef.IsBaseItself())
+    const CRecHead &head = Table.Heads[i];
+    CMftRef baseRef;
+    baseRef.Val = head.BaseMftRef;
+    if (!head.IsFILE || baseRef.IsBaseItself())
+      continue;
+    UInt64 refIndex = baseRef.GetIndex();
+    if (refIndex >= numRecs)
+      return S_FALSE;
+    CRecHead &refHead = Table.Heads[(unsigned)refIndex];
+    bool moveAttrs = (refHead.SeqNumber == baseRef.GetNumber() && refHead.BaseMftRef == 0);
+    if (head.InUse() && refHead.InUse())
     {
-      UInt64 refIndex = rec.BaseMftRef.GetIndex();
-      if (refIndex > (UInt32)Recs.Size())
+      if (!moveAttrs)
         return S_FALSE;
-      CMftRec &refRec = Recs[(unsigned)refIndex];
-      bool moveAttrs = (refRec.SeqNumber == rec.BaseMftRef.GetNumber() && refRec.BaseMftRef.IsBaseItself());
-      if (rec.InUse() && refRec.InUse())
-      {
-        if (!moveAttrs)
-          return S_FALSE;
-      }
-      else if (rec.InUse() || refRec.InUse())
-        moveAttrs = false;
-      if (moveAttrs)
-        refRec.MoveAttrsFrom(rec);
     }
+    else if (head.InUse() || refHead.InUse())
+      moveAttrs = false;
+    if (moveAttrs)
+    {
+      // LoadRec() reads the attributes of extension records
+      ExtRecs.Add(((UInt64)refIndex << 32) | i);
+      refHead.HasExtRecs = true;
+    }
+  }
+  ExtRecs.Sort(CompareExtRecs, NULL);
+
+  Recs.ClearAndReserve(numRecs);
+  for (i = 0; i < numRecs; i++)
+  {
+    const CRecHead &head = Table.Heads[i];
+    CRecInfo rec;
+    rec.SeqNumber = head.SeqNumber;
+    rec.Flags = head.Flags;
+    rec.MyNumNameLinks = 0;
+    rec.MyItemIndex = -1;
+    Recs.AddInReserved(rec);
   }
 
-  for (i = 0; i < Recs.Size(); i++)
-    Recs[i].ParseDataNames();
+  CRecordVector<UInt64> parentRefs; // ParentDirRef for each item
   
-  for (i = 0; i < Recs.Size(); i++)
+  for (i = 0; i < numRecs; i++)
   {
-    CMftRec &rec = Recs[i];
-    if (!rec.IsFILE() || !rec.BaseMftRef.IsBaseItself())
+    CRecHead head = Table.Heads[i];
+    if (!head.IsFILE || head.BaseMftRef != 0)
       continue;
     if (i < kNumSysRecs && !_showSystemFiles)
       continue;
-    if (!rec.InUse() && !_showDeletedFiles)
+    if (!head.InUse() && !_showDeletedFiles)
       continue;
 
-    rec.MyNumNameLinks = rec.FileNames.Size();
-    
-    // printf("\n%4d: ", i);
-    
-    /* Actually DataAttrs / DataRefs are sorted by name.
-       It can not be more than one unnamed stream in DataRefs
-       And indexOfUnnamedStream <= 0.
-    */
+    CRecInfo &rec = Recs[i];
 
-    int indexOfUnnamedStream = -1;
-    if (!rec.IsDir())
+    if (head.HasExtRecs || (head.NumNames == 0 && i < kNumSysRecs))
     {
-      FOR_VECTOR (di, rec.DataRefs)
-        if (rec.DataAttrs[rec.DataRefs[di].Start].Name.IsEmpty())
-        {
-          indexOfUnnamedStream = di;
-          break;
-        }
+      RINOK(LoadRec(i));
+      Table.AddNames(Rec, head);
     }
-
-    if (rec.FileNames.IsEmpty())
+    
+    rec.MyNumNameLinks = head.NumNames;
+    
+    // printf("\n%4d: ", i);
+    
+    if (head.NumNames == 0)
     {
       bool needShow = true;
       if (i < kNumSysRecs)
       {
         needShow = false;
-        FOR_VECTOR (di, rec.DataRefs)
-          if (rec.GetSize(di) != 0)
+        FOR_VECTOR (di, Rec.DataRefs)
+          if (Rec.GetSize(di) != 0)
           {
             needShow = true;
             break;
@@ -1884,37 +2241,68 @@ HRESULT CDatabase::Open()
       }
       if (needShow)
       {
-        CFileNameAttr &fna = rec.FileNames.AddNew();
+        CNameRef ref;
         // we set incorrect ParentDirRef, that will place item to [LOST] folder
-        fna.ParentDirRef.Val = (UInt64)(Int64)-1;
+        ref.ParentDirRef = (UInt64)(Int64)-1;
         char s[16 + 16];
         ConvertUInt32ToString(i, MyStpCpy(s, "[NONAME]-"));
-        fna.Name.SetFromAscii(s);
-        fna.NameType = kFileNameType_Win32Dos;
-        fna.Attrib = 0;
+        UString2 name;
+        name.SetFromAscii(s);
+        ref.Len = (UInt16)name.Len();
+        ref.Pos = Table.AddString(name.GetRawPtr(), ref.Len);
+        ref.NameType = kFileNameType_Win32Dos;
+        head.FirstName = Table.Names.Add(ref);
+        head.NumNames = 1;
       }
     }
 
+    /* Actually DataAttrs / DataRefs are sorted by name.
+       It can not be more than one unnamed stream in DataRefs
+       And indexOfUnnamedStream <= 0.
+    */
+
+    int indexOfUnnamedStream = -1;
+    if (!rec.IsDir())
+    {
+      for (unsigned di = 0; di < head.NumStreams; di++)
+        if (Table.Streams[head.FirstStream + di].Len == 0)
+        {
+          indexOfUnnamedStream = di;
+          break;
+        }
+    }
+
     // bool isMainName = true;
 
-    FOR_VECTOR (t, rec.FileNames)
+    for (unsigned t = 0; t < head.NumNames; t++)
     {
-      #ifdef SHOW_DEBUG_INFO
-      const CFileNameAttr &fna = rec.FileNames[t];
-      #endif
-      PRF(printf("\n %4d ", (int)fna.NameType));
-      PRF_UTF16(fna.Name);
+      const CNameRef &fn = Table.Names[head.FirstName + t];
+      PRF(printf("\n %4d ", (int)fn.NameType));
+      PRF_UTF16(GetName(fn.Pos));
       // PRF(printf("  | "));
 
-      if (rec.FindWin32Name_for_DosName(t) >= 0)
+      if (fn.NameType == kFileNameType_Dos)
       {
-        rec.MyNumNameLinks--;
-        continue;
+        // we skip dos name, if there is win32 name for same folder
+        unsigned k;
+        for (k = 0; k < head.NumNames; k++)
+        {
+          const CNameRef &next = Table.Names[head.FirstName + k];
+          if (next.NameType == kFileNameType_Win32 && next.ParentDirRef == fn.ParentDirRef)
+            break;
+        }
+        if (k != head.NumNames)
+        {
+          rec.MyNumNameLinks--;
+          continue;
+        }
       }
       
       CItem item;
       item.NameIndex = t;
       item.RecIndex = i;
+      item.NamePos = fn.Pos;
+      item.NameLen = fn.Len;
       item.DataIndex = rec.IsDir() ?
           k_Item_DataIndex_IsDir :
             (indexOfUnnamedStream < 0 ?
@@ -1924,6 +2312,7 @@ HRESULT CDatabase::Open()
       if (rec.MyItemIndex < 0)
         rec.MyItemIndex = Items.Size();
       item.ParentHost = Items.Add(item);
+      parentRefs.Add(fn.ParentDirRef);
       
       /* we can use that code to reduce the number of alt streams:
          it will not show how alt streams for hard links. */
@@ -1931,33 +2320,41 @@ HRESULT CDatabase::Open()
 
       unsigned numAltStreams = 0;
 
-      FOR_VECTOR (di, rec.DataRefs)
+      for (unsigned di = 0; di < head.NumStreams; di++)
       {
         if (!rec.IsDir() && (int)di == indexOfUnnamedStream)
           continue;
 
-        const UString2 &subName = rec.DataAttrs[rec.DataRefs[di].Start].Name;
+        const CNameRef &subName = Table.Streams[head.FirstStream + di];
         
         PRF(printf("\n alt stream: "));
-        PRF_UTF16(subName);
+        PRF_UTF16(GetName(subName.Pos));
 
         {
           // $BadClus:$Bad is sparse file for all clusters. So we skip it.
-          if (i == kRecIndex_BadClus && subName == L"$Bad")
+          if (i == kRecIndex_BadClus && wcscmp(GetName(subName.Pos), L"$Bad") == 0)
             continue;
         }
 
         numAltStreams++;
         ThereAreAltStreams = true;
         item.DataIndex = di;
+        item.StreamNamePos = subName.Pos;
+        item.StreamNameLen = subName.Len;
         Items.Add(item);
+        parentRefs.Add(fn.ParentDirRef);
       }
     }
   }
+
+  Table.Heads.ClearAndFree();
+  Table.Names.ClearAndFree();
+  Table.Streams.ClearAndFree();
   
   if (Recs.Size() > kRecIndex_Security)
   {
-    const CMftRec &rec = Recs[kRecIndex_Security];
+    RINOK(LoadRec(kRecIndex_Security));
+    const CMftRec &rec = Rec;
     FOR_VECTOR (di, rec.DataRefs)
     {
       const CAttr &attr = rec.DataAttrs[rec.DataRefs[di].Start];
@@ -1994,9 +2391,8 @@ HRESULT CDatabase::Open()
   for (i = 0; i < Items.Size(); i++)
   {
     CItem &item = Items[i];
-    const CMftRec &rec = Recs[item.RecIndex];
-    const CFileNameAttr &fn = rec.FileNames[item.NameIndex];
-    const CMftRef &parentDirRef = fn.ParentDirRef;
+    CMftRef parentDirRef;
+    parentDirRef.Val = parentRefs[i];
     UInt64 refIndex = parentDirRef.GetIndex();
     if (refIndex == kRecIndex_RootDir)
       item.ParentFolder = -1;
@@ -2113,23 +2509,30 @@ STDMETHODIMP CHandler::GetRawProp(UInt32 index, PROPID propID, const void **data
   if (propID == kpidName)
   {
     #ifdef MY_CPU_LE
-    const UString2 *s;
+    const wchar_t *s;
+    unsigned len;
     if (index >= Items.Size())
-      s = &VirtFolderNames[index - Items.Size()];
+    {
+      const UString2 &name = VirtFolderNames[index - Items.Size()];
+      s = name.IsEmpty() ? (const wchar_t *)EmptyString : name.GetRawPtr();
+      len = name.Len();
+    }
     else
     {
       const CItem &item = Items[index];
-      const CMftRec &rec = Recs[item.RecIndex];
       if (item.IsAltStream())
-        s = &rec.DataAttrs[rec.DataRefs[item.DataIndex].Start].Name;
+      {
+        s = GetName(item.StreamNamePos);
+        len = item.StreamNameLen;
+      }
       else
-        s = &rec.FileNames[item.NameIndex].Name;
+      {
+        s = GetName(item.NamePos);
+        len = item.NameLen;
+      }
     }
-    if (s->IsEmpty())
-      *data = (const wchar_t *)EmptyString;
-    else
-      *data = s->GetRawPtr();
-    *dataSize = (s->Len() + 1) * sizeof(wchar_t);
+    *data = s;
+    *dataSize = (len + 1) * sizeof(wchar_t);
     *propType = PROP_DATA_TYPE_wchar_t_PTR_Z_LE;
     #endif
     return S_OK;
@@ -2140,8 +2543,8 @@ STDMETHODIMP CHandler::GetRawProp(UInt32 index, PROPID propID, const void **data
     if (index >= Items.Size())
       return S_OK;
     const CItem &item = Items[index];
-    const CMftRec &rec = Recs[item.RecIndex];
-    const CByteBuffer &reparse = rec.ReparseData;
+    RINOK(LoadRec(item.RecIndex));
+    const CByteBuffer &reparse = Rec.ReparseData;
 
     if (reparse.Size() != 0)
     {
@@ -2156,7 +2559,8 @@ STDMETHODIMP CHandler::GetRawProp(UInt32 index, PROPID propID, const void **data
     if (index >= Items.Size())
       return S_OK;
     const CItem &item = Items[index];
-    const CMftRec &rec = Recs[item.RecIndex];
+    RINOK(LoadRec(item.RecIndex));
+    const CMftRec &rec = Rec;
     if (rec.SiAttr.SecurityId >= 0)
     {
       UInt64 offset;
@@ -2180,8 +2584,8 @@ STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
     return S_OK;
   IInStream *stream2;
   const CItem &item = Items[index];
-  const CMftRec &rec = Recs[item.RecIndex];
-  HRESULT res = rec.GetStream(InStream, item.DataIndex, Header.ClusterSizeLog, Header.NumClusters, &stream2);
+  RINOK(LoadRec(item.RecIndex));
+  HRESULT res = Rec.GetStream(InStream, item.DataIndex, Header.ClusterSizeLog, Header.NumClusters, &stream2);
   *stream = (ISequentialInStream *)stream2;
   return res;
   COM_TRY_END
@@ -2297,7 +2701,12 @@ STDMETHODIMP CHandler::GetArchiveProperty(PROPID propID, PROPVARIANT *value)
   COM_TRY_BEGIN
   NCOM::CPropVariant prop;
 
-  const CMftRec *volRec = (Recs.Size() > kRecIndex_Volume ? &Recs[kRecIndex_Volume] : NULL);
+  const CMftRec *volRec = NULL;
+  if ((propID == kpidCTime || propID == kpidMTime) && Recs.Size() > kRecIndex_Volume)
+  {
+    RINOK(LoadRec(kRecIndex_Volume));
+    volRec = &Rec;
+  }
 
   switch (propID)
   {
@@ -2423,7 +2832,8 @@ STDMETHODIMP CHandler::GetProperty(UInt32 index, PROPID propID, PROPVARIANT *val
   }
 
   const CItem &item = Items[index];
-  const CMftRec &rec = Recs[item.RecIndex];
+  RINOK(LoadRec(item.RecIndex));
+  const CMftRec &rec = Rec;
 
   const CAttr *data= NULL;
   if (item.DataIndex >= 0)
@@ -2479,21 +2889,16 @@ STDMETHODIMP CHandler::GetProperty(UInt32 index, PROPID propID, PROPVARIANT *val
 
     case kpidName:
     {
-      const UString2 *s;
       if (item.IsAltStream())
-        s = &rec.DataAttrs[rec.DataRefs[item.DataIndex].Start].Name;
-      else
-        s = &rec.FileNames[item.NameIndex].Name;
-      if (s->IsEmpty())
-        prop = (const wchar_t *)EmptyString;
+        prop = GetName(item.StreamNamePos);
       else
-        prop = s->GetRawPtr();
+        prop = GetName(item.NamePos);
       break;
     }
 
     case kpidShortName:
     {
-      if (!item.IsAltStream())
+      if (!item.IsAltStream() && item.NameIndex < rec.FileNames.Size())
       {
         int dosNameIndex = rec.FindDosName(item.NameIndex);
         if (dosNameIndex >= 0)
@@ -2510,7 +2915,7 @@ STDMETHODIMP CHandler::GetProperty(UInt32 index, PROPID propID, PROPVARIANT *val
 
     case kpidIsDir: prop = item.IsDir(); break;
     case kpidIsAltStream: prop = item.IsAltStream(); break;
-    case kpidIsDeleted: prop = !rec.InUse(); break;
+    case kpidIsDeleted: prop = !Recs[item.RecIndex].InUse(); break;
     case kpidIsAux: prop = false; break;
 
     case kpidMTime: NtfsTimeToProp(rec.SiAttr.MTime, prop); break;
@@ -2548,7 +2953,13 @@ STDMETHODIMP CHandler::GetProperty(UInt32 index, PROPID propID, PROPVARIANT *val
       prop = attrib;
       break;
     }
-    case kpidLinks: if (rec.MyNumNameLinks != 1) prop = rec.MyNumNameLinks; break;
+    case kpidLinks:
+    {
+      const UInt32 numLinks = Recs[item.RecIndex].MyNumNameLinks;
+      if (numLinks != 1)
+        prop = numLinks;
+      break;
+    }
     
     case kpidNumAltStreams:
     {
@@ -2622,9 +3033,11 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     if (index >= (UInt32)Items.Size())
       continue;
     const CItem &item = Items[allFilesMode ? i : indices[i]];
-    const CMftRec &rec = Recs[item.RecIndex];
     if (item.DataIndex >= 0)
-      totalSize += rec.GetSize(item.DataIndex);
+    {
+      RINOK(LoadRec(item.RecIndex));
+      totalSize += Rec.GetSize(item.DataIndex);
+    }
   }
   RINOK(extractCallback->SetTotal(totalSize));
 
@@ -2673,12 +3086,20 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     realOutStream.Release();
     outStreamSpec->Init();
 
-    const CMftRec &rec = Recs[item.RecIndex];
+    RINOK(LoadRec(item.RecIndex));
+    UInt64 packSize = 0;
+    UInt64 unpackSize = 0;
+    if (item.DataIndex >= 0)
+    {
+      const CAttr &data = Rec.DataAttrs[Rec.DataRefs[item.DataIndex].Start];
+      packSize = data.GetPackSize();
+      unpackSize = data.GetSize();
+    }
 
     int res = NExtract::NOperationResult::kDataError;
     {
       CMyComPtr<IInStream> inStream;
-      HRESULT hres = rec.GetStream(InStream, item.DataIndex, Header.ClusterSizeLog, Header.NumClusters, &inStream);
+      HRESULT hres = Rec.GetStream(InStream, item.DataIndex, Header.ClusterSizeLog, Header.NumClusters, &inStream);
       if (hres == S_FALSE)
         res = NExtract::NOperationResult::kUnsupportedMethod;
       else
@@ -2696,12 +3117,8 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
         }
       }
     }
-    if (item.DataIndex >= 0)
-    {
-      const CAttr &data = rec.DataAttrs[rec.DataRefs[item.DataIndex].Start];
-      totalPackSize += data.GetPackSize();
-      totalSize += data.GetSize();
-    }
+    totalPackSize += packSize;
+    totalSize += unpackSize;
     outStreamSpec->ReleaseStream();
     RINOK(extractCallback->SetOperationResult(res));
   }
@@ -2737,7 +3154,9 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
       RINOK(PROPVARIANT_to_bool(prop, _showSystemFiles));
     }
     else
-      return E_INVALIDARG;
+    {
+      RINOK(_mtProps.SetProperty(name, prop));
+    }
   }
   return S_OK;
 }
@@ -6,10 +6,12 @@
 
 #include "../../../C/CpuArch.h"
 
+#include "../../Common/AutoPtr.h"
 #include "../../Common/ComTry.h"
 #include "../../Common/IntToString.h"
 
 #include "../../Windows/PropVariant.h"
+#include "../../Windows/System.h"
 
 #include "../Common/RegisterArc.h"
 #include "../Common/StreamObjects.h"
@@ -31,6 +33,53 @@ namespace NQcow {
   
 static const Byte k_Signature[] = SIGNATURE;
 
+class CDeflateClusterDecoder: public CClusterDecoder
+{
+  CBufInStream *_bufInStreamSpec;
+  CMyComPtr<ISequentialInStream> _bufInStream;
+
+  CBufPtrSeqOutStream *_bufOutStreamSpec;
+  CMyComPtr<ISequentialOutStream> _bufOutStream;
+
+  NCompress::NDeflate::NDecoder::CCOMCoder *_deflateDecoderSpec;
+  CMyComPtr<ICompressCoder> _deflateDecoder;
+public:
+  CDeflateClusterDecoder()
+  {
+    _bufInStreamSpec = new CBufInStream;
+    _bufInStream = _bufInStreamSpec;
+    _bufOutStreamSpec = new CBufPtrSeqOutStream();
+    _bufOutStream = _bufOutStreamSpec;
+    _deflateDecoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder();
+    _deflateDecoder = _deflateDecoderSpec;
+    _deflateDecoderSpec->Set_NeedFinishInput(true);
+  }
+
+  HRESULT Decode(const Byte *src, size_t srcSize, Byte *dest, size_t &destSize)
+  {
+    _bufInStreamSpec->Init(src, srcSize);
+    _bufOutStreamSpec->Init(dest, destSize);
+    
+    // Do we need to use smaller block than clusterSize for last cluster?
+    UInt64 blockSize64 = destSize;
+    HRESULT res = _deflateDecoderSpec->Code(_bufInStream, _bufOutStream, NULL, &blockSize64, NULL);
+
+    /*
+    if (_bufOutStreamSpec->GetPos() != destSize)
+      memset(dest + _bufOutStreamSpec->GetPos(), 0, destSize - _bufOutStreamSpec->GetPos());
+    */
+
+    if (res == S_OK)
+      if (!_deflateDecoderSpec->IsFinished()
+          || _bufOutStreamSpec->GetPos() != destSize)
+        res = S_FALSE;
+    return res;
+  }
+};
+
+static CClusterDecoder *CreateDeflateClusterDecoder() { return new CDeflateClusterDecoder; }
+
+
 class CHandler: public CHandlerImg
 {
   unsigned _clusterBits;
@@ -38,8 +87,8 @@ class CHandler: public CHandlerImg
   UInt64 _compressedFlag;
 
   CObjectVector<CByteBuffer> _tables;
-  UInt64 _cacheCluster;
-  CByteBuffer _cache;
+  CClusterCache _clusterCache;
+  UInt64 _nextCluster; // the cluster that follows last unpacked cluster
   CByteBuffer _cacheCompressed;
 
   UInt64 _comprPos;
@@ -47,14 +96,7 @@ class CHandler: public CHandlerImg
 
   UInt64 _phySize;
 
-  CBufInStream *_bufInStreamSpec;
-  CMyComPtr<ISequentialInStream> _bufInStream;
-
-  CBufPtrSeqOutStream *_bufOutStreamSpec;
-  CMyComPtr<ISequentialOutStream> _bufOutStream;
-
-  NCompress::NDeflate::NDecoder::CCOMCoder *_deflateDecoderSpec;
-  CMyComPtr<ICompressCoder> _deflateDecoder;
+  CMyAutoPtr<CClusterDecoder> _decoder;
 
   bool _needDeflate;
   bool _isArc;
@@ -75,6 +117,10 @@ class CHandler: public CHandlerImg
     return Seek(0);
   }
 
+  UInt64 GetClusterEntry(UInt64 cluster) const;
+  HRESULT ReadPackedCluster(UInt64 v, const Byte *&packed, size_t &packedSize);
+  HRESULT DecodeCluster(UInt64 cluster, UInt64 v);
+
   HRESULT Open2(IInStream *stream, IArchiveOpenCallback *openCallback);
 
 public:
@@ -85,6 +131,117 @@ public:
 };
 
 
+UInt64 CHandler::GetClusterEntry(UInt64 cluster) const
+{
+  UInt64 high = cluster >> _numMidBits;
+  if (high < _tables.Size())
+  {
+    const CByteBuffer &buffer = _tables[(unsigned)high];
+    if (buffer.Size() != 0)
+    {
+      size_t midBits = (size_t)cluster & (((size_t)1 << _numMidBits) - 1);
+      return Get64((const Byte *)buffer + (midBits << 3));
+    }
+  }
+  return 0;
+}
+
+
+HRESULT CHandler::ReadPackedCluster(UInt64 v, const Byte *&packed, size_t &packedSize)
+{
+  unsigned numOffsetBits = (62 - (_clusterBits - 8));
+  UInt64 offset = v & (((UInt64)1 << 62) - 1);
+  const size_t dataSize = ((size_t)(offset >> numOffsetBits) + 1) << 9;
+  offset &= ((UInt64)1 << numOffsetBits) - 1;
+  UInt64 sectorOffset = offset >> 9 << 9;
+  UInt64 offset2inCache = sectorOffset - _comprPos;
+  
+  if (sectorOffset >= _comprPos && offset2inCache < _comprSize)
+  {
+    if (offset2inCache != 0)
+    {
+      _comprSize -= (size_t)offset2inCache;
+      memmove(_cacheCompressed, _cacheCompressed + offset2inCache, _comprSize);
+      _comprPos = sectorOffset;
+    }
+    sectorOffset += _comprSize;
+  }
+  else
+  {
+    _comprPos = sectorOffset;
+    _comprSize = 0;
+  }
+  
+  // printf("\nDeflate");
+  if (sectorOffset != _posInArc)
+  {
+    // printf("\nDeflate %12I64x %12I64x\n", sectorOffset, sectorOffset - _posInArc);
+    RINOK(Seek(sectorOffset));
+  }
+  
+  if (_cacheCompressed.Size() < dataSize)
+    return E_FAIL;
+  if (dataSize > _comprSize)
+  {
+    size_t dataSize3 = dataSize - _comprSize;
+    size_t dataSize2 = dataSize3;
+    RINOK(ReadStream(Stream, _cacheCompressed + _comprSize, &dataSize2));
+    _posInArc += dataSize2;
+    if (dataSize2 != dataSize3)
+      return E_FAIL;
+    _comprSize += dataSize2;
+  }
+  
+  const size_t kSectorMask = (1 << 9) - 1;
+  size_t offsetInSector = ((size_t)offset & kSectorMask);
+  packed = _cacheCompressed + offsetInSector;
+  packedSize = dataSize - offsetInSector;
+  return S_OK;
+}
+
+
+HRESULT CHandler::DecodeCluster(UInt64 cluster, UInt64 v)
+{
+  const size_t clusterSize = (size_t)1 << _clusterBits;
+  const Byte *packed;
+  size_t packedSize;
+
+  #ifndef _7ZIP_ST
+  /* If reading is sequential, we also unpack the next compressed clusters
+     in parallel threads. Packed data is read here in order of clusters. */
+  if (cluster == _nextCluster && _clusterCache.GetNumThreads() > 1)
+  {
+    RINOK(ReadPackedCluster(v, packed, packedSize));
+    for (;;)
+    {
+      CClusterDecodeJob &job = _clusterCache.AddJob(cluster);
+      memcpy(job.Packed, packed, packedSize);
+      job.PackedSize = packedSize;
+      job.DestSize = clusterSize;
+      _nextCluster = ++cluster;
+      if (_clusterCache.GetNumJobs() == _clusterCache.GetNumThreads()
+          || (cluster << _clusterBits) >= _size
+          || _clusterCache.IsCached(cluster))
+        break;
+      v = GetClusterEntry(cluster);
+      if ((v & _compressedFlag) == 0
+          || ReadPackedCluster(v, packed, packedSize) != S_OK)
+        break;
+    }
+    return _clusterCache.DecodeJobs();
+  }
+  #endif
+
+  RINOK(ReadPackedCluster(v, packed, packedSize));
+  unsigned slotIndex = _clusterCache.GetNewSlot();
+  size_t destSize = clusterSize;
+  RINOK((*_decoder).Decode(packed, packedSize, _clusterCache.GetSlotData(slotIndex), destSize));
+  _clusterCache.SetSlotKey(slotIndex, cluster);
+  _nextCluster = cluster + 1;
+  return S_OK;
+}
+
+
 STDMETHODIMP CHandler::Read(void *data, UInt32 size, UInt32 *processedSize)
 {
   if (processedSize)
@@ -110,127 +267,46 @@ STDMETHODIMP CHandler::Read(void *data, UInt32 size, UInt32 *processedSize)
         size = (UInt32)rem;
     }
 
-    if (cluster == _cacheCluster)
     {
-      memcpy(data, _cache + lowBits, size);
-      _virtPos += size;
-      if (processedSize)
-        *processedSize = size;
-      return S_OK;
+      const Byte *cache = _clusterCache.Find(cluster);
+      if (cache)
+      {
+        memcpy(data, cache + lowBits, size);
+        _virtPos += size;
+        if (processedSize)
+          *processedSize = size;
+        return S_OK;
+      }
     }
     
-    UInt64 high = cluster >> _numMidBits;
- 
-    if (high < _tables.Size())
+    UInt64 v = GetClusterEntry(cluster);
+        
+    if (v != 0)
     {
-      const CByteBuffer &buffer = _tables[(unsigned)high];
-    
-      if (buffer.Size() != 0)
+      if ((v & _compressedFlag) != 0)
       {
-        size_t midBits = (size_t)cluster & (((size_t)1 << _numMidBits) - 1);
-        const Byte *p = (const Byte *)buffer + (midBits << 3);
-        UInt64 v = Get64(p);
-        
-        if (v != 0)
-        {
-          if ((v & _compressedFlag) != 0)
-          {
-            if (_version <= 1)
-              return E_FAIL;
-            unsigned numOffsetBits = (62 - (_clusterBits - 8));
-            UInt64 offset = v & (((UInt64)1 << 62) - 1);
-            const size_t dataSize = ((size_t)(offset >> numOffsetBits) + 1) << 9;
-            offset &= ((UInt64)1 << numOffsetBits) - 1;
-            UInt64 sectorOffset = offset >> 9 << 9;
-            UInt64 offset2inCache = sectorOffset - _comprPos;
-            
-            if (sectorOffset >= _comprPos && offset2inCache < _comprSize)
-            {
-              if (offset2inCache != 0)
-              {
-                _comprSize -= (size_t)offset2inCache;
-                memmove(_cacheCompressed, _cacheCompressed + offset2inCache, _comprSize);
-                _comprPos = sectorOffset;
-              }
-              sectorOffset += _comprSize;
-            }
-            else
-            {
-              _comprPos = sectorOffset;
-              _comprSize = 0;
-            }
-            
-            // printf("\nDeflate");
-            if (sectorOffset != _posInArc)
-            {
-              // printf("\nDeflate %12I64x %12I64x\n", sectorOffset, sectorOffset - _posInArc);
-              RINOK(Seek(sectorOffset));
-            }
-            
-            if (_cacheCompressed.Size() < dataSize)
-              return E_FAIL;
-            size_t dataSize3 = dataSize - _comprSize;
-            size_t dataSize2 = dataSize3;
-            RINOK(ReadStream(Stream, _cacheCompressed + _comprSize, &dataSize2));
-            _posInArc += dataSize2;
-            if (dataSize2 != dataSize3)
-              return E_FAIL;
-            _comprSize += dataSize2;
-            
-            const size_t kSectorMask = (1 << 9) - 1;
-            size_t offsetInSector = ((size_t)offset & kSectorMask);
-            _bufInStreamSpec->Init(_cacheCompressed + offsetInSector, dataSize - offsetInSector);
-            
-            _cacheCluster = (UInt64)(Int64)-1;
-            if (_cache.Size() < clusterSize)
-              return E_FAIL;
-            _bufOutStreamSpec->Init(_cache, clusterSize);
-            
-            // Do we need to use smaller block than clusterSize for last cluster?
-            UInt64 blockSize64 = clusterSize;
-            HRESULT res = _deflateDecoderSpec->Code(_bufInStream, _bufOutStream, NULL, &blockSize64, NULL);
-
-            /*
-            if (_bufOutStreamSpec->GetPos() != clusterSize)
-              memset(_cache + _bufOutStreamSpec->GetPos(), 0, clusterSize - _bufOutStreamSpec->GetPos());
-            */
-
-            if (res == S_OK)
-              if (!_deflateDecoderSpec->IsFinished()
-                  || _bufOutStreamSpec->GetPos() != clusterSize)
-                res = S_FALSE;
-
-            RINOK(res);
-            _cacheCluster = cluster;
-            
-            continue;
-            /*
-            memcpy(data, _cache + lowBits, size);
-            _virtPos += size;
-            if (processedSize)
-              *processedSize = size;
-            return S_OK;
-            */
-          }
+        if (_version <= 1)
+          return E_FAIL;
+        RINOK(DecodeCluster(cluster, v));
+        continue;
+      }
 
-          // version 3 support zero clusters
-          if (((UInt32)v & 511) != 1)
-          {
-            v &= (_compressedFlag - 1);
-            v += lowBits;
-            if (v != _posInArc)
-            {
-              // printf("\n%12I64x\n", v - _posInArc);
-              RINOK(Seek(v));
-            }
-            HRESULT res = Stream->Read(data, size, &size);
-            _posInArc += size;
-            _virtPos += size;
-            if (processedSize)
-              *processedSize = size;
-            return res;
-          }
+      // version 3 support zero clusters
+      if (((UInt32)v & 511) != 1)
+      {
+        v &= (_compressedFlag - 1);
+        v += lowBits;
+        if (v != _posInArc)
+        {
+          // printf("\n%12I64x\n", v - _posInArc);
+          RINOK(Seek(v));
         }
+        HRESULT res = Stream->Read(data, size, &size);
+        _posInArc += size;
+        _virtPos += size;
+        if (processedSize)
+          *processedSize = size;
+        return res;
       }
     }
     
@@ -546,7 +622,8 @@ STDMETHODIMP CHandler::Close()
   _phySize = 0;
   _size = 0;
 
-  _cacheCluster = (UInt64)(Int64)-1;
+  _clusterCache.Clear();
+  _nextCluster = 0;
   _comprPos = 0;
   _comprSize = 0;
   _needDeflate = false;
@@ -573,28 +650,19 @@ STDMETHODIMP CHandler::GetStream(UInt32 /* index */, ISequentialInStream **strea
     if (_version <= 1)
       return S_FALSE;
 
-    if (!_bufInStream)
-    {
-      _bufInStreamSpec = new CBufInStream;
-      _bufInStream = _bufInStreamSpec;
-    }
-    
-    if (!_bufOutStream)
-    {
-      _bufOutStreamSpec = new CBufPtrSeqOutStream();
-      _bufOutStream = _bufOutStreamSpec;
-    }
-
-    if (!_deflateDecoder)
-    {
-      _deflateDecoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder();
-      _deflateDecoder = _deflateDecoderSpec;
-      _deflateDecoderSpec->Set_NeedFinishInput(true);
-    }
+    if (!_decoder.get())
+      _decoder.reset(CreateDeflateClusterDecoder());
     
     size_t clusterSize = (size_t)1 << _clusterBits;
-    _cache.AllocAtLeast(clusterSize);
+    _clusterCache.Alloc(clusterSize, kClusterCacheSize);
+    #ifndef _7ZIP_ST
+    RINOK(_clusterCache.CreateThreads(NSystem::GetNumberOfProcessors(),
+        CreateDeflateClusterDecoder, clusterSize * 2));
+    #endif
     _cacheCompressed.AllocAtLeast(clusterSize * 2);
+    _comprPos = 0;
+    _comprSize = 0;
+    _nextCluster = 0;
   }
     
   CMyComPtr<ISequentialInStream> streamTemp = this;
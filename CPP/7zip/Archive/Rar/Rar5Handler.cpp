@@ -851,7 +851,17 @@ struct CUnpacker
 
   CLinkFile *linkFile;
 
-  CUnpacker(): linkFile(NULL) { NeedClearSolid[0] = NeedClearSolid[1] = true; }
+  #ifndef _7ZIP_ST
+  UInt32 NumThreads;
+  #endif
+
+  CUnpacker(): linkFile(NULL)
+  {
+    NeedClearSolid[0] = NeedClearSolid[1] = true;
+    #ifndef _7ZIP_ST
+    NumThreads = 1;
+    #endif
+  }
 
   HRESULT Create(DECL_EXTERNAL_CODECS_LOC_VARS const CItem &item, bool isSolid, bool &wrongPassword);
 
@@ -907,6 +917,17 @@ HRESULT CUnpacker::Create(DECL_EXTERNAL_CODECS_LOC_VARS const CItem &item, bool
       RINOK(CreateCoder(EXTERNAL_CODECS_LOC_VARS methodID, false, lzCoder));
       if (!lzCoder)
         return E_NOTIMPL;
+      
+      #ifndef _7ZIP_ST
+      {
+        CMyComPtr<ICompressSetCoderMt> setCoderMt;
+        lzCoder.QueryInterface(IID_ICompressSetCoderMt, &setCoderMt);
+        if (setCoderMt)
+        {
+          RINOK(setCoderMt->SetNumberOfThreads(NumThreads));
+        }
+      }
+      #endif
     }
 
     CMyComPtr<ICompressSetDecoderProperties2> csdp;
@@ -2168,16 +2189,30 @@ class CVolsInStream:
   public CMyUnknownImp
 {
   UInt64 _rem;
-  ISequentialInStream *_stream;
+  IInStream *_stream;
   const CObjectVector<CArc> *_arcs;
   const CObjectVector<CItem> *_items;
   int _itemIndex;
+  #ifndef _7ZIP_ST
+  NWindows::NSynchronization::CCriticalSection *_cs;
+  UInt64 _pos;
+  #endif
 public:
   bool CrcIsOK;
 private:
   CHash _hash;
 public:
   MY_UNKNOWN_IMP
+
+  #ifndef _7ZIP_ST
+  CVolsInStream(): _cs(NULL) {}
+
+  /* If CriticalSection is set, the stream keeps its own position,
+     and Seek() and Read() of volume stream are called under lock.
+     So some CVolsInStream objects can read same volumes in different threads. */
+  void SetCriticalSection(NWindows::NSynchronization::CCriticalSection *cs) { _cs = cs; }
+  #endif
+
   void Init(const CObjectVector<CArc> *arcs,
       const CObjectVector<CItem> *items,
       unsigned itemIndex)
@@ -2206,7 +2241,14 @@ STDMETHODIMP CVolsInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
         break;
       const CItem &item = (*_items)[_itemIndex];
       IInStream *s = (*_arcs)[item.VolIndex].Stream;
-      RINOK(s->Seek(item.GetDataPosition(), STREAM_SEEK_SET, NULL));
+      #ifndef _7ZIP_ST
+      if (_cs)
+        _pos = item.GetDataPosition();
+      else
+      #endif
+      {
+        RINOK(s->Seek(item.GetDataPosition(), STREAM_SEEK_SET, NULL));
+      }
       _stream = s;
       if (CrcIsOK && item.IsSplitAfter())
         _hash.Init(item);
@@ -2219,7 +2261,21 @@ STDMETHODIMP CVolsInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
       if (cur > _rem)
         cur = (UInt32)_rem;
       UInt32 num = cur;
-      HRESULT res = _stream->Read(data, cur, &cur);
+      HRESULT res;
+      #ifndef _7ZIP_ST
+      if (_cs)
+      {
+        NWindows::NSynchronization::CCriticalSectionLock lock(*_cs);
+        res = _stream->Seek(_pos, STREAM_SEEK_SET, NULL);
+        if (res == S_OK)
+          res = _stream->Read(data, cur, &cur);
+        else
+          cur = 0;
+        _pos += cur;
+      }
+      else
+      #endif
+        res = _stream->Read(data, cur, &cur);
       _hash.Update(data, cur);
       realProcessedSize += cur;
       if (processedSize)
@@ -2310,6 +2366,135 @@ static HRESULT CopyData_with_Progress(const Byte *data, size_t size,
 }
 
 
+#ifndef _7ZIP_ST
+
+/* Non-solid items are independent streams, so Extract() can decode them
+   in threads to memory buffers. The main thread calls the extract callback
+   and writes the buffers in original order. */
+
+struct CItemJob: public CDecodeJob
+{
+  CUnpacker Unpacker;
+  CVolsInStream *VolsInStreamSpec;
+  CMyComPtr<ISequentialInStream> VolsInStream;
+  CBufPtrSeqOutStream *OutStreamSpec;
+  CMyComPtr<ISequentialOutStream> OutStream;
+  CByteBuffer Buf;
+
+  const CObjectVector<CArc> *Arcs;
+  const CObjectVector<CItem> *Items;
+  unsigned RefIndex;
+  unsigned ItemIndex;
+  UInt64 PackSize;
+  bool TestMode;   // the data is not stored in test mode
+
+  bool CrcOK;
+
+  void Create(NWindows::NSynchronization::CCriticalSection *cs)
+  {
+    VolsInStreamSpec = new CVolsInStream;
+    VolsInStream = VolsInStreamSpec;
+    VolsInStreamSpec->SetCriticalSection(cs);
+    OutStreamSpec = new CBufPtrSeqOutStream;
+    OutStream = OutStreamSpec;
+  }
+
+  virtual HRESULT Decode();
+};
+
+HRESULT CItemJob::Decode()
+{
+  const CItem &item = (*Items)[ItemIndex];
+  ISequentialOutStream *outStream = NULL;
+  CrcOK = true;
+  OutStreamSpec->Init(NULL, 0);
+  if (!TestMode)
+  {
+    Buf.AllocAtLeast((size_t)item.Size);
+    OutStreamSpec->Init(Buf, (size_t)item.Size);
+    outStream = OutStream;
+  }
+  VolsInStreamSpec->Init(Arcs, Items, ItemIndex);
+  HRESULT res = Unpacker.Code(item, item, PackSize, VolsInStream, outStream, NULL, CrcOK);
+  if (!VolsInStreamSpec->CrcIsOK)
+    CrcOK = false;
+  return res;
+}
+
+
+bool CHandler::CanDecodeInThread(unsigned refIndex) const
+{
+  const CRefItem &ref = _refs[refIndex];
+  if (ref.Link >= 0 || ref.Item != ref.Last)
+    return false;
+  const CItem &item = _items[ref.Item];
+  if (item.IsDir()
+      || item.IsService()
+      || item.IsSolid()
+      || item.IsEncrypted()
+      || item.IsSplit()
+      || item.Is_UnknownSize()
+      || item.Is_CopyLink())
+    return false;
+  
+  // next solid item needs the window after this item
+  for (unsigned n = refIndex + 1; n < _refs.Size(); n++)
+  {
+    const CItem &nextItem = _items[_refs[n].Item];
+    if (!nextItem.IsService())
+      return !nextItem.IsSolid();
+  }
+  return true;
+}
+
+
+HRESULT CHandler::FinishItemJob(CDecodeThread &thread, const CItemJob &job,
+    IArchiveExtractCallback *extractCallback, Int32 testMode,
+    UInt64 &totalUnpacked, UInt64 &totalPacked)
+{
+  HRESULT result = thread.WaitJob();
+
+  totalUnpacked += _items[job.ItemIndex].Size;
+  totalPacked += job.PackSize;
+
+  CMyComPtr<ISequentialOutStream> realOutStream;
+  Int32 askMode = testMode ?
+      NExtract::NAskMode::kTest :
+      NExtract::NAskMode::kExtract;
+  
+  RINOK(extractCallback->GetStream(job.RefIndex, &realOutStream, askMode));
+  
+  if (!realOutStream && !testMode)
+    return S_OK;
+
+  RINOK(extractCallback->PrepareOperation(askMode));
+
+  if (realOutStream)
+  {
+    RINOK(WriteStream(realOutStream, job.Buf, job.OutStreamSpec->GetPos()));
+    realOutStream.Release();
+  }
+
+  int opRes = job.CrcOK ?
+      NExtract::NOperationResult::kOK:
+      NExtract::NOperationResult::kCRCError;
+
+  if (result != S_OK)
+  {
+    if (result == S_FALSE)
+      opRes = NExtract::NOperationResult::kDataError;
+    else if (result == E_NOTIMPL)
+      opRes = NExtract::NOperationResult::kUnsupportedMethod;
+    else
+      return result;
+  }
+
+  return extractCallback->SetOperationResult(opRes);
+}
+
+#endif
+
+
 STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback)
 {
@@ -2499,6 +2684,41 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   CMyComPtr<ICompressProgressInfo> progress = lps;
   lps->Init(extractCallback, false);
 
+  #ifndef _7ZIP_ST
+  unpacker.NumThreads = _mtProps.NumThreads;
+
+  NWindows::NSynchronization::CCriticalSection cs;
+  CObjArray<CItemJob> jobs;
+  CDecodeThreads threads;
+  UInt32 numThreads = 0;
+  UInt32 numStarted = 0;
+  UInt32 numFinished = 0;
+  UInt64 itemSizeMax = 0;
+
+  if (_mtProps.NumThreads > 1)
+  {
+    UInt32 numItemsMt = 0;
+    FOR_VECTOR(k, _refs)
+      if (extractStatuses[k] == kStatus_Extract && CanDecodeInThread(k))
+        numItemsMt++;
+    
+    RINOK(threads.Create(_mtProps.NumThreads, numItemsMt));
+    if (threads.Size() != 0)
+    {
+      numThreads = threads.Size();
+      itemSizeMax = GetDecodeMemLimit() / numThreads;
+      jobs.Alloc(numThreads);
+      for (UInt32 t = 0; t < numThreads; t++)
+      {
+        CItemJob &job = jobs[t];
+        job.Arcs = &_arcs;
+        job.Items = &_items;
+        job.Create(&cs);
+      }
+    }
+  }
+  #endif
+
   // bool needClearSolid = true;
 
   FOR_VECTOR(i, _refs)
@@ -2511,6 +2731,54 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     lps->InSize = totalPacked;
     lps->OutSize = totalUnpacked;
     RINOK(lps->SetCur());
+
+    #ifndef _7ZIP_ST
+    if (numThreads != 0)
+    {
+      const CItem &item = _items[_refs[i].Item];
+      
+      if (extractStatuses[i] == kStatus_Extract && CanDecodeInThread(i))
+      {
+        UInt64 memSize = (testMode ? 0 : item.Size);
+        if (item.GetMethod() != 0)
+          memSize += (UInt64)1 << (item.GetDictSize() + 17);
+        
+        if (memSize <= itemSizeMax)
+        {
+          if (numStarted - numFinished == numThreads)
+          {
+            unsigned t = numFinished % numThreads;
+            numFinished++;
+            RINOK(FinishItemJob(threads[t], jobs[t], extractCallback, testMode, totalUnpacked, totalPacked));
+          }
+          
+          unsigned t = numStarted % numThreads;
+          CItemJob &job = jobs[t];
+          bool wrongPassword;
+          if (job.Unpacker.Create(EXTERNAL_CODECS_VARS item, false, wrongPassword) == S_OK)
+          {
+            job.RefIndex = i;
+            job.ItemIndex = _refs[i].Item;
+            job.PackSize = GetPackSize(i);
+            job.TestMode = (testMode != 0);
+            threads[t].StartJob(&job);
+            numStarted++;
+            unpacker.NeedClearSolid[0] = true;
+            curUnpackSize = 0;
+            curPackSize = 0;
+            continue;
+          }
+        }
+      }
+      
+      while (numStarted != numFinished)
+      {
+        unsigned t = numFinished % numThreads;
+        numFinished++;
+        RINOK(FinishItemJob(threads[t], jobs[t], extractCallback, testMode, totalUnpacked, totalPacked));
+      }
+    }
+    #endif
     
     CMyComPtr<ISequentialOutStream> realOutStream;
 
@@ -2690,6 +2958,15 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     RINOK(extractCallback->SetOperationResult(opRes));
   }
 
+  #ifndef _7ZIP_ST
+  while (numStarted != numFinished)
+  {
+    unsigned t = numFinished % numThreads;
+    numFinished++;
+    RINOK(FinishItemJob(threads[t], jobs[t], extractCallback, testMode, totalUnpacked, totalPacked));
+  }
+  #endif
+
   {
     FOR_VECTOR(i, linkFiles)
       if (linkFiles[i].NumLinks != 0)
@@ -2702,6 +2979,23 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 }
 
 
+STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps)
+{
+  _mtProps.Init();
+
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    if (name.IsEmpty())
+      return E_INVALIDARG;
+
+    RINOK(_mtProps.SetProperty(name, values[i]));
+  }
+  return S_OK;
+}
+
+
 IMPL_ISetCompressCodecsInfo
 
 REGISTER_ARC_I(
@@ -10,6 +10,7 @@
 #include "../../../Windows/PropVariant.h"
 
 #include "../../Common/CreateCoder.h"
+#include "../../Common/DecodeThreads.h"
 
 #include "../IArchive.h"
 
@@ -364,9 +365,14 @@ struct CArc
 };
 
 
+#ifndef _7ZIP_ST
+struct CItemJob;
+#endif
+
 class CHandler:
   public IInArchive,
   public IArchiveGetRawProps,
+  public ISetProperties,
   PUBLIC_ISetCompressCodecsInfo
   public CMyUnknownImp
 {
@@ -382,11 +388,19 @@ private:
   bool _isArc;
   CByteBuffer _comment;
   UString _missingVolName;
+  CDecodeMtProps _mtProps;
 
   DECL_EXTERNAL_CODECS_VARS
 
   UInt64 GetPackSize(unsigned refIndex) const;
   
+  #ifndef _7ZIP_ST
+  bool CanDecodeInThread(unsigned refIndex) const;
+  HRESULT FinishItemJob(CDecodeThread &thread, const CItemJob &job,
+      IArchiveExtractCallback *extractCallback, Int32 testMode,
+      UInt64 &totalUnpacked, UInt64 &totalPacked);
+  #endif
+  
   void FillLinks();
   
   HRESULT Open2(IInStream *stream,
@@ -396,12 +410,14 @@ private:
 public:
   MY_QUERYINTERFACE_BEGIN2(IInArchive)
   MY_QUERYINTERFACE_ENTRY(IArchiveGetRawProps)
+  MY_QUERYINTERFACE_ENTRY(ISetProperties)
   QUERY_ENTRY_ISetCompressCodecsInfo
   MY_QUERYINTERFACE_END
   MY_ADDREF_RELEASE
   
   INTERFACE_IInArchive(;)
   INTERFACE_IArchiveGetRawProps(;)
+  STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
 
   DECL_ISetCompressCodecsInfo
 };
@@ -16,7 +16,6 @@
 #include "../../Windows/TimeUtils.h"
 
 #include "../Common/CWrappers.h"
-#include "../Common/LimitedStreams.h"
 #include "../Common/ProgressUtils.h"
 #include "../Common/RegisterArc.h"
 #include "../Common/StreamObjects.h"
@@ -26,6 +25,8 @@
 #include "../Compress/ZlibDecoder.h"
 #include "../Compress/LzmaDecoder.h"
 
+#include "HandlerCont.h"
+
 namespace NArchive {
 namespace NSquashfs {
 
@@ -824,9 +825,60 @@ struct CFrag
   UInt32 Size;
 };
 
+// it unpacks data, fragment or metadata block that is already in memory
+
+class CBlockDecoder: public CClusterDecoder
+{
+  CBufInStream *_inStreamSpec;
+  CMyComPtr<ISequentialInStream> _inStream;
+
+  CBufPtrSeqOutStream *_outStreamSpec;
+  CMyComPtr<ISequentialOutStream> _outStream;
+
+  NCompress::NLzma::CDecoder *_lzmaDecoderSpec;
+  CMyComPtr<ICompressCoder> _lzmaDecoder;
+
+  NCompress::NZlib::CDecoder *_zlibDecoderSpec;
+  CMyComPtr<ICompressCoder> _zlibDecoder;
+  
+  CXzUnpacker _xz;
+public:
+  UInt32 Method;
+  bool SeveralMethods;
+  bool NoPropsLZMA;
+  UInt32 BlockSize; // dictionary size for LZMA stream without properties
+
+  CBlockDecoder();
+  ~CBlockDecoder() { XzUnpacker_Free(&_xz); }
+  
+  HRESULT Decode(const Byte *src, size_t srcSize, Byte *dest, size_t &destSize);
+};
+
+static CClusterDecoder *CreateBlockDecoder() { return new CBlockDecoder; }
+
+CBlockDecoder::CBlockDecoder():
+    Method(kMethod_ZLIB),
+    SeveralMethods(false),
+    NoPropsLZMA(false),
+    BlockSize(0)
+{
+  XzUnpacker_Construct(&_xz, &g_Alloc);
+
+  _inStreamSpec = new CBufInStream;
+  _inStream = _inStreamSpec;
+
+  _outStreamSpec = new CBufPtrSeqOutStream();
+  _outStream = _outStreamSpec;
+}
+
+
+// size of memory for unpacked fragment blocks
+static const size_t kFragCacheSize = (size_t)1 << 23;
+
 class CHandler:
   public IInArchive,
   public IInArchiveGetStream,
+  public ISetProperties,
   public CMyUnknownImp
 {
   CRecordVector<CItem> _items;
@@ -851,39 +903,32 @@ class CHandler:
   CRecordVector<bool> _blockCompressed;
   CRecordVector<UInt64> _blockOffsets;
   
-  CByteBuffer _cachedBlock;
-  UInt64 _cachedBlockStartPos;
-  UInt32 _cachedPackBlockSize;
-  UInt32 _cachedUnpackBlockSize;
-
-  CLimitedSequentialInStream *_limitedInStreamSpec;
-  CMyComPtr<ISequentialInStream> _limitedInStream;
+  // unpacked blocks are keyed by position of packed block in archive
+  CClusterCache _dataCache;
+  CClusterCache _fragCache;
+  UInt64 _nextBlockIndex; // the data block that follows last unpacked data block
 
-  CBufPtrSeqOutStream *_outStreamSpec;
-  CMyComPtr<ISequentialOutStream> _outStream;
-
-  NCompress::NLzma::CDecoder *_lzmaDecoderSpec;
-  CMyComPtr<ICompressCoder> _lzmaDecoder;
-
-  NCompress::NZlib::CDecoder *_zlibDecoderSpec;
-  CMyComPtr<ICompressCoder> _zlibDecoder;
-  
-  CXzUnpacker _xz;
+  CBlockDecoder _decoder;
+  CDecodeMtProps _mtProps;
 
   CByteBuffer _inputBuffer;
 
   CDynBufSeqOutStream *_dynOutStreamSpec;
   CMyComPtr<ISequentialOutStream> _dynOutStream;
 
-  void ClearCache()
+  void SetDecoderParams(CBlockDecoder &decoder) const
   {
-    _cachedBlockStartPos = 0;
-    _cachedPackBlockSize = 0;
-    _cachedUnpackBlockSize = 0;
+    decoder.Method = _h.Method;
+    decoder.SeveralMethods = _h.SeveralMethods;
+    decoder.NoPropsLZMA = _noPropsLZMA;
+    decoder.BlockSize = _h.BlockSize;
   }
 
-  HRESULT Decompress(ISequentialOutStream *outStream, Byte *outBuf, bool *outBufWasWritten, UInt32 *outBufWasWrittenSize,
-      UInt32 inSize, UInt32 outSizeMax);
+  // it reads (inSize) bytes from current position of _stream and unpacks them
+  HRESULT Decompress(Byte *dest, size_t &destSize, UInt32 inSize);
+  #ifndef _7ZIP_ST
+  HRESULT DecodeDataBlocks(UInt64 blockIndex);
+  #endif
   HRESULT ReadMetadataBlock(UInt32 &packSize);
   HRESULT ReadData(CData &data, UInt64 start, UInt64 end);
 
@@ -896,28 +941,17 @@ class CHandler:
 
 public:
   CHandler();
-  ~CHandler()
-  {
-    XzUnpacker_Free(&_xz);
-  }
 
-  MY_UNKNOWN_IMP2(IInArchive, IInArchiveGetStream)
+  MY_UNKNOWN_IMP3(IInArchive, IInArchiveGetStream, ISetProperties)
   INTERFACE_IInArchive(;)
   STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
+  STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
 
   HRESULT ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize);
 };
 
 CHandler::CHandler()
 {
-  XzUnpacker_Construct(&_xz, &g_Alloc);
-
-  _limitedInStreamSpec = new CLimitedSequentialInStream;
-  _limitedInStream = _limitedInStreamSpec;
-
-  _outStreamSpec = new CBufPtrSeqOutStream();
-  _outStream = _outStreamSpec;
-
   _dynOutStreamSpec = new CDynBufSeqOutStream;
   _dynOutStream = _dynOutStreamSpec;
 }
@@ -1104,117 +1138,118 @@ static HRESULT LzoDecode(Byte *dest, SizeT *destLen, const Byte *src, SizeT *src
   }
 }
 
-HRESULT CHandler::Decompress(ISequentialOutStream *outStream, Byte *outBuf, bool *outBufWasWritten, UInt32 *outBufWasWrittenSize, UInt32 inSize, UInt32 outSizeMax)
+HRESULT CBlockDecoder::Decode(const Byte *src, size_t srcSize, Byte *dest, size_t &destSize)
 {
-  if (outBuf)
+  const size_t outSizeMax = destSize;
+  destSize = 0;
+  UInt32 method = Method;
+  if (SeveralMethods)
   {
-    *outBufWasWritten = false;
-    *outBufWasWrittenSize = 0;
-  }
-  UInt32 method = _h.Method;
-  if (_h.SeveralMethods)
-  {
-    Byte b;
-    RINOK(ReadStream_FALSE(_stream, &b, 1));
-    RINOK(_stream->Seek(-1, STREAM_SEEK_CUR, NULL));
-    method = (b == 0x5D ? kMethod_LZMA : kMethod_ZLIB);
+    if (srcSize == 0)
+      return S_FALSE;
+    method = (src[0] == 0x5D ? kMethod_LZMA : kMethod_ZLIB);
   }
 
-  if (method == kMethod_ZLIB && _needCheckLzma)
+  if (method == kMethod_ZLIB || method == kMethod_LZMA)
   {
-    Byte b;
-    RINOK(ReadStream_FALSE(_stream, &b, 1));
-    RINOK(_stream->Seek(-1, STREAM_SEEK_CUR, NULL));
-    if (b == 0)
+    _outStreamSpec->Init(dest, outSizeMax);
+    HRESULT res;
+    if (method == kMethod_ZLIB)
     {
-      _noPropsLZMA = true;
-      method = _h.Method = kMethod_LZMA;
+      if (!_zlibDecoder)
+      {
+        _zlibDecoderSpec = new NCompress::NZlib::CDecoder();
+        _zlibDecoder = _zlibDecoderSpec;
+      }
+      _inStreamSpec->Init(src, srcSize);
+      res = _zlibDecoder->Code(_inStream, _outStream, NULL, NULL, NULL);
+      if (res == S_OK && srcSize != _zlibDecoderSpec->GetInputProcessedSize())
+        res = S_FALSE;
     }
-    _needCheckLzma = false;
-  }
-  
-  if (method == kMethod_ZLIB)
-  {
-    if (!_zlibDecoder)
+    else
     {
-      _zlibDecoderSpec = new NCompress::NZlib::CDecoder();
-      _zlibDecoder = _zlibDecoderSpec;
+      if (!_lzmaDecoder)
+      {
+        _lzmaDecoderSpec = new NCompress::NLzma::CDecoder();
+        _lzmaDecoderSpec->FinishStream = true;
+        _lzmaDecoder = _lzmaDecoderSpec;
+      }
+      const UInt32 kPropsSize = LZMA_PROPS_SIZE + 8;
+      Byte props[kPropsSize];
+      UInt32 propsSize;
+      UInt64 outSize;
+      if (NoPropsLZMA)
+      {
+        props[0] = 0x5D;
+        SetUi32(&props[1], BlockSize);
+        propsSize = 0;
+        outSize = outSizeMax;
+      }
+      else
+      {
+        if (srcSize < kPropsSize)
+          return S_FALSE;
+        memcpy(props, src, kPropsSize);
+        propsSize = kPropsSize;
+        outSize = GetUi64(&props[LZMA_PROPS_SIZE]);
+        if (outSize > outSizeMax)
+          return S_FALSE;
+      }
+      RINOK(_lzmaDecoderSpec->SetDecoderProperties2(props, LZMA_PROPS_SIZE));
+      _inStreamSpec->Init(src + propsSize, srcSize - propsSize);
+      res = _lzmaDecoder->Code(_inStream, _outStream, NULL, &outSize, NULL);
+      if (res == S_OK && srcSize != propsSize + _lzmaDecoderSpec->GetInputProcessedSize())
+        res = S_FALSE;
     }
-    RINOK(_zlibDecoder->Code(_limitedInStream, outStream, NULL, NULL, NULL));
-    if (inSize != _zlibDecoderSpec->GetInputProcessedSize())
-      return S_FALSE;
+    destSize = _outStreamSpec->GetPos();
+    return res;
   }
-  else if (method == kMethod_LZMA)
+
+  SizeT destLen = outSizeMax, srcLen = srcSize;
+  if (method == kMethod_LZO)
   {
-    if (!_lzmaDecoder)
-    {
-      _lzmaDecoderSpec = new NCompress::NLzma::CDecoder();
-      _lzmaDecoderSpec->FinishStream = true;
-      _lzmaDecoder = _lzmaDecoderSpec;
-    }
-    const UInt32 kPropsSize = LZMA_PROPS_SIZE + 8;
-    Byte props[kPropsSize];
-    UInt32 propsSize;
-    UInt64 outSize;
-    if (_noPropsLZMA)
-    {
-      props[0] = 0x5D;
-      SetUi32(&props[1], _h.BlockSize);
-      propsSize = 0;
-      outSize = outSizeMax;
-    }
-    else
-    {
-      RINOK(ReadStream_FALSE(_limitedInStream, props, kPropsSize));
-      propsSize = kPropsSize;
-      outSize = GetUi64(&props[LZMA_PROPS_SIZE]);
-      if (outSize > outSizeMax)
-        return S_FALSE;
-    }
-    RINOK(_lzmaDecoderSpec->SetDecoderProperties2(props, LZMA_PROPS_SIZE));
-    RINOK(_lzmaDecoder->Code(_limitedInStream, outStream, NULL, &outSize, NULL));
-    if (inSize != propsSize + _lzmaDecoderSpec->GetInputProcessedSize())
-      return S_FALSE;
+    RINOK(LzoDecode(dest, &destLen, src, &srcLen));
   }
   else
   {
-    if (_inputBuffer.Size() < inSize)
-      _inputBuffer.Alloc(inSize);
-    RINOK(ReadStream_FALSE(_stream, _inputBuffer, inSize));
-
-    Byte *dest = outBuf;
-    if (!outBuf)
-    {
-      dest = _dynOutStreamSpec->GetBufPtrForWriting(outSizeMax);
-      if (!dest)
-        return E_OUTOFMEMORY;
-    }
-    SizeT destLen = outSizeMax, srcLen = inSize;
-    if (method == kMethod_LZO)
-    {
-      RINOK(LzoDecode(dest, &destLen, _inputBuffer, &srcLen));
-    }
-    else
-    {
-      ECoderStatus status;
-      XzUnpacker_Init(&_xz);
-      SRes res = XzUnpacker_Code(&_xz, dest, &destLen, _inputBuffer, &srcLen, CODER_FINISH_END, &status);
-      if (res != 0)
-        return SResToHRESULT(res);
-      if (status != CODER_STATUS_NEEDS_MORE_INPUT || !XzUnpacker_IsStreamWasFinished(&_xz))
-        return S_FALSE;
-    }
-    if (inSize != srcLen)
+    ECoderStatus status;
+    XzUnpacker_Init(&_xz);
+    SRes res = XzUnpacker_Code(&_xz, dest, &destLen, src, &srcLen, CODER_FINISH_END, &status);
+    if (res != 0)
+      return SResToHRESULT(res);
+    if (status != CODER_STATUS_NEEDS_MORE_INPUT || !XzUnpacker_IsStreamWasFinished(&_xz))
       return S_FALSE;
-    if (outBuf)
+  }
+  if (srcSize != srcLen)
+    return S_FALSE;
+  destSize = destLen;
+  return S_OK;
+}
+
+HRESULT CHandler::Decompress(Byte *dest, size_t &destSize, UInt32 inSize)
+{
+  if (_inputBuffer.Size() < inSize)
+    _inputBuffer.Alloc(inSize);
+  RINOK(ReadStream_FALSE(_stream, _inputBuffer, inSize));
+
+  if (_needCheckLzma && inSize != 0)
+  {
+    UInt32 method = _h.Method;
+    if (_h.SeveralMethods)
+      method = (_inputBuffer[0] == 0x5D ? kMethod_LZMA : kMethod_ZLIB);
+    if (method == kMethod_ZLIB)
     {
-      *outBufWasWritten = true;
-      *outBufWasWrittenSize = (UInt32)destLen;
+      if (_inputBuffer[0] == 0)
+      {
+        _noPropsLZMA = true;
+        _h.Method = kMethod_LZMA;
+      }
+      _needCheckLzma = false;
     }
-    else
-      _dynOutStreamSpec->UpdateSize(destLen);
   }
-  return S_OK;
+  
+  SetDecoderParams(_decoder);
+  return _decoder.Decode(_inputBuffer, inSize, dest, destSize);
 }
 
 HRESULT CHandler::ReadMetadataBlock(UInt32 &packSize)
@@ -1236,8 +1271,12 @@ HRESULT CHandler::ReadMetadataBlock(UInt32 &packSize)
   packSize = offset + size;
   if (isCompressed)
   {
-    _limitedInStreamSpec->Init(size);
-    RINOK(Decompress(_dynOutStream, NULL, NULL, NULL, size, kMetadataBlockSize));
+    Byte *buf = _dynOutStreamSpec->GetBufPtrForWriting(kMetadataBlockSize);
+    if (!buf)
+      return E_OUTOFMEMORY;
+    size_t destSize = kMetadataBlockSize;
+    RINOK(Decompress(buf, destSize, size));
+    _dynOutStreamSpec->UpdateSize(destSize);
   }
   else
   {
@@ -1675,7 +1714,6 @@ STDMETHODIMP CHandler::Open(IInStream *stream, const UInt64 *, IArchiveOpenCallb
   COM_TRY_BEGIN
   {
     Close();
-    _limitedInStreamSpec->SetStream(stream);
     HRESULT res;
     try
     {
@@ -1702,7 +1740,6 @@ STDMETHODIMP CHandler::Close()
 {
   _sizeCalculated = 0;
 
-  _limitedInStreamSpec->ReleaseStream();
   _stream.Release();
 
   _items.Clear();
@@ -1716,8 +1753,9 @@ STDMETHODIMP CHandler::Close()
   // _uids.Free();
   // _gids.Free();;
 
-  _cachedBlock.Free();
-  ClearCache();
+  _dataCache.Free();
+  _fragCache.Free();
+  _nextBlockIndex = 0;
 
   return S_OK;
 }
@@ -1991,6 +2029,7 @@ HRESULT CHandler::ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize)
   UInt32 packBlockSize;
   UInt32 offsetInBlock = 0;
   bool compressed;
+  bool isFrag = false;
   if (blockIndex < _blockCompressed.Size())
   {
     compressed = _blockCompressed[(int)blockIndex];
@@ -2007,6 +2046,7 @@ HRESULT CHandler::ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize)
     blockOffset = frag.StartBlock;
     packBlockSize = GET_COMPRESSED_BLOCK_SIZE(frag.Size);
     compressed = IS_COMPRESSED_BLOCK(frag.Size);
+    isFrag = true;
   }
 
   if (packBlockSize == 0)
@@ -2016,40 +2056,110 @@ HRESULT CHandler::ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize)
     return S_OK;
   }
 
-  if (blockOffset != _cachedBlockStartPos ||
-      packBlockSize != _cachedPackBlockSize)
+  CClusterCache &cache = isFrag ? _fragCache : _dataCache;
+  size_t unpackSize;
+  const Byte *p = cache.Find(blockOffset, unpackSize);
+  
+  if (!p)
   {
-    ClearCache();
-    RINOK(_stream->Seek(blockOffset, STREAM_SEEK_SET, NULL));
-    _limitedInStreamSpec->Init(packBlockSize);
-    
-    if (compressed)
-    {
-      _outStreamSpec->Init((Byte *)_cachedBlock, _h.BlockSize);
-      bool outBufWasWritten;
-      UInt32 outBufWasWrittenSize;
-      HRESULT res = Decompress(_outStream, _cachedBlock, &outBufWasWritten, &outBufWasWrittenSize, packBlockSize, _h.BlockSize);
-      if (outBufWasWritten)
-        _cachedUnpackBlockSize = outBufWasWrittenSize;
-      else
-        _cachedUnpackBlockSize = (UInt32)_outStreamSpec->GetPos();
-      RINOK(res);
+    #ifndef _7ZIP_ST
+    if (!isFrag && compressed
+        && blockIndex == _nextBlockIndex
+        && packBlockSize <= _h.BlockSize * 2
+        && _dataCache.GetNumThreads() > 1)
+    {
+      RINOK(DecodeDataBlocks(blockIndex));
     }
     else
+    #endif
     {
-      RINOK(ReadStream_FALSE(_limitedInStream, _cachedBlock, packBlockSize));
-      _cachedUnpackBlockSize = packBlockSize;
+      RINOK(_stream->Seek(blockOffset, STREAM_SEEK_SET, NULL));
+      const unsigned slotIndex = cache.GetNewSlot();
+      Byte *slot = cache.GetSlotData(slotIndex);
+      if (compressed)
+      {
+        unpackSize = _h.BlockSize;
+        RINOK(Decompress(slot, unpackSize, packBlockSize));
+      }
+      else
+      {
+        if (packBlockSize > _h.BlockSize)
+          return S_FALSE;
+        RINOK(ReadStream_FALSE(_stream, slot, packBlockSize));
+        unpackSize = packBlockSize;
+      }
+      cache.SetSlotKey(slotIndex, blockOffset, unpackSize);
+      if (!isFrag)
+        _nextBlockIndex = blockIndex + 1;
     }
-    _cachedBlockStartPos = blockOffset;
-    _cachedPackBlockSize = packBlockSize;
+    p = cache.Find(blockOffset, unpackSize);
+    if (!p)
+      return S_FALSE;
   }
-  if (offsetInBlock + blockSize > _cachedUnpackBlockSize)
+  
+  if (offsetInBlock + blockSize > unpackSize)
     return S_FALSE;
   if (blockSize != 0)
-    memcpy(dest, _cachedBlock + offsetInBlock, blockSize);
+    memcpy(dest, p + offsetInBlock, blockSize);
   return S_OK;
 }
 
+#ifndef _7ZIP_ST
+
+/*
+  It's called for sequential reading of compressed data block.
+  It reads packed data of this block and of next compressed blocks of the file,
+  and unpacks them in parallel threads.
+*/
+
+HRESULT CHandler::DecodeDataBlocks(UInt64 blockIndex)
+{
+  const CNode &node = _nodes[_nodeIndex];
+  const size_t packSizeMax = (size_t)_h.BlockSize * 2;
+  
+  for (;;)
+  {
+    const unsigned index = (unsigned)blockIndex;
+    const UInt64 blockOffset = _blockOffsets[index] + node.StartBlock;
+    const UInt32 packBlockSize = (UInt32)(_blockOffsets[index + 1] - _blockOffsets[index]);
+    {
+      HRESULT res = _stream->Seek(blockOffset, STREAM_SEEK_SET, NULL);
+      if (res == S_OK)
+      {
+        if (_inputBuffer.Size() < packBlockSize)
+          _inputBuffer.Alloc(packBlockSize);
+        res = ReadStream_FALSE(_stream, _inputBuffer, packBlockSize);
+      }
+      if (res != S_OK)
+      {
+        if (_dataCache.GetNumJobs() == 0)
+          return res;
+        break;
+      }
+    }
+    CClusterDecodeJob &job = _dataCache.AddJob(blockOffset);
+    memcpy(job.Packed, _inputBuffer, packBlockSize);
+    job.PackedSize = packBlockSize;
+    job.DestSize = _h.BlockSize;
+    _nextBlockIndex = ++blockIndex;
+
+    if (_dataCache.GetNumJobs() == _dataCache.GetNumThreads()
+        || blockIndex >= _blockCompressed.Size())
+      break;
+    const unsigned next = (unsigned)blockIndex;
+    const UInt32 nextPackSize = (UInt32)(_blockOffsets[next + 1] - _blockOffsets[next]);
+    if (!_blockCompressed[next]
+        || nextPackSize == 0
+        || nextPackSize > packSizeMax
+        || _dataCache.IsCached(_blockOffsets[next] + node.StartBlock))
+      break;
+  }
+
+  return _dataCache.DecodeJobs();
+}
+
+#endif
+
 STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback)
 {
@@ -2180,11 +2290,20 @@ STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
 
   _nodeIndex = item.Node;
 
-  size_t cacheSize = _h.BlockSize;
-  if (_cachedBlock.Size() != cacheSize)
   {
-    ClearCache();
-    _cachedBlock.Alloc(cacheSize);
+    UInt32 numThreads = _mtProps.NumThreads;
+    #ifndef _7ZIP_ST
+    if (numThreads > kNumDecodeThreadsMax)
+      numThreads = kNumDecodeThreadsMax;
+    #endif
+    _dataCache.Alloc(_h.BlockSize, (size_t)_h.BlockSize * 2 * numThreads);
+    _fragCache.Alloc(_h.BlockSize, kFragCacheSize);
+    _nextBlockIndex = 0;
+    #ifndef _7ZIP_ST
+    RINOK(_dataCache.CreateThreads(numThreads, CreateBlockDecoder, (size_t)_h.BlockSize * 2));
+    for (unsigned i = 0; i < _dataCache.GetNumThreads(); i++)
+      SetDecoderParams(*static_cast<CBlockDecoder *>(_dataCache.GetThreadDecoder(i)));
+    #endif
   }
 
   CSquashfsInStream *streamSpec = new CSquashfsInStream;
@@ -2203,6 +2322,21 @@ STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
   COM_TRY_END
 }
 
+STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps)
+{
+  _mtProps.Init();
+
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    if (name.IsEmpty())
+      return E_INVALIDARG;
+    RINOK(_mtProps.SetProperty(name, values[i]));
+  }
+  return S_OK;
+}
+
 static const Byte k_Signature[] = {
     4, 'h', 's', 'q', 's',
     4, 's', 'q', 's', 'h',
@@ -2,11 +2,15 @@
 
 #include "StdAfx.h"
 
+#include "../../../../C/7zCrc.h"
+#include "../../../../C/CpuArch.h"
+
 #include "../../../Common/ComTry.h"
 #include "../../../Common/IntToString.h"
 #include "../../../Common/StringConvert.h"
 #include "../../../Common/UTFConvert.h"
 
+#include "../../../Windows/System.h"
 #include "../../../Windows/TimeUtils.h"
 
 #include "../../Common/LimitedStreams.h"
@@ -113,16 +117,219 @@ HRESULT CHandler::ReadItem2(ISequentialInStream *stream, bool &filled, CItemEx &
   return S_OK;
 }
 
+static bool IsEmptyRecord(const Byte *p)
+{
+  for (unsigned i = 0; i < NFileHeader::kRecordSize; i++)
+    if (p[i] != 0)
+      return false;
+  return true;
+}
+
+/*
+  OpenIndex() looks for index item (written with -mindex=on) at the end of archive.
+  If index is correct, it fills (_items) from index without reading all headers.
+  If there is no index or it's not correct, it returns S_OK with (indexWasUsed = false).
+*/
+
+HRESULT CHandler::OpenIndex(IInStream *stream, UInt64 endPos, bool &indexWasUsed)
+{
+  indexWasUsed = false;
+
+  const UInt32 kTailSizeMax = (UInt32)1 << 16;
+  const UInt64 tailEnd = endPos & ~(UInt64)(NFileHeader::kRecordSize - 1);
+  const UInt32 tailSize = (UInt32)MyMin(tailEnd, (UInt64)kTailSizeMax);
+  if (tailSize == 0)
+    return S_OK;
+  
+  CByteBuffer tail(tailSize);
+  RINOK(stream->Seek(tailEnd - tailSize, STREAM_SEEK_SET, NULL));
+  RINOK(ReadStream_FALSE(stream, tail, tailSize));
+  
+  UInt32 pos = tailSize;
+  do
+  {
+    if (pos == 0)
+      return S_OK;
+    pos -= NFileHeader::kRecordSize;
+  }
+  while (IsEmptyRecord(tail + pos));
+  
+  // pax record of index ends with '\n' after footer
+  if (tail[pos + NFileHeader::kRecordSize - 1] != '\n')
+    return S_OK;
+  const Byte *footer = tail + pos + NFileHeader::kRecordSize - 1 - NFileHeader::NIndex::kFooterSize;
+  if (memcmp(footer, NFileHeader::NIndex::kSignature, sizeof(NFileHeader::NIndex::kSignature)) != 0)
+    return S_OK;
+  
+  const UInt64 indexEnd = tailEnd - tailSize + pos + NFileHeader::kRecordSize;
+  const UInt64 indexHeaderPos = GetUi64(footer + 8);
+  const UInt64 recordsSize = GetUi64(footer + 16);
+  const UInt32 numItems = GetUi32(footer + 24);
+  
+  if (indexHeaderPos >= indexEnd
+      || (indexHeaderPos & (NFileHeader::kRecordSize - 1)) != 0
+      || recordsSize < 8
+      || recordsSize > ((UInt32)1 << 30)
+      || numItems > (recordsSize - 8) / NFileHeader::NIndex::kRecordHeaderSize)
+    return S_OK;
+
+  CItemEx indexItem;
+  {
+    RINOK(stream->Seek(indexHeaderPos, STREAM_SEEK_SET, NULL));
+    bool filled;
+    EErrorType error;
+    RINOK(ReadItem(stream, filled, indexItem, error));
+    if (!filled
+        || error != k_ErrorType_OK
+        || indexItem.LinkFlag != NFileHeader::NIndex::kLinkFlag
+        || indexItem.Name != NFileHeader::NIndex::kName
+        || indexItem.PackSize < recordsSize + NFileHeader::NIndex::kFooterSize + 1
+        || indexItem.PackSize > recordsSize + NFileHeader::NIndex::kFooterSize + NFileHeader::kRecordSize * 2
+        || indexHeaderPos + indexItem.HeaderSize + indexItem.PackSize != indexEnd)
+      return S_OK;
+  }
+
+  // we read pax record without footer: "<len> 7ZIP.TarIndex=" and index data
+  const size_t dataSize = (size_t)indexItem.PackSize - 1 - NFileHeader::NIndex::kFooterSize;
+  CByteBuffer data(dataSize);
+  RINOK(ReadStream_FALSE(stream, data, dataSize));
+  
+  char sizeString[32];
+  ConvertUInt64ToString(indexItem.PackSize, sizeString);
+  AString prefix = sizeString;
+  prefix.Add_Space();
+  prefix += NFileHeader::NIndex::kKeyword;
+  prefix += '=';
+  if (prefix.Len() + recordsSize > dataSize
+      || memcmp(data, prefix.Ptr(), prefix.Len()) != 0)
+    return S_OK;
+
+  const Byte *buf = data + prefix.Len();
+  const size_t size = (size_t)recordsSize;
+  if (CrcCalc(buf, size) != GetUi32(footer + 28))
+    return S_OK;
+
+  bool utf8_OK = true;
+  size_t offs = 8;
+  
+  _items.ClearAndReserve(numItems);
+  
+  for (UInt32 i = 0; i < numItems; i++)
+  {
+    const Byte *p = buf + offs;
+    if (size - offs < NFileHeader::NIndex::kRecordHeaderSize)
+      break;
+    const UInt32 nameLen = GetUi32(p + 9);
+    offs += NFileHeader::NIndex::kRecordHeaderSize;
+    if (nameLen > size - offs)
+      break;
+    offs += nameLen;
+    
+    CItemEx &item = _items.AddNew();
+    item.HeaderPos = GetUi64(p);
+    item.HeaderSize = 0;
+    item.LinkFlag = (char)p[8];
+    item.Name.SetFrom((const char *)p + NFileHeader::NIndex::kRecordHeaderSize, nameLen);
+    item.NameCouldBeReduced = false;
+    item.LinkNameCouldBeReduced = false;
+    item.PackSize = 0;
+    item.Size = 0;
+    item.MTime = 0;
+    item.Mode = 0;
+    item.UID = 0;
+    item.GID = 0;
+    item.DeviceMajorDefined = false;
+    item.DeviceMinorDefined = false;
+    
+    if (item.HeaderPos >= indexHeaderPos
+        || (item.HeaderPos & (NFileHeader::kRecordSize - 1)) != 0
+        || item.Name.Len() != nameLen)
+      break;
+    if (!_forceCodePage && utf8_OK)
+      utf8_OK = CheckUTF8(item.Name);
+  }
+
+  if (_items.Size() != numItems || offs != size)
+  {
+    _items.Clear();
+    return S_OK;
+  }
+
+  _phySize = indexEnd;
+  _headersSize = GetUi64(buf) + indexItem.HeaderSize;
+  {
+    // the index item must be last item in archive
+    CItemEx item;
+    bool filled;
+    RINOK(stream->Seek(indexEnd, STREAM_SEEK_SET, NULL));
+    RINOK(ReadItem2(stream, filled, item));
+    if (filled || _error != k_ErrorType_OK)
+    {
+      _items.Clear();
+      _phySize = 0;
+      _headersSize = 0;
+      _error = k_ErrorType_OK;
+      _thereIsPaxExtendedHeader = false;
+      return S_OK;
+    }
+  }
+
+  if (!_forceCodePage && !utf8_OK)
+    _curCodePage = k_DefaultCodePage;
+
+  _itemIsLoaded.ClearAndSetSize(numItems);
+  for (UInt32 i = 0; i < numItems; i++)
+    _itemIsLoaded[i] = false;
+  
+  indexWasUsed = true;
+  return S_OK;
+}
+
+HRESULT CHandler::LoadItem(UInt32 index)
+{
+  if (_itemIsLoaded.IsEmpty() || _itemIsLoaded[index])
+    return S_OK;
+  CItemEx &item = _items[index];
+  RINOK(_stream->Seek(item.HeaderPos, STREAM_SEEK_SET, NULL));
+  CItemEx item2;
+  bool filled;
+  EErrorType error;
+  RINOK(ReadItem(_stream, filled, item2, error));
+  if (!filled
+      || error != k_ErrorType_OK
+      || item2.LinkFlag != item.LinkFlag
+      || item2.Name != item.Name)
+    return E_FAIL; // index doesn't match to headers
+  if (item2.IsPaxExtendedHeader())
+    _thereIsPaxExtendedHeader = true;
+  item2.HeaderPos = item.HeaderPos;
+  item = item2;
+  _itemIsLoaded[index] = true;
+  return S_OK;
+}
+
 HRESULT CHandler::Open2(IInStream *stream, IArchiveOpenCallback *callback)
 {
   UInt64 endPos = 0;
   {
     RINOK(stream->Seek(0, STREAM_SEEK_END, &endPos));
-    RINOK(stream->Seek(0, STREAM_SEEK_SET, NULL));
   }
   
   _phySizeDefined = true;
   
+  {
+    bool indexWasUsed;
+    RINOK(OpenIndex(stream, endPos, indexWasUsed));
+    if (indexWasUsed)
+    {
+      _openCodePage = _curCodePage;
+      _isArc = true;
+      return S_OK;
+    }
+  }
+
+  RINOK(stream->Seek(0, STREAM_SEEK_SET, NULL));
+
   bool utf8_OK = true;
   if (!_forceCodePage)
   {
@@ -176,6 +383,12 @@ HRESULT CHandler::Open2(IInStream *stream, IArchiveOpenCallback *callback)
     }
   }
 
+  // index item is not shown as item of archive
+  if (!_items.IsEmpty()
+      && _items.Back().LinkFlag == NFileHeader::NIndex::kLinkFlag
+      && _items.Back().Name == NFileHeader::NIndex::kName)
+    _items.DeleteBack();
+
   if (!_forceCodePage)
   {
     if (!utf8_OK)
@@ -243,6 +456,7 @@ STDMETHODIMP CHandler::Close()
   // _isSparse = false;
   _thereIsPaxExtendedHeader = false;
   _items.Clear();
+  _itemIsLoaded.Clear();
   _seqStream.Release();
   _stream.Release();
   return S_OK;
@@ -313,7 +527,13 @@ STDMETHODIMP CHandler::GetProperty(UInt32 index, PROPID propID, PROPVARIANT *val
 
   const CItemEx *item;
   if (_stream)
+  {
+    if (propID != kpidPath && propID != kpidIsDir)
+    {
+      RINOK(LoadItem(index));
+    }
     item = &_items[index];
+  }
   else
   {
     if (index < _curIndex)
@@ -368,7 +588,14 @@ HRESULT CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   UInt64 totalSize = 0;
   UInt32 i;
   for (i = 0; i < numItems; i++)
-    totalSize += _items[allFilesMode ? i : indices[i]].GetUnpackSize();
+  {
+    UInt32 index = allFilesMode ? i : indices[i];
+    if (!seqMode)
+    {
+      RINOK(LoadItem(index));
+    }
+    totalSize += _items[index].GetUnpackSize();
+  }
   extractCallback->SetTotal(totalSize);
 
   UInt64 totalPackSize;
@@ -465,7 +692,14 @@ HRESULT CHandler::Extract(const UInt32 *indices, UInt32 numItems,
           RINOK(_stream->Seek(item->GetDataPosition(), STREAM_SEEK_SET, NULL));
         }
         streamSpec->Init(item->GetPackSizeAligned());
-        RINOK(copyCoder->Code(inStream2, outStream, NULL, NULL, progress));
+        // the streams of compressed archives (tar.xz, tar.gz) return S_FALSE for data errors
+        HRESULT res = copyCoder->Code(inStream2, outStream, NULL, NULL, progress);
+        if (res == S_FALSE)
+          opRes = NExtract::NOperationResult::kDataError;
+        else
+        {
+          RINOK(res);
+        }
       }
       if (outStreamSpec->GetRem() != 0)
         opRes = NExtract::NOperationResult::kDataError;
@@ -601,6 +835,7 @@ STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
 {
   COM_TRY_BEGIN
   
+  RINOK(LoadItem(index));
   const CItemEx &item = _items[index];
 
   if (item.IsSparse())
@@ -640,6 +875,8 @@ void CHandler::Init()
   // _codePage = CP_OEMCP;
   _curCodePage = _specifiedCodePage = CP_UTF8;  // CP_OEMCP;
   _thereIsPaxExtendedHeader = false;
+  _writeIndex = false;
+  _numThreads = NSystem::GetNumberOfProcessors();
 }
 
 STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps)
@@ -668,6 +905,16 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
       _forceCodePage = true;
       _curCodePage = _specifiedCodePage = cp;
     }
+    else if (name.IsEqualTo("index"))
+    {
+      RINOK(PROPVARIANT_to_bool(prop, _writeIndex));
+    }
+    else if (name.IsPrefixedBy_Ascii_NoCase("mt"))
+    {
+      #ifndef _7ZIP_ST
+      RINOK(ParseMtProp(name.Ptr(2), prop, NSystem::GetNumberOfProcessors(), _numThreads));
+      #endif
+    }
     else
       return E_INVALIDARG;
   }
@@ -29,6 +29,10 @@ public:
   CMyComPtr<IInStream> _stream;
   CMyComPtr<ISequentialInStream> _seqStream;
 private:
+  // if archive was opened with index, only Name, LinkFlag and HeaderPos
+  // of items are known, and other fields are read from headers by LoadItem()
+  CBoolVector _itemIsLoaded;
+
   UInt32 _curIndex;
   bool _latestIsRead;
   CItemEx _latestItem;
@@ -47,10 +51,14 @@ private:
   UInt32 _curCodePage;
   UInt32 _openCodePage;
 
+  bool _writeIndex;
+  UInt32 _numThreads;
+
   NCompress::CCopyCoder *copyCoderSpec;
   CMyComPtr<ICompressCoder> copyCoder;
 
   HRESULT ReadItem2(ISequentialInStream *stream, bool &filled, CItemEx &itemInfo);
+  HRESULT OpenIndex(IInStream *stream, UInt64 endPos, bool &indexWasUsed);
   HRESULT Open2(IInStream *stream, IArchiveOpenCallback *callback);
   HRESULT SkipTo(UInt32 index);
   void TarStringToUnicode(const AString &s, NWindows::NCOM::CPropVariant &prop, bool toOs = false) const;
@@ -69,6 +77,7 @@ public:
   STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
   STDMETHOD(SetProperties)(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps);
 
+  HRESULT LoadItem(UInt32 index);
   void Init();
   CHandler();
 };
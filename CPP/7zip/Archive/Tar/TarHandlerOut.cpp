@@ -77,6 +77,15 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
 
   if ((_stream && (_error != k_ErrorType_OK /* || _isSparse */)) || _seqStream)
     return E_NOTIMPL;
+  
+  if (_stream)
+  {
+    FOR_VECTOR (i, _items)
+    {
+      RINOK(LoadItem(i));
+    }
+  }
+  
   CObjectVector<CUpdateItem> updateItems;
   UINT codePage = (_forceCodePage ? _specifiedCodePage : _openCodePage);
   
@@ -166,7 +175,7 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
     updateItems.Sort(CompareUpdateItems, NULL);
   }
   
-  return UpdateArchive(_stream, outStream, _items, updateItems, codePage, callback);
+  return UpdateArchive(_stream, outStream, _items, updateItems, codePage, _writeIndex, _numThreads, callback);
   
   COM_TRY_END
 }
@@ -11,6 +11,13 @@ namespace NFileHeader {
   const char *kLongLink = "././@LongLink";
   const char *kLongLink2 = "@LongLink";
 
+  namespace NIndex
+  {
+    const char *kName = "././@TarIndex";
+    const char *kKeyword = "7ZIP.TarIndex";
+    const Byte kSignature[8] = { 'T', 'a', 'r', 'I', 'n', 'd', 'e', 'x' };
+  }
+
   // The magic field is filled with this if uname and gname are valid.
   namespace NMagic
   {
@@ -70,6 +70,40 @@ namespace NFileHeader
   extern const char *kLongLink;  //   = "././@LongLink";
   extern const char *kLongLink2; //   = "@LongLink";
 
+  /*
+    Index of items. It can be written as last item of archive.
+    It's pax global extended header (NIndex::kLinkFlag) with name NIndex::kName.
+    tar programs don't extract pax global headers, and they ignore unknown keywords,
+    so they skip that item.
+    Data of that item is one pax record (the size is aligned for kRecordSize):
+      "<len> 7ZIP.TarIndex=" Index "\n"
+    where (len) is decimal size of full record.
+    pax records are parsed by (len), so Index is binary data:
+      UInt64  HeadersSize
+      Records for each item:
+        UInt64  HeaderPos
+        Byte    LinkFlag
+        UInt32  NameLen
+        char    Name[NameLen]
+      zero padding
+      Footer (kFooterSize bytes):
+        Byte    Signature[8]
+        UInt64  HeaderPos of index item
+        UInt64  Size of HeadersSize field and records
+        UInt32  NumItems
+        UInt32  CRC of HeadersSize field and records
+    All numbers are little-endian.
+  */
+  namespace NIndex
+  {
+    extern const char *kName; // = "././@TarIndex";
+    extern const char *kKeyword; // = "7ZIP.TarIndex";
+    extern const Byte kSignature[8];
+    const char kLinkFlag = 'g';
+    const unsigned kFooterSize = 32;
+    const unsigned kRecordHeaderSize = 13;
+  }
+
   namespace NMagic
   {
     // extern const char *kUsTar;  //  = "ustar"; // 5 chars
@@ -2,10 +2,22 @@
 
 #include "StdAfx.h"
 
+#include "../../../../C/7zCrc.h"
+#include "../../../../C/CpuArch.h"
+
+#include "../../../Common/DynamicBuffer.h"
+#include "../../../Common/IntToString.h"
+#include "../../../Common/MyLinux.h"
+
 #include "../../../Windows/TimeUtils.h"
 
 #include "../../Common/LimitedStreams.h"
 #include "../../Common/ProgressUtils.h"
+#include "../../Common/StreamUtils.h"
+
+#ifndef _7ZIP_ST
+#include "../../Common/VirtThread.h"
+#endif
 
 #include "../../Compress/CopyCoder.h"
 
@@ -18,10 +30,247 @@ namespace NTar {
 HRESULT GetPropString(IArchiveUpdateCallback *callback, UInt32 index, PROPID propId,
     AString &res, UINT codePage, bool convertSlash = false);
 
+static void AddIndexRecord(CByteDynamicBuffer &records, UInt64 headerPos, const CItem &item)
+{
+  const unsigned nameLen = item.Name.Len();
+  Byte *p = records.GetCurPtrAndGrow(NFileHeader::NIndex::kRecordHeaderSize + nameLen);
+  SetUi64(p, headerPos);
+  p[8] = (Byte)item.LinkFlag;
+  SetUi32(p + 9, nameLen);
+  memcpy(p + NFileHeader::NIndex::kRecordHeaderSize, item.Name.Ptr(), nameLen);
+}
+
+static HRESULT WriteIndex(COutArchive &outArchive, ISequentialOutStream *outStream,
+    const CByteDynamicBuffer &records, UInt32 numItems, UInt64 headersSize)
+{
+  const size_t recordsSize = records.GetPos();
+  const unsigned keywordLen = MyStringLen(NFileHeader::NIndex::kKeyword);
+  
+  // the size of pax record includes the number of digits in that size
+  size_t size;
+  char sizeString[32];
+  for (unsigned numDigits = 1;; numDigits++)
+  {
+    size = (numDigits + 1 + keywordLen + 1 + recordsSize + NFileHeader::NIndex::kFooterSize + 1
+        + NFileHeader::kRecordSize - 1) & ~(size_t)(NFileHeader::kRecordSize - 1);
+    ConvertUInt64ToString(size, sizeString);
+    if (MyStringLen(sizeString) == numDigits)
+      break;
+  }
+  
+  AString prefix = sizeString;
+  prefix.Add_Space();
+  prefix += NFileHeader::NIndex::kKeyword;
+  prefix += '=';
+  
+  CByteBuffer data(size);
+  memset(data, 0, size);
+  memcpy(data, prefix.Ptr(), prefix.Len());
+  Byte *index = data + prefix.Len();
+  memcpy(index, records, recordsSize);
+  SetUi64(index, headersSize);
+  
+  Byte *footer = data + size - 1 - NFileHeader::NIndex::kFooterSize;
+  memcpy(footer, NFileHeader::NIndex::kSignature, sizeof(NFileHeader::NIndex::kSignature));
+  SetUi64(footer + 8, outArchive.Pos);
+  SetUi64(footer + 16, recordsSize);
+  SetUi32(footer + 24, numItems);
+  SetUi32(footer + 28, CrcCalc(index, recordsSize));
+  data[size - 1] = '\n';
+
+  CItem item;
+  item.Name = NFileHeader::NIndex::kName;
+  item.LinkFlag = NFileHeader::NIndex::kLinkFlag;
+  item.PackSize = size;
+  item.Size = size;
+  item.MTime = 0;
+  item.Mode = MY_LIN_S_IRUSR | MY_LIN_S_IWUSR | MY_LIN_S_IRGRP | MY_LIN_S_IROTH;
+  item.UID = 0;
+  item.GID = 0;
+  item.DeviceMajorDefined = false;
+  item.DeviceMinorDefined = false;
+  memcpy(item.Magic, NFileHeader::NMagic::kUsTar_00, 8);
+
+  RINOK(outArchive.WriteHeader(item));
+  RINOK(WriteStream(outStream, data, size));
+  outArchive.Pos += size;
+  return S_OK;
+}
+
+// it fills the properties of new or old item and the link for symbolic link
+
+static HRESULT GetUpdateItemProps(IArchiveUpdateCallback *updateCallback,
+    const CObjectVector<CItemEx> &inputItems,
+    const CUpdateItem &ui, UINT codePage,
+    CItem &item, AString &symLink)
+{
+  if (ui.NewProps)
+  {
+    item.Mode = ui.Mode;
+    item.Name = ui.Name;
+    item.User = ui.User;
+    item.Group = ui.Group;
+    
+    if (ui.IsDir)
+    {
+      item.LinkFlag = NFileHeader::NLinkFlag::kDirectory;
+      item.PackSize = 0;
+    }
+    else
+    {
+      item.LinkFlag = NFileHeader::NLinkFlag::kNormal;
+      item.PackSize = ui.Size;
+    }
+    
+    item.MTime = ui.MTime;
+    item.DeviceMajorDefined = false;
+    item.DeviceMinorDefined = false;
+    item.UID = 0;
+    item.GID = 0;
+    memcpy(item.Magic, NFileHeader::NMagic::kUsTar_00, 8);
+  }
+  else
+    item = inputItems[ui.IndexInArc];
+
+  symLink.Empty();
+  if (ui.NewData || ui.NewProps)
+  {
+    RINOK(GetPropString(updateCallback, ui.IndexInClient, kpidSymLink, symLink, codePage, true));
+    if (!symLink.IsEmpty())
+    {
+      item.LinkFlag = NFileHeader::NLinkFlag::kSymLink;
+      item.LinkName = symLink;
+    }
+  }
+  return S_OK;
+}
+
+/* OpenNewData() gets the stream of new data and it sets the sizes of item.
+   (needWrite == false) means that item must be skipped. */
+
+static HRESULT OpenNewData(IArchiveUpdateCallback *updateCallback,
+    const CUpdateItem &ui, UINT codePage, const AString &symLink,
+    CItem &item, bool &needWrite, CMyComPtr<ISequentialInStream> &fileInStream)
+{
+  item.SparseBlocks.Clear();
+  item.PackSize = ui.Size;
+  item.Size = ui.Size;
+  if (ui.Size == (UInt64)(Int64)-1)
+    return E_INVALIDARG;
+
+  needWrite = true;
+  
+  if (!symLink.IsEmpty())
+  {
+    item.PackSize = 0;
+    item.Size = 0;
+    return S_OK;
+  }
+  
+  HRESULT res = updateCallback->GetStream(ui.IndexInClient, &fileInStream);
+  
+  if (res == S_FALSE)
+  {
+    needWrite = false;
+    return S_OK;
+  }
+  RINOK(res);
+  
+  if (fileInStream)
+  {
+    CMyComPtr<IStreamGetProps> getProps;
+    fileInStream->QueryInterface(IID_IStreamGetProps, (void **)&getProps);
+    if (getProps)
+    {
+      FILETIME mTime;
+      UInt64 size2;
+      if (getProps->GetProps(&size2, NULL, NULL, &mTime, NULL) == S_OK)
+      {
+        item.PackSize = size2;
+        item.Size = size2;
+        item.MTime = NWindows::NTime::FileTimeToUnixTime64(mTime);;
+      }
+    }
+  }
+  else
+  {
+    item.PackSize = 0;
+    item.Size = 0;
+  }
+
+  {
+    AString hardLink;
+    RINOK(GetPropString(updateCallback, ui.IndexInClient, kpidHardLink, hardLink, codePage, true));
+    if (!hardLink.IsEmpty())
+    {
+      item.LinkFlag = NFileHeader::NLinkFlag::kHardLink;
+      item.LinkName = hardLink;
+      item.PackSize = 0;
+      item.Size = 0;
+      fileInStream.Release();
+    }
+  }
+  return S_OK;
+}
+
+
+#ifndef _7ZIP_ST
+
+/*
+  Multithreaded mode: the main thread gets the properties and opens the streams
+  of next new files in advance, and the read-ahead threads read the data of
+  these files to memory buffers. The main thread writes headers and data in
+  original order. As in multithreaded zip update, SetOperationResult() is
+  called just after GetStream() of same item, so the calls to update callback
+  are in original order, and the callback can't see interleaved items.
+  The streams can be released later than in single-threaded mode.
+  The latency of file reading is hidden for trees of small files.
+*/
+
+static const size_t kReadAheadBufSize = (size_t)1 << 20;
+
+class CReadAheadThread: public CVirtThread
+{
+public:
+  CItem Item;
+  bool NeedWrite;
+  bool StreamWasOpened;
+  CMyComPtr<ISequentialInStream> Stream; // it's released, if all data was read to buffer
+  CByteBuffer Buf;
+  size_t DataSize;
+  HRESULT Result;
+
+  HRESULT Create()
+  {
+    Buf.Alloc(kReadAheadBufSize);
+    WRes wres = CVirtThread::Create();
+    return HRESULT_FROM_WIN32(wres);
+  }
+  ~CReadAheadThread() { CVirtThread::WaitThreadFinish(); }
+  virtual void Execute();
+};
+
+void CReadAheadThread::Execute()
+{
+  try
+  {
+    DataSize = Buf.Size();
+    Result = ReadStream(Stream, Buf, &DataSize);
+    if (Result == S_OK && DataSize != Buf.Size())
+      Stream.Release();
+  }
+  catch(...) { Result = E_FAIL; }
+}
+
+#endif
+
+
 HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
     const CObjectVector<NArchive::NTar::CItemEx> &inputItems,
     const CObjectVector<CUpdateItem> &updateItems,
     UINT codePage,
+    bool writeIndex,
+    UInt32 numThreads,
     IArchiveUpdateCallback *updateCallback)
 {
   COutArchive outArchive;
@@ -59,6 +308,42 @@ HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
   CMyComPtr<CLimitedSequentialInStream> inStreamLimited(streamSpec);
   streamSpec->SetStream(inStream);
 
+  CByteDynamicBuffer indexRecords;
+  UInt32 numIndexItems = 0;
+  UInt64 headersSize = 0;
+  if (writeIndex)
+    indexRecords.GetCurPtrAndGrow(8); // HeadersSize
+
+  #ifndef _7ZIP_ST
+  
+  CUIntVector newDataItems;
+  CObjArray<CReadAheadThread> threads;
+  unsigned numReadAheadThreads = 0;
+  unsigned numStarted = 0;
+  unsigned numFinished = 0;
+  
+  if (numThreads > 1)
+  {
+    for (i = 0; i < updateItems.Size(); i++)
+      if (updateItems[i].NewData)
+        newDataItems.Add(i);
+    if (newDataItems.Size() > 1)
+    {
+      numReadAheadThreads = MyMin(numThreads, newDataItems.Size());
+      threads.Alloc(numReadAheadThreads);
+      for (unsigned t = 0; t < numReadAheadThreads; t++)
+      {
+        RINOK(threads[t].Create());
+      }
+    }
+  }
+  
+  #else
+  
+  UNUSED_VAR(numThreads);
+  
+  #endif
+
   complexity = 0;
 
   for (i = 0; i < updateItems.Size(); i++)
@@ -68,140 +353,108 @@ HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
 
     const CUpdateItem &ui = updateItems[i];
     CItem item;
-  
-    if (ui.NewProps)
-    {
-      item.Mode = ui.Mode;
-      item.Name = ui.Name;
-      item.User = ui.User;
-      item.Group = ui.Group;
-      
-      if (ui.IsDir)
-      {
-        item.LinkFlag = NFileHeader::NLinkFlag::kDirectory;
-        item.PackSize = 0;
-      }
-      else
-      {
-        item.LinkFlag = NFileHeader::NLinkFlag::kNormal;
-        item.PackSize = ui.Size;
-      }
-      
-      item.MTime = ui.MTime;
-      item.DeviceMajorDefined = false;
-      item.DeviceMinorDefined = false;
-      item.UID = 0;
-      item.GID = 0;
-      memcpy(item.Magic, NFileHeader::NMagic::kUsTar_00, 8);
-    }
-    else
-      item = inputItems[ui.IndexInArc];
-
     AString symLink;
-    if (ui.NewData || ui.NewProps)
-    {
-      RINOK(GetPropString(updateCallback, ui.IndexInClient, kpidSymLink, symLink, codePage, true));
-      if (!symLink.IsEmpty())
-      {
-        item.LinkFlag = NFileHeader::NLinkFlag::kSymLink;
-        item.LinkName = symLink;
-      }
-    }
 
     if (ui.NewData)
     {
-      item.SparseBlocks.Clear();
-      item.PackSize = ui.Size;
-      item.Size = ui.Size;
-      if (ui.Size == (UInt64)(Int64)-1)
-        return E_INVALIDARG;
-
       CMyComPtr<ISequentialInStream> fileInStream;
+      bool needWrite;
+      bool streamWasOpened;
+      const Byte *readAheadData = NULL;
+      size_t readAheadSize = 0;
+      bool opResultWasSet = false;
 
-      bool needWrite = true;
-      
-      if (!symLink.IsEmpty())
+      #ifndef _7ZIP_ST
+      if (numReadAheadThreads != 0)
       {
-        item.PackSize = 0;
-        item.Size = 0;
+        while (numStarted < newDataItems.Size() && numStarted < numFinished + numReadAheadThreads)
+        {
+          CReadAheadThread &thread = threads[numStarted % numReadAheadThreads];
+          const CUpdateItem &ui2 = updateItems[newDataItems[numStarted]];
+          AString symLink2;
+          RINOK(GetUpdateItemProps(updateCallback, inputItems, ui2, codePage, thread.Item, symLink2));
+          RINOK(OpenNewData(updateCallback, ui2, codePage, symLink2, thread.Item, thread.NeedWrite, thread.Stream));
+          thread.StreamWasOpened = (thread.Stream != NULL);
+          thread.DataSize = 0;
+          thread.Result = S_OK;
+          if (thread.StreamWasOpened)
+            thread.Start();
+          numStarted++;
+          RINOK(updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK));
+        }
+        
+        CReadAheadThread &thread = threads[numFinished % numReadAheadThreads];
+        numFinished++;
+        if (thread.StreamWasOpened)
+          thread.WaitExecuteFinish();
+        RINOK(thread.Result);
+        item = thread.Item;
+        needWrite = thread.NeedWrite;
+        streamWasOpened = thread.StreamWasOpened;
+        fileInStream = thread.Stream;
+        thread.Stream.Release();
+        readAheadData = thread.Buf;
+        readAheadSize = thread.DataSize;
+        opResultWasSet = true;
       }
       else
+      #endif
       {
-        HRESULT res = updateCallback->GetStream(ui.IndexInClient, &fileInStream);
-        
-        if (res == S_FALSE)
-          needWrite = false;
-        else
-        {
-          RINOK(res);
-          
-          if (fileInStream)
-          {
-            CMyComPtr<IStreamGetProps> getProps;
-            fileInStream->QueryInterface(IID_IStreamGetProps, (void **)&getProps);
-            if (getProps)
-            {
-              FILETIME mTime;
-              UInt64 size2;
-              if (getProps->GetProps(&size2, NULL, NULL, &mTime, NULL) == S_OK)
-              {
-                item.PackSize = size2;
-                item.Size = size2;
-                item.MTime = NWindows::NTime::FileTimeToUnixTime64(mTime);;
-              }
-            }
-          }
-          else
-          {
-            item.PackSize = 0;
-            item.Size = 0;
-          }
-
-          {
-            AString hardLink;
-            RINOK(GetPropString(updateCallback, ui.IndexInClient, kpidHardLink, hardLink, codePage, true));
-            if (!hardLink.IsEmpty())
-            {
-              item.LinkFlag = NFileHeader::NLinkFlag::kHardLink;
-              item.LinkName = hardLink;
-              item.PackSize = 0;
-              item.Size = 0;
-              fileInStream.Release();
-            }
-          }
-        }
+        RINOK(GetUpdateItemProps(updateCallback, inputItems, ui, codePage, item, symLink));
+        RINOK(OpenNewData(updateCallback, ui, codePage, symLink, item, needWrite, fileInStream));
+        streamWasOpened = (fileInStream != NULL);
       }
 
       if (needWrite)
       {
         UInt64 fileHeaderStartPos = outArchive.Pos;
         RINOK(outArchive.WriteHeader(item));
-        if (fileInStream)
+        headersSize += outArchive.Pos - fileHeaderStartPos;
+        if (streamWasOpened)
         {
-          RINOK(copyCoder->Code(fileInStream, outStream, NULL, NULL, progress));
-          outArchive.Pos += copyCoderSpec->TotalSize;
-          if (copyCoderSpec->TotalSize != item.PackSize)
+          UInt64 dataSize = readAheadSize;
+          if (readAheadSize != 0)
+          {
+            RINOK(WriteStream(outStream, readAheadData, readAheadSize));
+          }
+          if (fileInStream)
+          {
+            RINOK(copyCoder->Code(fileInStream, outStream, NULL, NULL, progress));
+            dataSize += copyCoderSpec->TotalSize;
+          }
+          outArchive.Pos += dataSize;
+          if (dataSize != item.PackSize)
           {
             if (!outSeekStream)
               return E_FAIL;
             UInt64 backOffset = outArchive.Pos - fileHeaderStartPos;
             RINOK(outSeekStream->Seek(-(Int64)backOffset, STREAM_SEEK_CUR, NULL));
             outArchive.Pos = fileHeaderStartPos;
-            item.PackSize = copyCoderSpec->TotalSize;
+            item.PackSize = dataSize;
             RINOK(outArchive.WriteHeader(item));
             RINOK(outSeekStream->Seek(item.PackSize, STREAM_SEEK_CUR, NULL));
             outArchive.Pos += item.PackSize;
           }
           RINOK(outArchive.FillDataResidual(item.PackSize));
         }
+        if (writeIndex)
+        {
+          AddIndexRecord(indexRecords, fileHeaderStartPos, item);
+          numIndexItems++;
+        }
       }
       
       complexity += item.PackSize;
-      RINOK(updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK));
+      if (!opResultWasSet)
+      {
+        RINOK(updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK));
+      }
     }
     else
     {
+      RINOK(GetUpdateItemProps(updateCallback, inputItems, ui, codePage, item, symLink));
       const CItemEx &existItem = inputItems[ui.IndexInArc];
+      const UInt64 fileHeaderStartPos = outArchive.Pos;
       UInt64 size;
       
       if (ui.NewProps)
@@ -231,14 +484,22 @@ HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
         item.GID = existItem.GID;
         
         RINOK(outArchive.WriteHeader(item));
+        headersSize += outArchive.Pos - fileHeaderStartPos;
         RINOK(inStream->Seek(existItem.GetDataPosition(), STREAM_SEEK_SET, NULL));
         size = existItem.PackSize;
       }
       else
       {
+        headersSize += existItem.HeaderSize;
         RINOK(inStream->Seek(existItem.HeaderPos, STREAM_SEEK_SET, NULL));
         size = existItem.GetFullSize();
       }
+
+      if (writeIndex)
+      {
+        AddIndexRecord(indexRecords, fileHeaderStartPos, item);
+        numIndexItems++;
+      }
       
       streamSpec->Init(size);
 
@@ -260,6 +521,12 @@ HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
   
   lps->InSize = lps->OutSize = complexity;
   RINOK(lps->SetCur());
+
+  if (writeIndex)
+  {
+    RINOK(WriteIndex(outArchive, outStream, indexRecords, numIndexItems, headersSize));
+  }
+  
   return outArchive.WriteFinishHeader();
 }
 
@@ -31,6 +31,8 @@ HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
     const CObjectVector<CItemEx> &inputItems,
     const CObjectVector<CUpdateItem> &updateItems,
     UINT codePage,
+    bool writeIndex,
+    UInt32 numThreads,
     IArchiveUpdateCallback *updateCallback);
 
 }}
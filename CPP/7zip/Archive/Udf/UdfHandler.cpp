@@ -212,6 +212,35 @@ STDMETHODIMP CHandler::GetProperty(UInt32 index, PROPID propID, PROPVARIANT *val
   COM_TRY_END
 }
 
+// it adds the extents of non-inline item without end marker
+
+HRESULT CHandler::GetExtents(const CLogVol &vol, const CItem &item, CRecordVector<CSeekExtent> &extents) const
+{
+  extents.Clear();
+  UInt64 size = item.Size;
+  UInt64 virtOffset = 0;
+  FOR_VECTOR (extentIndex, item.Extents)
+  {
+    const CMyExtent &extent = item.Extents[extentIndex];
+    UInt32 len = extent.GetLen();
+    if (len == 0)
+      continue;
+    if (size < len)
+      return S_FALSE;
+      
+    CSeekExtent se;
+    se.Phy = vol.GetPhyPos(extent.PartitionRef, extent.Pos);
+    se.Virt = virtOffset;
+    virtOffset += len;
+    extents.Add(se);
+
+    size -= len;
+  }
+  if (size != 0)
+    return S_FALSE;
+  return S_OK;
+}
+
 STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
 {
   *stream = 0;
@@ -221,7 +250,6 @@ STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
   const CRef &ref = vol.FileSets[ref2.Fs].Refs[ref2.Ref];
   const CFile &file = _archive.Files[ref.FileIndex];
   const CItem &item = _archive.Items[file.ItemIndex];
-  UInt64 size = item.Size;
 
   if (!item.IsRecAndAlloc() || !item.CheckChunkSizes() || ! _archive.CheckItemExtents(ref2.Vol, item))
     return E_NOTIMPL;
@@ -237,35 +265,10 @@ STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
   
   extentStreamSpec->Stream = _inStream;
 
-  UInt64 virtOffset = 0;
-  FOR_VECTOR (extentIndex, item.Extents)
-  {
-    const CMyExtent &extent = item.Extents[extentIndex];
-    UInt32 len = extent.GetLen();
-    if (len == 0)
-      continue;
-    if (size < len)
-      return S_FALSE;
-      
-    int partitionIndex = vol.PartitionMaps[extent.PartitionRef].PartitionIndex;
-    UInt32 logBlockNumber = extent.Pos;
-    const CPartition &partition = _archive.Partitions[partitionIndex];
-    UInt64 offset = ((UInt64)partition.Pos << _archive.SecLogSize) +
-      (UInt64)logBlockNumber * vol.BlockSize;
-      
-    CSeekExtent se;
-    se.Phy = offset;
-    se.Virt = virtOffset;
-    virtOffset += len;
-    extentStreamSpec->Extents.Add(se);
-
-    size -= len;
-  }
-  if (size != 0)
-    return S_FALSE;
+  RINOK(GetExtents(vol, item, extentStreamSpec->Extents));
   CSeekExtent se;
   se.Phy = 0;
-  se.Virt = virtOffset;
+  se.Virt = item.Size;
   extentStreamSpec->Extents.Add(se);
   extentStreamSpec->Init();
   *stream = extentStream.Detach();
@@ -308,54 +311,140 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   CLimitedSequentialOutStream *outStreamSpec = new CLimitedSequentialOutStream;
   CMyComPtr<ISequentialOutStream> outStream(outStreamSpec);
 
-  for (i = 0; i < numItems; i++)
+  /* The data of small items is read to memory in order of physical position of extents.
+     Then these items are sent to callback in original order.
+     Big items are copied with big reads without buffering. */
+
+  CExtentsReader reader;
+  CRecordVector<CSeekExtent> extents;
+  CRecordVector<bool> isBufItem;
+
+  for (i = 0; i < numItems;)
   {
     lps->InSize = lps->OutSize = currentTotalSize;
     RINOK(lps->SetCur());
-    CMyComPtr<ISequentialOutStream> realOutStream;
-    Int32 askMode = testMode ?
-        NExtract::NAskMode::kTest :
-        NExtract::NAskMode::kExtract;
-    UInt32 index = allFilesMode ? i : indices[i];
-    
-    RINOK(extractCallback->GetStream(index, &realOutStream, askMode));
 
-    const CRef2 &ref2 = _refs2[index];
-    const CRef &ref = _archive.LogVols[ref2.Vol].FileSets[ref2.Fs].Refs[ref2.Ref];
-    const CFile &file = _archive.Files[ref.FileIndex];
-    const CItem &item = _archive.Items[file.ItemIndex];
-
-    if (item.IsDir())
+    reader.Clear();
+    isBufItem.Clear();
+    UInt32 numBatchItems;
+    
+    for (numBatchItems = 0; i + numBatchItems < numItems; numBatchItems++)
     {
-      RINOK(extractCallback->PrepareOperation(askMode));
-      RINOK(extractCallback->SetOperationResult(NExtract::NOperationResult::kOK));
-      continue;
+      UInt32 index = allFilesMode ? i + numBatchItems : indices[i + numBatchItems];
+      const CRef2 &ref2 = _refs2[index];
+      const CLogVol &vol = _archive.LogVols[ref2.Vol];
+      const CRef &ref = vol.FileSets[ref2.Fs].Refs[ref2.Ref];
+      const CFile &file = _archive.Files[ref.FileIndex];
+      const CItem &item = _archive.Items[file.ItemIndex];
+      
+      bool isBuf = false;
+      if (!item.IsDir()
+          && item.IsRecAndAlloc() && item.CheckChunkSizes() && _archive.CheckItemExtents(ref2.Vol, item)
+          && !item.IsInline
+          && GetExtents(vol, item, extents) == S_OK)
+      {
+        if (item.Size > CExtentsReader::kReadSize
+            || reader.GetDataSize() + item.Size > CExtentsReader::kBufSize)
+          break;
+        isBuf = true;
+      }
+      
+      reader.AddItem();
+      if (isBuf)
+        FOR_VECTOR (e, extents)
+        {
+          const UInt64 next = (e + 1 < extents.Size()) ? extents[e + 1].Virt : item.Size;
+          reader.AddExtent(extents[e].Phy, (size_t)(next - extents[e].Virt));
+        }
+      isBufItem.Add(isBuf);
     }
-    currentTotalSize += item.Size;
 
-    if (!testMode && !realOutStream)
-      continue;
+    if (numBatchItems != 0)
+    {
+      RINOK(reader.Read(_inStream, progress));
+    }
 
-    RINOK(extractCallback->PrepareOperation(askMode));
-    outStreamSpec->SetStream(realOutStream);
-    realOutStream.Release();
-    outStreamSpec->Init(item.Size);
-    Int32 opRes;
-    CMyComPtr<ISequentialInStream> udfInStream;
-    HRESULT res = GetStream(index, &udfInStream);
-    if (res == E_NOTIMPL)
-      opRes = NExtract::NOperationResult::kUnsupportedMethod;
-    else if (res != S_OK)
-      opRes = NExtract::NOperationResult::kDataError;
-    else
+    // if (numBatchItems == 0), we copy one big item directly
+    const UInt32 numCurItems = (numBatchItems == 0) ? 1 : numBatchItems;
+  
+    for (UInt32 k = 0; k < numCurItems; k++, i++)
     {
-      RINOK(copyCoder->Code(udfInStream, outStream, NULL, NULL, progress));
-      opRes = outStreamSpec->IsFinishedOK() ?
-        NExtract::NOperationResult::kOK:
-        NExtract::NOperationResult::kDataError;
+      CMyComPtr<ISequentialOutStream> realOutStream;
+      Int32 askMode = testMode ?
+          NExtract::NAskMode::kTest :
+          NExtract::NAskMode::kExtract;
+      UInt32 index = allFilesMode ? i : indices[i];
+      
+      RINOK(extractCallback->GetStream(index, &realOutStream, askMode));
+  
+      const CRef2 &ref2 = _refs2[index];
+      const CLogVol &vol = _archive.LogVols[ref2.Vol];
+      const CRef &ref = vol.FileSets[ref2.Fs].Refs[ref2.Ref];
+      const CFile &file = _archive.Files[ref.FileIndex];
+      const CItem &item = _archive.Items[file.ItemIndex];
+  
+      if (item.IsDir())
+      {
+        RINOK(extractCallback->PrepareOperation(askMode));
+        RINOK(extractCallback->SetOperationResult(NExtract::NOperationResult::kOK));
+        continue;
+      }
+      const UInt64 itemStartPos = currentTotalSize;
+      currentTotalSize += item.Size;
+  
+      if (!testMode && !realOutStream)
+        continue;
+  
+      RINOK(extractCallback->PrepareOperation(askMode));
+      outStreamSpec->SetStream(realOutStream);
+      realOutStream.Release();
+      outStreamSpec->Init(item.Size);
+      Int32 opRes;
+      
+      if (numBatchItems == 0 || isBufItem[k])
+      {
+        if (numBatchItems != 0)
+        {
+          UInt64 processed;
+          RINOK(reader.WriteItem(k, outStream, processed));
+        }
+        else
+        {
+          RINOK(GetExtents(vol, item, extents));
+          FOR_VECTOR (e, extents)
+          {
+            const CSeekExtent &se = extents[e];
+            const UInt64 size = ((e + 1 < extents.Size()) ? extents[e + 1].Virt : item.Size) - se.Virt;
+            lps->InSize = lps->OutSize = itemStartPos + se.Virt;
+            UInt64 processed;
+            RINOK(reader.CopyExtent(_inStream, se.Phy, size, outStream, progress, processed));
+            if (processed != size)
+              break;
+          }
+        }
+        opRes = outStreamSpec->IsFinishedOK() ?
+          NExtract::NOperationResult::kOK:
+          NExtract::NOperationResult::kDataError;
+      }
+      else
+      {
+        CMyComPtr<ISequentialInStream> udfInStream;
+        HRESULT res = GetStream(index, &udfInStream);
+        if (res == E_NOTIMPL)
+          opRes = NExtract::NOperationResult::kUnsupportedMethod;
+        else if (res != S_OK)
+          opRes = NExtract::NOperationResult::kDataError;
+        else
+        {
+          RINOK(copyCoder->Code(udfInStream, outStream, NULL, NULL, progress));
+          opRes = outStreamSpec->IsFinishedOK() ?
+            NExtract::NOperationResult::kOK:
+            NExtract::NOperationResult::kDataError;
+        }
+      }
+      outStreamSpec->ReleaseStream();
+      RINOK(extractCallback->SetOperationResult(opRes));
     }
-    outStreamSpec->ReleaseStream();
-    RINOK(extractCallback->SetOperationResult(opRes));
   }
   return S_OK;
   COM_TRY_END
@@ -5,6 +5,8 @@
 
 #include "../../../Common/MyCom.h"
 
+#include "../../Common/LimitedStreams.h"
+
 #include "../IArchive.h"
 
 #include "UdfIn.h"
@@ -27,6 +29,8 @@ class CHandler:
   CMyComPtr<IInStream> _inStream;
   CInArchive _archive;
   CRecordVector<CRef2> _refs2;
+
+  HRESULT GetExtents(const CLogVol &vol, const CItem &item, CRecordVector<CSeekExtent> &extents) const;
 public:
   MY_UNKNOWN_IMP2(IInArchive, IInArchiveGetStream)
   INTERFACE_IInArchive(;)
@@ -250,9 +250,7 @@ bool CInArchive::CheckExtent(int volIndex, int partitionRef, UInt32 blockPos, UI
   const CLogVol &vol = LogVols[volIndex];
   if (partitionRef >= (int)vol.PartitionMaps.Size())
     return false;
-  const CPartition &partition = Partitions[vol.PartitionMaps[partitionRef].PartitionIndex];
-  UInt64 offset = ((UInt64)partition.Pos << SecLogSize) + (UInt64)blockPos * vol.BlockSize;
-  return (offset + len) <= (((UInt64)partition.Pos + partition.Len) << SecLogSize);
+  return (vol.GetPhyPos(partitionRef, blockPos) + len) <= vol.PartitionMaps[partitionRef].PhyEnd;
 }
 
 bool CInArchive::CheckItemExtents(int volIndex, const CItem &item) const
@@ -270,9 +268,7 @@ HRESULT CInArchive::Read(int volIndex, int partitionRef, UInt32 blockPos, UInt32
 {
   if (!CheckExtent(volIndex, partitionRef, blockPos, len))
     return S_FALSE;
-  const CLogVol &vol = LogVols[volIndex];
-  const CPartition &partition = Partitions[vol.PartitionMaps[partitionRef].PartitionIndex];
-  UInt64 offset = ((UInt64)partition.Pos << SecLogSize) + (UInt64)blockPos * vol.BlockSize;
+  const UInt64 offset = LogVols[volIndex].GetPhyPos(partitionRef, blockPos);
   RINOK(_stream->Seek(offset, STREAM_SEEK_SET, NULL));
   HRESULT res = ReadStream_FALSE(_stream, buf, len);
   if (res == S_FALSE && offset + len > FileSize)
@@ -837,6 +833,8 @@ HRESULT CInArchive::Open2()
             // return S_FALSE;
           }
           pm.PartitionIndex = i;
+          pm.PhyPos = (UInt64)part.Pos << SecLogSize;
+          pm.PhyEnd = ((UInt64)part.Pos + part.Len) << SecLogSize;
           part.VolIndex = volIndex;
 
           totalSize += (UInt64)part.Len << SecLogSize;
@@ -943,12 +941,7 @@ HRESULT CInArchive::Open2()
           if (size < len)
             break;
           
-          int partitionIndex = vol.PartitionMaps[extent.PartitionRef].PartitionIndex;
-          UInt32 logBlockNumber = extent.Pos;
-          const CPartition &partition = Partitions[partitionIndex];
-          UInt64 offset = ((UInt64)partition.Pos << SecLogSize) +
-              (UInt64)logBlockNumber * vol.BlockSize;
-          UpdatePhySize(offset + len);
+          UpdatePhySize(vol.GetPhyPos(extent.PartitionRef, extent.Pos) + len);
         }
       }
     }
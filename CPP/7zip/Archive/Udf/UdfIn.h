@@ -168,6 +168,10 @@ struct CPartitionMap
   // Byte Data[256];
 
   int PartitionIndex;
+
+  // physical position of partition, it's set after partition is found
+  UInt64 PhyPos;
+  UInt64 PhyEnd;
 };
 
 // ECMA 4/14.6
@@ -324,6 +328,9 @@ struct CLogVol
   CObjectVector<CFileSet> FileSets;
 
   UString GetName() const { return Id.GetString(); }
+
+  UInt64 GetPhyPos(unsigned partitionRef, UInt32 blockPos) const
+    { return PartitionMaps[partitionRef].PhyPos + (UInt64)blockPos * BlockSize; }
 };
 
 struct CProgressVirt
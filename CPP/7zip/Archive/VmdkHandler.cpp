@@ -6,6 +6,7 @@
 
 #include "../../../C/CpuArch.h"
 
+#include "../../Common/AutoPtr.h"
 #include "../../Common/ComTry.h"
 #include "../../Common/IntToString.h"
 #include "../../Common/StringConvert.h"
@@ -13,6 +14,7 @@
 #include "../../Common/UTFConvert.h"
 
 #include "../../Windows/PropVariant.h"
+#include "../../Windows/System.h"
 
 #include "../Common/RegisterArc.h"
 #include "../Common/StreamObjects.h"
@@ -365,6 +367,24 @@ struct CExtent
   CHeader h;
 
   UInt64 GetEndOffset() const { return StartOffset + NumBytes; }
+
+  // key of cluster in cluster cache is virtual sector of cluster
+  UInt64 GetClusterKey(UInt64 cluster) const { return (StartOffset >> 9) + (cluster << (ClusterBits - 9)); }
+
+  UInt32 GetClusterEntry(UInt64 cluster) const
+  {
+    const UInt64 high = cluster >> k_NumMidBits;
+    if (high < Tables.Size())
+    {
+      const CByteBuffer &table = Tables[(unsigned)high];
+      if (table.Size() != 0)
+      {
+        const size_t midBits = (size_t)cluster & ((1 << k_NumMidBits) - 1);
+        return Get32((const Byte *)table + (midBits << 2));
+      }
+    }
+    return 0;
+  }
   
   bool IsVmdk() const { return !IsZero && !IsFlat; };
   // if (IsOK && IsVmdk()), then VMDK header of this extent was read
@@ -419,6 +439,49 @@ struct CExtent
 };
   
 
+class CZlibClusterDecoder: public CClusterDecoder
+{
+  CBufInStream *_bufInStreamSpec;
+  CMyComPtr<ISequentialInStream> _bufInStream;
+
+  CBufPtrSeqOutStream *_bufOutStreamSpec;
+  CMyComPtr<ISequentialOutStream> _bufOutStream;
+
+  NCompress::NZlib::CDecoder *_zlibDecoderSpec;
+  CMyComPtr<ICompressCoder> _zlibDecoder;
+public:
+  CZlibClusterDecoder()
+  {
+    _bufInStreamSpec = new CBufInStream;
+    _bufInStream = _bufInStreamSpec;
+    _bufOutStreamSpec = new CBufPtrSeqOutStream();
+    _bufOutStream = _bufOutStreamSpec;
+    _zlibDecoderSpec = new NCompress::NZlib::CDecoder;
+    _zlibDecoder = _zlibDecoderSpec;
+  }
+
+  HRESULT Decode(const Byte *src, size_t srcSize, Byte *dest, size_t &destSize)
+  {
+    _bufInStreamSpec->Init(src, srcSize);
+    _bufOutStreamSpec->Init(dest, destSize);
+    
+    // Do we need to use smaller block than clusterSize for last cluster?
+    UInt64 blockSize64 = destSize;
+    HRESULT res = _zlibDecoderSpec->Code(_bufInStream, _bufOutStream, NULL, &blockSize64, NULL);
+
+    if (_bufOutStreamSpec->GetPos() != destSize
+        || _zlibDecoderSpec->GetInputProcessedSize() != srcSize)
+    {
+      if (res == S_OK)
+        res = S_FALSE;
+    }
+    return res;
+  }
+};
+
+static CClusterDecoder *CreateZlibClusterDecoder() { return new CZlibClusterDecoder; }
+
+
 class CHandler: public CHandlerImg
 {
   bool _isArc;
@@ -429,9 +492,8 @@ class CHandler: public CHandlerImg
   bool _isMultiVol;
   bool _needDeflate;
 
-  UInt64 _cacheCluster;
-  unsigned _cacheExtent;
-  CByteBuffer _cache;
+  CClusterCache _clusterCache;
+  UInt64 _nextClusterKey; // the key of cluster that follows last unpacked cluster
   CByteBuffer _cacheCompressed;
   
   unsigned _clusterBitsMax;
@@ -439,14 +501,7 @@ class CHandler: public CHandlerImg
 
   CObjectVector<CExtent> _extents;
 
-  CBufInStream *_bufInStreamSpec;
-  CMyComPtr<ISequentialInStream> _bufInStream;
-
-  CBufPtrSeqOutStream *_bufOutStreamSpec;
-  CMyComPtr<ISequentialOutStream> _bufOutStream;
-
-  NCompress::NZlib::CDecoder *_zlibDecoderSpec;
-  CMyComPtr<ICompressCoder> _zlibDecoder;
+  CMyAutoPtr<CClusterDecoder> _decoder;
 
   CByteBuffer _descriptorBuf;
   CDescriptor _descriptor;
@@ -458,6 +513,9 @@ class CHandler: public CHandlerImg
     _virtPos = 0;
   }
 
+  HRESULT ReadPackedCluster(CExtent &extent, UInt64 cluster, UInt32 v, size_t &packedSize);
+  HRESULT DecodeCluster(CExtent &extent, UInt64 cluster, UInt32 v);
+
   virtual HRESULT Open2(IInStream *stream, IArchiveOpenCallback *openCallback);
   virtual void CloseAtError();
 public:
@@ -468,6 +526,94 @@ public:
 };
 
 
+HRESULT CHandler::ReadPackedCluster(CExtent &extent, UInt64 cluster, UInt32 v, size_t &packedSize)
+{
+  const UInt64 offset = (UInt64)v << 9;
+  if (offset != extent.PosInArc)
+  {
+    // printf("\n%12x %12x\n", (unsigned)offset, (unsigned)(offset - extent.PosInArc));
+    RINOK(extent.Seek(offset));
+  }
+  
+  const size_t kStartSize = 1 << 9;
+  {
+    size_t curSize = kStartSize;
+    RINOK(extent.Read(_cacheCompressed, &curSize));
+    // _stream_PackSize += curSize;
+    if (curSize != kStartSize)
+      return S_FALSE;
+  }
+
+  if (Get64(_cacheCompressed) != (cluster << (extent.ClusterBits - 9)))
+    return S_FALSE;
+
+  UInt32 dataSize = Get32(_cacheCompressed + 8);
+  if (dataSize > ((UInt32)1 << 31))
+    return S_FALSE;
+
+  size_t dataSize2 = (size_t)dataSize + 12;
+  
+  if (dataSize2 > kStartSize)
+  {
+    dataSize2 = (dataSize2 + 511) & ~(size_t)511;
+    if (dataSize2 > _cacheCompressed.Size())
+      return S_FALSE;
+    size_t curSize = dataSize2 - kStartSize;
+    const size_t curSize2 = curSize;
+    RINOK(extent.Read(_cacheCompressed + kStartSize, &curSize));
+    // _stream_PackSize += curSize;
+    if (curSize != curSize2)
+      return S_FALSE;
+  }
+
+  packedSize = dataSize;
+  return S_OK;
+}
+
+
+HRESULT CHandler::DecodeCluster(CExtent &extent, UInt64 cluster, UInt32 v)
+{
+  const size_t clusterSize = (size_t)1 << extent.ClusterBits;
+  const UInt64 numClusters = (extent.NumBytes + clusterSize - 1) >> extent.ClusterBits;
+  size_t packedSize;
+
+  #ifndef _7ZIP_ST
+  /* If reading is sequential, we also unpack the next compressed grains
+     of this extent in parallel threads. Packed data is read here in order of grains. */
+  if (extent.GetClusterKey(cluster) == _nextClusterKey && _clusterCache.GetNumThreads() > 1)
+  {
+    RINOK(ReadPackedCluster(extent, cluster, v, packedSize));
+    for (;;)
+    {
+      CClusterDecodeJob &job = _clusterCache.AddJob(extent.GetClusterKey(cluster));
+      memcpy(job.Packed, _cacheCompressed + 12, packedSize);
+      job.PackedSize = packedSize;
+      job.DestSize = clusterSize;
+      cluster++;
+      _nextClusterKey = extent.GetClusterKey(cluster);
+      if (_clusterCache.GetNumJobs() == _clusterCache.GetNumThreads()
+          || cluster >= numClusters
+          || _clusterCache.IsCached(_nextClusterKey))
+        break;
+      v = extent.GetClusterEntry(cluster);
+      if (v == 0 || v == extent.ZeroSector
+          || ReadPackedCluster(extent, cluster, v, packedSize) != S_OK)
+        break;
+    }
+    return _clusterCache.DecodeJobs();
+  }
+  #endif
+
+  RINOK(ReadPackedCluster(extent, cluster, v, packedSize));
+  unsigned slotIndex = _clusterCache.GetNewSlot();
+  size_t destSize = clusterSize;
+  RINOK((*_decoder).Decode(_cacheCompressed + 12, packedSize, _clusterCache.GetSlotData(slotIndex), destSize));
+  _clusterCache.SetSlotKey(slotIndex, extent.GetClusterKey(cluster));
+  _nextClusterKey = extent.GetClusterKey(cluster + 1);
+  return S_OK;
+}
+
+
 STDMETHODIMP CHandler::Read(void *data, UInt32 size, UInt32 *processedSize)
 {
   if (processedSize)
@@ -604,140 +750,57 @@ STDMETHODIMP CHandler::Read(void *data, UInt32 size, UInt32 *processedSize)
         size = (UInt32)rem;
     }
 
-    if (extentIndex == _cacheExtent && cluster == _cacheCluster)
     {
-      memcpy(data, _cache + lowBits, size);
-      _virtPos += size;
-      if (processedSize)
-        *processedSize = size;
-      return S_OK;
+      const Byte *cache = _clusterCache.Find(extent.GetClusterKey(cluster));
+      if (cache)
+      {
+        memcpy(data, cache + lowBits, size);
+        _virtPos += size;
+        if (processedSize)
+          *processedSize = size;
+        return S_OK;
+      }
     }
     
-    const UInt64 high = cluster >> k_NumMidBits;
- 
-    if (high < extent.Tables.Size())
-    {
-      const CByteBuffer &table = extent.Tables[(unsigned)high];
+    const UInt32 v = extent.GetClusterEntry(cluster);
     
-      if (table.Size() != 0)
+    if (v != 0 && v != extent.ZeroSector)
+    {
+      UInt64 offset = (UInt64)v << 9;
+      if (extent.NeedDeflate)
       {
-        const size_t midBits = (size_t)cluster & ((1 << k_NumMidBits) - 1);
-        const Byte *p = (const Byte *)table + (midBits << 2);
-        const UInt32 v = Get32(p);
-        
-        if (v != 0 && v != extent.ZeroSector)
+        HRESULT res = DecodeCluster(extent, cluster, v);
+        if (res == S_FALSE)
+          _stream_dataError = true;
+        RINOK(res);
+        continue;
+      }
+      {
+        offset += lowBits;
+        if (offset != extent.PosInArc)
         {
-          UInt64 offset = (UInt64)v << 9;
-          if (extent.NeedDeflate)
-          {
-            if (offset != extent.PosInArc)
-            {
-              // printf("\n%12x %12x\n", (unsigned)offset, (unsigned)(offset - extent.PosInArc));
-              RINOK(extent.Seek(offset));
-            }
-            
-            const size_t kStartSize = 1 << 9;
-            {
-              size_t curSize = kStartSize;
-              RINOK(extent.Read(_cacheCompressed, &curSize));
-              // _stream_PackSize += curSize;
-              if (curSize != kStartSize)
-                return S_FALSE;
-            }
-
-            if (Get64(_cacheCompressed) != (cluster << (clusterBits - 9)))
-              return S_FALSE;
-
-            UInt32 dataSize = Get32(_cacheCompressed + 8);
-            if (dataSize > ((UInt32)1 << 31))
-              return S_FALSE;
-
-            size_t dataSize2 = (size_t)dataSize + 12;
-            
-            if (dataSize2 > kStartSize)
-            {
-              dataSize2 = (dataSize2 + 511) & ~(size_t)511;
-              if (dataSize2 > _cacheCompressed.Size())
-                return S_FALSE;
-              size_t curSize = dataSize2 - kStartSize;
-              const size_t curSize2 = curSize;
-              RINOK(extent.Read(_cacheCompressed + kStartSize, &curSize));
-              // _stream_PackSize += curSize;
-              if (curSize != curSize2)
-                return S_FALSE;
-            }
-
-            _bufInStreamSpec->Init(_cacheCompressed + 12, dataSize);
-            
-            _cacheCluster = (UInt64)(Int64)-1;
-            _cacheExtent = (unsigned)(int)-1;
-
-            if (_cache.Size() < clusterSize)
-              return E_FAIL;
-            _bufOutStreamSpec->Init(_cache, clusterSize);
-            
-            // Do we need to use smaller block than clusterSize for last cluster?
-            UInt64 blockSize64 = clusterSize;
-            HRESULT res = _zlibDecoderSpec->Code(_bufInStream, _bufOutStream, NULL, &blockSize64, NULL);
-
-            /*
-            if (_bufOutStreamSpec->GetPos() != clusterSize)
-            {
-              _stream_dataError = true;
-              memset(_cache + _bufOutStreamSpec->GetPos(), 0, clusterSize - _bufOutStreamSpec->GetPos());
-            }
-            */
-
-              if (_bufOutStreamSpec->GetPos() != clusterSize
-                  || _zlibDecoderSpec->GetInputProcessedSize() != dataSize)
-              {
-                _stream_dataError = true;
-                if (res == S_OK)
-                  res = S_FALSE;
-              }
-
-            RINOK(res);
-            
-            _cacheCluster = cluster;
-            _cacheExtent = extentIndex;
-            
-            continue;
-            /*
-            memcpy(data, _cache + lowBits, size);
-            _virtPos += size;
-            if (processedSize)
-              *processedSize = size;
-            return S_OK;
-            */
-          }
-          {
-            offset += lowBits;
-            if (offset != extent.PosInArc)
-            {
-              // printf("\n%12x %12x\n", (unsigned)offset, (unsigned)(offset - extent.PosInArc));
-              RINOK(extent.Seek(offset));
-            }
-            UInt32 size2 = 0;
-            HRESULT res = extent.Stream->Read(data, size, &size2);
-            if (res == S_OK && size2 == 0)
-            {
-              _stream_unavailData = true;
-              /*
-              memset(data, 0, size);
-              _virtPos += size;
-              if (processedSize)
-                *processedSize = size;
-              return S_OK;
-              */
-            }
-            extent.PosInArc += size2;
-            // _stream_PackSize += size2;
-            _virtPos += size2;
-            if (processedSize)
-              *processedSize = size2;
-            return res;
-          }
+          // printf("\n%12x %12x\n", (unsigned)offset, (unsigned)(offset - extent.PosInArc));
+          RINOK(extent.Seek(offset));
+        }
+        UInt32 size2 = 0;
+        HRESULT res = extent.Stream->Read(data, size, &size2);
+        if (res == S_OK && size2 == 0)
+        {
+          _stream_unavailData = true;
+          /*
+          memset(data, 0, size);
+          _virtPos += size;
+          if (processedSize)
+            *processedSize = size;
+          return S_OK;
+          */
         }
+        extent.PosInArc += size2;
+        // _stream_PackSize += size2;
+        _virtPos += size2;
+        if (processedSize)
+          *processedSize = size2;
+        return res;
       }
     }
     
@@ -1434,8 +1497,8 @@ STDMETHODIMP CHandler::Close()
   _phySize = 0;
   _size = 0;
   
-  _cacheCluster = (UInt64)(Int64)-1;
-  _cacheExtent = (unsigned)(int)-1;
+  _clusterCache.Clear();
+  _nextClusterKey = 0;
 
   _clusterBitsMax = 0;
 
@@ -1472,27 +1535,17 @@ STDMETHODIMP CHandler::GetStream(UInt32 /* index */, ISequentialInStream **strea
 
   if (_needDeflate)
   {
-    if (!_bufInStream)
-    {
-      _bufInStreamSpec = new CBufInStream;
-      _bufInStream = _bufInStreamSpec;
-    }
-    
-    if (!_bufOutStream)
-    {
-      _bufOutStreamSpec = new CBufPtrSeqOutStream();
-      _bufOutStream = _bufOutStreamSpec;
-    }
-
-    if (!_zlibDecoder)
-    {
-      _zlibDecoderSpec = new NCompress::NZlib::CDecoder;
-      _zlibDecoder = _zlibDecoderSpec;
-    }
+    if (!_decoder.get())
+      _decoder.reset(CreateZlibClusterDecoder());
     
     const size_t clusterSize = (size_t)1 << _clusterBitsMax;
-    _cache.AllocAtLeast(clusterSize);
+    _clusterCache.Alloc(clusterSize, kClusterCacheSize);
+    #ifndef _7ZIP_ST
+    RINOK(_clusterCache.CreateThreads(NSystem::GetNumberOfProcessors(),
+        CreateZlibClusterDecoder, clusterSize * 2));
+    #endif
     _cacheCompressed.AllocAtLeast(clusterSize * 2);
+    _nextClusterKey = 0;
   }
 
   FOR_VECTOR (i, _extents)
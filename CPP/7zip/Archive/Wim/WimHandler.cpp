@@ -1203,9 +1203,21 @@ CHandler::CHandler()
   _xmlError = false;
 }
 
+// index in array is NMethod value
+static const char * const k_MethodNames[] =
+{
+    "Copy"
+  , "XPRESS"
+  , "LZX"
+  , "LZMS"
+};
+
 STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps)
 {
   InitDefaults();
+  #ifndef _7ZIP_ST
+  const UInt32 numProcessors = NSystem::GetNumberOfProcessors();
+  #endif
 
   for (UInt32 i = 0; i < numProps; i++)
   {
@@ -1233,6 +1245,28 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
       RINOK(ParsePropToUInt32(L"", prop, image));
       _defaultImageNumber = image;
     }
+    else if (name.IsEqualTo("m") || name.IsEqualTo("0"))
+    {
+      if (prop.vt != VT_BSTR)
+        return E_INVALIDARG;
+      unsigned k;
+      for (k = 0; k < ARRAY_SIZE(k_MethodNames); k++)
+        if (StringsAreEqualNoCase_Ascii(prop.bstrVal, k_MethodNames[k]))
+          break;
+      if (k == ARRAY_SIZE(k_MethodNames))
+        return E_INVALIDARG;
+      _method = k;
+    }
+    else if (name.IsEqualTo("s"))
+    {
+      RINOK(PROPVARIANT_to_bool(prop, _solid));
+    }
+    else if (name.IsPrefixedBy_Ascii_NoCase("mt"))
+    {
+      #ifndef _7ZIP_ST
+      RINOK(ParseMtProp(name.Ptr(2), prop, numProcessors, _numThreads));
+      #endif
+    }
     else
       return E_INVALIDARG;
   }
@@ -5,6 +5,10 @@
 
 #include "../../../Common/MyCom.h"
 
+#ifndef _7ZIP_ST
+#include "../../../Windows/System.h"
+#endif
+
 #include "WimIn.h"
 
 namespace NArchive {
@@ -46,6 +50,10 @@ class CHandler:
 
   bool _keepMode_ShowImageNumber;
 
+  unsigned _method;       // NMethod::* or 0 for uncompressed resources
+  bool _solid;
+  UInt32 _numThreads;
+
   UInt64 _phySize;
   int _firstVolumeIndex;
 
@@ -54,6 +62,12 @@ class CHandler:
     _set_use_ShowImageNumber = false;
     _set_showImageNumber = false;
     _defaultImageNumber = -1;
+    _method = 0;
+    _solid = false;
+    _numThreads = 1;
+    #ifndef _7ZIP_ST
+    _numThreads = NWindows::NSystem::GetNumberOfProcessors();
+    #endif
   }
 
   bool IsUpdateSupported() const
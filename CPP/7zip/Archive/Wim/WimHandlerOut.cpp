@@ -10,12 +10,21 @@
 
 #include "../../../Windows/PropVariant.h"
 #include "../../../Windows/TimeUtils.h"
+#ifndef _7ZIP_ST
+#include "../../../Windows/Thread.h"
+#endif
 
 #include "../../Common/LimitedStreams.h"
+#include "../../Common/MtJobRing.h"
 #include "../../Common/ProgressUtils.h"
+#include "../../Common/StreamObjects.h"
 #include "../../Common/StreamUtils.h"
 #include "../../Common/UniqBlocks.h"
 
+#include "../../Compress/LzmsEncoder.h"
+#include "../../Compress/LzxEncoder.h"
+#include "../../Compress/XpressEncoder.h"
+
 #include "../../Crypto/RandGen.h"
 #include "../../Crypto/Sha1Cls.h"
 
@@ -348,6 +357,654 @@ STDMETHODIMP CInStreamWithSha1::Read(void *data, UInt32 size, UInt32 *processedS
 }
 
 
+// ---------- Resource compression ----------
+
+/* Each chunk of resource is compressed independently. So chunks are
+   compressed by worker threads, and the main thread writes packed chunks
+   in original order.
+   Non-solid resource: chunk table is written before chunks. We reserve
+   the table for expected size of stream and we fill it, when all chunks of
+   resource were written.
+   Solid resource (SolidBig): all packed chunks of solid block are kept
+   in memory, until the block is closed. Small files go to solid blocks. */
+
+static const unsigned kChunkSizeBits_LZMS = 17;
+static const unsigned kSolidChunkSizeBits = 21;
+static const UInt64 kSolidBlockSizeMax = (UInt64)1 << 25;
+static const UInt64 kSolidFileSizeMax = (UInt64)1 << 24;
+static const unsigned kNumJobsPerThread = 2;
+
+class CChunkEncoder
+{
+  NCompress::NXpress::CEncoder *_xpressEncoder;
+  NCompress::NLzx::CEncoder *_lzxEncoder;
+  NCompress::NLzms::CEncoder *_lzmsEncoder;
+public:
+  CChunkEncoder(): _xpressEncoder(NULL), _lzxEncoder(NULL), _lzmsEncoder(NULL) {}
+  ~CChunkEncoder()
+  {
+    delete _xpressEncoder;
+    delete _lzxEncoder;
+    delete _lzmsEncoder;
+  }
+
+  // (packSize == 0), if packed data is not smaller than (size)
+  HRESULT Code(unsigned method, const Byte *data, size_t size, Byte *dest, size_t &packSize);
+};
+
+HRESULT CChunkEncoder::Code(unsigned method, const Byte *data, size_t size, Byte *dest, size_t &packSize)
+{
+  packSize = 0;
+  if (size < 2)
+    return S_OK;
+  // the reader treats the chunk with (packSize == unpackSize) as stored chunk
+  packSize = size - 1;
+  if (method == NMethod::kXPRESS)
+  {
+    if (!_xpressEncoder)
+      _xpressEncoder = new NCompress::NXpress::CEncoder;
+    return _xpressEncoder->Code(data, size, dest, &packSize);
+  }
+  if (method == NMethod::kLZX)
+  {
+    if (!_lzxEncoder)
+      _lzxEncoder = new NCompress::NLzx::CEncoder;
+    return _lzxEncoder->Code(data, size, dest, &packSize);
+  }
+  if (method == NMethod::kLZMS)
+  {
+    if (!_lzmsEncoder)
+      _lzmsEncoder = new NCompress::NLzms::CEncoder;
+    return _lzmsEncoder->Code(data, size, dest, &packSize);
+  }
+  packSize = 0;
+  return E_NOTIMPL;
+}
+
+
+struct CPackJob
+{
+  CByteBuffer InBuf;
+  CByteBuffer OutBuf;
+  size_t InSize;
+  size_t PackSize; // 0 : chunk is stored
+  UInt64 TargetId;
+  HRESULT Result;
+};
+
+
+// resource or solid block that receives packed chunks
+
+struct CPackTarget
+{
+  bool IsSolid;
+  bool Finished;  // all chunks were submitted
+  bool Completed;
+  bool Skip;      // non-solid: the stream is duplicate, so we don't need its data
+  int StreamIndex;
+  UInt64 NumChunks;
+  UInt64 NumChunksWritten;
+  UInt64 UnpackSize;
+  UInt64 PackSize;  // size of written chunks
+  UInt64 StartPos;
+  UInt64 TableSize; // non-solid: reserved size for chunk table
+  CRecordVector<UInt32> ChunkSizes;
+  CObjectVector<CByteBuffer> Chunks; // solid: packed chunks
+
+  CPackTarget():
+      IsSolid(false),
+      Finished(false),
+      Completed(false),
+      Skip(false),
+      StreamIndex(-1),
+      NumChunks(0),
+      NumChunksWritten(0),
+      UnpackSize(0),
+      PackSize(0),
+      StartPos(0),
+      TableSize(0)
+      {}
+};
+
+
+static UInt64 GetChunkTableSize(UInt64 unpackSize, unsigned chunkSizeBits)
+{
+  const UInt64 numChunks = (unpackSize + (((UInt32)1 << chunkSizeBits) - 1)) >> chunkSizeBits;
+  if (numChunks < 2)
+    return 0;
+  const unsigned entrySizeShifts = (unpackSize < ((UInt64)1 << 32) ? 2 : 3);
+  return (numChunks - 1) << entrySizeShifts;
+}
+
+
+class CResourcePacker;
+
+#ifndef _7ZIP_ST
+
+static THREAD_FUNC_DECL PackThread(void *threadInfo);
+
+struct CPackThread
+{
+  NWindows::CThread Thread;
+  CResourcePacker *Packer;
+  CChunkEncoder Encoder;
+
+  void WaitAndCode();
+};
+
+#endif
+
+
+class CResourcePacker
+{
+  unsigned _method;
+  unsigned _chunkSizeBits;
+  CChunkEncoder _encoder;
+
+  CMtJobRing _ring;     // the start of ring is first job that was not written
+  CObjectVector<CPackJob> _jobs;
+
+  CObjectVector<CPackTarget> _targets;
+  UInt64 _targetsStartId; // id of _targets[0]
+
+  int _solidTarget;       // index in _targets, or -1
+  CByteBuffer _solidBuf;
+  size_t _solidBufPos;
+  UInt64 _solidOffset;    // offset of current solid block in solid run
+
+  #ifndef _7ZIP_ST
+  CObjectVector<CPackThread> _threads;
+  #endif
+
+  CPackJob &GetJob(unsigned jobIndex) { return _jobs[_ring.GetSlot(jobIndex)]; }
+  CPackTarget &GetTarget(UInt64 id) { return _targets[(unsigned)(id - _targetsStartId)]; }
+
+  UInt64 AddTarget(bool isSolid);
+  HRESULT WriteNextJob();
+  HRESULT GetFreeJob(CPackJob *&job);
+  HRESULT SubmitJob(CPackJob &job);
+  HRESULT CompleteTarget(CPackTarget &target);
+  HRESULT CompleteTargets();
+  HRESULT AddSolidChunk();
+
+public:
+  CMyComPtr<IOutStream> OutStream;
+  UInt64 Pos;
+  CRecordVector<CStreamInfo> *Streams;
+  CRecordVector<CStreamInfo> SolidBigs;
+
+  #ifndef _7ZIP_ST
+  bool GetJobForThread(unsigned &slot) { return _ring.GetJobForThread(slot); }
+  CPackJob &GetJobInSlot(unsigned slot) { return _jobs[slot]; }
+  void SetJobDone(unsigned slot) { _ring.SetJobDone(slot); }
+  #endif
+
+  unsigned GetMethod() const { return _method; }
+
+  CResourcePacker():
+      _targetsStartId(0),
+      _solidTarget(-1),
+      _solidBufPos(0),
+      _solidOffset(0),
+      Pos(0),
+      Streams(NULL)
+      {}
+  ~CResourcePacker() { StopThreads(); }
+
+  HRESULT Create(unsigned method, unsigned chunkSizeBits, UInt32 numThreads);
+  void StopThreads();
+
+  /* AddResource() reads the stream to the end and submits chunks of new non-solid resource.
+     Then the caller must call FinishResource() with index of stream in (Streams)
+     or with (-1), if the data is not required. */
+  HRESULT AddResource(ISequentialInStream *stream, UInt64 expectedSize,
+      ICompressProgressInfo *progress, UInt64 &size);
+  HRESULT FinishResource(int streamIndex);
+
+  // (offset) is offset of stream in solid run
+  HRESULT AddToSolid(ISequentialInStream *stream, ICompressProgressInfo *progress, UInt64 &offset, UInt64 &size);
+  UInt64 GetSolidBlockSize() const { return _solidTarget < 0 ? 0 : _targets[_solidTarget].UnpackSize; }
+  HRESULT CloseSolidBlock();
+
+  // writes all submitted chunks. Open solid block is kept in memory.
+  HRESULT Flush();
+};
+
+
+HRESULT CResourcePacker::Create(unsigned method, unsigned chunkSizeBits, UInt32 numThreads)
+{
+  _method = method;
+  _chunkSizeBits = chunkSizeBits;
+
+  #ifdef _7ZIP_ST
+  numThreads = 1;
+  #endif
+  if (numThreads < 1)
+    numThreads = 1;
+
+  unsigned numJobs = 1;
+  if (numThreads > 1)
+    numJobs = numThreads * kNumJobsPerThread;
+
+  size_t bufSize = (size_t)1 << chunkSizeBits;
+  if (method == NMethod::kLZMS)
+  {
+    const size_t solidChunkSize = (size_t)1 << kSolidChunkSizeBits;
+    if (bufSize < solidChunkSize)
+      bufSize = solidChunkSize;
+  }
+
+  _jobs.ClearAndReserve(numJobs);
+  for (unsigned i = 0; i < numJobs; i++)
+  {
+    CPackJob &job = _jobs.AddNew();
+    job.InBuf.Alloc(bufSize);
+    job.OutBuf.Alloc(bufSize);
+  }
+
+  RINOK(_ring.Create(numJobs, numThreads > 1 ? numThreads : 0));
+
+  #ifndef _7ZIP_ST
+  if (numThreads > 1)
+  {
+    _threads.ClearAndReserve(numThreads);
+    for (UInt32 t = 0; t < numThreads; t++)
+    {
+      CPackThread &thread = _threads.AddNew();
+      thread.Packer = this;
+      RINOK(thread.Thread.Create(PackThread, &thread));
+    }
+  }
+  #endif
+
+  return S_OK;
+}
+
+
+void CResourcePacker::StopThreads()
+{
+  #ifndef _7ZIP_ST
+  if (_threads.IsEmpty())
+    return;
+  _ring.ExitThreads();
+  FOR_VECTOR (i, _threads)
+  {
+    CPackThread &thread = _threads[i];
+    if (thread.Thread.IsCreated())
+    {
+      thread.Thread.Wait();
+      thread.Thread.Close();
+    }
+  }
+  _threads.Clear();
+  #endif
+}
+
+
+#ifndef _7ZIP_ST
+
+void CPackThread::WaitAndCode()
+{
+  for (;;)
+  {
+    unsigned slot;
+    if (!Packer->GetJobForThread(slot))
+      return;
+    CPackJob &job = Packer->GetJobInSlot(slot);
+    
+    HRESULT res;
+    size_t packSize = 0;
+    try
+    {
+      res = Encoder.Code(Packer->GetMethod(), job.InBuf, job.InSize, job.OutBuf, packSize);
+    }
+    catch(...) { res = E_OUTOFMEMORY; }
+    
+    job.PackSize = packSize;
+    job.Result = res;
+    Packer->SetJobDone(slot);
+  }
+}
+
+static THREAD_FUNC_DECL PackThread(void *threadInfo)
+{
+  ((CPackThread *)threadInfo)->WaitAndCode();
+  return 0;
+}
+
+#endif
+
+
+UInt64 CResourcePacker::AddTarget(bool isSolid)
+{
+  const UInt64 id = _targetsStartId + _targets.Size();
+  _targets.AddNew().IsSolid = isSolid;
+  return id;
+}
+
+
+HRESULT CResourcePacker::SubmitJob(CPackJob &job)
+{
+  job.Result = S_OK;
+  job.PackSize = 0;
+  GetTarget(job.TargetId).NumChunks++;
+
+  #ifndef _7ZIP_ST
+  if (_threads.IsEmpty())
+  #endif
+    job.Result = _encoder.Code(_method, job.InBuf, job.InSize, job.OutBuf, job.PackSize);
+  
+  return _ring.Submit();
+}
+
+
+HRESULT CResourcePacker::GetFreeJob(CPackJob *&job)
+{
+  if (_ring.IsFull())
+  {
+    RINOK(WriteNextJob());
+  }
+  job = &GetJob(_ring.GetEnd());
+  return S_OK;
+}
+
+
+HRESULT CResourcePacker::WriteNextJob()
+{
+  CPackJob &job = GetJob(_ring.GetStart());
+  _ring.WaitFirst();
+  RINOK(job.Result);
+  _ring.ReleaseFirst();
+
+  CPackTarget &target = GetTarget(job.TargetId);
+
+  const Byte *data = job.OutBuf;
+  size_t size = job.PackSize;
+  if (size == 0)
+  {
+    data = job.InBuf;
+    size = job.InSize;
+  }
+
+  if (target.IsSolid)
+    target.Chunks.AddNew().CopyFrom(data, size);
+  else
+  {
+    if (target.NumChunksWritten == 0)
+      target.StartPos = Pos;
+    if (!target.Skip)
+    {
+      if (target.NumChunksWritten == 0)
+      {
+        // we reserve the space for chunk table
+        Byte temp[1 << 8];
+        memset(temp, 0, sizeof(temp));
+        for (UInt64 rem = target.TableSize; rem != 0;)
+        {
+          size_t cur = sizeof(temp);
+          if (cur > rem)
+            cur = (size_t)rem;
+          RINOK(WriteStream(OutStream, temp, cur));
+          rem -= cur;
+        }
+        Pos += target.TableSize;
+      }
+      RINOK(WriteStream(OutStream, data, size));
+      Pos += size;
+    }
+  }
+
+  target.ChunkSizes.Add((UInt32)size);
+  target.PackSize += size;
+  target.NumChunksWritten++;
+  
+  if (target.Finished && target.NumChunksWritten == target.NumChunks)
+    return CompleteTargets();
+  return S_OK;
+}
+
+
+HRESULT CResourcePacker::CompleteTarget(CPackTarget &target)
+{
+  target.Completed = true;
+  
+  if (target.IsSolid)
+  {
+    const unsigned kSolidHeaderSize = 8 + 4 + 4;
+    const unsigned numChunks = target.ChunkSizes.Size();
+    const size_t headerSize = kSolidHeaderSize + (size_t)numChunks * 4;
+    CByteArr header(headerSize);
+    Set64((Byte *)header, target.UnpackSize);
+    Set32(header + 8, (UInt32)1 << kSolidChunkSizeBits);
+    Set32(header + 12, _method);
+    for (unsigned i = 0; i < numChunks; i++)
+      Set32(header + kSolidHeaderSize + i * 4, target.ChunkSizes[i]);
+    
+    CStreamInfo s;
+    s.Resource.Clear();
+    s.Resource.PackSize = headerSize + target.PackSize;
+    s.Resource.Offset = Pos;
+    s.Resource.UnpackSize = k_SolidBig_Resource_Marker;
+    s.Resource.Flags = NResourceFlags::kSolid;
+    s.PartNumber = 1;
+    s.RefCount = 1;
+    memset(s.Hash, 0, kHashSize);
+    SolidBigs.Add(s);
+    
+    RINOK(WriteStream(OutStream, header, headerSize));
+    FOR_VECTOR (i, target.Chunks)
+    {
+      const CByteBuffer &buf = target.Chunks[i];
+      RINOK(WriteStream(OutStream, buf, buf.Size()));
+    }
+    Pos += s.Resource.PackSize;
+    target.Chunks.Clear();
+    return S_OK;
+  }
+
+  if (target.Skip)
+  {
+    if (target.NumChunksWritten != 0 && Pos != target.StartPos)
+    {
+      // we remove the data that was written already
+      RINOK(OutStream->Seek(target.StartPos, STREAM_SEEK_SET, &Pos));
+      RINOK(OutStream->SetSize(Pos));
+    }
+    return S_OK;
+  }
+
+  const UInt64 tableSize = GetChunkTableSize(target.UnpackSize, _chunkSizeBits);
+  if (tableSize != target.TableSize)
+  {
+    // the size of stream was changed, and we have reserved another size for chunk table
+    return E_FAIL;
+  }
+
+  if (tableSize != 0)
+  {
+    const size_t tableSizeT = (size_t)tableSize;
+    if (tableSizeT != tableSize)
+      return E_OUTOFMEMORY;
+    CByteArr table(tableSizeT);
+    const unsigned entrySizeShifts = (target.UnpackSize < ((UInt64)1 << 32) ? 2 : 3);
+    UInt64 offset = 0;
+    for (size_t i = 0; (i << entrySizeShifts) < tableSizeT; i++)
+    {
+      offset += target.ChunkSizes[(unsigned)i];
+      Byte *p = table + (i << entrySizeShifts);
+      if (entrySizeShifts == 2)
+      {
+        Set32(p, (UInt32)offset);
+      }
+      else
+      {
+        Set64(p, offset);
+      }
+    }
+    RINOK(OutStream->Seek(target.StartPos, STREAM_SEEK_SET, NULL));
+    RINOK(WriteStream(OutStream, table, tableSizeT));
+    RINOK(OutStream->Seek(Pos, STREAM_SEEK_SET, NULL));
+  }
+
+  CResource &r = (*Streams)[target.StreamIndex].Resource;
+  r.PackSize = tableSize + target.PackSize;
+  r.Offset = target.StartPos;
+  r.UnpackSize = target.UnpackSize;
+  r.Flags |= NResourceFlags::kCompressed;
+  return S_OK;
+}
+
+
+HRESULT CResourcePacker::CompleteTargets()
+{
+  FOR_VECTOR (i, _targets)
+  {
+    CPackTarget &target = _targets[i];
+    if (!target.Completed && target.Finished && target.NumChunksWritten == target.NumChunks)
+    {
+      RINOK(CompleteTarget(target));
+    }
+  }
+  
+  unsigned num = 0;
+  while (num < _targets.Size() && _targets[num].Completed)
+    num++;
+  if (num != 0)
+  {
+    _targets.DeleteFrontal(num);
+    _targetsStartId += num;
+    if (_solidTarget >= 0)
+      _solidTarget -= num;
+  }
+  return S_OK;
+}
+
+
+HRESULT CResourcePacker::AddResource(ISequentialInStream *stream, UInt64 expectedSize,
+    ICompressProgressInfo *progress, UInt64 &size)
+{
+  const UInt64 targetId = AddTarget(false);
+  {
+    CPackTarget &target = GetTarget(targetId);
+    target.TableSize = GetChunkTableSize(expectedSize, _chunkSizeBits);
+  }
+  
+  const size_t chunkSize = (size_t)1 << _chunkSizeBits;
+  size = 0;
+  
+  for (;;)
+  {
+    CPackJob *job;
+    RINOK(GetFreeJob(job));
+    size_t cur = chunkSize;
+    RINOK(ReadStream(stream, job->InBuf, &cur));
+    if (cur == 0)
+      break;
+    job->InSize = cur;
+    job->TargetId = targetId;
+    GetTarget(targetId).UnpackSize += cur;
+    RINOK(SubmitJob(*job));
+    size += cur;
+    if (progress)
+    {
+      RINOK(progress->SetRatioInfo(&size, &size));
+    }
+    if (cur != chunkSize)
+      break;
+  }
+  return S_OK;
+}
+
+
+HRESULT CResourcePacker::FinishResource(int streamIndex)
+{
+  CPackTarget &target = _targets.Back();
+  target.Finished = true;
+  target.StreamIndex = streamIndex;
+  target.Skip = (streamIndex < 0);
+  if (target.NumChunksWritten == target.NumChunks)
+    return CompleteTargets();
+  return S_OK;
+}
+
+
+HRESULT CResourcePacker::AddSolidChunk()
+{
+  CPackJob *job;
+  RINOK(GetFreeJob(job));
+  memcpy(job->InBuf, _solidBuf, _solidBufPos);
+  job->InSize = _solidBufPos;
+  job->TargetId = _targetsStartId + (unsigned)_solidTarget;
+  _solidBufPos = 0;
+  return SubmitJob(*job);
+}
+
+
+HRESULT CResourcePacker::AddToSolid(ISequentialInStream *stream, ICompressProgressInfo *progress, UInt64 &offset, UInt64 &size)
+{
+  const size_t chunkSize = (size_t)1 << kSolidChunkSizeBits;
+  if (_solidTarget < 0)
+  {
+    AddTarget(true);
+    _solidTarget = _targets.Size() - 1;
+    if (_solidBuf.Size() != chunkSize)
+      _solidBuf.Alloc(chunkSize);
+    _solidBufPos = 0;
+  }
+
+  offset = _solidOffset + _targets[_solidTarget].UnpackSize;
+  size = 0;
+  
+  for (;;)
+  {
+    if (_solidBufPos == chunkSize)
+    {
+      RINOK(AddSolidChunk());
+    }
+    size_t cur = chunkSize - _solidBufPos;
+    RINOK(ReadStream(stream, _solidBuf + _solidBufPos, &cur));
+    if (cur == 0)
+      break;
+    _solidBufPos += cur;
+    _targets[_solidTarget].UnpackSize += cur;
+    size += cur;
+    if (progress)
+    {
+      RINOK(progress->SetRatioInfo(&size, &size));
+    }
+  }
+  return S_OK;
+}
+
+
+HRESULT CResourcePacker::CloseSolidBlock()
+{
+  if (_solidTarget < 0)
+    return S_OK;
+  if (_solidBufPos != 0)
+  {
+    RINOK(AddSolidChunk());
+  }
+  CPackTarget &target = _targets[_solidTarget];
+  _solidOffset += target.UnpackSize;
+  target.Finished = true;
+  _solidTarget = -1;
+  if (target.NumChunksWritten == target.NumChunks)
+    return CompleteTargets();
+  return S_OK;
+}
+
+
+HRESULT CResourcePacker::Flush()
+{
+  while (!_ring.IsEmpty())
+  {
+    RINOK(WriteNextJob());
+  }
+  return S_OK;
+}
+
+
 static void SetFileTimeToMem(Byte *p, const FILETIME &ft)
 {
   Set32(p, ft.dwLowDateTime);
@@ -683,6 +1340,16 @@ void CHeader::SetDefaultFields(bool useLZX)
 }
 
 
+static void SetHeaderMethod(CHeader &header, unsigned method)
+{
+  static const UInt32 k_MethodFlags[] = { 0, NHeaderFlags::kXPRESS, NHeaderFlags::kLZX, NHeaderFlags::kLZMS };
+  const unsigned chunkSizeBits = (method == NMethod::kLZMS ? kChunkSizeBits_LZMS : kChunkSizeBits);
+  header.Flags |= NHeaderFlags::kCompression | k_MethodFlags[method];
+  header.ChunkSize = (UInt32)1 << chunkSizeBits;
+  header.ChunkSizeBits = chunkSizeBits;
+}
+
+
 static void AddTrees(CObjectVector<CDir> &trees, CObjectVector<CMetaItem> &metaItems, const CMetaItem &ri, int curTreeIndex)
 {
   while (curTreeIndex >= (int)trees.Size())
@@ -1342,6 +2009,9 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
   CHeader header;
   header.SetDefaultFields(false);
 
+  unsigned method = _method;
+  bool solid = _solid;
+
   if (isUpdate)
   {
     const CHeader &srcHeader = _volumes[1].Header;
@@ -1349,6 +2019,29 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
     header.Version = srcHeader.Version;
     header.ChunkSize = srcHeader.ChunkSize;
     header.ChunkSizeBits = srcHeader.ChunkSizeBits;
+    solid = false;
+    if (srcHeader.IsCompressed())
+    {
+      // new resources must use the method and chunk size of old resources.
+      // If our encoders don't support them, we store new resources without compression.
+      method = srcHeader.GetMethod();
+      if ((method == NMethod::kLZX && header.ChunkSizeBits != kChunkSizeBits)
+          || (method == NMethod::kXPRESS && header.ChunkSizeBits > 16)
+          || method > NMethod::kLZMS)
+        method = 0;
+    }
+    else if (method != 0)
+      SetHeaderMethod(header, method);
+  }
+  else
+  {
+    if (solid)
+    {
+      method = NMethod::kLZMS;
+      header.Version = k_Version_Solid;
+    }
+    if (method != 0)
+      SetHeaderMethod(header, method);
   }
 
   {
@@ -1374,6 +2067,14 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
   
   CRecordVector<CStreamInfo> streams;
   CUIntVector sortedHashes; // indexes to streams, sorted by SHA1
+
+  CResourcePacker packer;
+  if (method != 0)
+  {
+    RINOK(packer.Create(method, header.ChunkSizeBits, _numThreads));
+    packer.OutStream = outStream;
+    packer.Streams = &streams;
+  }
   
   // ---------- Copy unchanged data streams ----------
 
@@ -1452,6 +2153,8 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
     streams.Add(s);
   }
 
+  packer.Pos = curPos;
+
   
   // ---------- Write new items ----------
 
@@ -1602,6 +2305,11 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
         else
         {
           index = streams.Size();
+          if (method != 0)
+          {
+            RINOK(packer.Flush());
+            curPos = packer.Pos;
+          }
           RINOK(WriteStream(outStream, (const Byte *)mi.Reparse + 8, packSize));
           CStreamInfo s;
           s.Resource.PackSize = packSize;
@@ -1616,12 +2324,83 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
           s.RefCount = 1;
           memcpy(s.Hash, hash, kHashSize);
           curPos += packSize;
+          packer.Pos = curPos;
 
           streams.Add(s);
         }
         
         mi.HashIndex = index;
       }
+      else if (method != 0)
+      {
+        inShaStreamSpec->SetStream(fileInStream);
+        fileInStream.Release();
+        inShaStreamSpec->Init();
+
+        // big files are written as separate resources even in solid mode
+        const bool toSolid = (solid && size < kSolidFileSizeMax);
+        UInt64 solidOffset = 0;
+        if (toSolid)
+        {
+          RINOK(packer.AddToSolid(inShaStream, progress, solidOffset, size));
+        }
+        else
+        {
+          RINOK(packer.AddResource(inShaStream, size, progress, size));
+        }
+
+        int newIndex = -1;
+        
+        if (size != 0)
+        {
+          Byte hash[kHashSize];
+          inShaStreamSpec->Final(hash);
+
+          int index = AddUniqHash(&streams.Front(), sortedHashes, hash, streams.Size());
+
+          if (index >= 0)
+          {
+            // the data of duplicate stream in solid block is not removed
+            streams[index].RefCount++;
+          }
+          else
+          {
+            index = streams.Size();
+            newIndex = index;
+            CStreamInfo s;
+            s.Resource.Clear();
+            if (toSolid)
+            {
+              s.Resource.PackSize = size;
+              s.Resource.Offset = solidOffset;
+              s.Resource.UnpackSize = 0;
+              s.Resource.Flags = NResourceFlags::kSolid;
+            }
+            // else : (packer) sets the fields of resource, when the resource is written
+            s.PartNumber = 1;
+            s.RefCount = 1;
+            memcpy(s.Hash, hash, kHashSize);
+            streams.Add(s);
+          }
+          
+          if (ui.AltStreamIndex < 0)
+            mi.HashIndex = index;
+          else
+            mi.AltStreams[ui.AltStreamIndex].HashIndex = index;
+        }
+
+        if (toSolid)
+        {
+          if (packer.GetSolidBlockSize() >= kSolidBlockSizeMax)
+          {
+            RINOK(packer.CloseSolidBlock());
+          }
+        }
+        else
+        {
+          RINOK(packer.FinishResource(newIndex));
+        }
+      }
       else
       {
         inShaStreamSpec->SetStream(fileInStream);
@@ -1690,6 +2469,13 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
     RINOK(callback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK));
   }
 
+  if (method != 0)
+  {
+    RINOK(packer.CloseSolidBlock());
+    RINOK(packer.Flush());
+    curPos = packer.Pos;
+  }
+
   while (secureBlocks.Size() < numNewImages)
     secureBlocks.AddNew();
 
@@ -1795,24 +2581,40 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
       s.PartNumber = 1;
       s.RefCount = 1;
       memcpy(s.Hash, digest, kHashSize);
-      streams.Add(s);
+      unsigned streamIndex = streams.Add(s);
+
+      if (method != 0)
+      {
+        CBufInStream *metaStreamSpec = new CBufInStream;
+        CMyComPtr<ISequentialInStream> metaStream = metaStreamSpec;
+        metaStreamSpec->Init((const Byte *)meta, pos);
+        packer.Pos = curPos;
+        UInt64 metaSize;
+        RINOK(packer.AddResource(metaStream, pos, NULL, metaSize));
+        RINOK(packer.FinishResource(streamIndex));
+        RINOK(packer.Flush());
+        curPos = packer.Pos;
+      }
+      else
+      {
+        RINOK(WriteStream(outStream, (const Byte *)meta, pos));
+        curPos += pos;
+      }
+      meta.Free();
 
       if (_bootIndex != 0 && _bootIndex == (UInt32)i + 1)
       {
-        header.MetadataResource = s.Resource;
+        header.MetadataResource = streams[streamIndex].Resource;
         header.BootIndex = _bootIndex;
       }
-
-      RINOK(WriteStream(outStream, (const Byte *)meta, pos));
-      meta.Free();
-      curPos += pos;
     }
   }
 
   lps->InSize = lps->OutSize = complexity;
   RINOK(lps->SetCur());
 
-  header.OffsetResource.UnpackSize = header.OffsetResource.PackSize = (UInt64)streams.Size() * kStreamInfoSize;
+  const unsigned numStreamInfos = streams.Size() + packer.SolidBigs.Size();
+  header.OffsetResource.UnpackSize = header.OffsetResource.PackSize = (UInt64)numStreamInfos * kStreamInfoSize;
   header.OffsetResource.Offset = curPos;
   header.OffsetResource.Flags = NResourceFlags::kMetadata;
 
@@ -1820,12 +2622,22 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
   
   // ---------- Write Streams Info Tables ----------
 
-  for (i = 0; i < streams.Size(); i++)
+  /* The solid run is the sequence of solid entries in the table.
+     So we write non-solid entries, then SolidBig entries, and then SolidSmall entries. */
+
+  for (unsigned pass = 0; pass < 3; pass++)
   {
-    Byte buf[kStreamInfoSize];
-    streams[i].WriteTo(buf);
-    RINOK(WriteStream(outStream, buf, kStreamInfoSize));
-    curPos += kStreamInfoSize;
+    const CRecordVector<CStreamInfo> &v = (pass == 1 ? packer.SolidBigs : streams);
+    for (i = 0; i < v.Size(); i++)
+    {
+      const CStreamInfo &si = v[i];
+      if (pass != 1 && si.Resource.IsSolid() != (pass == 2))
+        continue;
+      Byte buf[kStreamInfoSize];
+      si.WriteTo(buf);
+      RINOK(WriteStream(outStream, buf, kStreamInfoSize));
+      curPos += kStreamInfoSize;
+    }
   }
 
   AString xml = "<WIM>";
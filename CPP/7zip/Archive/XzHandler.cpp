@@ -68,9 +68,243 @@ void CStatInfo::Clear()
   CrcError = false;
 }
 
+/*
+  CBlockInfo describes one xz block from xz index.
+  Blocks from all xz streams are stored in the order of unpacked data.
+*/
+
+struct CBlockInfo
+{
+  UInt64 UnpackPos;
+  UInt64 UnpackSize;
+  UInt64 PackPos;
+  UInt64 PackSize; // including padding and check field
+  CXzStreamFlags StreamFlags;
+};
+
+/*
+  CSeekInStream provides random access to unpacked data of xz archive.
+  It uses the table of blocks that was read from xz indexes at open.
+  Read() decodes only the blocks that contain requested data:
+  Seek() + Read() restarts decoding from the start of block that contains new position.
+  So archives that were compressed with small blocks (-ms={Size}) are good for random access.
+  The check field of block is verified when the block is decoded to its end.
+*/
+
+class CSeekInStream:
+  public IInStream,
+  public CMyUnknownImp
+{
+  CXzUnpackerCPP _xzu;
+  
+  bool _decoderIsReady;
+  bool _blockIsFinished;
+  unsigned _blockIndex;
+  UInt64 _virtPos;
+  UInt64 _curPos;     // unpack position of decoder
+  UInt64 _packRem;    // the size of data of current block that was not read from InStream
+  size_t _inPos;
+  size_t _inLim;
+  UInt64 _size;
+
+  HRESULT InitBlock(unsigned blockIndex);
+  HRESULT DecodeData(Byte *data, UInt32 size, UInt32 &processed);
+  HRESULT SkipTo(UInt64 pos);
+public:
+  CMyComPtr<IInStream> InStream;
+  CRecordVector<CBlockInfo> Blocks;
+
+  MY_UNKNOWN_IMP2(ISequentialInStream, IInStream)
+  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
+
+  HRESULT Init();
+};
+
+static const size_t kSeekInBufSize = 1 << 16;
+static const size_t kSeekOutBufSize = 1 << 16;
+
+HRESULT CSeekInStream::Init()
+{
+  _xzu.InBuf = (Byte *)MyAlloc(kSeekInBufSize);
+  _xzu.OutBuf = (Byte *)MyAlloc(kSeekOutBufSize);
+  if (!_xzu.InBuf || !_xzu.OutBuf)
+    return E_OUTOFMEMORY;
+  _decoderIsReady = false;
+  _virtPos = 0;
+  _curPos = 0;
+  _size = 0;
+  if (!Blocks.IsEmpty())
+    _size = Blocks.Back().UnpackPos + Blocks.Back().UnpackSize;
+  return S_OK;
+}
+
+HRESULT CSeekInStream::InitBlock(unsigned blockIndex)
+{
+  const CBlockInfo &b = Blocks[blockIndex];
+  _decoderIsReady = false;
+  RINOK(InStream->Seek(b.PackPos, STREAM_SEEK_SET, NULL));
+  XzUnpacker_PrepareToRandomBlockDecoding(&_xzu.p, b.StreamFlags);
+  _blockIndex = blockIndex;
+  _blockIsFinished = false;
+  _curPos = b.UnpackPos;
+  _packRem = b.PackSize;
+  _inPos = 0;
+  _inLim = 0;
+  _decoderIsReady = true;
+  return S_OK;
+}
+
+HRESULT CSeekInStream::DecodeData(Byte *data, UInt32 size, UInt32 &processed)
+{
+  processed = 0;
+  
+  for (;;)
+  {
+    if (_blockIsFinished)
+    {
+      if (size == 0 || _blockIndex + 1 >= Blocks.Size())
+        return S_OK;
+      RINOK(InitBlock(_blockIndex + 1));
+    }
+    
+    const CBlockInfo &b = Blocks[_blockIndex];
+    const UInt64 blockRem = b.UnpackPos + b.UnpackSize - _curPos;
+    
+    // we finish the block even if the caller doesn't need more data to check the block
+    if (size == 0 && blockRem != 0)
+      return S_OK;
+    
+    if (_inPos == _inLim)
+    {
+      size_t cur = kSeekInBufSize;
+      if (cur > _packRem)
+        cur = (size_t)_packRem;
+      if (cur == 0)
+        return S_FALSE;
+      RINOK(ReadStream(InStream, _xzu.InBuf, &cur));
+      if (cur == 0)
+        return S_FALSE;
+      _packRem -= cur;
+      _inPos = 0;
+      _inLim = cur;
+    }
+    
+    SizeT outLen = size;
+    if (outLen > blockRem)
+      outLen = (SizeT)blockRem;
+    SizeT inLen = _inLim - _inPos;
+    ECoderStatus status;
+    SRes res = XzUnpacker_Code(&_xzu.p, data, &outLen, _xzu.InBuf + _inPos, &inLen,
+        (outLen == blockRem) ? CODER_FINISH_END : CODER_FINISH_ANY, &status);
+    
+    _inPos += inLen;
+    data += outLen;
+    size -= (UInt32)outLen;
+    processed += (UInt32)outLen;
+    _curPos += outLen;
+    
+    if (res != SZ_OK)
+      return (res == SZ_ERROR_MEM) ? E_OUTOFMEMORY : S_FALSE;
+    
+    if (XzUnpacker_IsBlockFinished(&_xzu.p))
+    {
+      if (_curPos != b.UnpackPos + b.UnpackSize || _inPos != _inLim || _packRem != 0)
+        return S_FALSE;
+      _blockIsFinished = true;
+      continue;
+    }
+    
+    if (inLen == 0 && outLen == 0)
+      return S_FALSE;
+  }
+}
+
+HRESULT CSeekInStream::SkipTo(UInt64 pos)
+{
+  while (_curPos < pos)
+  {
+    UInt64 rem = pos - _curPos;
+    UInt32 size = (UInt32)kSeekOutBufSize;
+    if (size > rem)
+      size = (UInt32)rem;
+    UInt32 processed;
+    RINOK(DecodeData(_xzu.OutBuf, size, processed));
+    if (processed == 0)
+      return S_FALSE;
+  }
+  return S_OK;
+}
+
+STDMETHODIMP CSeekInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (processedSize)
+    *processedSize = 0;
+  if (size == 0)
+    return S_OK;
+  if (_virtPos >= _size)
+    return S_OK;
+  {
+    const UInt64 rem = _size - _virtPos;
+    if (size > rem)
+      size = (UInt32)rem;
+  }
+
+  if (!_decoderIsReady || _curPos != _virtPos)
+  {
+    unsigned left = 0, right = Blocks.Size();
+    while (right - left > 1)
+    {
+      const unsigned mid = (left + right) / 2;
+      if (Blocks[mid].UnpackPos <= _virtPos)
+        left = mid;
+      else
+        right = mid;
+    }
+    if (!_decoderIsReady || _curPos > _virtPos || _blockIndex != left)
+    {
+      RINOK(InitBlock(left));
+    }
+    HRESULT res = SkipTo(_virtPos);
+    if (res != S_OK)
+    {
+      _decoderIsReady = false;
+      return res;
+    }
+  }
+
+  UInt32 processed;
+  HRESULT res = DecodeData((Byte *)data, size, processed);
+  _virtPos += processed;
+  if (processedSize)
+    *processedSize = processed;
+  if (res != S_OK)
+    _decoderIsReady = false;
+  return res;
+}
+
+STDMETHODIMP CSeekInStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition)
+{
+  switch (seekOrigin)
+  {
+    case STREAM_SEEK_SET: break;
+    case STREAM_SEEK_CUR: offset += _virtPos; break;
+    case STREAM_SEEK_END: offset += _size; break;
+    default: return STG_E_INVALIDFUNCTION;
+  }
+  if (offset < 0)
+    return HRESULT_WIN32_ERROR_NEGATIVE_SEEK;
+  _virtPos = offset;
+  if (newPosition)
+    *newPosition = offset;
+  return S_OK;
+}
+
+
 class CHandler:
   public IInArchive,
   public IArchiveOpenSeq,
+  public IInArchiveGetStream,
   #ifndef EXTRACT_ONLY
   public IOutArchive,
   public ISetProperties,
@@ -89,13 +323,18 @@ class CHandler:
 
   AString _methodsString;
 
+  // blocks from xz indexes. It's empty, if indexes were not read at open
+  CRecordVector<CBlockInfo> _blocks;
+
   #ifndef EXTRACT_ONLY
 
   UInt32 _filterId;
+  UInt64 _blockSize;
 
   void Init()
   {
     _filterId = 0;
+    _blockSize = 0;
     CMultiMethodProps::Init();
   }
   
@@ -115,6 +354,7 @@ class CHandler:
 public:
   MY_QUERYINTERFACE_BEGIN2(IInArchive)
   MY_QUERYINTERFACE_ENTRY(IArchiveOpenSeq)
+  MY_QUERYINTERFACE_ENTRY(IInArchiveGetStream)
   #ifndef EXTRACT_ONLY
   MY_QUERYINTERFACE_ENTRY(IOutArchive)
   MY_QUERYINTERFACE_ENTRY(ISetProperties)
@@ -124,6 +364,7 @@ public:
 
   INTERFACE_IInArchive(;)
   STDMETHOD(OpenSeq)(ISequentialInStream *stream);
+  STDMETHOD(GetStream)(UInt32 index, ISequentialInStream **stream);
 
   #ifndef EXTRACT_ONLY
   INTERFACE_IOutArchive(;)
@@ -464,6 +705,27 @@ HRESULT CHandler::Open2(IInStream *inStream, /* UInt32 flags, */ IArchiveOpenCal
     _stat.NumBlocks_Defined = true;
 
     AddString(_methodsString, GetCheckString(xzs.p));
+
+    // (xzs.p.streams[0]) is the last stream in archive
+    UInt64 unpackPos = 0;
+    for (size_t si = xzs.p.num; si != 0;)
+    {
+      const CXzStream &st = xzs.p.streams[--si];
+      UInt64 packPos = st.startOffset + XZ_STREAM_HEADER_SIZE;
+      for (size_t bi = 0; bi < st.numBlocks; bi++)
+      {
+        const CXzBlockSizes &bs = st.blocks[bi];
+        CBlockInfo b;
+        b.UnpackPos = unpackPos;
+        b.UnpackSize = bs.unpackSize;
+        b.PackPos = packPos;
+        b.PackSize = (bs.totalSize + 3) & ~(UInt64)3;
+        b.StreamFlags = st.flags;
+        _blocks.Add(b);
+        unpackPos += b.UnpackSize;
+        packPos += b.PackSize;
+      }
+    }
   }
   else
   {
@@ -506,11 +768,28 @@ STDMETHODIMP CHandler::Close()
   _phySize_Defined = false;
   
    _methodsString.Empty();
+  _blocks.Clear();
   _stream.Release();
   _seqStream.Release();
   return S_OK;
 }
 
+STDMETHODIMP CHandler::GetStream(UInt32 index, ISequentialInStream **stream)
+{
+  COM_TRY_BEGIN
+  *stream = NULL;
+  if (index != 0 || !_stream || _blocks.IsEmpty())
+    return S_FALSE;
+  CSeekInStream *spec = new CSeekInStream;
+  CMyComPtr<ISequentialInStream> specStream = spec;
+  spec->InStream = _stream;
+  spec->Blocks = _blocks;
+  RINOK(spec->Init());
+  *stream = specStream.Detach();
+  return S_OK;
+  COM_TRY_END
+}
+
 class CSeekToSeqStream:
   public IInStream,
   public CMyUnknownImp
@@ -842,6 +1121,7 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
     XzFilterProps_Init(&filter);
     xzProps.lzma2Props = &lzma2Props;
     xzProps.filterProps = (_filterId != 0 ? &filter : NULL);
+    xzProps.blockSize = _blockSize;
     switch (_crcSize)
     {
       case  0: xzProps.checkId = XZ_CHECK_NO; break;
@@ -908,6 +1188,15 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
   Init();
   for (UInt32 i = 0; i < numProps; i++)
   {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    if (!name.IsEmpty() && name[0] == 's')
+    {
+      // s={Size} : the size of unpacked data in each xz block
+      name.Delete(0);
+      RINOK(ParsePropToSize(name, values[i], _blockSize));
+      continue;
+    }
     RINOK(SetProperty(names[i], values[i]));
   }
 
@@ -2,17 +2,25 @@
 
 #include "StdAfx.h"
 
+#include "../../../Common/AutoPtr.h"
 #include "../../../Common/ComTry.h"
 #include "../../../Common/IntToString.h"
 #include "../../../Common/StringConvert.h"
 
 #include "../../../Windows/PropVariant.h"
 #include "../../../Windows/TimeUtils.h"
+#ifndef _7ZIP_ST
+#include "../../../Windows/Synchronization.h"
+#include "../../../Windows/Thread.h"
+#endif
 
 #include "../../IPassword.h"
 
 #include "../../Common/FilterCoder.h"
+#include "../../Common/InMemDecoder.h"
 #include "../../Common/LimitedStreams.h"
+#include "../../Common/LockedStreams.h"
+#include "../../Common/MtJobRing.h"
 #include "../../Common/ProgressUtils.h"
 #include "../../Common/StreamObjects.h"
 #include "../../Common/StreamUtils.h"
@@ -493,6 +501,7 @@ STDMETHODIMP CHandler::Close()
 
 class CLzmaDecoder:
   public ICompressCoder,
+  public ICompressDecodeBuf,
   public CMyUnknownImp
 {
   NCompress::NLzma::CDecoder *DecoderSpec;
@@ -501,8 +510,9 @@ public:
   CLzmaDecoder();
   STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
       const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD(DecodeBuf)(const Byte *inBuf, size_t *inSize, Byte *outBuf, size_t *outSize);
 
-  MY_UNKNOWN_IMP
+  MY_UNKNOWN_IMP1(ICompressDecodeBuf)
 };
 
 CLzmaDecoder::CLzmaDecoder()
@@ -522,6 +532,24 @@ HRESULT CLzmaDecoder::Code(ISequentialInStream *inStream, ISequentialOutStream *
   return Decoder->Code(inStream, outStream, NULL, outSize, progress);
 }
 
+HRESULT CLzmaDecoder::DecodeBuf(const Byte *inBuf, size_t *inSize, Byte *outBuf, size_t *outSize)
+{
+  const size_t packSize = *inSize;
+  size_t size = *outSize;
+  *inSize = 0;
+  *outSize = 0;
+  if (packSize < 9)
+    return S_FALSE;
+  if (inBuf[2] != 5 || inBuf[3] != 0)
+    return E_NOTIMPL;
+  RINOK(DecoderSpec->SetDecoderProperties2(inBuf + 4, 5));
+  size_t inProcessed = packSize - 9;
+  HRESULT res = DecoderSpec->DecodeBuf(inBuf + 9, &inProcessed, outBuf, &size);
+  *inSize = inProcessed + 9;
+  *outSize = size;
+  return res;
+}
+
 
 class CXzDecoder:
   public ICompressCoder,
@@ -572,6 +600,8 @@ class CZipDecoder
   CMyComPtr<ICryptoGetTextPassword> getTextPassword;
   CObjectVector<CMethodItem> methodItems;
 
+  CInMemDecoder _inMemDecoder;
+
 public:
   CZipDecoder():
       _zipCryptoDecoderSpec(0),
@@ -581,7 +611,7 @@ public:
 
   HRESULT Decode(
     DECL_EXTERNAL_CODECS_LOC_VARS
-    CInArchive &archive, const CItemEx &item,
+    ISequentialInStream *packStream, const CItemEx &item,
     ISequentialOutStream *realOutStream,
     IArchiveExtractCallback *extractCallback,
     ICompressProgressInfo *compressProgress,
@@ -611,7 +641,7 @@ static HRESULT SkipStreamData(ISequentialInStream *stream, UInt64 size)
 
 HRESULT CZipDecoder::Decode(
     DECL_EXTERNAL_CODECS_LOC_VARS
-    CInArchive &archive, const CItemEx &item,
+    ISequentialInStream *packStream, const CItemEx &item,
     ISequentialOutStream *realOutStream,
     IArchiveExtractCallback *extractCallback,
     ICompressProgressInfo *compressProgress,
@@ -659,8 +689,6 @@ HRESULT CZipDecoder::Decode(
   outStreamSpec->SetStream(realOutStream);
   outStreamSpec->Init(needCRC);
   
-  CMyComPtr<ISequentialInStream> packStream;
-
   CLimitedSequentialInStream *limitedStreamSpec = new CLimitedSequentialInStream;
   CMyComPtr<ISequentialInStream> inStream(limitedStreamSpec);
 
@@ -672,12 +700,6 @@ HRESULT CZipDecoder::Decode(
         return S_OK;
       packSize -= NCrypto::NWzAes::kMacSize;
     }
-    RINOK(archive.GetItemStream(item, true, packStream));
-    if (!packStream)
-    {
-      res = NExtract::NOperationResult::kUnavailable;
-      return S_OK;
-    }
     limitedStreamSpec->SetStream(packStream);
     limitedStreamSpec->Init(packSize);
   }
@@ -926,7 +948,17 @@ HRESULT CZipDecoder::Decode(
       inStreamNew = inStream;
 
     if (result == S_OK)
-      result = coder->Code(inStreamNew, outStream, NULL, &item.Size, compressProgress);
+    {
+      CMyComPtr<ICompressDecodeBuf> decodeBuf;
+      if (!item.IsEncrypted())
+        coder->QueryInterface(IID_ICompressDecodeBuf, (void **)&decodeBuf);
+      // small items that are not encrypted are decoded in memory
+      if (decodeBuf && CInMemDecoder::CanDecode(item.PackSize, item.Size))
+        result = _inMemDecoder.Decode(decodeBuf, inStreamNew, (size_t)item.PackSize, (size_t)item.Size,
+            outStream, compressProgress);
+      else
+        result = coder->Code(inStreamNew, outStream, NULL, &item.Size, compressProgress);
+    }
     
     if (result == S_FALSE)
       return S_OK;
@@ -964,6 +996,246 @@ HRESULT CZipDecoder::Decode(
 }
 
 
+#ifndef _7ZIP_ST
+
+/* Multithreaded extraction:
+   The items that are not encrypted and not large are decoded by worker threads
+   to memory buffers. Each thread reads pack data from the shared archive stream
+   at its own position. The main thread passes items to IArchiveExtractCallback
+   in original order, and it decodes other items itself, when their turn comes.
+   The number of queued items and the total size of their buffers are limited. */
+
+static const UInt32 kMtItemSizeMax = (UInt32)1 << 23;
+static const UInt64 kMtBufSizeMax = (UInt64)1 << 27;
+static const unsigned kMtNumJobsPerThread = 8;
+
+struct CMtJob
+{
+  CItemEx Item;
+  UInt32 ItemIndex; // index in list of items for extraction
+  UInt64 DataPos;
+  CDynBufSeqOutStream *OutStreamSpec;
+  CMyComPtr<ISequentialOutStream> OutStream;
+  HRESULT Result;
+  Int32 OpRes;
+  bool Skip;
+};
+
+class CMtExtract;
+
+static THREAD_FUNC_DECL MtExtractThread(void *threadInfo);
+
+struct CMtThread
+{
+  DECL_EXTERNAL_CODECS_LOC_VARS2;
+
+  NWindows::CThread Thread;
+  CMtExtract *Mt;
+  CZipDecoder Decoder;
+
+  void WaitAndDecode();
+};
+
+class CMtExtract
+{
+public:
+  CLockedInStream *LockedStreamSpec;
+  CMyComPtr<IUnknown> LockedStream;
+
+  CObjectVector<CMtThread> Threads;
+
+  CMtJobRing Ring;
+  CObjectVector<CMtJob> Jobs;
+  UInt64 BufSize;          // unpack size of queued jobs
+  UInt32 ScanIndex;        // next item that must be checked for queueing
+
+  CMtExtract():
+      BufSize(0),
+      ScanIndex(0)
+  {
+    LockedStreamSpec = new CLockedInStream;
+    LockedStream = LockedStreamSpec;
+  }
+  ~CMtExtract() { StopThreads(); }
+
+  HRESULT Create(
+      DECL_EXTERNAL_CODECS_LOC_VARS
+      IInStream *stream, UInt32 numThreads);
+  void StopThreads();
+
+  CMtJob &GetJob(unsigned jobIndex) { return Jobs[Ring.GetSlot(jobIndex)]; }
+  bool IsNextJob(UInt32 itemIndex) { return !Ring.IsEmpty() && GetJob(Ring.GetStart()).ItemIndex == itemIndex; }
+
+  HRESULT AddJobs(CInArchive &archive, const CObjectVector<CItemEx> &items,
+      const UInt32 *indices, UInt32 numItems);
+  void SkipItem(UInt32 itemIndex);
+  void ReleaseNextJob();
+
+  HRESULT ReadLocalItem(CInArchive &archive, CItemEx &item, bool &isAvail)
+  {
+    NSynchronization::CCriticalSectionLock lock(LockedStreamSpec->CriticalSection);
+    HRESULT res = archive.ReadLocalItemAfterCdItem(item, isAvail);
+    LockedStreamSpec->Pos = (UInt64)(Int64)-1;
+    return res;
+  }
+};
+
+HRESULT CMtExtract::Create(
+    DECL_EXTERNAL_CODECS_LOC_VARS
+    IInStream *stream, UInt32 numThreads)
+{
+  LockedStreamSpec->Stream = stream;
+  LockedStreamSpec->Pos = (UInt64)(Int64)-1;
+  
+  const unsigned numJobs = numThreads * kMtNumJobsPerThread;
+  Jobs.ClearAndReserve(numJobs);
+  for (unsigned i = 0; i < numJobs; i++)
+    Jobs.AddInReserved(CMtJob());
+  RINOK(Ring.Create(numJobs, numThreads));
+  
+  Threads.ClearAndReserve(numThreads);
+  for (UInt32 t = 0; t < numThreads; t++)
+  {
+    Threads.AddInReserved(CMtThread());
+    CMtThread &thread = Threads.Back();
+    #ifdef EXTERNAL_CODECS
+    thread.__externalCodecs = __externalCodecs;
+    #endif
+    thread.Mt = this;
+    RINOK(thread.Thread.Create(MtExtractThread, &thread));
+  }
+  return S_OK;
+}
+
+void CMtExtract::StopThreads()
+{
+  if (Threads.IsEmpty())
+    return;
+  Ring.ExitThreads();
+  FOR_VECTOR (i, Threads)
+  {
+    CMtThread &thread = Threads[i];
+    if (thread.Thread.IsCreated())
+    {
+      thread.Thread.Wait();
+      thread.Thread.Close();
+    }
+  }
+  Threads.Clear();
+}
+
+HRESULT CMtExtract::AddJobs(CInArchive &archive, const CObjectVector<CItemEx> &items,
+    const UInt32 *indices, UInt32 numItems)
+{
+  while (ScanIndex < numItems && !Ring.IsFull())
+  {
+    const CItemEx &item = items[indices ? indices[ScanIndex] : ScanIndex];
+    if (item.IsDir()
+        || item.IsEncrypted()
+        || item.Size > kMtItemSizeMax
+        || !archive.IsLocalOffsetOK(item))
+    {
+      ScanIndex++;
+      continue;
+    }
+    if (!Ring.IsEmpty() && BufSize + item.Size > kMtBufSizeMax)
+      break;
+
+    CMtJob &job = GetJob(Ring.GetEnd());
+    job.Item = item;
+    {
+      // the main thread will report the error for such item
+      bool isAvail;
+      if (ReadLocalItem(archive, job.Item, isAvail) != S_OK
+          || !archive.GetItemDataPos(job.Item, job.DataPos))
+      {
+        ScanIndex++;
+        continue;
+      }
+    }
+    
+    job.ItemIndex = ScanIndex++;
+    job.OutStreamSpec = new CDynBufSeqOutStream;
+    job.OutStream = job.OutStreamSpec;
+    job.Result = S_OK;
+    job.OpRes = NExtract::NOperationResult::kDataError;
+    job.Skip = false;
+    BufSize += item.Size;
+    RINOK(Ring.Submit());
+  }
+  return S_OK;
+}
+
+/* The item that is skipped by callback is not queued.
+   If the job for that item was queued already, but no thread has taken it,
+   the thread will not decode it. */
+
+void CMtExtract::SkipItem(UInt32 itemIndex)
+{
+  if (ScanIndex == itemIndex)
+  {
+    ScanIndex++;
+    return;
+  }
+  if (IsNextJob(itemIndex))
+  {
+    NSynchronization::CCriticalSectionLock lock(Ring.CS);
+    GetJob(Ring.GetStart()).Skip = true;
+  }
+}
+
+void CMtExtract::ReleaseNextJob()
+{
+  CMtJob &job = GetJob(Ring.GetStart());
+  BufSize -= job.Item.Size;
+  job.OutStream.Release();
+  job.OutStreamSpec = NULL;
+  Ring.ReleaseFirst();
+}
+
+void CMtThread::WaitAndDecode()
+{
+  for (;;)
+  {
+    unsigned slot;
+    if (!Mt->Ring.GetJobForThread(slot))
+      return;
+    CMtJob &job = Mt->Jobs[slot];
+    bool skip;
+    {
+      NSynchronization::CCriticalSectionLock lock(Mt->Ring.CS);
+      skip = job.Skip;
+    }
+    
+    HRESULT res = S_OK;
+    if (!skip)
+    {
+      try
+      {
+        CLockedSequentialInStreamMT *packStreamSpec = new CLockedSequentialInStreamMT;
+        CMyComPtr<ISequentialInStream> packStream = packStreamSpec;
+        packStreamSpec->Init(Mt->LockedStreamSpec, job.DataPos);
+        res = Decoder.Decode(
+            EXTERNAL_CODECS_LOC_VARS
+            packStream, job.Item, job.OutStream, NULL, NULL, 1, job.OpRes);
+      }
+      catch(...) { res = E_OUTOFMEMORY; }
+    }
+    
+    job.Result = res;
+    Mt->Ring.SetJobDone(slot);
+  }
+}
+
+static THREAD_FUNC_DECL MtExtractThread(void *threadInfo)
+{
+  ((CMtThread *)threadInfo)->WaitAndDecode();
+  return 0;
+}
+
+#endif
+
+
 STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback)
 {
@@ -991,6 +1263,17 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   CMyComPtr<ICompressProgressInfo> progress = lps;
   lps->Init(extractCallback, false);
 
+  #ifndef _7ZIP_ST
+  CMtExtract *mt = NULL;
+  CMyAutoPtr<CMtExtract> mtPtr;
+  if (_props.NumThreads > 1 && numItems > 1 && !m_Archive.IsMultiVol)
+  {
+    mt = new CMtExtract;
+    mtPtr.reset(mt);
+    RINOK(mt->Create(EXTERNAL_CODECS_VARS m_Archive.GetBaseStream(), _props.NumThreads));
+  }
+  #endif
+
   for (i = 0; i < numItems; i++,
       currentTotalUnPacked += currentItemUnPacked,
       currentTotalPacked += currentItemPacked)
@@ -1019,6 +1302,30 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
     RINOK(extractCallback->GetStream(index, &realOutStream, askMode));
 
+    #ifndef _7ZIP_ST
+    CMyComPtr<ISequentialOutStream> mtOutStream;
+    CDynBufSeqOutStream *mtOutStreamSpec = NULL;
+    HRESULT mtResult = S_OK;
+    Int32 mtOpRes = NExtract::NOperationResult::kDataError;
+    if (mt)
+    {
+      if (!testMode && !realOutStream)
+        mt->SkipItem(i);
+      RINOK(mt->AddJobs(m_Archive, m_Items, allFilesMode ? NULL : indices, numItems));
+      if (mt->IsNextJob(i))
+      {
+        mt->Ring.WaitFirst();
+        CMtJob &job = mt->GetJob(mt->Ring.GetStart());
+        item = job.Item;
+        mtOutStreamSpec = job.OutStreamSpec;
+        mtOutStream = job.OutStream;
+        mtResult = job.Result;
+        mtOpRes = job.OpRes;
+        mt->ReleaseNextJob();
+      }
+    }
+    #endif
+
     if (!isLocalOffsetOK)
     {
       RINOK(extractCallback->PrepareOperation(askMode));
@@ -1030,7 +1337,11 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     if (!item.FromLocal)
     {
       bool isAvail = true;
-      HRESULT res = m_Archive.ReadLocalItemAfterCdItem(item, isAvail);
+      HRESULT res =
+          #ifndef _7ZIP_ST
+          mt ? mt->ReadLocalItem(m_Archive, item, isAvail) :
+          #endif
+          m_Archive.ReadLocalItemAfterCdItem(item, isAvail);
       if (res == S_FALSE)
       {
         if (item.IsDir() || realOutStream || testMode)
@@ -1063,16 +1374,59 @@ STDMETHODIMP CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
     RINOK(extractCallback->PrepareOperation(askMode));
 
-    Int32 res;
-    HRESULT hres = myDecoder.Decode(
-        EXTERNAL_CODECS_VARS
-        m_Archive, item, realOutStream, extractCallback,
-        progress,
+    Int32 res = NExtract::NOperationResult::kUnavailable;
+
+    #ifndef _7ZIP_ST
+    if (mtOutStreamSpec)
+    {
+      RINOK(mtResult);
+      res = mtOpRes;
+      if (realOutStream)
+      {
+        RINOK(WriteStream(realOutStream, mtOutStreamSpec->GetBuffer(), mtOutStreamSpec->GetSize()));
+      }
+    }
+    else
+    #endif
+    {
+      CMyComPtr<ISequentialInStream> packStream;
+      #ifndef _7ZIP_ST
+      /* if the threads read the archive stream, we use it directly
+         only while (streamLock) holds the lock */
+      CMyAutoPtr<NSynchronization::CCriticalSectionLock> streamLock;
+      UInt64 dataPos;
+      if (mt && m_Archive.GetItemDataPos(item, dataPos))
+      {
+        CLockedSequentialInStreamMT *packStreamSpec = new CLockedSequentialInStreamMT;
+        packStream = packStreamSpec;
+        packStreamSpec->Init(mt->LockedStreamSpec, dataPos);
+      }
+      else
+      #endif
+      {
         #ifndef _7ZIP_ST
-        _props.NumThreads,
+        if (mt)
+        {
+          streamLock.reset(new NSynchronization::CCriticalSectionLock(mt->LockedStreamSpec->CriticalSection));
+          mt->LockedStreamSpec->Pos = (UInt64)(Int64)-1;
+        }
         #endif
-        res);
-    RINOK(hres);
+        RINOK(m_Archive.GetItemStream(item, true, packStream));
+      }
+      
+      if (packStream)
+      {
+        HRESULT hres = myDecoder.Decode(
+            EXTERNAL_CODECS_VARS
+            packStream, item, realOutStream, extractCallback,
+            progress,
+            #ifndef _7ZIP_ST
+            _props.NumThreads,
+            #endif
+            res);
+        RINOK(hres);
+      }
+    }
     realOutStream.Release();
     
     RINOK(extractCallback->SetOperationResult(res))
@@ -332,6 +332,15 @@ public:
 
   HRESULT GetItemStream(const CItemEx &item, bool seekPackData, CMyComPtr<ISequentialInStream> &stream);
 
+  // returns false, if pack data of item is not in base stream
+  bool GetItemDataPos(const CItemEx &item, UInt64 &pos) const
+  {
+    if (IsMultiVol || (UseDisk_in_SingleVol && item.Disk != EcdVolIndex))
+      return false;
+    pos = ArcInfo.Base + item.GetDataPosition();
+    return true;
+  }
+
   IInStream *GetBaseStream() { return StreamRef; }
 
   bool CanUpdate() const
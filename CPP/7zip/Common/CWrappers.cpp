@@ -182,6 +182,26 @@ CByteInBufWrap::CByteInBufWrap(): Buf(0)
 }
 
 
+/* ---------- CByteInMemWrap ---------- */
+
+static Byte WrapMem_ReadByte(void *pp) throw()
+{
+  CByteInMemWrap *p = (CByteInMemWrap *)pp;
+  if (p->Cur != p->Lim)
+    return *p->Cur++;
+  p->Extra = true;
+  return 0;
+}
+
+CByteInMemWrap::CByteInMemWrap(const Byte *data, size_t size) throw():
+    Cur(data),
+    Lim(data + size),
+    Extra(false)
+{
+  p.Read = WrapMem_ReadByte;
+}
+
+
 /* ---------- CByteOutBufWrap ---------- */
 
 void CByteOutBufWrap::Free() throw()
@@ -79,6 +79,16 @@ struct CByteInBufWrap
   }
 };
 
+struct CByteInMemWrap
+{
+  IByteIn p;
+  const Byte *Cur;
+  const Byte *Lim;
+  bool Extra;
+  
+  CByteInMemWrap(const Byte *data, size_t size) throw();
+};
+
 struct CByteOutBufWrap
 {
   IByteOut p;
@@ -0,0 +1,102 @@
+// DecodeThreads.cpp
+
+#include "StdAfx.h"
+
+#ifndef _7ZIP_ST
+#include "../../Windows/System.h"
+#endif
+
+#include "MethodProps.h"
+
+#include "DecodeThreads.h"
+
+void CDecodeMtProps::Init()
+{
+  #ifndef _7ZIP_ST
+  NumThreads = NWindows::NSystem::GetNumberOfProcessors();
+  #else
+  NumThreads = 1;
+  #endif
+}
+
+HRESULT CDecodeMtProps::SetProperty(const UString &name, const PROPVARIANT &prop)
+{
+  if (!name.IsPrefixedBy_Ascii_NoCase("mt"))
+    return E_INVALIDARG;
+  #ifndef _7ZIP_ST
+  RINOK(ParseMtProp(name.Ptr(2), prop, NWindows::NSystem::GetNumberOfProcessors(), NumThreads));
+  #endif
+  return S_OK;
+}
+
+
+#ifndef _7ZIP_ST
+
+UInt64 GetDecodeMemLimit()
+{
+  UInt64 memLimit = (UInt64)1 << 30;
+  UInt64 ramSize;
+  if (NWindows::NSystem::GetRamSize(ramSize))
+    memLimit = MyMin(memLimit, ramSize / 4);
+  return memLimit;
+}
+
+void CDecodeThread::Execute()
+{
+  try
+  {
+    _result = _job->Decode();
+  }
+  catch(...) { _result = E_OUTOFMEMORY; }
+}
+
+HRESULT CDecodeThread::WaitJob()
+{
+  if (_isBusy)
+  {
+    WaitExecuteFinish();
+    _isBusy = false;
+  }
+  return _result;
+}
+
+HRESULT CDecodeThreads::Create(UInt32 numThreads, UInt32 numJobs)
+{
+  if (numThreads > numJobs)
+    numThreads = numJobs;
+  if (numThreads > kNumDecodeThreadsMax)
+    numThreads = kNumDecodeThreadsMax;
+  if (numThreads < 2)
+    numThreads = 0;
+  if (numThreads == _numThreads)
+    return S_OK;
+  Free();
+  if (numThreads == 0)
+    return S_OK;
+  _threads.Alloc(numThreads);
+  for (unsigned i = 0; i < numThreads; i++)
+  {
+    HRESULT res = _threads[i].Create();
+    if (res != S_OK)
+    {
+      _threads.Free();
+      return res;
+    }
+  }
+  _numThreads = numThreads;
+  return S_OK;
+}
+
+void CDecodeThreads::Free()
+{
+  _threads.Free();
+  _numThreads = 0;
+}
+
+void CDecodeThreads::WaitAll()
+{
+  for (unsigned i = 0; i < _numThreads; i++)
+    _threads[i].WaitJob();
+}
+
+#endif
@@ -0,0 +1,93 @@
+// DecodeThreads.h
+
+#ifndef __DECODE_THREADS_H
+#define __DECODE_THREADS_H
+
+#include "../../Common/MyString.h"
+#include "../../Common/MyWindows.h"
+
+#ifndef _7ZIP_ST
+#include "../../Common/MyBuffer.h"
+#include "VirtThread.h"
+#endif
+
+/* CDecodeMtProps keeps the number of threads for archive handler
+   that can unpack items (or blocks of items) in threads.
+   The number is set by "mt" property of handler. */
+
+struct CDecodeMtProps
+{
+  UInt32 NumThreads;
+
+  CDecodeMtProps() { Init(); }
+  void Init();
+  // it returns E_INVALIDARG, if (name) is not "mt" property. (name) must be in lower case.
+  HRESULT SetProperty(const UString &name, const PROPVARIANT &prop);
+};
+
+
+#ifndef _7ZIP_ST
+
+// the limit for number of threads that unpack data to memory buffers
+const UInt32 kNumDecodeThreadsMax = 32;
+
+/* It returns the limit for total size of memory buffers
+   that can be allocated for unpacking in threads: min(1 GB, RAM / 4). */
+UInt64 GetDecodeMemLimit();
+
+/* CDecodeJob is the work for CDecodeThread. The caller fills the data of job
+   before CDecodeThread::StartJob(), and it doesn't change that data
+   until CDecodeThread::WaitJob() returns.
+   The destructor of thread waits for the end of job, so the jobs
+   must be destroyed after the threads that can use them. */
+
+struct CDecodeJob
+{
+  virtual HRESULT Decode() = 0;
+  virtual ~CDecodeJob() {}
+};
+
+class CDecodeThread: public CVirtThread
+{
+  CDecodeJob *_job;
+  bool _isBusy;
+  HRESULT _result;
+public:
+  CDecodeThread(): _job(NULL), _isBusy(false), _result(S_OK) {}
+  HRESULT Create() { return HRESULT_FROM_WIN32(CVirtThread::Create()); }
+  ~CDecodeThread() { CVirtThread::WaitThreadFinish(); }
+  virtual void Execute();
+
+  void StartJob(CDecodeJob *job)
+  {
+    _job = job;
+    _isBusy = true;
+    Start();
+  }
+  bool IsBusy() const { return _isBusy; }
+  CDecodeJob *GetJob() const { return _job; }
+  // it waits for the end of started job. It returns the result of last job.
+  HRESULT WaitJob();
+};
+
+class CDecodeThreads
+{
+  CObjArray<CDecodeThread> _threads;
+  unsigned _numThreads;
+public:
+  CDecodeThreads(): _numThreads(0) {}
+
+  /* It creates min(numThreads, numJobs, kNumDecodeThreadsMax) threads.
+     It doesn't create threads, if that number is smaller than 2.
+     The threads are kept, if the number of threads was not changed. */
+  HRESULT Create(UInt32 numThreads, UInt32 numJobs);
+  void Free();
+  void WaitAll();
+
+  unsigned Size() const { return _numThreads; }
+  CDecodeThread &operator[](unsigned i) { return _threads[i]; }
+};
+
+#endif
+
+#endif
@@ -409,6 +409,19 @@ STDMETHODIMP COutFileStream::SetSize(UInt64 newSize)
   #endif
 }
 
+STDMETHODIMP COutFileStream::Flush()
+{
+  #ifdef USE_WIN_FILE
+  
+  return ConvertBoolToHRESULT(File.Flush());
+  
+  #else
+  
+  return E_NOTIMPL;
+  
+  #endif
+}
+
 HRESULT COutFileStream::GetSize(UInt64 *size)
 {
   return ConvertBoolToHRESULT(File.GetLength(*size));
@@ -112,6 +112,7 @@ public:
 
 class COutFileStream:
   public IOutStream,
+  public IOutStreamFlush,
   public CMyUnknownImp
 {
 public:
@@ -145,11 +146,12 @@ public:
   #endif
 
 
-  MY_UNKNOWN_IMP1(IOutStream)
+  MY_UNKNOWN_IMP2(IOutStream, IOutStreamFlush)
 
   STDMETHOD(Write)(const void *data, UInt32 size, UInt32 *processedSize);
   STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
   STDMETHOD(SetSize)(UInt64 newSize);
+  STDMETHOD(Flush)();
 
   HRESULT GetSize(UInt64 *size);
 };
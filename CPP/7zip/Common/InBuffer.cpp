@@ -22,20 +22,43 @@ bool CInBuffer::Create(size_t bufSize) throw()
   const unsigned kMinBlockSize = 1;
   if (bufSize < kMinBlockSize)
     bufSize = kMinBlockSize;
-  if (_bufBase != 0 && _bufSize == bufSize)
-    return true;
-  Free();
-  _bufSize = bufSize;
-  _bufBase = (Byte *)::MidAlloc(bufSize);
-  return (_bufBase != 0);
+  if (_ownBuf == 0 || _ownBufSize != bufSize)
+  {
+    Free();
+    _ownBuf = (Byte *)::MidAlloc(bufSize);
+    if (_ownBuf == 0)
+      return false;
+    _ownBufSize = bufSize;
+  }
+  _bufBase = _ownBuf;
+  _bufSize = _ownBufSize;
+  return true;
 }
 
 void CInBuffer::Free() throw()
 {
-  ::MidFree(_bufBase);
+  ::MidFree(_ownBuf);
+  _ownBuf = 0;
+  _ownBufSize = 0;
   _bufBase = 0;
 }
 
+void CInBuffer::Init() throw()
+{
+  _bufBase = _ownBuf;
+  _bufSize = _ownBufSize;
+  CInBufferBase::Init();
+}
+
+void CInBuffer::InitMem(const Byte *data, size_t size) throw()
+{
+  _bufBase = (Byte *)data;
+  _bufSize = size;
+  CInBufferBase::Init();
+  _bufLim = _bufBase + size;
+  _wasFinished = true;
+}
+
 void CInBufferBase::Init() throw()
 {
   _processedSize = 0;
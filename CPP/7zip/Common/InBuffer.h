@@ -42,6 +42,11 @@ public:
   UInt64 GetProcessedSize() const { return _processedSize + NumExtraBytes + (_buf - _bufBase); }
   bool WasFinished() const { return _wasFinished; }
 
+  // direct access to buffered bytes for the decoders with fast loops
+  const Byte *GetPtr() const { return _buf; }
+  const Byte *GetLim() const { return _bufLim; }
+  void SetPtr(const Byte *p) { _buf = (Byte *)p; }
+
   void SetStream(ISequentialInStream *stream) { _stream = stream; }
   
   void SetBuf(Byte *buf, size_t bufSize, size_t end, size_t pos)
@@ -81,10 +86,18 @@ public:
 
 class CInBuffer: public CInBufferBase
 {
+  Byte *_ownBuf;
+  size_t _ownBufSize;
 public:
+  CInBuffer(): _ownBuf(0), _ownBufSize(0) {}
   ~CInBuffer() { Free(); }
   bool Create(size_t bufSize) throw(); // only up to 32-bits values now are supported!
   void Free() throw();
+  void Init() throw();
+
+  /* InitMem() uses external buffer that contains all data of stream.
+     The stream is not used in that mode. Next Init() returns to own buffer. */
+  void InitMem(const Byte *data, size_t size) throw();
 };
 
 #endif
@@ -0,0 +1,38 @@
+// InMemDecoder.cpp
+
+#include "StdAfx.h"
+
+#include "InMemDecoder.h"
+#include "StreamUtils.h"
+
+HRESULT CInMemDecoder::Decode(ICompressDecodeBuf *decoder,
+    ISequentialInStream *inStream, size_t packSize, size_t unpackSize,
+    ISequentialOutStream *outStream, ICompressProgressInfo *progress)
+{
+  _packBuf.AllocAtLeast(packSize);
+  _unpackBuf.AllocAtLeast(unpackSize);
+  
+  // if the archive is truncated, the decoder reports the error for available data
+  size_t inSize = packSize;
+  RINOK(ReadStream(inStream, _packBuf, &inSize));
+  
+  size_t outSize = unpackSize;
+  HRESULT res = decoder->DecodeBuf(_packBuf, &inSize, _unpackBuf, &outSize);
+  if (res != S_OK && res != S_FALSE)
+    return res;
+  if (outSize > unpackSize)
+    return E_FAIL;
+  if (res == S_OK && outSize != unpackSize)
+    res = S_FALSE;
+  
+  /* in case of data error, we write the decoded part of data,
+     as ICompressCoder::Code() does it */
+  RINOK(WriteStream(outStream, _unpackBuf, outSize));
+  if (res == S_OK && progress)
+  {
+    const UInt64 inSize64 = inSize;
+    const UInt64 outSize64 = outSize;
+    res = progress->SetRatioInfo(&inSize64, &outSize64);
+  }
+  return res;
+}
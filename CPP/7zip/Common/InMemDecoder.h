@@ -0,0 +1,32 @@
+// InMemDecoder.h
+
+#ifndef __IN_MEM_DECODER_H
+#define __IN_MEM_DECODER_H
+
+#include "../../Common/MyBuffer.h"
+
+#include "../ICoder.h"
+
+/* CInMemDecoder reads all packed data of small stream to memory buffer
+   and decodes it via ICompressDecodeBuf without intermediate stream buffers.
+   The caller must check CanDecode() and the support of ICompressDecodeBuf
+   before any data is read from (inStream). */
+
+class CInMemDecoder
+{
+  CByteBuffer _packBuf;
+  CByteBuffer _unpackBuf;
+public:
+  static bool CanDecode(UInt64 packSize, UInt64 unpackSize)
+  {
+    const UInt32 kSizeMax = (UInt32)1 << 22;
+    return packSize != 0 && packSize <= kSizeMax
+        && unpackSize != 0 && unpackSize <= kSizeMax;
+  }
+
+  HRESULT Decode(ICompressDecodeBuf *decoder,
+      ISequentialInStream *inStream, size_t packSize, size_t unpackSize,
+      ISequentialOutStream *outStream, ICompressProgressInfo *progress);
+};
+
+#endif
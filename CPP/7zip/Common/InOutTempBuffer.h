@@ -31,7 +31,6 @@ public:
   UInt64 GetDataSize() const { return _size; }
 };
 
-/*
 class CSequentialOutTempBufferImp:
   public ISequentialOutStream,
   public CMyUnknownImp
@@ -43,6 +42,5 @@ public:
 
   STDMETHOD(Write)(const void *data, UInt32 size, UInt32 *processedSize);
 };
-*/
 
 #endif
@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "LimitedStreams.h"
+#include "StreamUtils.h"
 
 STDMETHODIMP CLimitedSequentialInStream::Read(void *data, UInt32 size, UInt32 *processedSize)
 {
@@ -210,6 +211,139 @@ STDMETHODIMP CExtentsStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPo
 }
 
 
+// the gap between extents that is read instead of seek
+static const size_t kExtentsGapMax = (size_t)1 << 16;
+// the total size of gaps that are read to buffer
+static const size_t kExtentsGapsSizeMax = (size_t)1 << 18;
+
+#define RINOZ(x) { int __tt = (x); if (__tt != 0) return __tt; }
+
+int CExtentsReader::CompareExtents(const unsigned *p1, const unsigned *p2, void *param)
+{
+  const CRecordVector<CExtent> &extents = *(const CRecordVector<CExtent> *)param;
+  const CExtent &e1 = extents[*p1];
+  const CExtent &e2 = extents[*p2];
+  RINOZ(MyCompare(e1.Phy, e2.Phy));
+  return MyCompare(*p1, *p2);
+}
+
+HRESULT CExtentsReader::Read(IInStream *stream, ICompressProgressInfo *progress)
+{
+  // the buffer is allocated only once for typical groups of items
+  _buf.AllocAtLeast(MyMax(_dataSize, kBufSize) + kExtentsGapsSizeMax);
+  
+  _sorted.ClearAndReserve(_extents.Size());
+  FOR_VECTOR (i, _extents)
+  {
+    _extents[i].Processed = 0;
+    if (_extents[i].Size != 0)
+      _sorted.AddInReserved(i);
+  }
+  _sorted.Sort(CompareExtents, &_extents);
+
+  size_t bufPos = 0;
+  size_t gapsSize = 0;
+  UInt64 totalRead = 0;
+
+  for (unsigned i = 0; i < _sorted.Size();)
+  {
+    const UInt64 start = _extents[_sorted[i]].Phy;
+    UInt64 end = start + _extents[_sorted[i]].Size;
+    unsigned next;
+    
+    for (next = i + 1; next < _sorted.Size(); next++)
+    {
+      const CExtent &e = _extents[_sorted[next]];
+      UInt64 gap = 0;
+      if (e.Phy > end)
+      {
+        gap = e.Phy - end;
+        if (gap > kExtentsGapMax || gapsSize + gap > kExtentsGapsSizeMax)
+          break;
+      }
+      UInt64 end2 = e.Phy + e.Size;
+      if (end2 < end)
+        end2 = end;
+      if (end2 - start > kReadSize)
+        break;
+      gapsSize += (size_t)gap;
+      end = end2;
+    }
+
+    const size_t spanSize = (size_t)(end - start);
+    size_t size = spanSize;
+    RINOK(stream->Seek(start, STREAM_SEEK_SET, NULL));
+    RINOK(ReadStream(stream, _buf + bufPos, &size));
+    
+    for (; i < next; i++)
+    {
+      CExtent &e = _extents[_sorted[i]];
+      const size_t offset = (size_t)(e.Phy - start);
+      e.BufPos = bufPos + offset;
+      if (offset < size)
+        e.Processed = MyMin(e.Size, size - offset);
+    }
+
+    bufPos += spanSize;
+    totalRead += size;
+    if (progress)
+    {
+      RINOK(progress->SetRatioInfo(&totalRead, &totalRead));
+    }
+  }
+  
+  return S_OK;
+}
+
+HRESULT CExtentsReader::WriteItem(unsigned itemIndex, ISequentialOutStream *outStream, UInt64 &processed) const
+{
+  processed = 0;
+  const unsigned limit = (itemIndex + 1 < _items.Size()) ? _items[itemIndex + 1] : _extents.Size();
+  for (unsigned i = _items[itemIndex]; i < limit; i++)
+  {
+    const CExtent &e = _extents[i];
+    if (outStream && e.Processed != 0)
+    {
+      RINOK(WriteStream(outStream, _buf + e.BufPos, e.Processed));
+    }
+    processed += e.Processed;
+    if (e.Processed != e.Size)
+      break;
+  }
+  return S_OK;
+}
+
+HRESULT CExtentsReader::CopyExtent(IInStream *stream, UInt64 phy, UInt64 size,
+    ISequentialOutStream *outStream, ICompressProgressInfo *progress, UInt64 &processed)
+{
+  processed = 0;
+  if (size == 0)
+    return S_OK;
+  _buf.AllocAtLeast(kBufSize + kExtentsGapsSizeMax);
+  RINOK(stream->Seek(phy, STREAM_SEEK_SET, NULL));
+  
+  for (;;)
+  {
+    size_t cur = kReadSize;
+    if (cur > size - processed)
+      cur = (size_t)(size - processed);
+    size_t cur2 = cur;
+    RINOK(ReadStream(stream, _buf, &cur2));
+    if (outStream && cur2 != 0)
+    {
+      RINOK(WriteStream(outStream, _buf, cur2));
+    }
+    processed += cur2;
+    if (progress)
+    {
+      RINOK(progress->SetRatioInfo(&processed, &processed));
+    }
+    if (cur2 != cur || processed == size)
+      return S_OK;
+  }
+}
+
+
 STDMETHODIMP CLimitedSequentialOutStream::Write(const void *data, UInt32 size, UInt32 *processedSize)
 {
   HRESULT result = S_OK;
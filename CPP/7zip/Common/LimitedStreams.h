@@ -6,6 +6,7 @@
 #include "../../Common/MyBuffer.h"
 #include "../../Common/MyCom.h"
 #include "../../Common/MyVector.h"
+#include "../ICoder.h"
 #include "../IStream.h"
 
 class CLimitedSequentialInStream:
@@ -134,6 +135,67 @@ public:
   }
 };
 
+/* CExtentsReader reads the data of group of items to memory buffer.
+   The extents of all items are sorted by physical position, and near
+   extents are read with big reads directly to buffer. So the items can
+   be extracted in original order without back and forth seeks.
+   The data of big items can be copied with CopyExtent(). */
+
+class CExtentsReader
+{
+  struct CExtent
+  {
+    UInt64 Phy;
+    size_t Size;
+    size_t BufPos;
+    size_t Processed;
+  };
+
+  CRecordVector<CExtent> _extents;
+  CRecordVector<unsigned> _items;
+  CRecordVector<unsigned> _sorted;
+  CByteBuffer _buf;
+  size_t _dataSize;
+
+  static int CompareExtents(const unsigned *p1, const unsigned *p2, void *param);
+public:
+  static const size_t kReadSize = (size_t)1 << 21;
+  
+  // the caller adds items while GetDataSize() is not larger than kBufSize
+  static const size_t kBufSize = (size_t)1 << 21;
+
+  CExtentsReader(): _dataSize(0) {}
+
+  void Clear()
+  {
+    _extents.Clear();
+    _items.Clear();
+    _dataSize = 0;
+  }
+  
+  void AddItem() { _items.Add(_extents.Size()); }
+  void AddExtent(UInt64 phy, size_t size)
+  {
+    CExtent e;
+    e.Phy = phy;
+    e.Size = size;
+    e.BufPos = 0;
+    e.Processed = 0;
+    _extents.Add(e);
+    _dataSize += size;
+  }
+  
+  size_t GetDataSize() const { return _dataSize; }
+  
+  HRESULT Read(IInStream *stream, ICompressProgressInfo *progress);
+  
+  // it writes the data of item up to first extent that was not read completely
+  HRESULT WriteItem(unsigned itemIndex, ISequentialOutStream *outStream, UInt64 &processed) const;
+  
+  HRESULT CopyExtent(IInStream *stream, UInt64 phy, UInt64 size,
+      ISequentialOutStream *outStream, ICompressProgressInfo *progress, UInt64 &processed);
+};
+
 class CLimitedSequentialOutStream:
   public ISequentialOutStream,
   public CMyUnknownImp
@@ -66,6 +66,49 @@ HRESULT ParsePropToUInt32(const UString &name, const PROPVARIANT &prop, UInt32 &
   return S_OK;
 }
 
+static HRESULT StringToSize(const UString &s, UInt64 &resValue)
+{
+  const wchar_t *end;
+  const UInt64 number = ConvertStringToUInt64(s, &end);
+  const unsigned numDigits = (unsigned)(end - s);
+  if (numDigits == 0 || s.Len() > numDigits + 1)
+    return E_INVALIDARG;
+  unsigned numBits = 0;
+  if (s.Len() != numDigits)
+  {
+    switch (MyCharLower_Ascii(s[numDigits]))
+    {
+      case 'b': numBits =  0; break;
+      case 'k': numBits = 10; break;
+      case 'm': numBits = 20; break;
+      case 'g': numBits = 30; break;
+      case 't': numBits = 40; break;
+      default: return E_INVALIDARG;
+    }
+  }
+  if (numBits != 0 && (number >> (64 - numBits)) != 0)
+    return E_INVALIDARG;
+  resValue = number << numBits;
+  return S_OK;
+}
+
+HRESULT ParsePropToSize(const UString &name, const PROPVARIANT &prop, UInt64 &resValue)
+{
+  if (!name.IsEmpty())
+  {
+    if (prop.vt != VT_EMPTY)
+      return E_INVALIDARG;
+    return StringToSize(name, resValue);
+  }
+  switch (prop.vt)
+  {
+    case VT_UI4: resValue = prop.ulVal; return S_OK;
+    case VT_UI8: resValue = prop.uhVal.QuadPart; return S_OK;
+    case VT_BSTR: return StringToSize(prop.bstrVal, resValue);
+  }
+  return E_INVALIDARG;
+}
+
 HRESULT ParseMtProp(const UString &name, const PROPVARIANT &prop, UInt32 defaultNumThreads, UInt32 &numThreads)
 {
   if (name.IsEmpty())
@@ -14,6 +14,9 @@ HRESULT PROPVARIANT_to_bool(const PROPVARIANT &prop, bool &dest);
 unsigned ParseStringToUInt32(const UString &srcString, UInt32 &number);
 HRESULT ParsePropToUInt32(const UString &name, const PROPVARIANT &prop, UInt32 &resValue);
 
+// size in bytes: {N}[b|k|m|g|t] in (name) or in (prop), or number in (prop)
+HRESULT ParsePropToSize(const UString &name, const PROPVARIANT &prop, UInt64 &resValue);
+
 HRESULT ParseMtProp(const UString &name, const PROPVARIANT &prop, UInt32 defaultNumThreads, UInt32 &numThreads);
 
 struct CProp
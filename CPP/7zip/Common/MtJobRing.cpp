@@ -0,0 +1,98 @@
+// MtJobRing.cpp
+
+#include "StdAfx.h"
+
+#include "MtJobRing.h"
+
+#ifndef _7ZIP_ST
+using namespace NWindows;
+using namespace NSynchronization;
+#endif
+
+HRESULT CMtJobRing::Create(unsigned numJobs, unsigned numThreads)
+{
+  _done.ClearAndSetSize(numJobs);
+  for (unsigned i = 0; i < numJobs; i++)
+    _done[i] = false;
+  _start = 0;
+  _end = 0;
+  #ifndef _7ZIP_ST
+  _dispatched = 0;
+  _numThreads = numThreads;
+  _exit = false;
+  if (numThreads != 0)
+  {
+    RINOK(_semaphore.Create(0, numJobs + numThreads));
+    RINOK(_doneEvent.CreateIfNotCreated());
+  }
+  #else
+  UNUSED_VAR(numThreads);
+  #endif
+  return S_OK;
+}
+
+HRESULT CMtJobRing::Submit()
+{
+  const unsigned slot = GetSlot(_end++);
+  #ifndef _7ZIP_ST
+  if (_numThreads != 0)
+  {
+    {
+      CCriticalSectionLock lock(CS);
+      _done[slot] = false;
+    }
+    return _semaphore.Release();
+  }
+  #endif
+  _done[slot] = true;
+  return S_OK;
+}
+
+void CMtJobRing::WaitFirst()
+{
+  #ifndef _7ZIP_ST
+  const unsigned slot = GetSlot(_start);
+  for (;;)
+  {
+    {
+      CCriticalSectionLock lock(CS);
+      if (_done[slot])
+        return;
+    }
+    _doneEvent.Lock();
+  }
+  #endif
+}
+
+#ifndef _7ZIP_ST
+
+void CMtJobRing::ExitThreads()
+{
+  {
+    CCriticalSectionLock lock(CS);
+    _exit = true;
+  }
+  if (_numThreads != 0)
+    _semaphore.Release(_numThreads);
+}
+
+bool CMtJobRing::GetJobForThread(unsigned &slot)
+{
+  _semaphore.Lock();
+  CCriticalSectionLock lock(CS);
+  if (_exit)
+    return false;
+  slot = GetSlot(_dispatched++);
+  return true;
+}
+
+void CMtJobRing::SetJobDone(unsigned slot)
+{
+  {
+    CCriticalSectionLock lock(CS);
+    _done[slot] = true;
+  }
+  _doneEvent.Set();
+}
+
+#endif
@@ -0,0 +1,72 @@
+// MtJobRing.h
+
+#ifndef __MT_JOB_RING_H
+#define __MT_JOB_RING_H
+
+#include "../../Common/MyVector.h"
+#include "../../Common/MyWindows.h"
+
+#ifndef _7ZIP_ST
+#include "../../Windows/Synchronization.h"
+#endif
+
+/* CMtJobRing controls the ring buffer of jobs that are processed by worker threads.
+   The caller stores the jobs in own array of (Size()) items:
+   the job with counter (i) is stored in item (GetSlot(i)).
+   Job counters are not wrapped to (Size()).
+   The main thread submits new jobs to the end of ring, and it takes the results
+   of jobs from the start of ring in original order. The threads take the jobs
+   in same order. If there are no threads, the main thread must process
+   the job itself before Submit(). */
+
+class CMtJobRing
+{
+  CRecordVector<bool> _done;
+  unsigned _start;      // first job that was not released by main thread
+  unsigned _end;
+  #ifndef _7ZIP_ST
+  unsigned _dispatched; // first job that was not taken by thread
+  unsigned _numThreads;
+  bool _exit;
+  NWindows::NSynchronization::CSemaphore _semaphore;
+  NWindows::NSynchronization::CAutoResetEvent _doneEvent;
+public:
+  // it protects the job data that can be changed by both threads
+  NWindows::NSynchronization::CCriticalSection CS;
+  #endif
+public:
+  CMtJobRing():
+      _start(0),
+      _end(0)
+      #ifndef _7ZIP_ST
+      , _dispatched(0)
+      , _numThreads(0)
+      , _exit(false)
+      #endif
+      {}
+  
+  HRESULT Create(unsigned numJobs, unsigned numThreads);
+  
+  unsigned Size() const { return _done.Size(); }
+  unsigned GetSlot(unsigned jobIndex) const { return jobIndex % _done.Size(); }
+  unsigned GetStart() const { return _start; }
+  unsigned GetEnd() const { return _end; }
+  bool IsEmpty() const { return _start == _end; }
+  bool IsFull() const { return _end - _start == _done.Size(); }
+
+  // functions for main thread
+  HRESULT Submit();
+  void WaitFirst();
+  void ReleaseFirst() { _start++; }
+  
+  #ifndef _7ZIP_ST
+  // the caller must wait for threads after that call
+  void ExitThreads();
+  
+  // functions for worker threads
+  bool GetJobForThread(unsigned &slot);
+  void SetJobDone(unsigned slot);
+  #endif
+};
+
+#endif
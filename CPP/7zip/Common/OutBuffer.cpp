@@ -11,22 +11,47 @@ bool COutBuffer::Create(UInt32 bufSize) throw()
   const UInt32 kMinBlockSize = 1;
   if (bufSize < kMinBlockSize)
     bufSize = kMinBlockSize;
-  if (_buf != 0 && _bufSize == bufSize)
-    return true;
-  Free();
-  _bufSize = bufSize;
-  _buf = (Byte *)::MidAlloc(bufSize);
-  return (_buf != 0);
+  if (_ownBuf == 0 || _ownBufSize != bufSize)
+  {
+    Free();
+    _ownBuf = (Byte *)::MidAlloc(bufSize);
+    if (_ownBuf == 0)
+      return false;
+    _ownBufSize = bufSize;
+  }
+  _buf = _ownBuf;
+  _bufSize = _ownBufSize;
+  return true;
 }
 
 void COutBuffer::Free() throw()
 {
-  ::MidFree(_buf);
+  ::MidFree(_ownBuf);
+  _ownBuf = 0;
+  _ownBufSize = 0;
   _buf = 0;
 }
 
+void COutBuffer::InitMem(Byte *buf, UInt32 size) throw()
+{
+  _stream = 0;
+  _buf2 = 0;
+  _buf = buf;
+  _bufSize = size;
+  _streamPos = 0;
+  _limitPos = _bufSize;
+  _pos = 0;
+  _processedSize = 0;
+  _overDict = false;
+  #ifdef _NO_EXCEPTIONS
+  ErrorCode = S_OK;
+  #endif
+}
+
 void COutBuffer::Init() throw()
 {
+  _buf = _ownBuf;
+  _bufSize = _ownBufSize;
   _streamPos = 0;
   _limitPos = _bufSize;
   _pos = 0;
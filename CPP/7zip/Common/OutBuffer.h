@@ -26,6 +26,8 @@ protected:
   UInt64 _processedSize;
   Byte  *_buf2;
   bool _overDict;
+  Byte *_ownBuf;
+  UInt32 _ownBufSize;
 
   HRESULT FlushPart() throw();
 public:
@@ -33,7 +35,7 @@ public:
   HRESULT ErrorCode;
   #endif
 
-  COutBuffer(): _buf(0), _pos(0), _stream(0), _buf2(0) {}
+  COutBuffer(): _buf(0), _pos(0), _stream(0), _buf2(0), _ownBuf(0), _ownBufSize(0) {}
   ~COutBuffer() { Free(); }
   
   bool Create(UInt32 bufSize) throw();
@@ -42,6 +44,11 @@ public:
   void SetMemStream(Byte *buf) { _buf2 = buf; }
   void SetStream(ISequentialOutStream *stream) { _stream = stream; }
   void Init() throw();
+
+  /* InitMem() uses external buffer (buf) as window for all output data.
+     The stream is not used in that mode. Next Init() returns to own buffer. */
+  void InitMem(Byte *buf, UInt32 size) throw();
+  
   HRESULT Flush() throw();
   void FlushWithCheck();
 
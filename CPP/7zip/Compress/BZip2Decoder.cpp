@@ -690,6 +690,44 @@ STDMETHODIMP CDecoder::Code(ISequentialInStream *inStream, ISequentialOutStream
   return CodeReal(inStream, outStream, progress);
 }
 
+STDMETHODIMP CDecoder::DecodeBuf(const Byte *inBuf, size_t *inSize, Byte *outBuf, size_t *outSize)
+{
+  const size_t size = *outSize;
+  const size_t packSize = *inSize;
+  *inSize = 0;
+  *outSize = 0;
+  if (size == 0 || size > ((UInt32)1 << 31))
+    return E_NOTIMPL;
+
+  IsBz = false;
+  BzWasFinished = false;
+  CrcError = false;
+  // the stream version of decoder must reinit input buffer after that call
+  _needInStreamInit = true;
+
+  HRESULT res;
+  try
+  {
+    Base.BitDecoder.InitMem(inBuf, packSize);
+    m_OutStream.InitMem(outBuf, (UInt32)size);
+    res = DecodeFile(NULL);
+    if (res == S_OK)
+      res = Flush();
+  }
+  catch(const CInBufferException &e)  { res = e.ErrorCode; }
+  catch(const COutBufferException &e) { res = e.ErrorCode; }
+  catch(...) { res = E_FAIL; }
+
+  /* if the stream contains more data than (size), the window was
+     wrapped and the start of (outBuf) was overwritten. */
+  const UInt64 processed = m_OutStream.GetProcessedSize();
+  if (res == S_OK && processed > size)
+    res = S_FALSE;
+  *outSize = (size_t)(processed > size ? size : processed);
+  *inSize = (size_t)Base.BitDecoder.GetProcessedSize();
+  return res;
+}
+
 HRESULT CDecoder::CodeResume(ISequentialOutStream *outStream, ICompressProgressInfo *progress)
 {
   return CodeReal(NULL, outStream, progress);
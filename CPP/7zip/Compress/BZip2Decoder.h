@@ -96,6 +96,7 @@ public:
 
 class CDecoder :
   public ICompressCoder,
+  public ICompressDecodeBuf,
   #ifndef _7ZIP_ST
   public ICompressSetCoderMt,
   #endif
@@ -174,6 +175,7 @@ public:
   HRESULT Flush() { return m_OutStream.Flush(); }
 
   MY_QUERYINTERFACE_BEGIN2(ICompressCoder)
+  MY_QUERYINTERFACE_ENTRY(ICompressDecodeBuf)
   #ifndef _7ZIP_ST
   MY_QUERYINTERFACE_ENTRY(ICompressSetCoderMt)
   #endif
@@ -184,6 +186,7 @@ public:
   
   STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
       const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD(DecodeBuf)(const Byte *inBuf, size_t *inSize, Byte *outBuf, size_t *outSize);
 
   STDMETHOD(SetInStream)(ISequentialInStream *inStream);
   STDMETHOD(ReleaseInStream)();
@@ -20,9 +20,17 @@ static const unsigned kNumHuffPasses = 4;
 
 bool CThreadInfo::Alloc()
 {
+  if (m_UseSaIs && !m_BlockSorterIndexIsBig)
+  {
+    ::BigFree(m_BlockSorterIndex);
+    m_BlockSorterIndex = 0;
+  }
   if (m_BlockSorterIndex == 0)
   {
-    m_BlockSorterIndex = (UInt32 *)::BigAlloc(BLOCK_SORT_BUF_SIZE(kBlockSizeMax) * sizeof(UInt32));
+    m_BlockSorterIndexIsBig = m_UseSaIs;
+    m_BlockSorterIndex = (UInt32 *)::BigAlloc((m_UseSaIs ?
+        BLOCK_SORT_SAIS_BUF_SIZE(kBlockSizeMax) :
+        BLOCK_SORT_BUF_SIZE(kBlockSizeMax)) * sizeof(UInt32));
     if (m_BlockSorterIndex == 0)
       return false;
   }
@@ -136,6 +144,10 @@ void CEncProps::Normalize(int level)
     BlockSizeMult = (level >= 5 ? 9 : (level >= 1 ? level * 2 - 1: 1));
   if (BlockSizeMult < kBlockSizeMultMin) BlockSizeMult = kBlockSizeMultMin;
   if (BlockSizeMult > kBlockSizeMultMax) BlockSizeMult = kBlockSizeMultMax;
+
+  if (Algo == (UInt32)(Int32)-1)
+    Algo = 0;
+  if (Algo > 1) Algo = 1;
 }
 
 CEncoder::CEncoder()
@@ -271,7 +283,9 @@ void CThreadInfo::EncodeBlock(const Byte *block, UInt32 blockSize)
   WriteBit2(0); // Randomised = false
   
   {
-    UInt32 origPtr = BlockSort(m_BlockSorterIndex, block, blockSize);
+    UInt32 origPtr = m_UseSaIs ?
+        BlockSortSaIs(m_BlockSorterIndex, block, blockSize) :
+        BlockSort(m_BlockSorterIndex, block, blockSize);
     // if (m_BlockSorterIndex[origPtr] != 0) throw 1;
     m_BlockSorterIndex[origPtr] = blockSize;
     WriteBits2(origPtr, kNumOrigBits);
@@ -752,6 +766,7 @@ HRESULT CEncoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *
     #endif
 
     ti.m_OptimizeNumTables = _props.DoOptimizeNumTables();
+    ti.m_UseSaIs = _props.UseSaIs();
 
     if (!ti.Alloc())
       return E_OUTOFMEMORY;
@@ -859,6 +874,7 @@ HRESULT CEncoder::SetCoderProperties(const PROPID *propIDs, const PROPVARIANT *c
     switch (propID)
     {
       case NCoderPropID::kNumPasses: props.NumPasses = v; break;
+      case NCoderPropID::kAlgorithm: props.Algo = v; break;
       case NCoderPropID::kDictionarySize: props.BlockSizeMult = v / kBlockSizeStep; break;
       case NCoderPropID::kLevel: level = v; break;
       case NCoderPropID::kNumThreads:
@@ -95,6 +95,7 @@ private:
   Byte *m_MtfArray;
   Byte *m_TempArray;
   UInt32 *m_BlockSorterIndex;
+  bool m_BlockSorterIndexIsBig;
 
   CMsbfEncoderTemp *m_OutStreamCurrent;
 
@@ -119,6 +120,7 @@ private:
   void EncodeBlock2(const Byte *block, UInt32 blockSize, UInt32 numPasses);
 public:
   bool m_OptimizeNumTables;
+  bool m_UseSaIs;
   CEncoder *Encoder;
   #ifndef _7ZIP_ST
   NWindows::CThread Thread;
@@ -137,7 +139,7 @@ public:
   DWORD ThreadFunc();
   #endif
 
-  CThreadInfo(): m_BlockSorterIndex(0), m_Block(0) {}
+  CThreadInfo(): m_Block(0), m_BlockSorterIndex(0), m_BlockSorterIndexIsBig(false) {}
   ~CThreadInfo() { Free(); }
   bool Alloc();
   void Free();
@@ -149,14 +151,17 @@ struct CEncProps
 {
   UInt32 BlockSizeMult;
   UInt32 NumPasses;
+  UInt32 Algo; // 0 - BlockSort (prefix doubling), 1 - SA-IS suffix sorting
   
   CEncProps()
   {
     BlockSizeMult = (UInt32)(Int32)-1;
     NumPasses = (UInt32)(Int32)-1;
+    Algo = (UInt32)(Int32)-1;
   }
   void Normalize(int level);
   bool DoOptimizeNumTables() const { return NumPasses > 1; }
+  bool UseSaIs() const { return Algo == 1; }
 };
 
 class CEncoder :
@@ -38,8 +38,16 @@ public:
     _value = 0;
   }
 
+  void InitMem(const Byte *data, size_t size)
+  {
+    _stream.InitMem(data, size);
+    _bitPos = kNumBigValueBits;
+    _value = 0;
+  }
+
   UInt64 GetStreamSize() const { return _stream.GetStreamSize(); }
   UInt64 GetProcessedSize() const { return _stream.GetProcessedSize() - ((kNumBigValueBits - _bitPos) >> 3); }
+  UInt64 GetProcessedBits() const { return (_stream.GetProcessedSize() << 3) - (kNumBigValueBits - _bitPos); }
 
   bool ThereAreDataInBitsBuffer() const { return this->_bitPos != kNumBigValueBits; }
 
@@ -89,6 +97,12 @@ public:
     _normalValue = 0;
   }
 
+  void InitMem(const Byte *data, size_t size)
+  {
+    CBaseDecoder<TInByte>::InitMem(data, size);
+    _normalValue = 0;
+  }
+
   void Normalize()
   {
     for (; this->_bitPos >= 8; this->_bitPos -= 8)
@@ -123,6 +137,33 @@ public:
 
   Byte ReadDirectByte() { return this->_stream.ReadByte(); }
 
+  /* The decoder with fast loop takes the bits that were not consumed yet
+     and then it reads next bytes directly from the stream buffer. */
+
+  TInByte &GetStream() { return this->_stream; }
+
+  UInt32 GetNormalValue(unsigned &numBits) const
+  {
+    numBits = kNumBigValueBits - this->_bitPos;
+    return _normalValue;
+  }
+
+  // (numBits <= 32). The upper bits of (val) must be zeros.
+  void SetNormalValue(UInt32 val, unsigned numBits)
+  {
+    this->_bitPos = kNumBigValueBits - numBits;
+    _normalValue = val;
+    /* (_value) must contain the inverted bytes for unread bits.
+       We restore these bytes from (val). Low bits of first byte
+       were consumed already, so they can contain any data. */
+    UInt32 value = 0;
+    unsigned shift = (8 - (numBits & 7)) & 7;
+    UInt64 v = (UInt64)val << shift;
+    for (numBits += shift; numBits != 0; numBits -= 8, v >>= 8)
+      value = (value << 8) | kInvertTable[(unsigned)v & 0xFF];
+    this->_value = value;
+  }
+
   Byte ReadAlignedByte()
   {
     if (this->_bitPos == kNumBigValueBits)
@@ -33,6 +33,14 @@ public:
     _value = 0;
     Normalize();
   }
+
+  void InitMem(const Byte *data, size_t size)
+  {
+    _stream.InitMem(data, size);
+    _bitPos = kNumBigValueBits;
+    _value = 0;
+    Normalize();
+  }
   
   UInt64 GetStreamSize() const { return _stream.GetStreamSize(); }
   UInt64 GetProcessedSize() const { return _stream.GetProcessedSize() - ((kNumBigValueBits - _bitPos) >> 3); }
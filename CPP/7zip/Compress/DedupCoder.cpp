@@ -0,0 +1,534 @@
+// DedupCoder.cpp
+
+#include "StdAfx.h"
+
+#include "../../../C/Alloc.h"
+#include "../../../C/CpuArch.h"
+
+#include "../Common/StreamUtils.h"
+
+#include "DedupCoder.h"
+
+namespace NCompress {
+namespace NDedup {
+
+#ifndef EXTRACT_ONLY
+
+static const UInt32 kWindowSizeDefault = (UInt32)1 << 27;
+static const unsigned kChunkBitsDefault = 13;
+static const unsigned kChunkBitsMin = 8;
+static const unsigned kChunkBitsMax = 20;
+
+static const unsigned kNumBucketEntriesLog = 2;
+static const unsigned kNumBucketEntries = 1 << kNumBucketEntriesLog;
+
+// literal run or reference can't be larger than that value
+static const UInt32 kItemSizeMax = (UInt32)1 << 30;
+
+static UInt64 g_Gear[256];
+
+static struct CGearTableInit
+{
+  CGearTableInit()
+  {
+    // any fixed pseudo-random table is good for chunking.
+    // The decoder doesn't depend on these values.
+    UInt64 x = 0x2545F4914F6CDD1D;
+    for (unsigned i = 0; i < 256; i++)
+    {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      g_Gear[i] = x;
+    }
+  }
+} g_GearTableInit;
+
+
+static UInt32 GetChunkHash(const Byte *p, size_t size)
+{
+  UInt64 h = size;
+  for (; size >= 8; size -= 8, p += 8)
+  {
+    h ^= GetUi64(p);
+    h *= 0x9E3779B97F4A7C15;
+    h ^= h >> 29;
+  }
+  for (; size != 0; size--)
+    h = (h ^ *p++) * 0x100000001B3;
+  h *= 0x9E3779B97F4A7C15;
+  return (UInt32)(h >> 32);
+}
+
+
+CEncoder::CEncoder():
+    _windowSizeProp(kWindowSizeDefault),
+    _chunkBits(kChunkBitsDefault),
+    _reduceSize((UInt64)(Int64)-1),
+    _windowSize(kWindowSizeDefault),
+    _buf(NULL),
+    _bufSize(0),
+    _entries(NULL),
+    _numEntries(0)
+  {}
+
+CEncoder::~CEncoder()
+{
+  ::BigFree(_buf);
+  ::MidFree(_entries);
+}
+
+
+STDMETHODIMP CEncoder::SetCoderProperties(const PROPID *propIDs, const PROPVARIANT *coderProps, UInt32 numProps)
+{
+  UInt32 windowSize = kWindowSizeDefault;
+  unsigned chunkBits = kChunkBitsDefault;
+  _reduceSize = (UInt64)(Int64)-1;
+
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    const PROPVARIANT &prop = coderProps[i];
+    PROPID propID = propIDs[i];
+    if (propID > NCoderPropID::kReduceSize)
+      continue;
+    if (propID == NCoderPropID::kReduceSize)
+    {
+      if (prop.vt == VT_UI8)
+        _reduceSize = prop.uhVal.QuadPart;
+      continue;
+    }
+    if (prop.vt != VT_UI4)
+      return E_INVALIDARG;
+    UInt32 v = (UInt32)prop.ulVal;
+    switch (propID)
+    {
+      case NCoderPropID::kDictionarySize:
+        if (v < kWindowSizeMin || v > kWindowSizeMax)
+          return E_INVALIDARG;
+        windowSize = v;
+        break;
+      case NCoderPropID::kBlockSize:
+      {
+        // average chunk size
+        unsigned k;
+        for (k = kChunkBitsMin; k <= kChunkBitsMax; k++)
+          if (((UInt32)1 << k) >= v)
+            break;
+        if (k > kChunkBitsMax)
+          return E_INVALIDARG;
+        chunkBits = k;
+        break;
+      }
+      case NCoderPropID::kNumThreads: break;
+      case NCoderPropID::kLevel: break;
+      default: return E_INVALIDARG;
+    }
+  }
+
+  _windowSizeProp = windowSize;
+  _chunkBits = chunkBits;
+
+  // the data in small stream can't be far
+  if (_reduceSize < windowSize)
+  {
+    windowSize = (UInt32)_reduceSize;
+    if (windowSize < kWindowSizeMin)
+      windowSize = kWindowSizeMin;
+  }
+  _windowSize = windowSize;
+  return S_OK;
+}
+
+
+STDMETHODIMP CEncoder::WriteCoderProperties(ISequentialOutStream *outStream)
+{
+  Byte props[kPropsSize];
+  props[0] = 0;
+  SetUi32(props + 1, _windowSize);
+  return WriteStream(outStream, props, kPropsSize);
+}
+
+
+/*
+  FastCDC normalized chunking:
+    no cut point before (minSize),
+    the stricter mask is used before (avgSize), and the easier mask after it.
+  The Gear hash is shifted left, so we use high bits that depend on last bytes.
+*/
+
+size_t CEncoder::FindChunkEnd(const Byte *p, size_t size) const
+{
+  const size_t avgSize = (size_t)1 << _chunkBits;
+  const size_t minSize = avgSize >> 2;
+  const size_t maxSize = avgSize << 3;
+
+  if (size <= minSize)
+    return size;
+  size_t normSize = avgSize;
+  size_t lim = maxSize;
+  if (lim > size)
+    lim = size;
+  if (normSize > lim)
+    normSize = lim;
+
+  const UInt64 maskS = (((UInt64)1 << (_chunkBits + 2)) - 1) << (64 - (_chunkBits + 2));
+  const UInt64 maskL = (((UInt64)1 << (_chunkBits - 2)) - 1) << (64 - (_chunkBits - 2));
+
+  UInt64 h = 0;
+  size_t i;
+  for (i = minSize; i < normSize; i++)
+  {
+    h = (h << 1) + g_Gear[p[i]];
+    if ((h & maskS) == 0)
+      return i + 1;
+  }
+  for (; i < lim; i++)
+  {
+    h = (h << 1) + g_Gear[p[i]];
+    if ((h & maskL) == 0)
+      return i + 1;
+  }
+  return lim;
+}
+
+
+static unsigned WriteNumber(Byte *p, UInt64 v)
+{
+  unsigned i = 0;
+  for (; v >= 0x80; v >>= 7)
+    p[i++] = (Byte)(v | 0x80);
+  p[i++] = (Byte)v;
+  return i;
+}
+
+HRESULT CEncoder::WriteToken(UInt64 v, const UInt64 *dist)
+{
+  Byte buf[24];
+  unsigned size = WriteNumber(buf, v);
+  if (dist)
+    size += WriteNumber(buf + size, *dist);
+  _outProcessed += size;
+  return WriteStream(_outStream, buf, size);
+}
+
+HRESULT CEncoder::WriteLiterals(const Byte *data, size_t size)
+{
+  if (size == 0)
+    return S_OK;
+  RINOK(WriteToken((UInt64)size << 1, NULL));
+  _outProcessed += size;
+  return WriteStream(_outStream, data, size);
+}
+
+
+HRESULT CEncoder::Alloc()
+{
+  const UInt32 windowSize = _windowSize;
+
+  // we keep (windowSize) bytes before current position and we read next block after it
+  const size_t chunkSizeMax = (size_t)1 << (_chunkBits + 3);
+  const size_t bufSize = (size_t)windowSize * 2 + chunkSizeMax;
+  if ((bufSize - chunkSizeMax) / 2 != windowSize)
+    return E_OUTOFMEMORY;
+  if (!_buf || _bufSize != bufSize)
+  {
+    ::BigFree(_buf);
+    _bufSize = 0;
+    _buf = (Byte *)::BigAlloc(bufSize);
+    if (!_buf)
+      return E_OUTOFMEMORY;
+    _bufSize = bufSize;
+  }
+
+  // about 2 entries per chunk of window
+  UInt32 numEntries = (UInt32)1 << 10;
+  while (numEntries < ((windowSize >> _chunkBits) << 1))
+    numEntries <<= 1;
+  if (!_entries || _numEntries != numEntries)
+  {
+    ::MidFree(_entries);
+    _numEntries = 0;
+    _entries = (CEntry *)::MidAlloc((size_t)numEntries * sizeof(CEntry));
+    if (!_entries)
+      return E_OUTOFMEMORY;
+    _numEntries = numEntries;
+  }
+  memset(_entries, 0, (size_t)numEntries * sizeof(CEntry));
+  return S_OK;
+}
+
+
+HRESULT CEncoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream, ICompressProgressInfo *progress)
+{
+  RINOK(Alloc());
+
+  _outStream = outStream;
+  _outProcessed = 0;
+
+  const size_t windowSize = _windowSize;
+  const size_t chunkSizeMax = (size_t)1 << (_chunkBits + 3);
+  const UInt32 bucketMask = (_numEntries - 1) & ~(UInt32)(kNumBucketEntries - 1);
+
+  Byte *buf = _buf;
+  UInt64 bufStartPos = 0; // stream position of buf[0]
+  size_t filled = 0;
+  size_t cur = 0;
+  bool wasFinished = false;
+
+  size_t litStart = 0;    // offset of pending literals in buf
+  size_t litSize = 0;
+  UInt64 refDist = 0;     // pending reference
+  UInt64 refSize = 0;
+
+  for (;;)
+  {
+    if (!wasFinished && filled - cur < chunkSizeMax)
+    {
+      if (filled == _bufSize)
+      {
+        RINOK(WriteLiterals(buf + litStart, litSize));
+        litSize = 0;
+        const size_t shift = cur - windowSize;
+        memmove(buf, buf + shift, filled - shift);
+        bufStartPos += shift;
+        filled -= shift;
+        cur -= shift;
+      }
+      size_t size = _bufSize - filled;
+      RINOK(ReadStream(inStream, buf + filled, &size));
+      if (size != _bufSize - filled)
+        wasFinished = true;
+      filled += size;
+      if (progress)
+      {
+        UInt64 inProcessed = bufStartPos + filled;
+        RINOK(progress->SetRatioInfo(&inProcessed, &_outProcessed));
+      }
+      continue;
+    }
+
+    if (cur == filled)
+      break;
+
+    const Byte *p = buf + cur;
+    const size_t size = FindChunkEnd(p, filled - cur);
+    const UInt32 hash = GetChunkHash(p, size);
+    const UInt64 pos = bufStartPos + cur;
+    CEntry *bucket = _entries + (hash & bucketMask);
+
+    CEntry *match = NULL;
+    CEntry *oldest = bucket;
+
+    for (unsigned i = 0; i < kNumBucketEntries; i++)
+    {
+      CEntry *e = bucket + i;
+      if (e->Len == size
+          && e->Hash == hash
+          && pos - e->Pos <= windowSize
+          && memcmp(buf + (size_t)(e->Pos - bufStartPos), p, size) == 0)
+      {
+        match = e;
+        break;
+      }
+      if (oldest->Len != 0 && (e->Len == 0 || e->Pos < oldest->Pos))
+        oldest = e;
+    }
+
+    if (match)
+    {
+      const UInt64 dist = pos - match->Pos;
+      if (litSize != 0)
+      {
+        RINOK(WriteLiterals(buf + litStart, litSize));
+        litSize = 0;
+      }
+      if (refSize != 0 && (dist != refDist || refSize + size > kItemSizeMax))
+      {
+        RINOK(WriteToken((refSize << 1) | 1, &refDist));
+        refSize = 0;
+      }
+      refDist = dist;
+      refSize += size;
+      // newer position stays in window longer
+      match->Pos = pos;
+    }
+    else
+    {
+      if (refSize != 0)
+      {
+        RINOK(WriteToken((refSize << 1) | 1, &refDist));
+        refSize = 0;
+      }
+      if (litSize != 0 && litSize + size > kItemSizeMax)
+      {
+        RINOK(WriteLiterals(buf + litStart, litSize));
+        litSize = 0;
+      }
+      if (litSize == 0)
+        litStart = cur;
+      litSize += size;
+      oldest->Pos = pos;
+      oldest->Hash = hash;
+      oldest->Len = (UInt32)size;
+    }
+
+    cur += size;
+  }
+
+  RINOK(WriteLiterals(buf + litStart, litSize));
+  if (refSize != 0)
+  {
+    RINOK(WriteToken((refSize << 1) | 1, &refDist));
+  }
+  return WriteToken(0, NULL);
+}
+
+
+STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    const UInt64 * /* inSize */, const UInt64 * /* outSize */, ICompressProgressInfo *progress)
+{
+  try { return CodeReal(inStream, outStream, progress); }
+  catch(...) { return E_OUTOFMEMORY; }
+}
+
+#endif
+
+
+STDMETHODIMP CDecoder::SetDecoderProperties2(const Byte *props, UInt32 size)
+{
+  if (size != kPropsSize || props[0] != 0)
+    return E_NOTIMPL;
+  UInt32 windowSize = GetUi32(props + 1);
+  if (windowSize < kWindowSizeMin || windowSize > kWindowSizeMax)
+    return E_NOTIMPL;
+  _windowSize = windowSize;
+  return S_OK;
+}
+
+
+bool CDecoder::ReadNumber(UInt64 &v)
+{
+  v = 0;
+  for (unsigned i = 0; i < 64; i += 7)
+  {
+    Byte b;
+    if (!_inStream.ReadByte(b))
+      return false;
+    v |= (UInt64)(b & 0x7F) << i;
+    if ((b & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+
+HRESULT CDecoder::CodeSpec(const UInt64 *outSize)
+{
+  UInt64 processed = 0;
+
+  for (;;)
+  {
+    UInt64 v;
+    if (!ReadNumber(v))
+      return S_FALSE;
+    if (v == 0)
+      break;
+
+    const UInt64 size = v >> 1;
+    // encoder doesn't write empty items, and CopyBlock() requires (len != 0)
+    if (size == 0 || size > kItemSizeMax)
+      return S_FALSE;
+    if (outSize && size > *outSize - processed)
+      return S_FALSE;
+
+    if (v & 1)
+    {
+      UInt64 dist;
+      if (!ReadNumber(dist))
+        return S_FALSE;
+      if (dist == 0 || dist > _windowSize || dist > processed)
+        return S_FALSE;
+      if (!_outWindow.CopyBlock((UInt32)dist - 1, (UInt32)size))
+        return S_FALSE;
+      processed += size;
+      continue;
+    }
+
+    // literals
+
+    UInt32 rem = (UInt32)size;
+    processed += rem;
+    while (rem != 0)
+    {
+      const Byte *src = _inStream.GetPtr();
+      size_t cur = _inStream.GetLim() - src;
+      const UInt32 pos = _outWindow.GetPos();
+      const UInt32 outRem = _outWindow.GetLimitPos() - pos - 1;
+      if (cur > outRem)
+        cur = outRem;
+      if (cur > rem)
+        cur = rem;
+      if (cur == 0)
+      {
+        Byte b;
+        if (!_inStream.ReadByte(b))
+          return S_FALSE;
+        _outWindow.PutByte(b);
+        rem--;
+        continue;
+      }
+      memcpy(_outWindow.GetBuf() + pos, src, cur);
+      _outWindow.SetPos(pos + (UInt32)cur);
+      _inStream.SetPtr(src + cur);
+      rem -= (UInt32)cur;
+    }
+  }
+
+  if (outSize && processed != *outSize)
+    return S_FALSE;
+  return S_OK;
+}
+
+
+HRESULT CDecoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    const UInt64 *outSize, ICompressProgressInfo * /* progress */)
+{
+  if (_windowSize == 0)
+    return E_INVALIDARG;
+
+  UInt32 windowSize = _windowSize;
+  if (outSize && *outSize < windowSize)
+  {
+    windowSize = (UInt32)*outSize;
+    if (windowSize < kWindowSizeMin)
+      windowSize = kWindowSizeMin;
+  }
+
+  if (!_inStream.Create(1 << 20))
+    return E_OUTOFMEMORY;
+  if (!_outWindow.Create(windowSize))
+    return E_OUTOFMEMORY;
+
+  _inStream.SetStream(inStream);
+  _inStream.Init();
+  _outWindow.SetStream(outStream);
+  _outWindow.Init(false);
+
+  HRESULT res = CodeSpec(outSize);
+  HRESULT res2 = _outWindow.Flush();
+  _inStream.SetStream(NULL);
+  _outWindow.SetStream(NULL);
+  return (res != S_OK) ? res : res2;
+}
+
+
+STDMETHODIMP CDecoder::Code(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    const UInt64 * /* inSize */, const UInt64 *outSize, ICompressProgressInfo *progress)
+{
+  try { return CodeReal(inStream, outStream, outSize, progress); }
+  catch(const CInBufferException &e) { return e.ErrorCode; }
+  catch(const CLzOutWindowException &e) { return e.ErrorCode; }
+  catch(...) { return S_FALSE; }
+}
+
+}}
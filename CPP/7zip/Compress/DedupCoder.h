@@ -0,0 +1,113 @@
+// DedupCoder.h
+
+#ifndef __COMPRESS_DEDUP_CODER_H
+#define __COMPRESS_DEDUP_CODER_H
+
+#include "../../Common/MyCom.h"
+
+#include "../ICoder.h"
+
+#include "../Common/InBuffer.h"
+
+#include "LzOutWindow.h"
+
+/*
+  Dedup is a preprocessing coder for long-range redundancy.
+  The encoder splits data to content-defined chunks (Gear rolling hash with
+  FastCDC normalized chunking) and replaces each chunk that is equal to
+  some previous chunk inside the window by reference to that chunk.
+  The output must be compressed by another method (LZMA2, for example).
+
+  Properties (5 bytes):
+    Byte    reserved (0)
+    UInt32  window size
+
+  Stream is sequence of items:
+    Number(len * 2)                 : (len) literal bytes follow
+    Number(len * 2 + 1), Number(dist) : copy (len) bytes from (dist) bytes back
+    Number(0)                       : end marker
+  Number is 7-bit little-endian variable length code.
+*/
+
+namespace NCompress {
+namespace NDedup {
+
+const unsigned kPropsSize = 5;
+
+const UInt32 kWindowSizeMin = (UInt32)1 << 16;
+const UInt32 kWindowSizeMax = (UInt32)1 << 31;
+
+#ifndef EXTRACT_ONLY
+
+class CEncoder:
+  public ICompressCoder,
+  public ICompressSetCoderProperties,
+  public ICompressWriteCoderProperties,
+  public CMyUnknownImp
+{
+  struct CEntry
+  {
+    UInt64 Pos;
+    UInt32 Hash;
+    UInt32 Len; // 0 for empty entry
+  };
+
+  UInt32 _windowSizeProp;
+  unsigned _chunkBits; // log2 of average chunk size
+  UInt64 _reduceSize;
+
+  UInt32 _windowSize;
+  Byte *_buf;
+  size_t _bufSize;
+  CEntry *_entries;
+  UInt32 _numEntries;
+
+  ISequentialOutStream *_outStream;
+  UInt64 _outProcessed;
+
+  size_t FindChunkEnd(const Byte *p, size_t size) const;
+  HRESULT WriteToken(UInt64 v, const UInt64 *dist);
+  HRESULT WriteLiterals(const Byte *data, size_t size);
+  HRESULT Alloc();
+  HRESULT CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream, ICompressProgressInfo *progress);
+public:
+  MY_UNKNOWN_IMP3(ICompressCoder, ICompressSetCoderProperties, ICompressWriteCoderProperties)
+
+  STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+      const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD(SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
+  STDMETHOD(WriteCoderProperties)(ISequentialOutStream *outStream);
+
+  CEncoder();
+  ~CEncoder();
+};
+
+#endif
+
+
+class CDecoder:
+  public ICompressCoder,
+  public ICompressSetDecoderProperties2,
+  public CMyUnknownImp
+{
+  CInBuffer _inStream;
+  CLzOutWindow _outWindow;
+  UInt32 _windowSize;
+
+  bool ReadNumber(UInt64 &v);
+  HRESULT CodeSpec(const UInt64 *outSize);
+  HRESULT CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+      const UInt64 *outSize, ICompressProgressInfo *progress);
+public:
+  MY_UNKNOWN_IMP2(ICompressCoder, ICompressSetDecoderProperties2)
+
+  STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+      const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD(SetDecoderProperties2)(const Byte *data, UInt32 size);
+
+  CDecoder(): _windowSize(0) {}
+};
+
+}}
+
+#endif
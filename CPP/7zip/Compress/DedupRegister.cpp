@@ -0,0 +1,24 @@
+// DedupRegister.cpp
+
+#include "StdAfx.h"
+
+#include "../Common/RegisterCodec.h"
+
+#include "DedupCoder.h"
+
+namespace NCompress {
+namespace NDedup {
+
+REGISTER_CODEC_CREATE(CreateDec, CDecoder)
+
+#ifndef EXTRACT_ONLY
+REGISTER_CODEC_CREATE(CreateEnc, CEncoder)
+#else
+#define CreateEnc NULL
+#endif
+
+// random ID: 3F (prefix), 62 E1 9C FC C7 (developer ID), 00 01 (method ID)
+
+REGISTER_CODEC_2(Dedup, CreateDec, CreateEnc, UINT64_CONST(0x3F62E19CFCC70001), "Dedup")
+
+}}
@@ -2,6 +2,8 @@
 
 #include "StdAfx.h"
 
+#include "../../../C/CpuArch.h"
+
 #include "DeflateDecoder.h"
 
 namespace NCompress {
@@ -13,6 +15,7 @@ CCoder::CCoder(bool deflate64Mode, bool deflateNSIS):
     _deflateNSIS(deflateNSIS),
     _keepHistory(false),
     _needFinishInput(false),
+    _stopAtBlockEnd(false),
     _needInitInStream(true),
     ZlibMode(false) {}
 
@@ -74,6 +77,117 @@ bool CCoder::DecodeLevels(Byte *levels, unsigned numSymbols)
   return true;
 }
 
+/*
+The entry of fast table:
+  bits  0..4  : the number of bits of Huffman code (or two codes for pair)
+  bits  5..9  : the number of direct bits after Huffman code
+  bits 10..11 : type of entry
+  bit  12     : (kFastPair) the entry contains two literals
+  bits 16..31 : literal (two literals) or start value of length or distance
+*/
+
+static const UInt32 kFastType_Lit   = 0 << 10;
+static const UInt32 kFastType_Match = 1 << 10;
+static const UInt32 kFastType_End   = 2 << 10;
+static const UInt32 kFastType_Slow  = 3 << 10; // long code or symbol that must be processed by main loop
+static const UInt32 kFastType_Mask  = 3 << 10;
+static const UInt32 kFastPair = 1 << 12;
+
+// DecodeFast() reads 8 bytes for each refill
+static const unsigned kFastInMargin = 8;
+// match copying can write up to 7 bytes after the end of match
+static const unsigned kFastOutMargin = kMatchMaxLen32 + 8;
+
+static void FillFastTable(UInt32 *table, unsigned numTableBits,
+    const Byte *levels, unsigned numSymbols, const UInt32 *symVals)
+{
+  const UInt32 tableSize = (UInt32)1 << numTableBits;
+  UInt32 i;
+  for (i = 0; i < tableSize; i++)
+    table[i] = kFastType_Slow;
+
+  UInt32 counts[kNumHuffmanBits + 1];
+  UInt32 codes[kNumHuffmanBits + 1];
+  unsigned len;
+  for (len = 0; len <= kNumHuffmanBits; len++)
+    counts[len] = 0;
+  unsigned sym;
+  for (sym = 0; sym < numSymbols; sym++)
+    counts[levels[sym]]++;
+  counts[0] = 0;
+  
+  UInt32 code = 0;
+  for (len = 1; len <= kNumHuffmanBits; len++)
+  {
+    code = (code + counts[len - 1]) << 1;
+    codes[len] = code;
+  }
+  
+  for (sym = 0; sym < numSymbols; sym++)
+  {
+    len = levels[sym];
+    if (len == 0)
+      continue;
+    code = codes[len]++;
+    if (len > numTableBits)
+      continue;
+    // Huffman codes are stored from the Most Significant Bit
+    UInt32 rev = 0;
+    for (unsigned k = 0; k < len; k++, code >>= 1)
+      rev = (rev << 1) | (code & 1);
+    for (i = rev; i < tableSize; i += (UInt32)1 << len)
+      table[i] = symVals[sym] | len;
+  }
+}
+
+void CCoder::BuildFastTables(const Byte *litLenLevels, const Byte *distLevels)
+{
+  UInt32 vals[kFixedMainTableSize];
+  unsigned i;
+  
+  for (i = 0; i < 0x100; i++)
+    vals[i] = (i << 16) | kFastType_Lit;
+  vals[kSymbolEndOfBlock] = kFastType_End;
+  for (i = 0; i < kFixedLenTableSize; i++)
+  {
+    UInt32 v = kFastType_Slow;
+    if (i < kNumLenSlots)
+    {
+      unsigned numBits = _deflate64Mode ? kLenDirectBits64[i] : kLenDirectBits32[i];
+      unsigned start = _deflate64Mode ? kLenStart64[i] : kLenStart32[i];
+      // the long matches of Deflate64 are processed by main loop
+      if (numBits <= 5)
+        v = ((UInt32)(start + kMatchMinLen) << 16) | (numBits << 5) | kFastType_Match;
+    }
+    vals[kSymbolMatch + i] = v;
+  }
+  FillFastTable(_fastMain, kFastMainTableBits, litLenLevels, kFixedMainTableSize, vals);
+
+  /* we join two literals, if the second code is also in table.
+     (i >> len) < i, so we process the entries from the end of table */
+  for (i = (1 << kFastMainTableBits); i != 0;)
+  {
+    i--;
+    const UInt32 e = _fastMain[i];
+    if ((e & kFastType_Mask) != kFastType_Lit)
+      continue;
+    const unsigned len = (unsigned)e & 0x1F;
+    const UInt32 e2 = _fastMain[i >> len];
+    if ((e2 & kFastType_Mask) != kFastType_Lit)
+      continue;
+    const unsigned len2 = (unsigned)e2 & 0x1F;
+    if (len + len2 > kFastMainTableBits)
+      continue;
+    _fastMain[i] = (e & ~(UInt32)0x1F) | ((e2 >> 16) << 24) | kFastPair | (len + len2);
+  }
+
+  for (i = 0; i < kFixedDistTableSize; i++)
+    vals[i] = (i < _numDistLevels) ?
+        ((kDistStart[i] << 16) | ((UInt32)kDistDirectBits[i] << 5) | kFastType_Match) :
+        kFastType_Slow;
+  FillFastTable(_fastDist, kFastDistTableBits, distLevels, kFixedDistTableSize, vals);
+}
+
 #define RIF(x) { if (!(x)) return false; }
 
 bool CCoder::ReadTables(void)
@@ -142,7 +256,206 @@ bool CCoder::ReadTables(void)
     memcpy(levels.distLevels, tmpLevels + numLitLenLevels, _numDistLevels);
   }
   RIF(m_MainDecoder.Build(levels.litLenLevels));
-  return m_DistDecoder.Build(levels.distLevels);
+  RIF(m_DistDecoder.Build(levels.distLevels));
+  BuildFastTables(levels.litLenLevels, levels.distLevels);
+  return true;
+}
+
+
+/* CFastBits is bit stream for Huffman decoders for long codes in DecodeFast().
+   It contains next kNumHuffmanBits bits from the Most Significant Bit. */
+
+struct CFastBits
+{
+  UInt32 Value;
+  unsigned NumBits;
+
+  CFastBits(UInt64 bits): NumBits(0)
+  {
+    Value = ((UInt32)NBitl::kInvertTable[(unsigned)bits & 0xFF] << (kNumHuffmanBits - 8))
+        | ((UInt32)NBitl::kInvertTable[(unsigned)(bits >> 8) & 0xFF] >> (16 - kNumHuffmanBits));
+  }
+  UInt32 GetValue(unsigned /* numBits */) const { return Value; }
+  void MovePos(unsigned numBits) { NumBits = numBits; }
+};
+
+#define FAST_REFILL \
+  bits |= GetUi64(in) << numBits; \
+  in += (63 - numBits) >> 3; \
+  numBits |= 56;
+
+#define FAST_SKIP(n) { bits >>= (n); numBits -= (n); }
+
+#define FAST_DIRECT(res, e) { \
+  const unsigned nb = (unsigned)(e) & 0x1F; FAST_SKIP(nb); \
+  const unsigned nd = (unsigned)((e) >> 5) & 0x1F; \
+  res = ((e) >> 16) + ((UInt32)bits & (((UInt32)1 << nd) - 1)); FAST_SKIP(nd); }
+
+/*
+DecodeFast() decodes the symbols of Huffman block, while there are enough bytes
+in input buffer and enough free space in window. It uses 64-bit bit buffer and
+it copies the matches with 8-byte words.
+It stops before symbol that must be processed by main loop in CodeSpec().
+*/
+
+HRESULT CCoder::DecodeFast(UInt32 &curSize)
+{
+  CInBuffer &inStream = m_InBitStream.GetStream();
+  const Byte *in = inStream.GetPtr();
+  const Byte *inLim = inStream.GetLim();
+  if ((size_t)(inLim - in) <= kFastInMargin)
+    return S_OK;
+  inLim -= kFastInMargin;
+
+  Byte * const buf = m_OutWindowStream.GetBuf();
+  const UInt32 bufSize = m_OutWindowStream.GetBufSize();
+  const bool overDict = m_OutWindowStream.IsOverDict();
+  UInt32 pos = m_OutWindowStream.GetPos();
+  UInt32 lim = m_OutWindowStream.GetLimitPos();
+  if (lim - pos > curSize)
+    lim = pos + curSize;
+  if (lim - pos <= kFastOutMargin)
+    return S_OK;
+  
+  Byte * const destStart = buf + pos;
+  Byte *dest = destStart;
+  const Byte * const destLim = buf + lim - kFastOutMargin;
+  const Byte * const inStart = in;
+
+  unsigned numBits;
+  UInt64 bits = m_InBitStream.GetNormalValue(numBits);
+  HRESULT res = S_OK;
+
+  while (in < inLim && dest < destLim)
+  {
+    FAST_REFILL
+    
+    UInt32 e = _fastMain[(UInt32)bits & ((1 << kFastMainTableBits) - 1)];
+    UInt32 len;
+    
+    if ((e & kFastType_Mask) == kFastType_Lit)
+    {
+      FAST_SKIP((unsigned)e & 0x1F);
+      *dest++ = (Byte)(e >> 16);
+      if (e & kFastPair)
+        *dest++ = (Byte)(e >> 24);
+      continue;
+    }
+    
+    if ((e & kFastType_Mask) == kFastType_Match)
+      FAST_DIRECT(len, e)
+    else if ((e & kFastType_Mask) == kFastType_End)
+    {
+      FAST_SKIP((unsigned)e & 0x1F);
+      _needReadTable = true;
+      break;
+    }
+    else
+    {
+      CFastBits fb(bits);
+      UInt32 sym = m_MainDecoder.Decode(&fb);
+      if (sym < 0x100)
+      {
+        FAST_SKIP(fb.NumBits);
+        *dest++ = (Byte)sym;
+        continue;
+      }
+      if (sym == kSymbolEndOfBlock)
+      {
+        FAST_SKIP(fb.NumBits);
+        _needReadTable = true;
+        break;
+      }
+      sym -= kSymbolMatch;
+      if (sym >= kNumLenSlots)
+        break;
+      const unsigned nd = _deflate64Mode ? kLenDirectBits64[sym] : kLenDirectBits32[sym];
+      if (nd > 5)
+        break;
+      FAST_SKIP(fb.NumBits);
+      len = (_deflate64Mode ? kLenStart64[sym] : kLenStart32[sym]) + kMatchMinLen
+          + ((UInt32)bits & (((UInt32)1 << nd) - 1));
+      FAST_SKIP(nd);
+    }
+
+    UInt32 distance;
+    e = _fastDist[(UInt32)bits & ((1 << kFastDistTableBits) - 1)];
+    if ((e & kFastType_Mask) != kFastType_Slow)
+      FAST_DIRECT(distance, e)
+    else
+    {
+      CFastBits fb(bits);
+      const UInt32 sym = m_DistDecoder.Decode(&fb);
+      if (sym >= _numDistLevels)
+      {
+        res = S_FALSE;
+        break;
+      }
+      FAST_SKIP(fb.NumBits);
+      const unsigned nd = kDistDirectBits[sym];
+      distance = kDistStart[sym] + ((UInt32)bits & (((UInt32)1 << nd) - 1));
+      FAST_SKIP(nd);
+    }
+
+    pos = (UInt32)(dest - buf);
+    if (distance < pos)
+    {
+      const Byte *src = dest - distance - 1;
+      Byte *end = dest + len;
+      if (distance >= 7)
+      {
+        do
+        {
+          SetUi64(dest, GetUi64(src));
+          dest += 8;
+          src += 8;
+        }
+        while (dest < end);
+      }
+      else if (distance == 0)
+        memset(dest, *src, len);
+      else
+      {
+        do
+          *dest++ = *src++;
+        while (dest != end);
+      }
+      dest = end;
+    }
+    else
+    {
+      if (!overDict)
+      {
+        res = S_FALSE;
+        break;
+      }
+      UInt32 srcPos = pos + bufSize - distance - 1;
+      do
+      {
+        *dest++ = buf[srcPos];
+        if (++srcPos == bufSize)
+          srcPos = 0;
+      }
+      while (--len != 0);
+    }
+  }
+
+  /* we return to the stream the bytes that were read in this function,
+     but were not consumed. Then there are no more than 32 bits in (bits). */
+  {
+    size_t numBytes = numBits >> 3;
+    const size_t numRead = (size_t)(in - inStart);
+    if (numBytes > numRead)
+      numBytes = numRead;
+    in -= numBytes;
+    numBits -= (unsigned)numBytes << 3;
+    inStream.SetPtr(in);
+    m_InBitStream.SetNormalValue((UInt32)(bits & (((UInt64)1 << numBits) - 1)), numBits);
+  }
+
+  curSize -= (UInt32)(dest - destStart);
+  m_OutWindowStream.SetPos((UInt32)(dest - buf));
+  return res;
 }
 
 HRESULT CCoder::CodeSpec(UInt32 curSize, bool finishInputStream)
@@ -151,8 +464,10 @@ HRESULT CCoder::CodeSpec(UInt32 curSize, bool finishInputStream)
     return S_OK;
   if (_remainLen == kLenIdNeedInit)
   {
+    /* The window is larger than history.
+       So DecodeFast() can write some bytes after the end of match. */
     if (!_keepHistory)
-      if (!m_OutWindowStream.Create(_deflate64Mode ? kHistorySize64: kHistorySize32))
+      if (!m_OutWindowStream.Create((_deflate64Mode ? kHistorySize64: kHistorySize32) << 2))
         return E_OUTOFMEMORY;
     RINOK(InitInStream(_needInitInStream));
     m_OutWindowStream.Init(_keepHistory);
@@ -199,6 +514,8 @@ HRESULT CCoder::CodeSpec(UInt32 curSize, bool finishInputStream)
       for (; m_StoredBlockSize > 0 && curSize > 0; m_StoredBlockSize--, curSize--)
         m_OutWindowStream.PutByte(m_InBitStream.ReadDirectByte());
       _needReadTable = (m_StoredBlockSize == 0);
+      if (_needReadTable && _stopAtBlockEnd)
+        break;
       continue;
     }
     
@@ -207,6 +524,10 @@ HRESULT CCoder::CodeSpec(UInt32 curSize, bool finishInputStream)
       if (m_InBitStream.ExtraBitsWereRead_Fast())
         return S_FALSE;
 
+      RINOK(DecodeFast(curSize));
+      if (_needReadTable || curSize == 0)
+        break;
+
       UInt32 sym = m_MainDecoder.Decode(&m_InBitStream);
 
       if (sym < 0x100)
@@ -266,6 +587,9 @@ HRESULT CCoder::CodeSpec(UInt32 curSize, bool finishInputStream)
         return S_FALSE;
       _needReadTable = true;
     }
+
+    if (_needReadTable && _stopAtBlockEnd)
+      break;
   }
 
   if (m_InBitStream.ExtraBitsWereRead())
@@ -354,6 +678,37 @@ HRESULT CCoder::Code(ISequentialInStream *inStream, ISequentialOutStream *outStr
   return res;
 }
 
+STDMETHODIMP CCoder::DecodeBuf(const Byte *inBuf, size_t *inSize, Byte *outBuf, size_t *outSize)
+{
+  const size_t size = *outSize;
+  const size_t packSize = *inSize;
+  *inSize = 0;
+  *outSize = 0;
+  if (_keepHistory || size == 0 || size > ((UInt32)1 << 31))
+    return E_NOTIMPL;
+  
+  HRESULT res;
+  DEFLATE_TRY_BEGIN
+  /* (outBuf) is the window for all output data,
+     so all matches are copied directly in (outBuf). */
+  m_InBitStream.InitMem(inBuf, packSize);
+  m_OutWindowStream.InitMem(outBuf, (UInt32)size);
+  m_FinalBlock = false;
+  _needReadTable = true;
+  _remainLen = 0;
+  res = CodeSpec((UInt32)size, _needFinishInput);
+  if (res == S_OK && InputEofError())
+    res = S_FALSE;
+  *outSize = (size_t)m_OutWindowStream.GetProcessedSize();
+  *inSize = (size_t)m_InBitStream.GetProcessedSize();
+  DEFLATE_TRY_END(res)
+  
+  // the stream version of decoder must reinit own buffers
+  _remainLen = kLenIdNeedInit;
+  _needInitInStream = true;
+  return res;
+}
+
 STDMETHODIMP CCoder::GetInStreamProcessedSize(UInt64 *value)
 {
   if (!value)
@@ -407,6 +762,52 @@ STDMETHODIMP CCoder::Read(void *data, UInt32 size, UInt32 *processedSize)
 
 #endif
 
+UInt32 CCoder::GetHistory(Byte *dest, UInt32 maxSize) const
+{
+  const Byte *buf = m_OutWindowStream.GetBuf();
+  const UInt32 pos = m_OutWindowStream.GetPos();
+  UInt32 size = pos;
+  if (m_OutWindowStream.IsOverDict())
+    size = m_OutWindowStream.GetBufSize();
+  if (size > maxSize)
+    size = maxSize;
+  if (size <= pos)
+    memcpy(dest, buf + pos - size, size);
+  else
+  {
+    const UInt32 rem = size - pos;
+    memcpy(dest, buf + m_OutWindowStream.GetBufSize() - rem, rem);
+    memcpy(dest + rem, buf, pos);
+  }
+  return size;
+}
+
+HRESULT CCoder::InitAtBlockStart(const Byte *history, UInt32 historySize, unsigned numSkipBits)
+{
+  if (_keepHistory || historySize > (_deflate64Mode ? kHistorySize64: kHistorySize32))
+    return E_NOTIMPL;
+  if (!m_OutWindowStream.Create((_deflate64Mode ? kHistorySize64: kHistorySize32) << 2))
+    return E_OUTOFMEMORY;
+  RINOK(InitInStream(true));
+  
+  HRESULT res;
+  DEFLATE_TRY_BEGIN
+  // the history bytes are placed to window, but they are not written to output
+  m_OutWindowStream.SetStream(NULL);
+  m_OutWindowStream.SetMemStream(NULL);
+  m_OutWindowStream.Init(false);
+  for (UInt32 i = 0; i < historySize; i++)
+    m_OutWindowStream.PutByte(history[i]);
+  res = Flush();
+  m_InBitStream.ReadBits(numSkipBits);
+  DEFLATE_TRY_END(res)
+  
+  m_FinalBlock = false;
+  _needReadTable = true;
+  _remainLen = 0;
+  return res;
+}
+
 STDMETHODIMP CCoder::CodeResume(ISequentialOutStream *outStream, const UInt64 *outSize, ICompressProgressInfo *progress)
 {
   _remainLen = kLenIdNeedInit;
@@ -21,9 +21,13 @@ namespace NDecoder {
 const int kLenIdFinished = -1;
 const int kLenIdNeedInit = -2;
 
+const unsigned kFastMainTableBits = 10;
+const unsigned kFastDistTableBits = 8;
+
 class CCoder:
   public ICompressCoder,
   public ICompressGetInStreamProcessedSize,
+  public ICompressDecodeBuf,
   #ifndef NO_READ_FROM_CODER
   public ICompressSetInStream,
   public ICompressSetOutStreamSize,
@@ -48,16 +52,23 @@ class CCoder:
   bool _deflate64Mode;
   bool _keepHistory;
   bool _needFinishInput;
+  bool _stopAtBlockEnd;
   
   bool _needInitInStream;
   bool _needReadTable;
   Int32 _remainLen;
   UInt32 _rep0;
 
+  // tables for fast loop. They are indexed by next bits of stream (LSB first)
+  UInt32 _fastMain[1 << kFastMainTableBits];
+  UInt32 _fastDist[1 << kFastDistTableBits];
+
   UInt32 ReadBits(unsigned numBits);
 
   bool DecodeLevels(Byte *levels, unsigned numSymbols);
+  void BuildFastTables(const Byte *litLenLevels, const Byte *distLevels);
   bool ReadTables();
+  HRESULT DecodeFast(UInt32 &curSize);
   
   HRESULT Flush() { return m_OutWindowStream.Flush(); }
   class CCoderReleaser
@@ -84,30 +95,39 @@ public:
 
   void Set_KeepHistory(bool keepHistory) { _keepHistory = keepHistory; }
   void Set_NeedFinishInput(bool needFinishInput) { _needFinishInput = needFinishInput; }
+  
+  /* if (stopAtBlockEnd) is set, Read() returns after the end of each block.
+     So the caller can save the state for random access with InitAtBlockStart(). */
+  void Set_StopAtBlockEnd(bool stopAtBlockEnd) { _stopAtBlockEnd = stopAtBlockEnd; }
 
   bool IsFinished() const { return _remainLen == kLenIdFinished;; }
   bool IsFinalBlock() const { return m_FinalBlock; }
+  bool IsAtBlockStart() const { return _remainLen == 0 && _needReadTable && !m_FinalBlock; }
 
   HRESULT CodeReal(ISequentialOutStream *outStream,
       const UInt64 *outSize, ICompressProgressInfo *progress);
 
   #ifndef NO_READ_FROM_CODER
-  MY_UNKNOWN_IMP5(
+  MY_UNKNOWN_IMP6(
       ICompressCoder,
       ICompressGetInStreamProcessedSize,
+      ICompressDecodeBuf,
       ICompressSetInStream,
       ICompressSetOutStreamSize,
       ISequentialInStream
       )
   #else
-  MY_UNKNOWN_IMP2(
+  MY_UNKNOWN_IMP3(
       ICompressCoder,
-      ICompressGetInStreamProcessedSize)
+      ICompressGetInStreamProcessedSize,
+      ICompressDecodeBuf)
   #endif
 
   STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
       const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
 
+  STDMETHOD(DecodeBuf)(const Byte *inBuf, size_t *inSize, Byte *outBuf, size_t *outSize);
+
   STDMETHOD(SetInStream)(ISequentialInStream *inStream);
   STDMETHOD(ReleaseInStream)();
   STDMETHOD(SetOutStreamSize)(const UInt64 *outSize);
@@ -141,6 +161,23 @@ public:
 
   UInt64 GetStreamSize() const { return m_InBitStream.GetStreamSize(); }
   UInt64 GetInputProcessedSize() const { return m_InBitStream.GetProcessedSize(); }
+  UInt64 GetInputProcessedBits() const { return m_InBitStream.GetProcessedBits(); }
+
+  // it copies up to (maxSize) latest unpacked bytes that can be used as history
+  UInt32 GetHistory(Byte *dest, UInt32 maxSize) const;
+  
+  /* InitAtBlockStart() prepares the decoder to continue decoding from the start of some block.
+     The input stream must be positioned at the byte that contains the first bit of that block.
+     (numSkipBits) low bits of that byte are skipped.
+     (history) is the data that was unpacked before that block. */
+  HRESULT InitAtBlockStart(const Byte *history, UInt32 historySize, unsigned numSkipBits);
+
+  // it prepares the decoder for next deflate stream that follows in same input stream
+  void InitForNextStream()
+  {
+    _remainLen = kLenIdNeedInit;
+    m_OutWindowStream.Init(_keepHistory);
+  }
 
   // IGetInStreamProcessedSize
   STDMETHOD(GetInStreamProcessedSize)(UInt64 *value);
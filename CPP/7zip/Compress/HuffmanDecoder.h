@@ -11,6 +11,7 @@ namespace NHuffman {
 template <unsigned kNumBitsMax, UInt32 m_NumSymbols, unsigned kNumTableBits = 9>
 class CDecoder
 {
+protected:
   UInt32 _limits[kNumBitsMax + 2];
   UInt32 _poses[kNumBitsMax + 1];
   UInt16 _lens[1 << kNumTableBits];
@@ -175,6 +176,85 @@ public:
 
 
 
+/*
+CDecoderMulti can return two symbols per one table lookup.
+If the code of some symbol (sym < kNumPairSymbols) is followed by the code of
+another such symbol, and both codes fit into kNumTableBits bits, DecodeMulti()
+returns (kPairFlag | sym | (sym2 << 8)). It's useful for literal-heavy streams.
+Other symbols are returned as in CDecoder::Decode().
+*/
+
+const UInt32 kPairFlag = (UInt32)1 << 16;
+
+#define HUFFMAN_IS_PAIR(sym) (((sym) >> 16) == 1)
+
+template <unsigned kNumBitsMax, UInt32 m_NumSymbols, unsigned kNumTableBits = 10, UInt32 kNumPairSymbols = 256>
+class CDecoderMulti: public CDecoder<kNumBitsMax, m_NumSymbols, kNumTableBits>
+{
+  UInt32 _pairs[1 << kNumTableBits];
+
+  void BuildPairs() throw()
+  {
+    const UInt32 kTableMask = ((UInt32)1 << kNumTableBits) - 1;
+    const UInt32 numItems = this->_limits[kNumTableBits] >> (kNumBitsMax - kNumTableBits);
+    
+    for (UInt32 i = 0; i < numItems; i++)
+    {
+      UInt32 pair = this->_lens[i];
+      unsigned len = (unsigned)(pair & 0xF);
+      UInt32 sym = pair >> 4;
+      if (sym < kNumPairSymbols)
+      {
+        // the index of second code, if unknown low bits are zeros
+        UInt32 i2 = (i << len) & kTableMask;
+        if (i2 < numItems)
+        {
+          UInt32 pair2 = this->_lens[i2];
+          unsigned len2 = (unsigned)(pair2 & 0xF);
+          UInt32 sym2 = pair2 >> 4;
+          if (sym2 < kNumPairSymbols && len + len2 <= kNumTableBits)
+            pair = ((kPairFlag | sym | (sym2 << 8)) << 4) | (len + len2);
+        }
+      }
+      _pairs[i] = pair;
+    }
+  }
+
+public:
+  bool Build(const Byte *lens) throw()
+  {
+    if (!CDecoder<kNumBitsMax, m_NumSymbols, kNumTableBits>::Build(lens))
+      return false;
+    BuildPairs();
+    return true;
+  }
+
+  template <class TBitDecoder>
+  UInt32 DecodeMulti(TBitDecoder *bitStream) const throw()
+  {
+    UInt32 val = bitStream->GetValue(kNumBitsMax);
+    
+    if (val < this->_limits[kNumTableBits])
+    {
+      UInt32 pair = _pairs[val >> (kNumBitsMax - kNumTableBits)];
+      bitStream->MovePos((unsigned)(pair & 0xF));
+      return pair >> 4;
+    }
+
+    unsigned numBits;
+    for (numBits = kNumTableBits + 1; val >= this->_limits[numBits]; numBits++);
+    
+    if (numBits > kNumBitsMax)
+      return 0xFFFFFFFF;
+
+    bitStream->MovePos(numBits);
+    UInt32 index = this->_poses[numBits] + ((val - this->_limits[numBits - 1]) >> (kNumBitsMax - numBits));
+    return this->_symbols[index];
+  }
+};
+
+
+
 template <UInt32 m_NumSymbols>
 class CDecoder7b
 {
@@ -13,6 +13,15 @@ class CLzOutWindow: public COutBuffer
 {
 public:
   void Init(bool solid = false) throw();
+
+  // direct access to window for the decoders with fast loops.
+  // The caller must not write at (_limitPos) or after it.
+  Byte *GetBuf() const { return _buf; }
+  UInt32 GetBufSize() const { return _bufSize; }
+  UInt32 GetPos() const { return _pos; }
+  UInt32 GetLimitPos() const { return _limitPos; }
+  bool IsOverDict() const { return _overDict; }
+  void SetPos(UInt32 pos) { _pos = pos; }
   
   // distance >= 0, len > 0,
   bool CopyBlock(UInt32 distance, UInt32 len)
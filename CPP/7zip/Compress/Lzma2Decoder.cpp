@@ -195,6 +195,38 @@ STDMETHODIMP CDecoder::Code(ISequentialInStream *inStream,
   return res2;
 }
 
+STDMETHODIMP CDecoder::DecodeBuf(const Byte *inBuf, size_t *inSize, Byte *outBuf, size_t *outSize)
+{
+  const SizeT size = *outSize;
+  SizeT inProcessed = *inSize;
+  *inSize = 0;
+  *outSize = 0;
+  if (!_inBuf)
+    return S_FALSE;
+
+  /* we use the probabilities of main decoder,
+     and (outBuf) is used as dictionary. Code() reinits (_state) later. */
+  CLzma2Dec p = _state;
+  p.decoder.dic = outBuf;
+  p.decoder.dicBufSize = size;
+  Lzma2Dec_Init(&p);
+
+  ELzmaStatus status;
+  SRes res = Lzma2Dec_DecodeToDic(&p, size, inBuf, &inProcessed,
+      _finishMode ? LZMA_FINISH_END : LZMA_FINISH_ANY, &status);
+  
+  *inSize = inProcessed;
+  *outSize = p.decoder.dicPos;
+  _inSizeProcessed = inProcessed;
+  _outSizeProcessed = p.decoder.dicPos;
+  
+  if (res != SZ_OK)
+    return SResToHRESULT(res);
+  if (_finishMode && status != LZMA_STATUS_FINISHED_WITH_MARK)
+    return S_FALSE;
+  return S_OK;
+}
+
 #ifndef NO_READ_FROM_CODER
 
 STDMETHODIMP CDecoder::Read(void *data, UInt32 size, UInt32 *processedSize)
@@ -181,6 +181,41 @@ STDMETHODIMP CDecoder::Code(ISequentialInStream *inStream, ISequentialOutStream
   return CodeSpec(inStream, outStream, progress);
 }
 
+STDMETHODIMP CDecoder::DecodeBuf(const Byte *inBuf, size_t *inSize, Byte *outBuf, size_t *outSize)
+{
+  const SizeT size = *outSize;
+  SizeT inProcessed = *inSize;
+  *inSize = 0;
+  *outSize = 0;
+  if (!_propsWereSet)
+    return S_FALSE;
+
+  /* we use the probabilities of main decoder,
+     and (outBuf) is used as dictionary. Code() reinits (_state) later. */
+  CLzmaDec p = _state;
+  p.dic = outBuf;
+  p.dicBufSize = size;
+  LzmaDec_Init(&p);
+  
+  ELzmaStatus status;
+  SRes res = LzmaDec_DecodeToDic(&p, size, inBuf, &inProcessed,
+      FinishStream ? LZMA_FINISH_END : LZMA_FINISH_ANY, &status);
+  
+  *inSize = inProcessed;
+  *outSize = p.dicPos;
+  _inSizeProcessed = inProcessed;
+  _outSizeProcessed = p.dicPos;
+  NeedMoreInput = (status == LZMA_STATUS_NEEDS_MORE_INPUT);
+  
+  if (res != SZ_OK)
+    return SResToHRESULT(res);
+  if (FinishStream &&
+        status != LZMA_STATUS_FINISHED_WITH_MARK &&
+        status != LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK)
+    return S_FALSE;
+  return S_OK;
+}
+
 #ifndef NO_READ_FROM_CODER
 
 STDMETHODIMP CDecoder::SetInStream(ISequentialInStream *inStream) { _inStream = inStream; return S_OK; }
@@ -16,6 +16,7 @@ class CDecoder:
   public ICompressSetDecoderProperties2,
   public ICompressSetFinishMode,
   public ICompressSetBufSize,
+  public ICompressDecodeBuf,
   #ifndef NO_READ_FROM_CODER
   public ICompressSetInStream,
   public ICompressSetOutStreamSize,
@@ -48,6 +49,7 @@ public:
   MY_QUERYINTERFACE_ENTRY(ICompressSetDecoderProperties2)
   MY_QUERYINTERFACE_ENTRY(ICompressSetFinishMode)
   MY_QUERYINTERFACE_ENTRY(ICompressSetBufSize)
+  MY_QUERYINTERFACE_ENTRY(ICompressDecodeBuf)
   #ifndef NO_READ_FROM_CODER
   MY_QUERYINTERFACE_ENTRY(ICompressSetInStream)
   MY_QUERYINTERFACE_ENTRY(ICompressSetOutStreamSize)
@@ -63,6 +65,7 @@ public:
   STDMETHOD(SetOutStreamSize)(const UInt64 *outSize);
   STDMETHOD(SetInBufSize)(UInt32 streamIndex, UInt32 size);
   STDMETHOD(SetOutBufSize)(UInt32 streamIndex, UInt32 size);
+  STDMETHOD(DecodeBuf)(const Byte *inBuf, size_t *inSize, Byte *outBuf, size_t *outSize);
 
   #ifndef NO_READ_FROM_CODER
   
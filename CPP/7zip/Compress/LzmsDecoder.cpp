@@ -10,9 +10,9 @@
 namespace NCompress {
 namespace NLzms {
 
-static UInt32 g_PosBases[k_NumPosSyms /* + 1 */];
+UInt32 g_PosBases[k_NumPosSyms /* + 1 */];
 
-static Byte g_PosDirectBits[k_NumPosSyms];
+Byte g_PosDirectBits[k_NumPosSyms];
 
 static const Byte k_PosRuns[31] =
 {
@@ -20,9 +20,9 @@ static const Byte k_PosRuns[31] =
   80, 85, 95, 105, 6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1
 };
 
-static UInt32 g_LenBases[k_NumLenSyms];
+UInt32 g_LenBases[k_NumLenSyms];
 
-static const Byte k_LenDirectBits[k_NumLenSyms] =
+const Byte k_LenDirectBits[k_NumLenSyms] =
 {
   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2,
@@ -64,7 +64,7 @@ static struct CInit
   }
 } g_Init;
 
-static unsigned GetNumPosSlots(size_t size)
+unsigned GetNumPosSlots(size_t size)
 {
   if (size < 2)
     return 0;
@@ -91,9 +91,7 @@ static unsigned GetNumPosSlots(size_t size)
 static const Int32 k_x86_WindowSize = 65535;
 static const Int32 k_x86_TransOffset = 1023;
 
-static const size_t k_x86_HistorySize = (1 << 16);
-
-static void x86_Filter(Byte *data, UInt32 size, Int32 *history)
+void x86_Filter(Byte *data, UInt32 size, Int32 *history, bool encoding)
 {
   if (size <= 17)
     return;
@@ -202,8 +200,15 @@ static void x86_Filter(Byte *data, UInt32 size, Int32 *history)
       UInt32 n = GetUi32(p2);
       if (i - last_x86_pos <= maxTransOffset)
       {
-        n -= i;
-        SetUi32(p2, n);
+        if (encoding)
+        {
+          SetUi32(p2, n + i);
+        }
+        else
+        {
+          n -= i;
+          SetUi32(p2, n);
+        }
       }
       target = history + (((UInt32)i + n) & 0xFFFF);
     }
@@ -569,7 +574,7 @@ HRESULT CDecoder::Code(const Byte *in, size_t inSize, Byte *out, size_t outSize)
     res = CodeReal(in, inSize, out, outSize);
   }
   // catch (...) { res = S_FALSE; }
-  x86_Filter(out, (UInt32)_pos, _x86_history);
+  x86_Filter(out, (UInt32)_pos, _x86_history, false);
   return res;
 }
 
@@ -90,6 +90,18 @@ const unsigned k_NumRepProbs   = 64;
 
 const unsigned k_NumHuffmanBits = 15;
 
+extern UInt32 g_PosBases[k_NumPosSyms];
+extern Byte g_PosDirectBits[k_NumPosSyms];
+extern UInt32 g_LenBases[k_NumLenSyms];
+extern const Byte k_LenDirectBits[k_NumLenSyms];
+
+unsigned GetNumPosSlots(size_t size);
+
+const size_t k_x86_HistorySize = (1 << 16);
+
+// (history) must contain k_x86_HistorySize items
+void x86_Filter(Byte *data, UInt32 size, Int32 *history, bool encoding);
+
 template <UInt32 m_NumSyms, UInt32 m_RebuildFreq, unsigned numTableBits>
 class CHuffDecoder: public NCompress::NHuffman::CDecoder<k_NumHuffmanBits, m_NumSyms, numTableBits>
 {
@@ -0,0 +1,419 @@
+// LzmsEncoder.cpp
+
+#include "StdAfx.h"
+
+#include <string.h>
+
+#include "../../../C/Alloc.h"
+
+#include "LzmsEncoder.h"
+
+namespace NCompress {
+namespace NLzms {
+
+static const UInt32 kMatchMinLen = 3;
+static const UInt32 kChunkSizeMax = (UInt32)1 << 30;
+
+// we check next position only for short matches
+static const UInt32 kLazyLenMax = 32;
+
+void CRangeEncoder::Init(Byte *data, size_t size)
+{
+  _low = 0;
+  _range = 0xFFFFFFFF;
+  _cache = 0;
+  _cacheSize = 1;
+  // the decoder reads 32-bit code at start. So first word of 48-bit encoder window is skipped.
+  _isFirstWord = true;
+  _cur = data;
+  _lim = data + size;
+  Overflow = false;
+}
+
+void CRangeEncoder::ShiftLow()
+{
+  if ((UInt32)_low < (UInt32)0xFFFF0000 || (unsigned)(_low >> 32) != 0)
+  {
+    UInt32 temp = _cache;
+    do
+    {
+      WriteWord(temp + (UInt32)(_low >> 32));
+      temp = 0xFFFF;
+    }
+    while (--_cacheSize != 0);
+    _cache = (UInt32)(_low >> 16) & 0xFFFF;
+  }
+  _cacheSize++;
+  _low = (UInt32)_low << 16;
+}
+
+void CRangeEncoder::Encode(UInt32 *state, UInt32 numStates, CProbEntry *probs, unsigned bit)
+{
+  UInt32 st = *state;
+  CProbEntry *entry = &probs[st];
+  *state = ((st << 1) & (numStates - 1)) | bit;
+
+  UInt32 prob = entry->GetProb();
+
+  if (_range <= 0xFFFF)
+  {
+    _range <<= 16;
+    ShiftLow();
+  }
+
+  UInt32 bound = (_range >> k_NumProbBits) * prob;
+
+  if (bit == 0)
+    _range = bound;
+  else
+  {
+    _low += bound;
+    _range -= bound;
+  }
+  entry->Update(bit);
+}
+
+void CRangeEncoder::Flush()
+{
+  // the decoder can read one additional word in final normalization
+  for (unsigned i = 0; i < 4; i++)
+    ShiftLow();
+}
+
+
+void CBitEncoder::WriteBits(UInt32 val, unsigned numBits)
+{
+  if (numBits > 16)
+  {
+    numBits -= 16;
+    WriteBits(val >> 16, numBits);
+    val &= 0xFFFF;
+    numBits = 16;
+  }
+  _value = (_value << numBits) | val;
+  _bitPos += numBits;
+  while (_bitPos >= 8)
+  {
+    _bitPos -= 8;
+    if (_cur == _lim)
+    {
+      Overflow = true;
+      return;
+    }
+    *_cur++ = (Byte)(_value >> _bitPos);
+  }
+}
+
+void CBitEncoder::Flush()
+{
+  if (_bitPos != 0)
+    WriteBits(0, 8 - _bitPos);
+}
+
+
+static unsigned GetSlot(const UInt32 *bases, unsigned num, UInt32 v)
+{
+  unsigned left = 0;
+  unsigned right = num;
+  while (right - left > 1)
+  {
+    unsigned m = (left + right) / 2;
+    if (v >= bases[m])
+      left = m;
+    else
+      right = m;
+  }
+  return left;
+}
+
+
+CEncoder::CEncoder():
+    _mfSize(0),
+    _buf(NULL),
+    _bufSize(0),
+    _bitsBuf(NULL),
+    _bitsBufSize(0),
+    _x86_history(NULL)
+{
+  MatchFinder_Construct(&_mf);
+}
+
+CEncoder::~CEncoder()
+{
+  MatchFinder_Free(&_mf, &g_BigAlloc);
+  ::MidFree(_buf);
+  ::MidFree(_bitsBuf);
+  ::MidFree(_x86_history);
+}
+
+UInt32 CEncoder::GetMatch(const Byte *cur, UInt32 rem, UInt32 &dist)
+{
+  UInt32 num = _mfVt.GetMatches(&_mf, _dists);
+  if (num == 0)
+    return 0;
+  UInt32 len = _dists[num - 2];
+  dist = _dists[num - 1] + 1;
+  if (len == kNumFastBytes)
+  {
+    const Byte *src = cur - dist;
+    while (len < rem && cur[len] == src[len])
+      len++;
+  }
+  return len;
+}
+
+UInt32 CEncoder::GetRepMatch(const Byte *cur, UInt32 pos, UInt32 rem, unsigned prevType, unsigned &repIndex) const
+{
+  // after LZ match the decoder doesn't use last distance as rep0
+  const unsigned offset = (prevType == 1 ? 1 : 0);
+  UInt32 best = 0;
+  for (unsigned i = 0; i < k_NumReps; i++)
+  {
+    const UInt32 dist = _reps[i + offset];
+    if (dist > pos)
+      continue;
+    const Byte *src = cur - dist;
+    UInt32 len = 0;
+    while (len < rem && cur[len] == src[len])
+      len++;
+    if (len > best)
+    {
+      best = len;
+      repIndex = i;
+    }
+  }
+  return best;
+}
+
+void CEncoder::GetBestMatch(const Byte *data, UInt32 pos, UInt32 size, unsigned prevType, CMatch &m)
+{
+  const Byte *cur = data + pos;
+  const UInt32 rem = size - pos;
+  UInt32 mainDist = 0;
+  UInt32 mainLen = GetMatch(cur, rem, mainDist);
+  // short match with big distance is not better than literals
+  if (mainLen == kMatchMinLen && mainDist > (1 << 14))
+    mainLen = 0;
+  unsigned repIndex = 0;
+  UInt32 repLen = GetRepMatch(cur, pos, rem, prevType, repIndex);
+  m.Len = 0;
+  if (repLen >= 2 && repLen + 1 >= mainLen)
+  {
+    m.Len = repLen;
+    m.Dist = _reps[repIndex + (prevType == 1 ? 1 : 0)];
+    m.RepIndex = (int)repIndex;
+  }
+  else if (mainLen >= kMatchMinLen)
+  {
+    m.Len = mainLen;
+    m.Dist = mainDist;
+    m.RepIndex = -1;
+  }
+}
+
+
+// it must be synchronized with initialization code in CDecoder::CodeReal()
+
+void CEncoder::InitState(size_t size)
+{
+  unsigned i;
+  for (i = 0; i < k_NumReps + 1; i++)
+    _reps[i] = i + 1;
+  _prevType = 0;
+
+  mainState = 0;
+  matchState = 0;
+
+  for (i = 0; i < k_NumMainProbs; i++) mainProbs[i].Init();
+  for (i = 0; i < k_NumMatchProbs; i++) matchProbs[i].Init();
+
+  for (unsigned k = 0; k < k_NumReps; k++)
+  {
+    lzRepStates[k] = 0;
+    for (i = 0; i < k_NumRepProbs; i++)
+      lzRepProbs[k][i].Init();
+  }
+
+  m_LitEncoder.Init();
+  m_LenEncoder.Init();
+  unsigned numPosSyms = GetNumPosSlots(size);
+  if (numPosSyms < 2)
+    numPosSyms = 2;
+  m_PosEncoder.Init(numPosSyms);
+}
+
+void CEncoder::EncodeLiteral(unsigned b)
+{
+  _rc.Encode(&mainState, k_NumMainProbs, mainProbs, 0);
+  _bs.WriteBits(m_LitEncoder.Codes[b], m_LitEncoder.Lens[b]);
+  m_LitEncoder.Update(b);
+  _prevType = 0;
+}
+
+void CEncoder::EncodeMatch(const CMatch &m)
+{
+  _rc.Encode(&mainState, k_NumMainProbs, mainProbs, 1);
+  _rc.Encode(&matchState, k_NumMatchProbs, matchProbs, 0);
+
+  if (m.RepIndex < 0)
+  {
+    _rc.Encode(&lzRepStates[0], k_NumRepProbs, lzRepProbs[0], 0);
+    const unsigned slot = GetSlot(g_PosBases, k_NumPosSyms, m.Dist);
+    _bs.WriteBits(m_PosEncoder.Codes[slot], m_PosEncoder.Lens[slot]);
+    m_PosEncoder.Update(slot);
+    _bs.WriteBits(m.Dist - g_PosBases[slot], g_PosDirectBits[slot]);
+    _reps[3] = _reps[2];
+    _reps[2] = _reps[1];
+    _reps[1] = _reps[0];
+    _reps[0] = m.Dist;
+  }
+  else
+  {
+    const unsigned repIndex = (unsigned)m.RepIndex;
+    _rc.Encode(&lzRepStates[0], k_NumRepProbs, lzRepProbs[0], 1);
+    _rc.Encode(&lzRepStates[1], k_NumRepProbs, lzRepProbs[1], repIndex == 0 ? 0 : 1);
+    if (repIndex != 0)
+      _rc.Encode(&lzRepStates[2], k_NumRepProbs, lzRepProbs[2], repIndex == 1 ? 0 : 1);
+    for (unsigned i = repIndex + (_prevType == 1 ? 1 : 0); i != 0; i--)
+      _reps[i] = _reps[i - 1];
+    _reps[0] = m.Dist;
+  }
+
+  const unsigned lenSlot = GetSlot(g_LenBases, k_NumLenSyms, m.Len);
+  _bs.WriteBits(m_LenEncoder.Codes[lenSlot], m_LenEncoder.Lens[lenSlot]);
+  m_LenEncoder.Update(lenSlot);
+  _bs.WriteBits(m.Len - g_LenBases[lenSlot], k_LenDirectBits[lenSlot]);
+
+  _prevType = 1;
+}
+
+
+HRESULT CEncoder::Code(const Byte *in, size_t inSize, Byte *out, size_t *outSize)
+{
+  const size_t outSizeMax = *outSize;
+  *outSize = 0;
+  if (inSize == 0 || inSize > kChunkSizeMax)
+    return E_INVALIDARG;
+
+  const UInt32 size = (UInt32)inSize;
+
+  if (_mfSize < size)
+  {
+    _mf.btMode = 1;
+    _mf.numHashBytes = 4;
+    _mf.cutValue = 32;
+    _mf.directInput = 1;
+    if (!MatchFinder_Create(&_mf, size, 0, kNumFastBytes, 0, &g_BigAlloc))
+      return E_OUTOFMEMORY;
+    MatchFinder_CreateVTable(&_mf, &_mfVt);
+    _mfSize = size;
+  }
+
+  if (_bufSize < size)
+  {
+    ::MidFree(_buf);
+    _bufSize = 0;
+    _buf = (Byte *)::MidAlloc(size);
+    if (!_buf)
+      return E_OUTOFMEMORY;
+    _bufSize = size;
+  }
+
+  if (_bitsBufSize < outSizeMax)
+  {
+    ::MidFree(_bitsBuf);
+    _bitsBufSize = 0;
+    _bitsBuf = (Byte *)::MidAlloc(outSizeMax);
+    if (!_bitsBuf)
+      return E_OUTOFMEMORY;
+    _bitsBufSize = outSizeMax;
+  }
+
+  if (!_x86_history)
+  {
+    _x86_history = (Int32 *)::MidAlloc(sizeof(Int32) * k_x86_HistorySize);
+    if (!_x86_history)
+      return E_OUTOFMEMORY;
+  }
+
+  memcpy(_buf, in, size);
+  x86_Filter(_buf, size, _x86_history, true);
+  const Byte *data = _buf;
+
+  _mf.bufferBase = _buf;
+  _mf.directInputRem = size;
+  _mfVt.Init(&_mf);
+
+  InitState(size);
+  _rc.Init(out, outSizeMax);
+  _bs.Init(_bitsBuf, outSizeMax);
+
+  {
+    UInt32 pos = 0;
+    CMatch m;
+    GetBestMatch(data, 0, size, _prevType, m);
+
+    while (pos < size)
+    {
+      if (_rc.Overflow || _bs.Overflow)
+        return S_OK;
+
+      if (m.Len == 0)
+      {
+        EncodeLiteral(data[pos]);
+        pos++;
+        if (pos < size)
+          GetBestMatch(data, pos, size, _prevType, m);
+        continue;
+      }
+
+      if (m.Len < kLazyLenMax && pos + 1 < size)
+      {
+        CMatch m2;
+        // if we write literal here, the next item will be encoded after literal
+        GetBestMatch(data, pos + 1, size, 0, m2);
+        if (m2.Len > m.Len)
+        {
+          EncodeLiteral(data[pos]);
+          pos++;
+          m = m2;
+          continue;
+        }
+        if (m.Len > 2)
+          _mfVt.Skip(&_mf, m.Len - 2);
+      }
+      else if (m.Len > 1)
+        _mfVt.Skip(&_mf, m.Len - 1);
+
+      EncodeMatch(m);
+      pos += m.Len;
+      if (pos < size)
+        GetBestMatch(data, pos, size, _prevType, m);
+    }
+  }
+
+  _rc.Flush();
+  _bs.Flush();
+  if (_rc.Overflow || _bs.Overflow)
+    return S_OK;
+
+  size_t rcSize = _rc.GetProcessed(out);
+  size_t bsSize = _bs.GetProcessed(_bitsBuf);
+  size_t packSize = rcSize + bsSize;
+  // the size of packed data must be even, and the decoder reads at least 8 bytes
+  packSize += (packSize & 1);
+  if (packSize < 8)
+    packSize = 8;
+  if (packSize > outSizeMax)
+    return S_OK;
+
+  memset(out + rcSize, 0, packSize - rcSize - bsSize);
+  Byte *dest = out + packSize;
+  for (size_t i = 0; i < bsSize; i++)
+    *(--dest) = _bitsBuf[i];
+
+  *outSize = packSize;
+  return S_OK;
+}
+
+}}
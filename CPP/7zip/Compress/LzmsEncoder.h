@@ -0,0 +1,180 @@
+// LzmsEncoder.h
+
+#ifndef __LZMS_ENCODER_H
+#define __LZMS_ENCODER_H
+
+#include "../../../C/LzFind.h"
+
+#include "LzmsDecoder.h"
+
+namespace NCompress {
+namespace NLzms {
+
+template <UInt32 m_NumSyms, UInt32 m_RebuildFreq>
+class CHuffEncoder
+{
+  UInt32 RebuildRem;
+  UInt32 NumSyms;
+  UInt32 Freqs[m_NumSyms];
+public:
+  UInt32 Codes[m_NumSyms];
+  Byte Lens[m_NumSyms];
+
+  void Generate() throw()
+  {
+    Huffman_Generate(Freqs, Codes, Lens, NumSyms, k_NumHuffmanBits);
+  }
+
+  // it must be synchronized with CHuffDecoder::Init()
+  void Init(UInt32 numSyms = m_NumSyms) throw()
+  {
+    RebuildRem = m_RebuildFreq;
+    NumSyms = numSyms;
+    for (UInt32 i = 0; i < numSyms; i++)
+      Freqs[i] = 1;
+    Generate();
+  }
+
+  // it must be called after the code of (sym) was written
+  void Update(UInt32 sym) throw()
+  {
+    Freqs[sym]++;
+    if (--RebuildRem != 0)
+      return;
+    Generate();
+    RebuildRem = m_RebuildFreq;
+    UInt32 num = NumSyms;
+    for (UInt32 i = 0; i < num; i++)
+      Freqs[i] = (Freqs[i] >> 1) + 1;
+  }
+};
+
+
+class CRangeEncoder
+{
+  UInt64 _low;
+  UInt32 _range;
+  UInt32 _cache;
+  UInt64 _cacheSize;
+  bool _isFirstWord;
+  Byte *_cur;
+  Byte *_lim;
+
+  void WriteWord(UInt32 v)
+  {
+    if (_isFirstWord)
+    {
+      _isFirstWord = false;
+      return;
+    }
+    if (_lim - _cur < 2)
+    {
+      Overflow = true;
+      return;
+    }
+    SetUi16(_cur, (UInt16)v);
+    _cur += 2;
+  }
+
+  void ShiftLow();
+public:
+  bool Overflow;
+
+  void Init(Byte *data, size_t size);
+  void Encode(UInt32 *state, UInt32 numStates, CProbEntry *probs, unsigned bit);
+  void Flush();
+  size_t GetProcessed(const Byte *data) const { return (size_t)(_cur - data); }
+};
+
+
+// LZMS bit stream is read from the end of packed data backward.
+// So we write the bytes to another buffer and reverse them at finish.
+
+class CBitEncoder
+{
+  UInt32 _value;
+  unsigned _bitPos;
+  Byte *_cur;
+  Byte *_lim;
+public:
+  bool Overflow;
+
+  void Init(Byte *data, size_t size)
+  {
+    _value = 0;
+    _bitPos = 0;
+    _cur = data;
+    _lim = data + size;
+    Overflow = false;
+  }
+
+  void WriteBits(UInt32 val, unsigned numBits);
+  void Flush();
+  size_t GetProcessed(const Byte *data) const { return (size_t)(_cur - data); }
+};
+
+
+/*
+  Encodes one LZMS chunk that can be decoded with NLzms::CDecoder::Code().
+  The encoder uses literals and LZ matches only. It doesn't use delta matches.
+  (*outSize) is the size of (out) buffer on input.
+  If packed data doesn't fit to (out) buffer, the function returns S_OK and (*outSize = 0).
+*/
+
+class CEncoder
+{
+  struct CMatch
+  {
+    UInt32 Len;
+    UInt32 Dist;
+    int RepIndex; // -1 for match with explicit distance
+  };
+
+  enum { kNumFastBytes = 64 };
+
+  CMatchFinder _mf;
+  IMatchFinder _mfVt;
+  UInt32 _mfSize;
+  Byte *_buf;
+  size_t _bufSize;
+  Byte *_bitsBuf;
+  size_t _bitsBufSize;
+  Int32 *_x86_history;
+
+  UInt32 _dists[kNumFastBytes * 2 + 2];
+
+  UInt32 _reps[k_NumReps + 1];
+  unsigned _prevType;
+
+  UInt32 mainState;
+  UInt32 matchState;
+  UInt32 lzRepStates[k_NumReps];
+
+  CProbEntry mainProbs[k_NumMainProbs];
+  CProbEntry matchProbs[k_NumMatchProbs];
+  CProbEntry lzRepProbs[k_NumReps][k_NumRepProbs];
+
+  CHuffEncoder<k_NumLitSyms, 1024> m_LitEncoder;
+  CHuffEncoder<k_NumPosSyms, 1024> m_PosEncoder;
+  CHuffEncoder<k_NumLenSyms, 512> m_LenEncoder;
+
+  CRangeEncoder _rc;
+  CBitEncoder _bs;
+
+  UInt32 GetMatch(const Byte *cur, UInt32 rem, UInt32 &dist);
+  UInt32 GetRepMatch(const Byte *cur, UInt32 pos, UInt32 rem, unsigned prevType, unsigned &repIndex) const;
+  void GetBestMatch(const Byte *data, UInt32 pos, UInt32 size, unsigned prevType, CMatch &m);
+
+  void InitState(size_t size);
+  void EncodeLiteral(unsigned b);
+  void EncodeMatch(const CMatch &m);
+public:
+  CEncoder();
+  ~CEncoder();
+
+  HRESULT Code(const Byte *in, size_t inSize, Byte *out, size_t *outSize);
+};
+
+}}
+
+#endif
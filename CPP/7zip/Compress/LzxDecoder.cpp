@@ -347,7 +347,25 @@ HRESULT CDecoder::CodeSpec(UInt32 curSize)
       if (_bitStream.WasExtraReadError_Fast())
         return S_FALSE;
 
-      UInt32 sym = _mainDecoder.Decode(&_bitStream);
+      UInt32 sym;
+      
+      /* DecodeMulti() can return two literals per one table lookup.
+         We use it only if there is space for both literals in this block. */
+      
+      if (next >= 2)
+      {
+        sym = _mainDecoder.DecodeMulti(&_bitStream);
+        if (HUFFMAN_IS_PAIR(sym))
+        {
+          win[_pos] = (Byte)sym;
+          win[_pos + 1] = (Byte)(sym >> 8);
+          _pos += 2;
+          next -= 2;
+          continue;
+        }
+      }
+      else
+        sym = _mainDecoder.Decode(&_bitStream);
       
       if (sym < 256)
       {
@@ -438,11 +456,26 @@ HRESULT CDecoder::CodeSpec(UInt32 curSize)
           ptrdiff_t src = (ptrdiff_t)srcPos - (ptrdiff_t)_pos;
           _pos += len;
           const Byte *lim = dest + len;
+          
+          /* we copy 8-byte words, if source is not closer than 8 bytes
+             before (dest). We don't write after (lim), since the window
+             after (lim) can contain the history that is still required. */
+          
+          if (src > 0 || src <= -8)
+          {
+            for (; len >= 8; len -= 8, dest += 8)
+              SetUi64(dest, GetUi64(dest + src));
+            if (len == 0)
+              continue;
+          }
+          
           *(dest) = *(dest + src);
           dest++;
-          do
+          while (dest != lim)
+          {
             *(dest) = *(dest + src);
-          while (++dest != lim);
+            dest++;
+          }
         }
       }
     }
@@ -200,7 +200,7 @@ private:
 
   Byte *_unpackedData;
   
-  NHuffman::CDecoder<kNumHuffmanBits, kMainTableSize> _mainDecoder;
+  NHuffman::CDecoderMulti<kNumHuffmanBits, kMainTableSize> _mainDecoder;
   NHuffman::CDecoder<kNumHuffmanBits, kNumLenSymbols> _lenDecoder;
   NHuffman::CDecoder7b<kAlignTableSize> _alignDecoder;
   NHuffman::CDecoder<kNumHuffmanBits, kLevelTableSize, 7> _levelDecoder;
@@ -0,0 +1,494 @@
+// LzxEncoder.cpp
+
+#include "StdAfx.h"
+
+#include <string.h>
+
+#include "../../../C/Alloc.h"
+#include "../../../C/CpuArch.h"
+#include "../../../C/HuffEnc.h"
+
+#include "LzxEncoder.h"
+
+namespace NCompress {
+namespace NLzx {
+
+static const UInt32 kTranslationSize = 12000000;
+
+// (dist + kNumReps - 1) must be smaller than window size
+static const UInt32 kDistMax = CEncoder::kChunkSize - kNumReps;
+
+static const unsigned kNumPosSlots_Chunk = kNumDictBits_Min * 2;
+static const unsigned kNumMainSyms = 256 + kNumPosSlots_Chunk * kNumLenSlots;
+
+static const UInt32 kLazyLenMax = 32;
+
+static void x86_Filter_Encode(Byte *data, UInt32 size)
+{
+  const UInt32 kResidue = 10;
+  if (size <= kResidue)
+    return;
+  const UInt32 lim = size - kResidue;
+
+  for (UInt32 i = 0; i < lim;)
+  {
+    if (data[i] != 0xE8)
+    {
+      i++;
+      continue;
+    }
+    Byte *p = data + i + 1;
+    Int32 v = GetUi32(p);
+    Int32 pos = (Int32)i;
+    if (v >= -pos && v < (Int32)kTranslationSize)
+    {
+      v = (v < (Int32)kTranslationSize - pos) ? v + pos : v - (Int32)kTranslationSize;
+      SetUi32(p, v);
+    }
+    i += 5;
+  }
+}
+
+static unsigned GetLog(UInt32 v)
+{
+  unsigned i = 0;
+  while ((v >>= 1) != 0)
+    i++;
+  return i;
+}
+
+
+class CBitEncoder
+{
+  UInt32 _value;
+  unsigned _bitPos;
+  Byte *_cur;
+  Byte *_lim;
+public:
+  bool Overflow;
+
+  void Init(Byte *data, size_t size)
+  {
+    _value = 0;
+    _bitPos = 0;
+    _cur = data;
+    _lim = data + size;
+    Overflow = false;
+  }
+
+  void WriteBits(UInt32 val, unsigned numBits)
+  {
+    _value = (_value << numBits) | val;
+    _bitPos += numBits;
+    if (_bitPos >= 16)
+    {
+      _bitPos -= 16;
+      if (_lim - _cur < 2)
+        Overflow = true;
+      else
+      {
+        SetUi16(_cur, (UInt16)(_value >> _bitPos));
+        _cur += 2;
+      }
+    }
+  }
+
+  void Flush()
+  {
+    if (_bitPos != 0)
+      WriteBits(0, 16 - _bitPos);
+  }
+
+  Byte *GetCur() const { return _cur; }
+};
+
+
+struct CLevelItem
+{
+  Byte Sym;
+  Byte Extra;
+  Byte SameSym;
+};
+
+/* We don't use history between blocks and chunks.
+   So previous levels are zeros, and delta symbol is (17 - level) % 17. */
+
+static unsigned GetLevelDeltaSym(unsigned level)
+{
+  return (kNumHuffmanBits + 1 - level) % (kNumHuffmanBits + 1);
+}
+
+static unsigned EncodeLevels(const Byte *levels, unsigned num, CLevelItem *items)
+{
+  unsigned numItems = 0;
+  for (unsigned i = 0; i < num;)
+  {
+    const unsigned level = levels[i];
+    unsigned run = 1;
+    while (i + run < num && levels[i + run] == level)
+      run++;
+
+    if (level == 0)
+    {
+      const unsigned kZero2_Max = kLevelSym_Zero2_Start + (1 << kLevelSym_Zero2_NumBits) - 1;
+      while (run >= kLevelSym_Zero2_Start)
+      {
+        unsigned k = (run < kZero2_Max ? run : kZero2_Max);
+        CLevelItem &item = items[numItems++];
+        item.Sym = kLevelSym_Zero2;
+        item.Extra = (Byte)(k - kLevelSym_Zero2_Start);
+        i += k;
+        run -= k;
+      }
+      if (run >= kLevelSym_Zero1_Start)
+      {
+        CLevelItem &item = items[numItems++];
+        item.Sym = kLevelSym_Zero1;
+        item.Extra = (Byte)(run - kLevelSym_Zero1_Start);
+        i += run;
+        run = 0;
+      }
+    }
+    else
+    {
+      const unsigned kSame_Max = kLevelSym_Same_Start + (1 << kLevelSym_Same_NumBits) - 1;
+      while (run >= kLevelSym_Same_Start)
+      {
+        unsigned k = (run < kSame_Max ? run : kSame_Max);
+        CLevelItem &item = items[numItems++];
+        item.Sym = kLevelSym_Same;
+        item.Extra = (Byte)(k - kLevelSym_Same_Start);
+        item.SameSym = (Byte)GetLevelDeltaSym(level);
+        i += k;
+        run -= k;
+      }
+    }
+
+    for (; run != 0; run--, i++)
+    {
+      CLevelItem &item = items[numItems++];
+      item.Sym = (Byte)GetLevelDeltaSym(level);
+    }
+  }
+  return numItems;
+}
+
+static void WriteLevels(CBitEncoder &bs, const Byte *levels, unsigned num)
+{
+  CLevelItem items[kMaxTableSize];
+  unsigned numItems = EncodeLevels(levels, num, items);
+
+  UInt32 freqs[kLevelTableSize];
+  UInt32 codes[kLevelTableSize];
+  Byte lens[kLevelTableSize];
+
+  unsigned i;
+  for (i = 0; i < kLevelTableSize; i++)
+    freqs[i] = 0;
+  for (i = 0; i < numItems; i++)
+  {
+    const CLevelItem &item = items[i];
+    freqs[item.Sym]++;
+    if (item.Sym == kLevelSym_Same)
+      freqs[item.SameSym]++;
+  }
+
+  Huffman_Generate(freqs, codes, lens, kLevelTableSize, (1 << kNumLevelBits) - 1);
+
+  for (i = 0; i < kLevelTableSize; i++)
+    bs.WriteBits(lens[i], kNumLevelBits);
+
+  for (i = 0; i < numItems; i++)
+  {
+    const CLevelItem &item = items[i];
+    const unsigned sym = item.Sym;
+    bs.WriteBits(codes[sym], lens[sym]);
+    if (sym == kLevelSym_Zero1)
+      bs.WriteBits(item.Extra, kLevelSym_Zero1_NumBits);
+    else if (sym == kLevelSym_Zero2)
+      bs.WriteBits(item.Extra, kLevelSym_Zero2_NumBits);
+    else if (sym == kLevelSym_Same)
+    {
+      bs.WriteBits(item.Extra, kLevelSym_Same_NumBits);
+      bs.WriteBits(codes[item.SameSym], lens[item.SameSym]);
+    }
+  }
+}
+
+
+CEncoder::CEncoder():
+    _mfCreated(false),
+    _buf(NULL),
+    _items(NULL)
+{
+  MatchFinder_Construct(&_mf);
+}
+
+CEncoder::~CEncoder()
+{
+  MatchFinder_Free(&_mf, &g_BigAlloc);
+  ::MidFree(_buf);
+  ::MidFree(_items);
+}
+
+UInt32 CEncoder::GetMatch(const Byte *cur, UInt32 rem, UInt32 &dist)
+{
+  UInt32 num = Bt3Zip_MatchFinder_GetMatches(&_mf, _dists);
+  for (; num != 0; num -= 2)
+  {
+    dist = _dists[num - 1] + 1;
+    if (dist <= kDistMax)
+      break;
+  }
+  if (num == 0)
+    return 0;
+  UInt32 len = _dists[num - 2];
+  if (len == kNumFastBytes)
+  {
+    UInt32 lim = (rem < kMatchMaxLen ? rem : kMatchMaxLen);
+    const Byte *src = cur - dist;
+    while (len < lim && cur[len] == src[len])
+      len++;
+  }
+  return len;
+}
+
+UInt32 CEncoder::GetRepMatch(const Byte *cur, UInt32 pos, UInt32 rem, unsigned &repIndex) const
+{
+  UInt32 lim = (rem < kMatchMaxLen ? rem : kMatchMaxLen);
+  UInt32 best = 0;
+  for (unsigned i = 0; i < kNumReps; i++)
+  {
+    const UInt32 dist = _reps[i];
+    if (dist > pos)
+      continue;
+    const Byte *src = cur - dist;
+    UInt32 len = 0;
+    while (len < lim && cur[len] == src[len])
+      len++;
+    if (len > best)
+    {
+      best = len;
+      repIndex = i;
+    }
+  }
+  return best;
+}
+
+
+void CEncoder::GetBestMatch(const Byte *data, UInt32 pos, UInt32 size, CMatch &m)
+{
+  const Byte *cur = data + pos;
+  const UInt32 rem = size - pos;
+  UInt32 mainDist = 0;
+  UInt32 mainLen = GetMatch(cur, rem, mainDist);
+  // short match with big distance is not better than literals
+  if (mainLen == kMatchMinLen + 1 && mainDist > (1 << 12))
+    mainLen = 0;
+  unsigned repIndex = 0;
+  UInt32 repLen = GetRepMatch(cur, pos, rem, repIndex);
+  m.Len = 0;
+  if (repLen >= kMatchMinLen && repLen + 1 >= mainLen)
+  {
+    m.Len = repLen;
+    m.Dist = _reps[repIndex];
+    m.RepIndex = (int)repIndex;
+  }
+  else if (mainLen > kMatchMinLen)
+  {
+    m.Len = mainLen;
+    m.Dist = mainDist;
+    m.RepIndex = -1;
+  }
+}
+
+
+HRESULT CEncoder::Code(const Byte *in, size_t inSize, Byte *out, size_t *outSize)
+{
+  const size_t outSizeMax = *outSize;
+  *outSize = 0;
+  if (inSize == 0 || inSize > kChunkSize)
+    return E_INVALIDARG;
+
+  const UInt32 size = (UInt32)inSize;
+
+  if (!_mfCreated)
+  {
+    _mf.btMode = 1;
+    _mf.numHashBytes = 3;
+    _mf.directInput = 1;
+    if (!MatchFinder_Create(&_mf, kChunkSize, 0, kNumFastBytes, 0, &g_BigAlloc))
+      return E_OUTOFMEMORY;
+    _mfCreated = true;
+  }
+
+  if (!_buf)
+  {
+    _buf = (Byte *)::MidAlloc(kChunkSize);
+    if (!_buf)
+      return E_OUTOFMEMORY;
+  }
+  if (!_items)
+  {
+    _items = (CItem *)::MidAlloc(kChunkSize * sizeof(CItem));
+    if (!_items)
+      return E_OUTOFMEMORY;
+  }
+
+  memcpy(_buf, in, size);
+  x86_Filter_Encode(_buf, size);
+  const Byte *data = _buf;
+
+  _mf.bufferBase = _buf;
+  _mf.directInputRem = size;
+  MatchFinder_Init(&_mf);
+
+  unsigned i;
+  for (i = 0; i < kNumReps; i++)
+    _reps[i] = 1;
+
+  UInt32 mainFreqs[kNumMainSyms];
+  UInt32 lenFreqs[kNumLenSymbols];
+  for (i = 0; i < kNumMainSyms; i++)
+    mainFreqs[i] = 0;
+  for (i = 0; i < kNumLenSymbols; i++)
+    lenFreqs[i] = 0;
+
+  // ---------- Parsing ----------
+
+  CItem *items = _items;
+  UInt32 numItems = 0;
+  {
+    UInt32 pos = 0;
+    CMatch m;
+    GetBestMatch(data, 0, size, m);
+
+    while (pos < size)
+    {
+      CItem &item = items[numItems++];
+
+      if (m.Len == 0)
+      {
+        item.MainSym = data[pos];
+        mainFreqs[item.MainSym]++;
+        pos++;
+        if (pos < size)
+          GetBestMatch(data, pos, size, m);
+        continue;
+      }
+
+      if (m.Len < kLazyLenMax && pos + 1 < size)
+      {
+        CMatch m2;
+        GetBestMatch(data, pos + 1, size, m2);
+        if (m2.Len > m.Len)
+        {
+          item.MainSym = data[pos];
+          mainFreqs[item.MainSym]++;
+          pos++;
+          m = m2;
+          continue;
+        }
+        if (m.Len > 2)
+          Bt3Zip_MatchFinder_Skip(&_mf, m.Len - 2);
+      }
+      else if (m.Len > 1)
+        Bt3Zip_MatchFinder_Skip(&_mf, m.Len - 1);
+
+      unsigned posSlot;
+      item.PosExtra = 0;
+
+      if (m.RepIndex >= 0)
+      {
+        posSlot = (unsigned)m.RepIndex;
+        _reps[posSlot] = _reps[0];
+        _reps[0] = m.Dist;
+      }
+      else
+      {
+        const UInt32 v = m.Dist + kNumReps - 1;
+        const unsigned numBits = GetLog(v);
+        posSlot = numBits * 2 + (unsigned)((v >> (numBits - 1)) & 1);
+        item.PosExtra = v & (((UInt32)1 << (numBits - 1)) - 1);
+        _reps[2] = _reps[1];
+        _reps[1] = _reps[0];
+        _reps[0] = m.Dist;
+      }
+
+      UInt32 lenSlot = m.Len - kMatchMinLen;
+      if (lenSlot >= kNumLenSlots - 1)
+      {
+        item.LenSym = (UInt16)(lenSlot - (kNumLenSlots - 1));
+        lenFreqs[item.LenSym]++;
+        lenSlot = kNumLenSlots - 1;
+      }
+      item.MainSym = (UInt16)(256 + posSlot * kNumLenSlots + lenSlot);
+      mainFreqs[item.MainSym]++;
+
+      pos += m.Len;
+      if (pos < size)
+        GetBestMatch(data, pos, size, m);
+    }
+  }
+
+  // ---------- Huffman codes ----------
+
+  UInt32 mainCodes[kNumMainSyms];
+  Byte mainLevels[kNumMainSyms];
+  UInt32 lenCodes[kNumLenSymbols];
+  Byte lenLevels[kNumLenSymbols];
+
+  Huffman_Generate(mainFreqs, mainCodes, mainLevels, kNumMainSyms, kNumHuffmanBits);
+  {
+    bool lenIsUsed = false;
+    for (i = 0; i < kNumLenSymbols; i++)
+      if (lenFreqs[i] != 0)
+        lenIsUsed = true;
+    if (lenIsUsed)
+      Huffman_Generate(lenFreqs, lenCodes, lenLevels, kNumLenSymbols, kNumHuffmanBits);
+    else
+      memset(lenLevels, 0, kNumLenSymbols);
+  }
+
+  // ---------- Writing ----------
+
+  CBitEncoder bs;
+  bs.Init(out, outSizeMax);
+
+  bs.WriteBits(kBlockType_Verbatim, kBlockType_NumBits);
+  if (size == kChunkSize)
+    bs.WriteBits(1, 1);
+  else
+  {
+    bs.WriteBits(0, 1);
+    bs.WriteBits(size, 16);
+  }
+
+  WriteLevels(bs, mainLevels, 256);
+  WriteLevels(bs, mainLevels + 256, kNumMainSyms - 256);
+  WriteLevels(bs, lenLevels, kNumLenSymbols);
+
+  for (UInt32 k = 0; k < numItems; k++)
+  {
+    if (bs.Overflow)
+      return S_OK;
+    const CItem &item = items[k];
+    const unsigned mainSym = item.MainSym;
+    bs.WriteBits(mainCodes[mainSym], mainLevels[mainSym]);
+    if (mainSym < 256)
+      continue;
+    const unsigned posSlot = (mainSym - 256) / kNumLenSlots;
+    if ((mainSym - 256) % kNumLenSlots == kNumLenSlots - 1)
+      bs.WriteBits(lenCodes[item.LenSym], lenLevels[item.LenSym]);
+    if (posSlot >= kNumReps)
+      bs.WriteBits(item.PosExtra, (posSlot >> 1) - 1);
+  }
+
+  bs.Flush();
+  if (bs.Overflow)
+    return S_OK;
+  *outSize = (size_t)(bs.GetCur() - out);
+  return S_OK;
+}
+
+}}
@@ -0,0 +1,63 @@
+// LzxEncoder.h
+
+#ifndef __LZX_ENCODER_H
+#define __LZX_ENCODER_H
+
+#include "../../../C/LzFind.h"
+
+#include "../../Common/MyCom.h"
+
+#include "Lzx.h"
+
+namespace NCompress {
+namespace NLzx {
+
+/*
+  Encodes one chunk of WIM variant of LZX:
+    - each chunk is independent (no history),
+    - x86 E8 translation with translation size 12000000 is always used,
+    - the chunk is written as one verbatim block.
+  The chunk can be decoded with CDecoder(true) with (numDictBits = kNumDictBits_Min).
+  (*outSize) is the size of (out) buffer on input.
+  If packed data doesn't fit to (out) buffer, the function returns S_OK and (*outSize = 0).
+*/
+
+class CEncoder
+{
+  struct CItem
+  {
+    UInt16 MainSym;
+    UInt16 LenSym;
+    UInt32 PosExtra;
+  };
+
+  struct CMatch
+  {
+    UInt32 Len;
+    UInt32 Dist;
+    int RepIndex; // -1 for match with explicit distance
+  };
+
+  enum { kNumFastBytes = 64 };
+
+  CMatchFinder _mf;
+  bool _mfCreated;
+  Byte *_buf;
+  CItem *_items;
+  UInt32 _reps[kNumReps];
+  UInt32 _dists[kNumFastBytes * 2 + 2];
+
+  UInt32 GetMatch(const Byte *cur, UInt32 rem, UInt32 &dist);
+  UInt32 GetRepMatch(const Byte *cur, UInt32 pos, UInt32 rem, unsigned &repIndex) const;
+  void GetBestMatch(const Byte *data, UInt32 pos, UInt32 size, CMatch &m);
+public:
+  static const UInt32 kChunkSize = (UInt32)1 << kNumDictBits_Min;
+
+  CEncoder();
+  ~CEncoder();
+  HRESULT Code(const Byte *in, size_t inSize, Byte *out, size_t *outSize);
+};
+
+}}
+
+#endif
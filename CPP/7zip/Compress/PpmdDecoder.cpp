@@ -134,6 +134,45 @@ STDMETHODIMP CDecoder::SetOutStreamSize(const UInt64 *outSize)
   return S_OK;
 }
 
+STDMETHODIMP CDecoder::DecodeBuf(const Byte *inBuf, size_t *inSize, Byte *outBuf, size_t *outSize)
+{
+  const size_t size = *outSize;
+  CByteInMemWrap inStream(inBuf, *inSize);
+  *inSize = 0;
+  *outSize = 0;
+  if (!Ppmd7_WasAllocated(&_ppmd))
+    return S_FALSE;
+  
+  // the stream version of decoder must be initialized again after that call
+  _status = kStatus_NeedInit;
+  _rangeDec.Stream = &inStream.p;
+  
+  HRESULT res = S_OK;
+  size_t i = 0;
+  if (Ppmd7z_RangeDec_Init(&_rangeDec))
+  {
+    Ppmd7_Init(&_ppmd, _order);
+    for (; i != size; i++)
+    {
+      int sym = Ppmd7_DecodeSymbol(&_ppmd, &_rangeDec.p);
+      if (inStream.Extra || sym < 0)
+      {
+        if (inStream.Extra || sym < -1)
+          res = S_FALSE;
+        break;
+      }
+      outBuf[i] = (Byte)sym;
+    }
+  }
+  else
+    res = S_FALSE;
+  
+  _rangeDec.Stream = &_inStream.p;
+  *inSize = (size_t)(inStream.Cur - inBuf);
+  *outSize = i;
+  return res;
+}
+
 #ifndef NO_READ_FROM_CODER
 
 STDMETHODIMP CDecoder::SetInStream(ISequentialInStream *inStream)
@@ -18,6 +18,7 @@ namespace NPpmd {
 class CDecoder :
   public ICompressCoder,
   public ICompressSetDecoderProperties2,
+  public ICompressDecodeBuf,
   #ifndef NO_READ_FROM_CODER
   public ICompressSetInStream,
   public ICompressSetOutStreamSize,
@@ -42,20 +43,23 @@ public:
 
   #ifndef NO_READ_FROM_CODER
   CMyComPtr<ISequentialInStream> InSeqStream;
-  MY_UNKNOWN_IMP4(
+  MY_UNKNOWN_IMP5(
       ICompressSetDecoderProperties2,
+      ICompressDecodeBuf,
       ICompressSetInStream,
       ICompressSetOutStreamSize,
       ISequentialInStream)
   #else
-  MY_UNKNOWN_IMP1(
-      ICompressSetDecoderProperties2)
+  MY_UNKNOWN_IMP2(
+      ICompressSetDecoderProperties2,
+      ICompressDecodeBuf)
   #endif
 
   STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
       const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
   STDMETHOD(SetDecoderProperties2)(const Byte *data, UInt32 size);
   STDMETHOD(SetOutStreamSize)(const UInt64 *outSize);
+  STDMETHOD(DecodeBuf)(const Byte *inBuf, size_t *inSize, Byte *outBuf, size_t *outSize);
 
   #ifndef NO_READ_FROM_CODER
   STDMETHOD(SetInStream)(ISequentialInStream *inStream);
@@ -73,12 +73,21 @@ CDecoder::CDecoder():
     _dictSizeLog(0),
     _isSolid(false),
     _wasInit(false),
+    #ifndef _7ZIP_ST
+    _numThreads(1),
+    _mtMode(false),
+    _writeStarted(false),
+    _numSentFilters(0),
+    #endif
     _inputBuf(NULL)
 {
 }
 
 CDecoder::~CDecoder()
 {
+  #ifndef _7ZIP_ST
+  CVirtThread::WaitThreadFinish();
+  #endif
   ::MidFree(_window);
   ::MidFree(_inputBuf);
 }
@@ -103,7 +112,7 @@ HRESULT CDecoder::WriteData(const Byte *data, size_t size)
   return res;
 }
 
-HRESULT CDecoder::ExecuteFilter(const CFilter &f)
+HRESULT CDecoder::ExecuteFilter(const CFilter &f, bool &unsupportedFilter)
 {
   bool useDest = false;
 
@@ -195,7 +204,7 @@ HRESULT CDecoder::ExecuteFilter(const CFilter &f)
     }
 
     default:
-      _unsupportedFilter = true;
+      unsupportedFilter = true;
   }
 
   return WriteData(useDest ?
@@ -205,17 +214,18 @@ HRESULT CDecoder::ExecuteFilter(const CFilter &f)
 }
 
 
-HRESULT CDecoder::WriteBuf()
+HRESULT CDecoder::WriteLz(const Byte *winEnd, UInt64 lzEnd, CRecordVector<CFilter> &filters, bool &unsupportedFilter)
 {
-  DeleteUnusedFilters();
+  HRESULT res = S_OK;
+  unsigned i;
 
-  for (unsigned i = 0; i < _filters.Size();)
+  for (i = 0; i < filters.Size();)
   {
-    const CFilter &f = _filters[i];
+    const CFilter &f = filters[i];
     
     UInt64 blockStart = f.Start;
 
-    size_t lzAvail = (size_t)(_lzSize - _lzWritten);
+    size_t lzAvail = (size_t)(lzEnd - _lzWritten);
     if (lzAvail == 0)
       break;
     
@@ -227,7 +237,9 @@ HRESULT CDecoder::WriteBuf()
         size = (size_t)rem;
       if (size != 0)
       {
-        RINOK(WriteData(_window + _winPos - lzAvail, size));
+        res = WriteData(winEnd - lzAvail, size);
+        if (res != S_OK)
+          break;
         _lzWritten += size;
       }
       continue;
@@ -239,35 +251,82 @@ HRESULT CDecoder::WriteBuf()
     {
       _filterSrc.AllocAtLeast(blockSize);
       if (!_filterSrc.IsAllocated())
-        return E_OUTOFMEMORY;
+      {
+        res = E_OUTOFMEMORY;
+        break;
+      }
     }
     
     size_t blockRem = (size_t)blockSize - offset;
     size_t size = lzAvail;
     if (size > blockRem)
       size = blockRem;
-    memcpy(_filterSrc + offset, _window + _winPos - lzAvail, size);
+    memcpy(_filterSrc + offset, winEnd - lzAvail, size);
     _lzWritten += size;
     offset += size;
     if (offset != blockSize)
-      return S_OK;
+      break;
 
-    _numUnusedFilters = ++i;
-    RINOK(ExecuteFilter(f));
+    i++;
+    res = ExecuteFilter(f, unsupportedFilter);
+    if (res != S_OK)
+      break;
   }
       
-  DeleteUnusedFilters();
+  filters.DeleteFrontal(i);
 
-  if (!_filters.IsEmpty())
-    return S_OK;
+  if (res != S_OK || !filters.IsEmpty())
+    return res;
   
-  size_t lzAvail = (size_t)(_lzSize - _lzWritten);
-  RINOK(WriteData(_window + _winPos - lzAvail, lzAvail));
+  size_t lzAvail = (size_t)(lzEnd - _lzWritten);
+  RINOK(WriteData(winEnd - lzAvail, lzAvail));
   _lzWritten += lzAvail;
   return S_OK;
 }
 
 
+#ifndef _7ZIP_ST
+
+void CDecoder::Execute()
+{
+  _writeRes = WriteLz(_writeWinEnd, _writeLzEnd, _writeFilters, _writeUnsupportedFilter);
+}
+
+HRESULT CDecoder::WaitWrite()
+{
+  if (!_writeStarted)
+    return S_OK;
+  WaitExecuteFinish();
+  _writeStarted = false;
+  _numSentFilters = _writeFilters.Size();
+  _mtWrittenSize = _writtenFileSize;
+  return _writeRes;
+}
+
+#endif
+
+
+HRESULT CDecoder::WriteBuf()
+{
+  #ifndef _7ZIP_ST
+  if (_mtMode)
+  {
+    RINOK(WaitWrite());
+    _writeFilters += _filters;
+    _filters.Clear();
+    _numSentFilters = _writeFilters.Size();
+    _writeWinEnd = _window + _winPos;
+    _writeLzEnd = _lzSize;
+    _writeStarted = true;
+    Start();
+    return S_OK;
+  }
+  #endif
+  
+  return WriteLz(_window + _winPos, _lzSize, _filters, _unsupportedFilter);
+}
+
+
 static UInt32 ReadUInt32(CBitDecoder &bi)
 {
   unsigned numBytes = bi.ReadBits9fix(2) + 1;
@@ -282,13 +341,13 @@ static const unsigned MAX_UNPACK_FILTERS = 8192;
 
 HRESULT CDecoder::AddFilter(CBitDecoder &_bitStream)
 {
-  DeleteUnusedFilters();
-
-  if (_filters.Size() >= MAX_UNPACK_FILTERS)
+  if (GetNumFilters() >= MAX_UNPACK_FILTERS)
   {
     RINOK(WriteBuf());
-    DeleteUnusedFilters();
-    if (_filters.Size() >= MAX_UNPACK_FILTERS)
+    #ifndef _7ZIP_ST
+    RINOK(WaitWrite());
+    #endif
+    if (GetNumFilters() >= MAX_UNPACK_FILTERS)
     {
       _unsupportedFilter = true;
       InitFilters();
@@ -329,7 +388,8 @@ HRESULT CDecoder::ReadTables(CBitDecoder &_bitStream)
   if (_progress)
   {
     UInt64 packSize = _bitStream.GetProcessedSize();
-    RINOK(_progress->SetRatioInfo(&packSize, &_writtenFileSize));
+    UInt64 writtenSize = GetWrittenSize();
+    RINOK(_progress->SetRatioInfo(&packSize, &writtenSize));
   }
 
   _bitStream.AlignToByte();
@@ -512,8 +572,8 @@ HRESULT CDecoder::DecodeLZ()
   size_t limit;
   {
     size_t rem = _winSize - _winPos;
-    if (rem > kWriteStep)
-      rem = kWriteStep;
+    if (rem > _writeStep)
+      rem = _writeStep;
     limit = _winPos + rem;
   }
   
@@ -522,7 +582,7 @@ HRESULT CDecoder::DecodeLZ()
     if (_winPos >= limit)
     {
       RINOK(WriteBuf());
-      if (_unpackSize_Defined && _writtenFileSize > _unpackSize)
+      if (_unpackSize_Defined && GetWrittenSize() > _unpackSize)
         break; // return S_FALSE;
       
       {
@@ -533,8 +593,8 @@ HRESULT CDecoder::DecodeLZ()
           _winPos = 0;
           rem = _winSize;
         }
-        if (rem > kWriteStep)
-          rem = kWriteStep;
+        if (rem > _writeStep)
+          rem = _writeStep;
         limit = _winPos + rem;
       }
 
@@ -787,12 +847,41 @@ HRESULT CDecoder::CodeReal()
 
   _lzFileStart = _lzSize;
   _lzWritten = _lzSize;
+
+  _writeStep = kWriteStep;
+
+  #ifndef _7ZIP_ST
+  _writeUnsupportedFilter = false;
+  _mtWrittenSize = 0;
+  _mtMode = false;
+  if (_numThreads > 1)
+  {
+    size_t step = _winSize >> 1;
+    if (step > kWriteStep)
+      step = kWriteStep;
+    if (!_unpackSize_Defined || _unpackSize > step)
+    {
+      RINOK(HRESULT_FROM_WIN32(CVirtThread::Create()));
+      _mtMode = true;
+      _writeStep = step;
+    }
+  }
+  #endif
   
   HRESULT res = DecodeLZ();
 
   HRESULT res2 = S_OK;
-  if (!_writeError && res != E_OUTOFMEMORY)
+  #ifndef _7ZIP_ST
+  res2 = WaitWrite();
+  #endif
+  if (res2 == S_OK && !_writeError && res != E_OUTOFMEMORY)
+  {
     res2 = WriteBuf();
+    #ifndef _7ZIP_ST
+    if (res2 == S_OK)
+      res2 = WaitWrite();
+    #endif
+  }
 
   /*
   if (res == S_OK)
@@ -940,11 +1029,21 @@ STDMETHODIMP CDecoder::Code(ISequentialInStream *inStream, ISequentialOutStream
       return S_FALSE;
     if (_unsupportedFilter)
       return E_NOTIMPL;
+    #ifndef _7ZIP_ST
+    if (_writeUnsupportedFilter)
+      return E_NOTIMPL;
+    #endif
     return S_OK;
   }
   // catch(const CInBufferException &e)  { return e.ErrorCode; }
   // catch(...) { return S_FALSE; }
-  catch(...) { return E_OUTOFMEMORY; }
+  catch(...)
+  {
+    #ifndef _7ZIP_ST
+    WaitWrite();
+    #endif
+    return E_OUTOFMEMORY;
+  }
   // CNewException is possible here. But probably CNewException is caused
   // by error in data stream.
 }
@@ -958,4 +1057,14 @@ STDMETHODIMP CDecoder::SetDecoderProperties2(const Byte *data, UInt32 size)
   return S_OK;
 }
 
+#ifndef _7ZIP_ST
+
+STDMETHODIMP CDecoder::SetNumberOfThreads(UInt32 numThreads)
+{
+  _numThreads = numThreads;
+  return S_OK;
+}
+
+#endif
+
 }}
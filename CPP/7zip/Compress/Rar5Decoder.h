@@ -15,6 +15,10 @@
 
 #include "../ICoder.h"
 
+#ifndef _7ZIP_ST
+#include "../Common/VirtThread.h"
+#endif
+
 #include "HuffmanDecoder.h"
 
 namespace NCompress {
@@ -238,6 +242,10 @@ const unsigned kNumHuffmanBits = 15;
 class CDecoder:
   public ICompressCoder,
   public ICompressSetDecoderProperties2,
+  #ifndef _7ZIP_ST
+  public ICompressSetCoderMt,
+  public CVirtThread,
+  #endif
   public CMyUnknownImp
 {
   bool _useAlignBits;
@@ -258,7 +266,6 @@ class CDecoder:
   UInt64 _lzSize;
 
   unsigned _numCorrectDistSymbols;
-  unsigned _numUnusedFilters;
 
   UInt64 _lzWritten;
   UInt64 _lzFileStart;
@@ -267,6 +274,7 @@ class CDecoder:
   UInt64 _lzEnd;
   UInt64 _writtenFileSize;
   size_t _winSizeAllocated;
+  size_t _writeStep;
 
   Byte _dictSizeLog;
   bool _tableWasFilled;
@@ -282,6 +290,33 @@ class CDecoder:
 
   CRecordVector<CFilter> _filters;
 
+  #ifndef _7ZIP_ST
+  
+  /*
+    In MT mode the main thread decodes LZ into window, and the writer thread
+    applies filters and writes data to _outStream.
+    The writer thread owns _lzWritten, _writtenFileSize, _filterSrc, _filterDst,
+    _writeFilters and _outStream while it's running.
+    The main thread doesn't overwrite the window range that is being written,
+    since (_writeStep <= _winSize / 2).
+  */
+
+  UInt32 _numThreads;
+  bool _mtMode;
+  bool _writeStarted;
+  bool _writeUnsupportedFilter;
+  unsigned _numSentFilters;
+  HRESULT _writeRes;
+  const Byte *_writeWinEnd;
+  UInt64 _writeLzEnd;
+  UInt64 _mtWrittenSize;
+  CRecordVector<CFilter> _writeFilters;
+  
+  HRESULT WaitWrite();
+  virtual void Execute();
+  
+  #endif
+
   ISequentialInStream *_inStream;
   ISequentialOutStream *_outStream;
   ICompressProgressInfo *_progress;
@@ -296,21 +331,34 @@ class CDecoder:
 
   void InitFilters()
   {
-    _numUnusedFilters = 0;
     _filters.Clear();
+    #ifndef _7ZIP_ST
+    _writeFilters.Clear();
+    _numSentFilters = 0;
+    #endif
   }
 
-  void DeleteUnusedFilters()
+  unsigned GetNumFilters() const
   {
-    if (_numUnusedFilters != 0)
-    {
-      _filters.DeleteFrontal(_numUnusedFilters);
-      _numUnusedFilters = 0;
-    }
+    #ifndef _7ZIP_ST
+    if (_mtMode)
+      return _filters.Size() + _numSentFilters;
+    #endif
+    return _filters.Size();
+  }
+
+  UInt64 GetWrittenSize() const
+  {
+    #ifndef _7ZIP_ST
+    if (_mtMode)
+      return _mtWrittenSize;
+    #endif
+    return _writtenFileSize;
   }
 
   HRESULT WriteData(const Byte *data, size_t size);
-  HRESULT ExecuteFilter(const CFilter &f);
+  HRESULT ExecuteFilter(const CFilter &f, bool &unsupportedFilter);
+  HRESULT WriteLz(const Byte *winEnd, UInt64 lzEnd, CRecordVector<CFilter> &filters, bool &unsupportedFilter);
   HRESULT WriteBuf();
   HRESULT AddFilter(CBitDecoder &_bitStream);
 
@@ -322,12 +370,21 @@ public:
   CDecoder();
   ~CDecoder();
 
-  MY_UNKNOWN_IMP1(ICompressSetDecoderProperties2)
+  MY_QUERYINTERFACE_BEGIN2(ICompressSetDecoderProperties2)
+  #ifndef _7ZIP_ST
+  MY_QUERYINTERFACE_ENTRY(ICompressSetCoderMt)
+  #endif
+  MY_QUERYINTERFACE_END
+  MY_ADDREF_RELEASE
 
   STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
       const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
 
   STDMETHOD(SetDecoderProperties2)(const Byte *data, UInt32 size);
+
+  #ifndef _7ZIP_ST
+  STDMETHOD(SetNumberOfThreads)(UInt32 numThreads);
+  #endif
 };
 
 }}
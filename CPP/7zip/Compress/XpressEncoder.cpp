@@ -0,0 +1,300 @@
+// XpressEncoder.cpp
+
+#include "StdAfx.h"
+
+#include "../../../C/Alloc.h"
+#include "../../../C/CpuArch.h"
+#include "../../../C/HuffEnc.h"
+
+#include "XpressEncoder.h"
+
+namespace NCompress {
+namespace NXpress {
+
+const unsigned kNumHuffBits = 15;
+const unsigned kNumLenSlots = 16;
+const unsigned kNumPosSlots = 16;
+const unsigned kNumSyms = 256 + kNumPosSlots * kNumLenSlots;
+const unsigned kEndSym = 256;
+
+const UInt32 kMatchMinLen = 3;
+const UInt32 kMatchMaxLen = kMatchMinLen + 0xFFFF;
+
+// we check next position only for short matches
+const UInt32 kLazyLenMax = 32;
+
+static unsigned GetLog(UInt32 v)
+{
+  unsigned i = 0;
+  while ((v >>= 1) != 0)
+    i++;
+  return i;
+}
+
+CEncoder::CEncoder():
+    _mfSize(0),
+    _items(NULL),
+    _itemsSize(0)
+{
+  MatchFinder_Construct(&_mf);
+}
+
+CEncoder::~CEncoder()
+{
+  MatchFinder_Free(&_mf, &g_BigAlloc);
+  ::MidFree(_items);
+}
+
+UInt32 CEncoder::GetMatch(const Byte *cur, UInt32 rem, UInt32 &dist)
+{
+  UInt32 num = Hc3Zip_MatchFinder_GetMatches(&_mf, _dists);
+  if (num == 0)
+    return 0;
+  UInt32 len = _dists[num - 2];
+  dist = _dists[num - 1] + 1;
+  if (len == kNumFastBytes)
+  {
+    UInt32 lim = rem;
+    if (lim > kMatchMaxLen)
+      lim = kMatchMaxLen;
+    const Byte *src = cur - dist;
+    while (len < lim && cur[len] == src[len])
+      len++;
+  }
+  return len;
+}
+
+
+struct CBitWriter
+{
+  UInt32 Value;
+  unsigned NumBits;
+  Byte *NextBits;
+  Byte *NextBits2;
+  Byte *NextByte;
+
+  void Init(Byte *p)
+  {
+    Value = 0;
+    NumBits = 0;
+    NextBits = p;
+    NextBits2 = p + 2;
+    NextByte = p + 4;
+  }
+
+  /* The decoder reads 16-bit words in advance.
+     So we keep two word slots reserved ahead of direct bytes. */
+
+  void WriteBits(UInt32 val, unsigned numBits)
+  {
+    Value = (Value << numBits) | val;
+    NumBits += numBits;
+    if (NumBits > 16)
+    {
+      NumBits -= 16;
+      SetUi16(NextBits, (UInt16)(Value >> NumBits));
+      NextBits = NextBits2;
+      NextBits2 = NextByte;
+      NextByte += 2;
+    }
+  }
+
+  void WriteByte(Byte b) { *NextByte++ = b; }
+
+  void WriteUInt16(UInt32 v)
+  {
+    SetUi16(NextByte, (UInt16)v);
+    NextByte += 2;
+  }
+
+  void Flush()
+  {
+    SetUi16(NextBits, (UInt16)(Value << (16 - NumBits)));
+    SetUi16(NextBits2, 0);
+  }
+};
+
+
+HRESULT CEncoder::Code(const Byte *in, size_t inSize, Byte *out, size_t *outSize)
+{
+  const size_t outSizeMax = *outSize;
+  *outSize = 0;
+  if (inSize == 0 || inSize > kChunkSizeMax)
+    return E_INVALIDARG;
+
+  const UInt32 size = (UInt32)inSize;
+
+  if (_mfSize < size)
+  {
+    _mf.btMode = 0;
+    _mf.numHashBytes = 3;
+    _mf.cutValue = 24;
+    _mf.directInput = 1;
+    if (!MatchFinder_Create(&_mf, size, 0, kNumFastBytes, 0, &g_BigAlloc))
+      return E_OUTOFMEMORY;
+    _mfSize = size;
+  }
+
+  if (_itemsSize < size)
+  {
+    ::MidFree(_items);
+    _itemsSize = 0;
+    _items = (CItem *)::MidAlloc(size * sizeof(CItem));
+    if (!_items)
+      return E_OUTOFMEMORY;
+    _itemsSize = size;
+  }
+
+  _mf.bufferBase = (Byte *)in;
+  _mf.directInputRem = size;
+  MatchFinder_Init(&_mf);
+
+  // ---------- Parsing ----------
+
+  CItem *items = _items;
+  UInt32 numItems = 0;
+  {
+    UInt32 pos = 0;
+    UInt32 dist = 0;
+    UInt32 len = GetMatch(in, size, dist);
+
+    while (pos < size)
+    {
+      CItem &item = items[numItems++];
+
+      if (len >= kMatchMinLen && len < kLazyLenMax && pos + 1 < size)
+      {
+        UInt32 dist2 = 0;
+        UInt32 len2 = GetMatch(in + pos + 1, size - pos - 1, dist2);
+        if (len2 > len)
+        {
+          item.Len = 0;
+          item.Dist = in[pos];
+          pos++;
+          len = len2;
+          dist = dist2;
+          continue;
+        }
+        item.Len = len;
+        item.Dist = dist;
+        Hc3Zip_MatchFinder_Skip(&_mf, len - 2);
+      }
+      else if (len >= kMatchMinLen)
+      {
+        item.Len = len;
+        item.Dist = dist;
+        Hc3Zip_MatchFinder_Skip(&_mf, len - 1);
+      }
+      else
+      {
+        item.Len = 0;
+        item.Dist = in[pos];
+        len = 1;
+      }
+
+      pos += len;
+      len = 0;
+      if (pos < size)
+        len = GetMatch(in + pos, size - pos, dist);
+    }
+  }
+
+  // ---------- Huffman code ----------
+
+  UInt32 freqs[kNumSyms];
+  UInt32 codes[kNumSyms];
+  Byte lens[kNumSyms];
+
+  unsigned i;
+  for (i = 0; i < kNumSyms; i++)
+    freqs[i] = 0;
+
+  for (i = 0; i < numItems; i++)
+  {
+    const CItem &item = items[i];
+    if (item.Len == 0)
+      freqs[item.Dist]++;
+    else
+    {
+      UInt32 lenSlot = item.Len - kMatchMinLen;
+      if (lenSlot > kNumLenSlots - 1)
+        lenSlot = kNumLenSlots - 1;
+      freqs[256 + (GetLog(item.Dist) << 4) + lenSlot]++;
+    }
+  }
+  freqs[kEndSym]++;
+
+  Huffman_Generate(freqs, codes, lens, kNumSyms, kNumHuffBits);
+
+  {
+    UInt64 numBits = lens[kEndSym];
+    size_t numBytes = 0;
+    for (i = 0; i < numItems; i++)
+    {
+      const CItem &item = items[i];
+      if (item.Len == 0)
+        numBits += lens[item.Dist];
+      else
+      {
+        UInt32 len = item.Len - kMatchMinLen;
+        unsigned posSlot = GetLog(item.Dist);
+        UInt32 lenSlot = len;
+        if (len >= kNumLenSlots - 1)
+        {
+          lenSlot = kNumLenSlots - 1;
+          numBytes += (len - (kNumLenSlots - 1) < 0xFF) ? 1 : 3;
+        }
+        numBits += lens[256 + (posSlot << 4) + lenSlot] + posSlot;
+      }
+    }
+    const UInt64 packSize = kNumSyms / 2 + ((numBits + 15) / 16 + 1) * 2 + numBytes;
+    if (packSize > outSizeMax)
+      return S_OK;
+    *outSize = (size_t)packSize;
+  }
+
+  // ---------- Writing ----------
+
+  for (i = 0; i < kNumSyms / 2; i++)
+    out[i] = (Byte)(lens[i * 2] | (lens[i * 2 + 1] << 4));
+
+  CBitWriter bw;
+  bw.Init(out + kNumSyms / 2);
+
+  for (i = 0; i < numItems; i++)
+  {
+    const CItem &item = items[i];
+    if (item.Len == 0)
+    {
+      bw.WriteBits(codes[item.Dist], lens[item.Dist]);
+      continue;
+    }
+
+    UInt32 len = item.Len - kMatchMinLen;
+    unsigned posSlot = GetLog(item.Dist);
+    UInt32 sym = 256 + (posSlot << 4) + (len < kNumLenSlots - 1 ? len : kNumLenSlots - 1);
+    bw.WriteBits(codes[sym], lens[sym]);
+
+    if (len >= kNumLenSlots - 1)
+    {
+      if (len - (kNumLenSlots - 1) < 0xFF)
+        bw.WriteByte((Byte)(len - (kNumLenSlots - 1)));
+      else
+      {
+        bw.WriteByte(0xFF);
+        bw.WriteUInt16(len);
+      }
+    }
+
+    bw.WriteBits(item.Dist - ((UInt32)1 << posSlot), posSlot);
+  }
+
+  bw.WriteBits(codes[kEndSym], lens[kEndSym]);
+  bw.Flush();
+
+  if ((size_t)(bw.NextByte - out) != *outSize)
+    return E_FAIL;
+  return S_OK;
+}
+
+}}
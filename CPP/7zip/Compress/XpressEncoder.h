@@ -0,0 +1,47 @@
+// XpressEncoder.h
+
+#ifndef __XPRESS_ENCODER_H
+#define __XPRESS_ENCODER_H
+
+#include "../../../C/LzFind.h"
+
+#include "../../Common/MyCom.h"
+
+namespace NCompress {
+namespace NXpress {
+
+/*
+  Encodes one XPRESS (Huffman) chunk that can be decoded with NXpress::Decode().
+  Each chunk is encoded independently. (inSize) must not exceed kChunkSizeMax.
+  (*outSize) is the size of (out) buffer on input.
+  If packed data doesn't fit to (out) buffer, the function returns S_OK and (*outSize = 0).
+*/
+
+class CEncoder
+{
+  struct CItem
+  {
+    UInt32 Len; // 0 for literal
+    UInt32 Dist; // (byte) for literal
+  };
+
+  enum { kNumFastBytes = 64 };
+
+  CMatchFinder _mf;
+  UInt32 _mfSize;
+  CItem *_items;
+  UInt32 _itemsSize;
+  UInt32 _dists[kNumFastBytes * 2 + 2];
+
+  UInt32 GetMatch(const Byte *cur, UInt32 rem, UInt32 &dist);
+public:
+  static const UInt32 kChunkSizeMax = (UInt32)1 << 16;
+
+  CEncoder();
+  ~CEncoder();
+  HRESULT Code(const Byte *in, size_t inSize, Byte *out, size_t *outSize);
+};
+
+}}
+
+#endif
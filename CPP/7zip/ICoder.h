@@ -253,6 +253,27 @@ CODER_INTERFACE(ICompressSetInStreamSize2, 0x39)
 };
 */
 
+CODER_INTERFACE(ICompressDecodeBuf, 0x3A)
+{
+  STDMETHOD(DecodeBuf)(const Byte *inBuf, size_t *inSize, Byte *outBuf, size_t *outSize) PURE;
+
+  /* Optional interface of decoder. It decodes the data from memory buffer
+     directly to caller's buffer without intermediate stream buffers.
+     The caller sets decoder properties and finish mode before, as for ICompressCoder::Code().
+       (*inSize)  : in: the size of packed data, out: the number of processed bytes
+       (*outSize) : in: the size of (outBuf), out: the number of written bytes
+     The decoder never writes after the end of (outBuf).
+     The decoder sets (*outSize) in all cases, and (outBuf) contains
+     (*outSize) decoded bytes also after error.
+     The caller usually reads input stream to (inBuf) before the call,
+     so it can't switch to ICompressCoder::Code() after the call.
+     returns:
+       S_OK      : no errors were found. The caller must check the processed sizes.
+       S_FALSE   : data error
+       E_NOTIMPL : unsupported method or mode, as for ICompressCoder::Code().
+       another error code : the caller must not use the data in (outBuf). */
+};
+
 
 /*
   ICompressFilter
@@ -100,6 +100,14 @@ STREAM_INTERFACE(IOutStreamFinish, 0x07)
   STDMETHOD(OutStreamFinish)() PURE;
 };
 
+/* IOutStreamFlush::Flush() commits written data to the storage device (fsync).
+   It's used where the order of writes to disk matters for crash safety. */
+
+STREAM_INTERFACE(IOutStreamFlush, 0x0A)
+{
+  STDMETHOD(Flush)() PURE;
+};
+
 
 STREAM_INTERFACE(IStreamGetProps, 0x08)
 {
@@ -119,15 +119,19 @@ SOURCES +=  \
   ../../../../CPP/7zip/Archive/Zip/ZipUpdate.cpp \
   ../../../../CPP/7zip/Common/CWrappers.cpp \
   ../../../../CPP/7zip/Common/CreateCoder.cpp \
+  ../../../../CPP/7zip/Common/DecodeThreads.cpp \
   ../../../../CPP/7zip/Common/FilePathAutoRename.cpp \
   ../../../../CPP/7zip/Common/FileStreams.cpp \
   ../../../../CPP/7zip/Common/FilterCoder.cpp \
   ../../../../CPP/7zip/Common/InBuffer.cpp \
+  ../../../../CPP/7zip/Common/InMemDecoder.cpp \
   ../../../../CPP/7zip/Common/InOutTempBuffer.cpp \
   ../../../../CPP/7zip/Common/LimitedStreams.cpp \
+  ../../../../CPP/7zip/Common/LockedStreams.cpp \
   ../../../../CPP/7zip/Common/MemBlocks.cpp \
   ../../../../CPP/7zip/Common/MethodId.cpp \
   ../../../../CPP/7zip/Common/MethodProps.cpp \
+  ../../../../CPP/7zip/Common/MtJobRing.cpp \
   ../../../../CPP/7zip/Common/OffsetStream.cpp \
   ../../../../CPP/7zip/Common/OutBuffer.cpp \
   ../../../../CPP/7zip/Common/OutMemStream.cpp \
@@ -153,6 +157,8 @@ SOURCES +=  \
   ../../../../CPP/7zip/Compress/ByteSwap.cpp \
   ../../../../CPP/7zip/Compress/CopyCoder.cpp \
   ../../../../CPP/7zip/Compress/CopyRegister.cpp \
+  ../../../../CPP/7zip/Compress/DedupCoder.cpp \
+  ../../../../CPP/7zip/Compress/DedupRegister.cpp \
   ../../../../CPP/7zip/Compress/Deflate64Register.cpp \
   ../../../../CPP/7zip/Compress/DeflateDecoder.cpp \
   ../../../../CPP/7zip/Compress/DeflateEncoder.cpp \
@@ -87,12 +87,15 @@ SOURCES +=  \
   ../../../../CPP/7zip/Common/FileStreams.cpp \
   ../../../../CPP/7zip/Common/FilterCoder.cpp \
   ../../../../CPP/7zip/Common/InBuffer.cpp \
+  ../../../../CPP/7zip/Common/InMemDecoder.cpp \
   ../../../../CPP/7zip/Common/InOutTempBuffer.cpp \
   ../../../../CPP/7zip/Common/LimitedStreams.cpp \
+  ../../../../CPP/7zip/Common/LockedStreams.cpp \
   ../../../../CPP/7zip/Common/MethodId.cpp \
   ../../../../CPP/7zip/Common/MethodProps.cpp \
   ../../../../CPP/7zip/Common/OffsetStream.cpp \
   ../../../../CPP/7zip/Common/OutBuffer.cpp \
+  ../../../../CPP/7zip/Common/ProgressMt.cpp \
   ../../../../CPP/7zip/Common/ProgressUtils.cpp \
   ../../../../CPP/7zip/Common/PropId.cpp \
   ../../../../CPP/7zip/Common/StreamBinder.cpp \
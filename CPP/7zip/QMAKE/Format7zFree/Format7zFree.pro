@@ -173,13 +173,17 @@ SOURCES +=  \
   ../../../../CPP/7zip/Archive/Zip/ZipUpdate.cpp \
   ../../../../CPP/7zip/Common/CWrappers.cpp \
   ../../../../CPP/7zip/Common/CreateCoder.cpp \
+  ../../../../CPP/7zip/Common/DecodeThreads.cpp \
   ../../../../CPP/7zip/Common/FilterCoder.cpp \
   ../../../../CPP/7zip/Common/InBuffer.cpp \
+  ../../../../CPP/7zip/Common/InMemDecoder.cpp \
   ../../../../CPP/7zip/Common/InOutTempBuffer.cpp \
   ../../../../CPP/7zip/Common/LimitedStreams.cpp \
+  ../../../../CPP/7zip/Common/LockedStreams.cpp \
   ../../../../CPP/7zip/Common/MemBlocks.cpp \
   ../../../../CPP/7zip/Common/MethodId.cpp \
   ../../../../CPP/7zip/Common/MethodProps.cpp \
+  ../../../../CPP/7zip/Common/MtJobRing.cpp \
   ../../../../CPP/7zip/Common/OffsetStream.cpp \
   ../../../../CPP/7zip/Common/OutBuffer.cpp \
   ../../../../CPP/7zip/Common/OutMemStream.cpp \
@@ -206,6 +210,8 @@ SOURCES +=  \
   ../../../../CPP/7zip/Compress/CodecExports.cpp \
   ../../../../CPP/7zip/Compress/CopyCoder.cpp \
   ../../../../CPP/7zip/Compress/CopyRegister.cpp \
+  ../../../../CPP/7zip/Compress/DedupCoder.cpp \
+  ../../../../CPP/7zip/Compress/DedupRegister.cpp \
   ../../../../CPP/7zip/Compress/Deflate64Register.cpp \
   ../../../../CPP/7zip/Compress/DeflateDecoder.cpp \
   ../../../../CPP/7zip/Compress/DeflateEncoder.cpp \
@@ -222,7 +228,9 @@ SOURCES +=  \
   ../../../../CPP/7zip/Compress/LzmaEncoder.cpp \
   ../../../../CPP/7zip/Compress/LzmaRegister.cpp \
   ../../../../CPP/7zip/Compress/LzmsDecoder.cpp \
+  ../../../../CPP/7zip/Compress/LzmsEncoder.cpp \
   ../../../../CPP/7zip/Compress/LzxDecoder.cpp \
+  ../../../../CPP/7zip/Compress/LzxEncoder.cpp \
   ../../../../CPP/7zip/Compress/PpmdDecoder.cpp \
   ../../../../CPP/7zip/Compress/PpmdEncoder.cpp \
   ../../../../CPP/7zip/Compress/PpmdRegister.cpp \
@@ -231,6 +239,7 @@ SOURCES +=  \
   ../../../../CPP/7zip/Compress/ShrinkDecoder.cpp \
   ../../../../CPP/7zip/Compress/ZDecoder.cpp \
   ../../../../CPP/7zip/Compress/XpressDecoder.cpp \
+  ../../../../CPP/7zip/Compress/XpressEncoder.cpp \
   ../../../../CPP/7zip/Compress/ZlibDecoder.cpp \
   ../../../../CPP/7zip/Compress/ZlibEncoder.cpp \
   ../../../../CPP/7zip/Crypto/7zAes.cpp \
@@ -35,9 +35,11 @@ SOURCES +=  \
   ../../../../C/CpuArch.c \
   ../../../../C/Ppmd7.c \
   ../../../../C/Ppmd7Dec.c \
+  ../../../../C/Threads.c \
   ../../../../CPP/7zip/Common/InBuffer.cpp \
   ../../../../CPP/7zip/Common/OutBuffer.cpp \
   ../../../../CPP/7zip/Common/StreamUtils.cpp \
+  ../../../../CPP/7zip/Common/VirtThread.cpp \
   ../../../../CPP/7zip/Compress/CodecExports.cpp \
   ../../../../CPP/7zip/Compress/DllExportsCompress.cpp \
   ../../../../CPP/7zip/Compress/LzOutWindow.cpp \
@@ -50,6 +52,7 @@ SOURCES +=  \
   ../../../../CPP/Common/CRC.cpp \
   ../../../../CPP/Common/MyVector.cpp \
   ../../../../CPP/Common/MyWindows.cpp \
+  ../../../../CPP/Windows/Synchronization.cpp \
 
 macx: LIBS += -framework CoreFoundation
 
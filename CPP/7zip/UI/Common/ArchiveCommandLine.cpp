@@ -142,7 +142,8 @@ enum Enum
   kWriteToAltStreamIfColon,
 
   kDeleteAfterCompressing,
-  kSetArcMTime
+  kSetArcMTime,
+  kUpdateInPlace
 
   #ifndef _NO_CRYPTO
   , kPassword
@@ -262,7 +263,8 @@ static const CSwitchForm kSwitchForms[] =
   { "snc" },
   
   { "sdel" },
-  { "stl" }
+  { "stl" },
+  { "sup" }
 
   #ifndef _NO_CRYPTO
   , { "p",  NSwitchType::kString }
@@ -1317,6 +1319,7 @@ void CArcCmdLineParser::Parse2(CArcCmdLineOptions &options)
 
     updateOptions.DeleteAfterCompressing = parser[NKey::kDeleteAfterCompressing].ThereIs;
     updateOptions.SetArcMTime = parser[NKey::kSetArcMTime].ThereIs;
+    updateOptions.UpdateInPlace = parser[NKey::kUpdateInPlace].ThereIs;
 
     if (updateOptions.StdOutMode && updateOptions.EMailMode)
       throw CArcCmdLineException("stdout mode and email mode cannot be combined");
@@ -1692,6 +1692,7 @@ static const CBenchMethod g_Bench[] =
 
   { 10, 18, 1010,    0, 1150, "PPMD:x1" },
   { 10, 22, 1655,    0, 1830, "PPMD:x5" },
+  { 10, 22, 1880,    0, 2000, "PPMD:x9" },
 
   {  2,  0,    6,    0,    6, "Delta:4" },
   {  2,  0,    4,    0,    4, "BCJ" },
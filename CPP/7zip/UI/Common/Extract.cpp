@@ -19,6 +19,100 @@ using namespace NWindows;
 using namespace NFile;
 using namespace NDir;
 
+extern bool g_CaseSensitive;
+
+// returns false, if some item of (node) is not exact path
+static bool GetCensorExactPaths(const NWildcard::CCensorNode &node, const UString &prefix, UStringVector &paths)
+{
+  if (!node.ExcludeItems.IsEmpty())
+    return false;
+  unsigned i;
+  for (i = 0; i < node.IncludeItems.Size(); i++)
+  {
+    const NWildcard::CItem &item = node.IncludeItems[i];
+    if (item.Recursive || !item.ForFile || item.PathParts.Size() != 1)
+      return false;
+    const UString &name = item.PathParts.Front();
+    if (name.IsEmpty() || (item.WildcardMatching && DoesNameContainWildcard(name)))
+      return false;
+    paths.Add(prefix + name);
+  }
+  for (i = 0; i < node.SubNodes.Size(); i++)
+  {
+    const NWildcard::CCensorNode &subNode = node.SubNodes[i];
+    UString prefix2 = prefix;
+    prefix2 += subNode.Name;
+    prefix2.Add_PathSepar();
+    if (!GetCensorExactPaths(subNode, prefix2, paths))
+      return false;
+  }
+  return true;
+}
+
+static int CompareIndexes(const UInt32 *p1, const UInt32 *p2, void * /* param */)
+{
+  return MyCompare(*p1, *p2);
+}
+
+/*
+  If (censor) contains exact paths of files only, we find the items
+  with IArchiveFindItem instead of the check of all items in archive.
+  (found == false) means that the caller must check all items.
+*/
+
+static HRESULT FindCensorItems(const CArc &arc, const NWildcard::CCensorNode &censor,
+    CRecordVector<UInt32> &indices, bool &found)
+{
+  found = false;
+  indices.Clear();
+  if (!g_CaseSensitive || arc.Ask_Deleted)
+    return S_OK;
+  CMyComPtr<IArchiveFindItem> findItem;
+  arc.Archive.QueryInterface(IID_IArchiveFindItem, (void **)&findItem);
+  if (!findItem)
+    return S_OK;
+  UStringVector paths;
+  if (!GetCensorExactPaths(censor, UString(), paths) || paths.IsEmpty())
+    return S_OK;
+
+  unsigned i;
+  for (i = 0; i < paths.Size(); i++)
+  {
+    const unsigned numPrev = indices.Size();
+    for (UInt32 index = 0;; index++)
+    {
+      HRESULT res = findItem->FindItem(paths[i], index, &index);
+      if (res == S_FALSE)
+        break;
+      if (res == E_NOTIMPL)
+        return S_OK;
+      RINOK(res);
+      indices.Add(index);
+    }
+    // it can be directory that has no item for itself
+    if (indices.Size() == numPrev)
+      return S_OK;
+  }
+
+  // the items in directory can be found only by the check of all items
+  for (i = 0; i < indices.Size(); i++)
+  {
+    bool isDir;
+    RINOK(Archive_IsItem_Dir(arc.Archive, indices[i], isDir));
+    if (isDir)
+      return S_OK;
+  }
+
+  indices.Sort(CompareIndexes, NULL);
+  unsigned num = 1;
+  for (i = 1; i < indices.Size(); i++)
+    if (indices[i] != indices[num - 1])
+      indices[num++] = indices[i];
+  indices.DeleteFrom(num);
+  found = true;
+  return S_OK;
+}
+
 static HRESULT DecompressArchive(
     CCodecs *codecs,
     const CArchiveLink &arcLink,
@@ -80,10 +174,20 @@ static HRESULT DecompressArchive(
     UInt32 numItems;
     RINOK(archive->GetNumberOfItems(&numItems));
     
+    CRecordVector<UInt32> foundIndices;
+    bool indicesWereFound = false;
+    if (!elimIsPossible && !allFilesAreAllowed)
+    {
+      RINOK(FindCensorItems(arc, wildcardCensor, foundIndices, indicesWereFound));
+      if (indicesWereFound)
+        numItems = foundIndices.Size();
+    }
+
     CReadArcItem item;
 
-    for (UInt32 i = 0; i < numItems; i++)
+    for (UInt32 k = 0; k < numItems; k++)
     {
+      UInt32 i = indicesWereFound ? foundIndices[k] : k;
       if (elimIsPossible || !allFilesAreAllowed)
       {
         RINOK(arc.GetItem(i, item));
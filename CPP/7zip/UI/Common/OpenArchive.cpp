@@ -3192,12 +3192,18 @@ HRESULT CArchiveLink::Open(COpenOptions &op)
     {
       NCOM::CPropVariant prop;
       RINOK(arc.Archive->GetArchiveProperty(kpidMainSubfile, &prop));
+      UInt32 numItems;
+      RINOK(arc.Archive->GetNumberOfItems(&numItems));
       if (prop.vt == VT_UI4)
         mainSubfile = prop.ulVal;
+      else if (op.types->Size() > Arcs.Size() && numItems == 1)
+      {
+        // the type of nested archive was specified (-ttar.gz),
+        // so we open the single item of compressed stream, if it supports random access
+        mainSubfile = 0;
+      }
       else
         break;
-      UInt32 numItems;
-      RINOK(arc.Archive->GetNumberOfItems(&numItems));
       if (mainSubfile >= numItems)
         break;
     }
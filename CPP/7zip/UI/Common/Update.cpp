@@ -487,6 +487,40 @@ bool CRenamePair::GetNewPath(bool isFolder, const UString &src, UString &dest) c
 int FindAltStreamColon_in_Path(const wchar_t *path);
 #endif
 
+static void GetMaxMTime(const CRecordVector<CUpdatePair2> &updatePairs2,
+    const CDirItems &dirItems, const CObjectVector<CArcItem> &arcItems, FILETIME &ft)
+{
+  ft.dwLowDateTime = 0;
+  ft.dwHighDateTime = 0;
+  FOR_VECTOR (i, updatePairs2)
+  {
+    const CUpdatePair2 &pair2 = updatePairs2[i];
+    const FILETIME *ft2 = NULL;
+    if (pair2.NewProps && pair2.DirIndex >= 0)
+      ft2 = &dirItems.Items[pair2.DirIndex].MTime;
+    else if (pair2.UseArcProps && pair2.ArcIndex >= 0)
+      ft2 = &arcItems[pair2.ArcIndex].MTime;
+    if (ft2)
+    {
+      if (::CompareFileTime(&ft, ft2) < 0)
+        ft = *ft2;
+    }
+  }
+}
+
+// we don't write to the file that is pointed by symbolic link
+
+static bool IsRegularFile(const NFind::CFileInfo &fi)
+{
+  if (fi.IsDir())
+    return false;
+  #ifdef FILE_ATTRIBUTE_UNIX_EXTENSION
+  if (fi.Attrib & FILE_ATTRIBUTE_UNIX_EXTENSION)
+    return S_ISREG(fi.Attrib >> 16);
+  #endif
+  return true;
+}
+
 static HRESULT Compress(
     const CUpdateOptions &options,
     bool isUpdatingItself,
@@ -501,8 +535,10 @@ static HRESULT Compress(
     CTempFiles &tempFiles,
     CUpdateErrorInfo &errorInfo,
     IUpdateCallbackUI *callback,
-    CFinishArchiveStat &st)
+    CFinishArchiveStat &st,
+    bool &updatedInPlace)
 {
+  updatedInPlace = false;
   CMyComPtr<IOutArchive> outArchive;
   int formatIndex = options.MethodMode.Type.FormatIndex;
   
@@ -664,6 +700,78 @@ static HRESULT Compress(
   if (options.RenamePairs.Size() != 0)
     updateCallbackSpec->NewNames = &newNames;
 
+  if (options.UpdateInPlace && isUpdatingItself && arc
+      && archivePath.Temp
+      && !options.StdOutMode
+      && !options.SfxMode
+      && options.VolumesSizes.Size() == 0
+      && arc->ArcStreamOffset == 0)
+  {
+    /* The handler appends new items to the end of existing archive.
+       If the handler returns S_FALSE, we create new archive in temp file. */
+    
+    CMyComPtr<IOutArchiveUpdateInPlace> inPlaceArchive;
+    outArchive.QueryInterface(IID_IOutArchiveUpdateInPlace, (void **)&inPlaceArchive);
+    const FString realPath = us2fs(archivePath.GetFinalPath());
+    NFind::CFileInfo fi;
+    
+    if (inPlaceArchive && fi.Find(realPath) && IsRegularFile(fi))
+    {
+      COutFileStream *outStreamSpec = new COutFileStream;
+      CMyComPtr<IOutStream> outStream = outStreamSpec;
+      if (!outStreamSpec->Open(realPath, OPEN_EXISTING))
+        return errorInfo.SetFromLastError("cannot open file", realPath);
+      
+      UInt64 oldSize;
+      RINOK(outStream->Seek(0, STREAM_SEEK_END, &oldSize));
+      RINOK(SetProperties(outArchive, options.MethodMode.Properties));
+      
+      HRESULT result = inPlaceArchive->UpdateItemsInPlace(outStream, updatePairs2.Size(), updateCallback);
+      
+      if (result != S_OK)
+      {
+        // the start header of archive was not changed, so we remove new data only
+        if (result != S_FALSE)
+        {
+          outStream->SetSize(oldSize);
+          outStreamSpec->Flush();
+        }
+        HRESULT res2 = outStreamSpec->Close();
+        if (result != S_FALSE)
+          return result;
+        RINOK(res2);
+      }
+      else
+      {
+        updatedInPlace = true;
+        
+        if (!updateCallbackSpec->AreAllFilesClosed())
+        {
+          errorInfo.Message = "There are unclosed input file:";
+          errorInfo.FileNames = updateCallbackSpec->_openFiles_Paths;
+          return E_FAIL;
+        }
+        
+        if (options.SetArcMTime)
+        {
+          FILETIME ft;
+          GetMaxMTime(updatePairs2, dirItems, arcItems, ft);
+          if (ft.dwLowDateTime != 0 || ft.dwHighDateTime != 0)
+            outStreamSpec->SetMTime(&ft);
+        }
+        
+        if (callback)
+        {
+          UInt64 size = 0;
+          outStreamSpec->GetSize(&size);
+          st.OutArcFileSize = size;
+        }
+        
+        return outStreamSpec->Close();
+      }
+    }
+  }
+
   CMyComPtr<IOutStream> outSeekStream;
   CMyComPtr<ISequentialOutStream> outStream;
 
@@ -820,22 +928,7 @@ static HRESULT Compress(
   if (options.SetArcMTime)
   {
     FILETIME ft;
-    ft.dwLowDateTime = 0;
-    ft.dwHighDateTime = 0;
-    FOR_VECTOR (i, updatePairs2)
-    {
-      CUpdatePair2 &pair2 = updatePairs2[i];
-      const FILETIME *ft2 = NULL;
-      if (pair2.NewProps && pair2.DirIndex >= 0)
-        ft2 = &dirItems.Items[pair2.DirIndex].MTime;
-      else if (pair2.UseArcProps && pair2.ArcIndex >= 0)
-        ft2 = &arcItems[pair2.ArcIndex].MTime;
-      if (ft2)
-      {
-        if (::CompareFileTime(&ft, ft2) < 0)
-          ft = *ft2;
-      }
-    }
+    GetMaxMTime(updatePairs2, dirItems, arcItems, ft);
     if (ft.dwLowDateTime != 0 || ft.dwHighDateTime != 0)
     {
       if (outStreamSpec)
@@ -1271,6 +1364,7 @@ HRESULT UpdateArchive(
   CTempFiles tempFiles;
 
   bool createTempFile = false;
+  bool updatedInPlace = false;
 
   if (!options.StdOutMode && options.UpdateArchiveItself)
   {
@@ -1370,6 +1464,7 @@ HRESULT UpdateArchive(
     RINOK(callback->StartArchive(name, isUpdating))
 
     CFinishArchiveStat st;
+    bool updatedInPlace2;
 
     RINOK(Compress(options,
         isUpdating,
@@ -1384,7 +1479,10 @@ HRESULT UpdateArchive(
         parentDirItem_Ptr,
 
         tempFiles,
-        errorInfo, callback, st));
+        errorInfo, callback, st, updatedInPlace2));
+
+    if (updatedInPlace2)
+      updatedInPlace = true;
 
     RINOK(callback->FinishArchive(st));
   }
@@ -1397,7 +1495,7 @@ HRESULT UpdateArchive(
   }
 
   tempFiles.Paths.Clear();
-  if (createTempFile)
+  if (createTempFile && !updatedInPlace)
   {
     try
     {
@@ -113,6 +113,7 @@ struct CUpdateOptions
   bool DeleteAfterCompressing;
 
   bool SetArcMTime;
+  bool UpdateInPlace; // append new items to existing archive, if handler supports it
 
   CObjectVector<CRenamePair> RenamePairs;
 
@@ -131,7 +132,8 @@ struct CUpdateOptions
     PathMode(NWildcard::k_RelatPath),
     
     DeleteAfterCompressing(false),
-    SetArcMTime(false)
+    SetArcMTime(false),
+    UpdateInPlace(false)
 
       {};
 
@@ -491,8 +491,12 @@ STDMETHODIMP CArchiveUpdateCallback::GetStream2(UInt32 index, ISequentialInStrea
     inStreamSpec->CallbackRef = index;
 
     const FString path = DirItems->GetPhyPath(up.DirIndex);
-    _openFiles_Indexes.Add(index);
-    _openFiles_Paths.Add(path);
+    {
+      // the streams can be released in another thread (InFileStream_On_Destroy)
+      MT_LOCK
+      _openFiles_Indexes.Add(index);
+      _openFiles_Paths.Add(path);
+    }
 
     #if defined(_WIN32) && !defined(UNDER_CE)
     if (DirItems->Items[up.DirIndex].AreReparseData())
@@ -455,4 +455,20 @@ bool COutFile::SetLength(UINT64 length) throw()
   return SetEndOfFile();
 }
 
+bool COutFile::Flush() throw()
+{
+  if (_fd == -1)
+  {
+     SetLastError( ERROR_INVALID_HANDLE );
+     return false;
+  }
+
+  int ret;
+  do {
+    ret = fsync(_fd);
+  } while (ret < 0 && (errno == EINTR));
+
+  return (ret == 0);
+}
+
 }}}
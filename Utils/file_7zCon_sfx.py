@@ -35,7 +35,9 @@ files_cpp=[
  'CPP/7zip/Common/FileStreams.cpp',
  'CPP/7zip/Common/FilterCoder.cpp',
  'CPP/7zip/Common/InBuffer.cpp',
+ 'CPP/7zip/Common/InMemDecoder.cpp',
  'CPP/7zip/Common/LimitedStreams.cpp',
+ 'CPP/7zip/Common/LockedStreams.cpp',
  'CPP/7zip/Common/OutBuffer.cpp',
  'CPP/7zip/Common/ProgressUtils.cpp',
  'CPP/7zip/Common/StreamBinder.cpp',
@@ -6,12 +6,14 @@ files_c=[
  'C/CpuArch.c',
  'C/Ppmd7.c',
  'C/Ppmd7Dec.c',
+ 'C/Threads.c',
 ]
 
 files_cpp=[
  'CPP/7zip/Common/InBuffer.cpp',
  'CPP/7zip/Common/OutBuffer.cpp',
  'CPP/7zip/Common/StreamUtils.cpp',
+ 'CPP/7zip/Common/VirtThread.cpp',
  'CPP/7zip/Compress/CodecExports.cpp',
  'CPP/7zip/Compress/DllExportsCompress.cpp',
  'CPP/7zip/Compress/LzOutWindow.cpp',
@@ -24,5 +26,6 @@ files_cpp=[
  'CPP/Common/CRC.cpp',
  'CPP/Common/MyVector.cpp',
  'CPP/Common/MyWindows.cpp',
+ 'CPP/Windows/Synchronization.cpp',
 ]
 
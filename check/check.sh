@@ -153,6 +153,373 @@ sure ${P7ZIP} x 7za.exe.xz
 sure diff 7za.exe 7za433_ref/bin/7za.exe
 sure rm -f 7za.exe
 
+echo ""
+echo "# TESTING (BZIP2 SA-IS) ..."
+echo "##########################"
+sure ${P7ZIP} -tbzip2 a 7za.exe.bz2 7za433_ref/bin/7za.exe
+sure ${P7ZIP} -tbzip2 -ma=1 a 7za.exe.sais.bz2 7za433_ref/bin/7za.exe
+sure cmp 7za.exe.bz2 7za.exe.sais.bz2
+sure rm -f 7za.exe.bz2 7za.exe.sais.bz2
+
+echo ""
+echo "# TESTING (WIM) ..."
+echo "##################"
+# 7za doesn't support WIM format
+if ${P7ZIP} i | grep -q " wim "
+then
+  for m in XPRESS LZX LZMS
+  do
+    sure ${P7ZIP} a -twim -m0=$m 7za433_$m.wim 7za433_ref
+    sure ${P7ZIP} t 7za433_$m.wim
+  done
+  sure ${P7ZIP} a -twim -ms=on -mmt=2 7za433_solid.wim 7za433_ref
+  sure ${P7ZIP} x -o7za433_wim 7za433_solid.wim
+  sure diff -r 7za433_ref 7za433_wim/7za433_ref
+  sure rm -fr 7za433_wim 7za433_*.wim
+fi
+
+echo ""
+echo "# TESTING (7z DEDUP) ..."
+echo "#######################"
+sure mkdir 7za433_dedup
+sure cp -r 7za433_ref 7za433_dedup/a
+sure cp -r 7za433_ref 7za433_dedup/b
+sure ${P7ZIP} a -mqd=on -mmt=2 7za433_dedup_qd.7z 7za433_dedup
+# each duplicate file must be in the solid block of its first copy
+sure ${P7ZIP} a -mqd=on -ms=3f 7za433_dedup_qd_3f.7z 7za433_dedup
+sure ${P7ZIP} a -mqd=on -ms=20k 7za433_dedup_qd_20k.7z 7za433_dedup
+for a in 7za433_dedup_qd_3f.7z 7za433_dedup_qd_20k.7z
+do
+  sure "${P7ZIP} l -slt $a | awk '/^Path = /{ p = \$0; sub(/^Path = 7za433_dedup\/[ab]/, \"\", p) } /^Block = ./{ if (p in b) { if (b[p] != \$3) bad = 1 } else b[p] = \$3 } END { exit bad }'"
+done
+# 7zr doesn't support Dedup filter
+if ${P7ZIP} i | grep -q " Dedup"
+then
+  sure ${P7ZIP} a -mf=Dedup 7za433_dedup_f.7z 7za433_dedup
+  sure ${P7ZIP} a -m0=Dedup:c=1k -m1=LZMA2:d=64k 7za433_dedup_m.7z 7za433_dedup
+fi
+sure rm -fr 7za433_dedup
+for a in 7za433_dedup_*.7z
+do
+  sure ${P7ZIP} x $a
+  sure diff -r 7za433_ref 7za433_dedup/a
+  sure diff -r 7za433_ref 7za433_dedup/b
+  sure rm -fr 7za433_dedup
+done
+sure rm -f 7za433_dedup_*.7z
+
+echo ""
+echo "# TESTING (7z PARALLEL SOLID BLOCKS) ..."
+echo "#######################"
+sure mkdir 7za433_mt
+sure cp -r 7za433_ref 7za433_mt/a
+sure cp -r 7za433_ref 7za433_mt/b
+sure ${P7ZIP} a -mmt=4 -ms=8f 7za433_mt_1.7z 7za433_mt
+sure ${P7ZIP} a -mmt=3 -ms=100k -m0=LZMA:d=1m 7za433_mt_2.7z 7za433_mt
+sure rm -fr 7za433_mt
+for a in 7za433_mt_*.7z
+do
+  sure ${P7ZIP} x $a
+  sure diff -r 7za433_ref 7za433_mt/a
+  sure diff -r 7za433_ref 7za433_mt/b
+  sure rm -fr 7za433_mt
+done
+sure rm -f 7za433_mt_*.7z
+
+echo ""
+echo "# TESTING (7z EXTRACT BY NAME) ..."
+echo "#######################"
+sure ${P7ZIP} x -o7za433_name ../test/7za433_7zip_lzma.7z 7za433_7zip_lzma/readme.txt
+sure diff 7za433_ref/readme.txt 7za433_name/7za433_7zip_lzma/readme.txt
+sure ${P7ZIP} x -o7za433_name2 ../test/7za433_7zip_lzma.7z 7za433_7zip_lzma/doc 7za433_7zip_lzma/bin/7za.exe
+sure diff -r 7za433_ref/doc 7za433_name2/7za433_7zip_lzma/doc
+sure diff 7za433_ref/bin/7za.exe 7za433_name2/7za433_7zip_lzma/bin/7za.exe
+sure rm -fr 7za433_name 7za433_name2
+
+echo ""
+echo "# TESTING (TAR INDEX) ..."
+echo "#######################"
+sure ${P7ZIP} a -ttar -mindex=on 7za433_idx.tar 7za433_ref
+sure tar tvf 7za433_idx.tar
+sure ${P7ZIP} l 7za433_idx.tar
+sure ${P7ZIP} x -o7za433_idx 7za433_idx.tar
+sure diff -r 7za433_ref 7za433_idx/7za433_ref
+sure ${P7ZIP} x -o7za433_idx2 7za433_idx.tar 7za433_ref/readme.txt
+sure diff 7za433_ref/readme.txt 7za433_idx2/7za433_ref/readme.txt
+sure ${P7ZIP} a -ttar -mindex=on 7za433_idx.tar 7za433_idx2
+sure ${P7ZIP} t 7za433_idx.tar
+sure rm -fr 7za433_idx 7za433_idx2
+sure ${P7ZIP} x -o7za433_idx 7za433_idx.tar
+sure diff -r 7za433_ref 7za433_idx/7za433_ref
+sure diff 7za433_ref/readme.txt 7za433_idx/7za433_idx2/7za433_ref/readme.txt
+sure rm -fr 7za433_idx
+# tar must skip the index (pax global header), so no other files are extracted
+sure mkdir 7za433_idx
+sure tar xf 7za433_idx.tar -C 7za433_idx
+sure diff -r 7za433_ref 7za433_idx/7za433_ref
+sure diff 7za433_ref/readme.txt 7za433_idx/7za433_idx2/7za433_ref/readme.txt
+sure rm -fr 7za433_idx/7za433_ref 7za433_idx/7za433_idx2
+sure rmdir 7za433_idx
+# indexed tar in multi-block xz : one member is extracted via xz block index
+sure ${P7ZIP} a -txz -ms=16k 7za433_idx.tar.xz 7za433_idx.tar
+sure ${P7ZIP} t 7za433_idx.tar.xz
+sure "${P7ZIP} l -slt 7za433_idx.tar.xz | grep -v 'Blocks = 1\$' | grep -q 'Blocks = '"
+sure ${P7ZIP} x -o7za433_idx -ttar.xz 7za433_idx.tar.xz 7za433_ref/readme.txt
+sure diff 7za433_ref/readme.txt 7za433_idx/7za433_ref/readme.txt
+sure rm -fr 7za433_idx
+sure ${P7ZIP} x -o7za433_idx -ttar.xz 7za433_idx.tar.xz
+sure diff -r 7za433_ref 7za433_idx/7za433_ref
+sure rm -fr 7za433_idx 7za433_idx.tar.xz
+sure rm -f 7za433_idx.tar
+
+sure ${P7ZIP} a -ttar -mmt=1 7za433_mt1.tar 7za433_ref
+sure ${P7ZIP} a -ttar -mmt=4 7za433_mt4.tar 7za433_ref
+sure cmp 7za433_mt1.tar 7za433_mt4.tar
+sure rm -f 7za433_mt1.tar 7za433_mt4.tar
+
+echo ""
+echo "# TESTING (GZIP RANDOM ACCESS) ..."
+echo "#######################"
+sure ${P7ZIP} a -ttar 7za433_gz.tar 7za433_ref
+sure ${P7ZIP} a -tgzip 7za433_gz.tar.gz 7za433_gz.tar
+sure ${P7ZIP} t -ttar.gzip 7za433_gz.tar.gz
+sure ${P7ZIP} x -o7za433_gz -ttar.gzip 7za433_gz.tar.gz 7za433_ref/readme.txt
+sure diff 7za433_ref/readme.txt 7za433_gz/7za433_ref/readme.txt
+sure rm -fr 7za433_gz
+sure ${P7ZIP} x -o7za433_gz -ttar.gzip 7za433_gz.tar.gz
+sure diff -r 7za433_ref 7za433_gz/7za433_ref
+sure rm -fr 7za433_gz 7za433_gz.tar 7za433_gz.tar.gz
+# indexed tar in gzip streams of 16 KB : the index of gzip streams gives access points and size
+sure ${P7ZIP} a -ttar -mindex=on 7za433_gz.tar 7za433_ref
+sure ${P7ZIP} a -tgzip -ms=16k 7za433_gz.tar.gz 7za433_gz.tar
+sure ${P7ZIP} t 7za433_gz.tar.gz
+sure "${P7ZIP} l -slt 7za433_gz.tar.gz | grep -q '^Size = '`wc -c < 7za433_gz.tar`'$'"
+sure ${P7ZIP} x -o7za433_gz -ttar.gzip 7za433_gz.tar.gz 7za433_ref/readme.txt
+sure diff 7za433_ref/readme.txt 7za433_gz/7za433_ref/readme.txt
+sure rm -fr 7za433_gz
+sure ${P7ZIP} x -o7za433_gz -ttar.gzip 7za433_gz.tar.gz
+sure diff -r 7za433_ref 7za433_gz/7za433_ref
+sure rm -fr 7za433_gz
+# other gzip decoders must ignore the index
+sure "gzip -dc 7za433_gz.tar.gz | cmp - 7za433_gz.tar"
+sure rm -f 7za433_gz.tar 7za433_gz.tar.gz
+
+echo ""
+echo "# TESTING (7z UPDATE IN PLACE) ..."
+echo "#######################"
+sure mkdir 7za433_sup
+sure cp -r 7za433_ref 7za433_sup/a
+sure ${P7ZIP} a 7za433_sup.7z 7za433_sup
+sure cp -r 7za433_ref 7za433_sup/b
+sure ${P7ZIP} a -sup 7za433_sup.7z 7za433_sup
+sure cp -r 7za433_ref 7za433_sup/c
+sure ${P7ZIP} a -sup -mhc=off 7za433_sup.7z 7za433_sup
+sure ${P7ZIP} t 7za433_sup.7z
+sure rm -fr 7za433_sup
+sure ${P7ZIP} x 7za433_sup.7z
+sure diff -r 7za433_ref 7za433_sup/a
+sure diff -r 7za433_ref 7za433_sup/b
+sure diff -r 7za433_ref 7za433_sup/c
+# deleting requires normal update
+sure ${P7ZIP} d -sup 7za433_sup.7z 7za433_sup/b
+sure ${P7ZIP} t 7za433_sup.7z
+sure rm -fr 7za433_sup
+sure ${P7ZIP} x 7za433_sup.7z
+sure diff -r 7za433_ref 7za433_sup/a
+sure diff -r 7za433_ref 7za433_sup/c
+sure rm -fr 7za433_sup 7za433_sup.7z
+
+echo ""
+echo "# TESTING (SQUASHFS) ..."
+echo "#######################"
+# 7za doesn't support SquashFS format
+if ${P7ZIP} i | grep -q " SquashFS "
+then
+  for mt in 1 4
+  do
+    sure ${P7ZIP} t -mmt=$mt ../test/7za433_squashfs.squashfs
+    sure ${P7ZIP} x -mmt=$mt -o7za433_sqfs ../test/7za433_squashfs.squashfs
+    sure diff 7za433_ref/bin/7za.exe 7za433_sqfs/7za.exe
+    sure diff 7za433_ref/doc/copying.txt 7za433_sqfs/copying.txt
+    sure diff 7za433_ref/readme.txt 7za433_sqfs/readme.txt
+    sure rm -fr 7za433_sqfs
+  done
+fi
+
+echo ""
+echo "# TESTING (DMG) ..."
+echo "#######################"
+# 7za doesn't support DMG format
+if ${P7ZIP} i | grep -q " Dmg "
+then
+  for mt in 1 4
+  do
+    sure ${P7ZIP} t -tdmg -mmt=$mt ../test/7za433_dmg.dmg
+    sure ${P7ZIP} x -tdmg -mmt=$mt -o7za433_dmg ../test/7za433_dmg.dmg
+    sure cmp "'7za433_dmg/0 - part0'" ../test/7za433_tar.tar
+    sure rm -fr 7za433_dmg
+  done
+  # the tar in partition is opened as nested archive
+  sure ${P7ZIP} x -o7za433_dmg ../test/7za433_dmg.dmg
+  sure diff -r 7za433_ref 7za433_dmg/7za433_tar
+  sure rm -fr 7za433_dmg
+fi
+
+echo ""
+echo "# TESTING (QCOW / VMDK) ..."
+echo "#######################"
+# 7za doesn't support QCOW and VMDK formats
+if ${P7ZIP} i | grep -q " VMDK "
+then
+  # compressed qcow2 and stream-optimized vmdk with 4 KB clusters. Disk data is 7za433_tar.tar
+  for t in qcow vmdk
+  do
+    for mt in 1 4
+    do
+      sure ${P7ZIP} t -t$t -mmt=$mt ../test/7za433_$t.$t*
+      sure ${P7ZIP} x -t$t -mmt=$mt -o7za433_$t ../test/7za433_$t.$t*
+      sure cmp 7za433_$t/7za433_$t.img ../test/7za433_tar.tar
+      sure rm -fr 7za433_$t
+      # the tar in disk is opened as nested archive and it's read via cluster cache
+      sure ${P7ZIP} x -mmt=$mt -o7za433_$t ../test/7za433_$t.$t*
+      sure diff -r 7za433_ref 7za433_$t/7za433_tar
+      sure rm -fr 7za433_$t
+    done
+  done
+fi
+
+echo ""
+echo "# TESTING (NTFS) ..."
+echo "#######################"
+# 7za doesn't support NTFS format
+if ${P7ZIP} i | grep -q " NTFS "
+then
+  # MFT of image has 3 chunks for parallel parsing
+  sure ${P7ZIP} x ../test/ntfs.img.xz
+  # ntfs_ref contains the files of image: hard links, alternate streams, [LOST] files
+  sure ${P7ZIP} x ../test/ntfs_ref.tar.xz
+  sure ${P7ZIP} x ntfs_ref.tar
+  for mt in 1 4
+  do
+    sure ${P7ZIP} t -mmt=$mt ntfs.img
+    sure ${P7ZIP} x -mmt=$mt -ontfs_$mt ntfs.img
+  done
+  sure diff -r ntfs_1 ntfs_4
+  sure rm -fr "'ntfs_1/[SYSTEM]'"
+  sure diff -r ntfs_ref ntfs_1
+  sure rm -fr ntfs_1 ntfs_4 ntfs.img ntfs_ref ntfs_ref.tar
+fi
+
+echo ""
+echo "# TESTING (EXT4) ..."
+echo "#######################"
+# 7za doesn't support Ext format
+if ${P7ZIP} i | grep -q " Ext "
+then
+  # inode tables of 4 groups are read in threads
+  sure ${P7ZIP} x ../test/7za433_ext4.img.xz
+  for mt in 1 4
+  do
+    sure ${P7ZIP} t -mmt=$mt 7za433_ext4.img
+    sure ${P7ZIP} x -mmt=$mt -o7za433_ext4 7za433_ext4.img
+    sure diff -r 7za433_ref 7za433_ext4/7za433_ref
+    sure rm -fr 7za433_ext4
+  done
+  sure rm -f 7za433_ext4.img
+fi
+
+echo ""
+echo "# TESTING (HFS) ..."
+echo "#######################"
+# 7za doesn't support HFS format
+if ${P7ZIP} i | grep -q " HFS "
+then
+  # image has decmpfs compressed files with many chunks
+  sure ${P7ZIP} x ../test/hfs.img.xz
+  for mt in 1 4
+  do
+    sure ${P7ZIP} t -mmt=$mt hfs.img
+    sure ${P7ZIP} x -mmt=$mt -ohfs_$mt hfs.img
+  done
+  sure diff -r hfs_1 hfs_4
+  sure rm -fr hfs_1 hfs_4 hfs.img
+fi
+
+echo ""
+echo "# TESTING (CAB) ..."
+echo "#######################"
+# LZX and MSZIP folders are decoded in threads with -mmt=4
+for mt in 1 4
+do
+  sure ${P7ZIP} t -mmt=$mt ../test/7za433_cab.cab
+  sure ${P7ZIP} x -mmt=$mt -o7za433_cab ../test/7za433_cab.cab
+  sure diff -r 7za433_ref 7za433_cab/7za433_ref
+  sure rm -fr 7za433_cab
+done
+
+echo ""
+echo "# TESTING (ISO / UDF) ..."
+echo "#######################"
+# 7za doesn't support Iso and Udf formats
+if ${P7ZIP} i | grep -q " Udf "
+then
+  # the data of items is placed in shuffled order in image
+  sure ${P7ZIP} x ../test/iso.iso.xz
+  for t in iso udf
+  do
+    for mt in 1 4
+    do
+      sure ${P7ZIP} t -t$t -mmt=$mt iso.iso
+      sure ${P7ZIP} x -t$t -mmt=$mt -o${t}_$mt iso.iso
+    done
+    sure diff -r ${t}_1 ${t}_4
+  done
+  sure diff 7za433_ref/readme.txt iso_1/SUB/README.TXT
+  sure diff 7za433_ref/doc/copying.txt udf_4/copying.txt
+  sure rm -fr iso_1 iso_4 udf_1 udf_4 iso.iso
+fi
+
+echo ""
+echo "# TESTING (FAT / EXFAT) ..."
+echo "#######################"
+# 7za doesn't support FAT format
+if ${P7ZIP} i | grep -q " FAT "
+then
+  # the files are fragmented in images
+  for f in fat16 exfat
+  do
+    sure ${P7ZIP} x ../test/$f.img.xz
+    for mt in 1 4
+    do
+      sure ${P7ZIP} t -mmt=$mt $f.img
+      sure ${P7ZIP} x -mmt=$mt -o${f}_$mt $f.img
+    done
+    sure diff -r ${f}_1 ${f}_4
+    sure diff 7za433_ref/readme.txt ${f}_1/readme.txt
+    sure diff 7za433_ref/doc/copying.txt ${f}_4/dir1/copying.txt
+    sure rm -fr ${f}_1 ${f}_4 $f.img
+  done
+fi
+
+echo ""
+echo "# TESTING (RAR5) ..."
+echo "#######################"
+# 7za doesn't support RAR5 format
+if ${P7ZIP} i | grep -q " Rar5 "
+then
+  # non-solid items are decoded in threads with -mmt=4
+  for a in rar5 rar5_solid
+  do
+    for mt in 1 4
+    do
+      sure ${P7ZIP} t -mmt=$mt ../test/$a.rar
+      sure ${P7ZIP} x -mmt=$mt -o${a}_$mt ../test/$a.rar
+    done
+    sure diff -r ${a}_1 ${a}_4
+    sure rm -fr ${a}_1 ${a}_4
+  done
+fi
+
 #####################################
 
 cd ..